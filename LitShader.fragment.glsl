@@ -0,0 +1,49 @@
+#version 410 core
+
+// Variants: VERTEX_TEXTURE and VERTEX_TANGENT come with the mesh, the ridges
+// need both; ALBEDO_MAP samples albedo instead of using base_color.
+
+layout (location = 0) out vec4 color;
+
+in vec3 frag_normal;
+#ifdef VERTEX_TANGENT
+in vec3 frag_tangent;
+#endif
+#ifdef VERTEX_TEXTURE
+in vec2 frag_texture;
+#endif
+in vec3 frag_view_position;
+
+uniform vec3 light_direction; // view space, pointing towards the light
+uniform vec4 base_color;
+#if defined(VERTEX_TEXTURE) && defined(VERTEX_TANGENT)
+uniform float bump_strength;
+#endif
+#ifdef ALBEDO_MAP
+uniform sampler2D albedo;
+#endif
+
+void main(void){
+        vec3 normal = normalize(frag_normal);
+        if (!gl_FrontFacing)
+                normal = -normal;
+#if defined(VERTEX_TEXTURE) && defined(VERTEX_TANGENT)
+        // Fine ridges across the U direction, bent along the tangent frame
+        float ridge = cos(frag_texture.x * 120.0);
+        normal = normalize(normal + bump_strength * ridge * normalize(frag_tangent));
+#endif
+
+        vec3 light = normalize(light_direction);
+        vec3 view = normalize(-frag_view_position);
+        float diffuse = max(dot(normal, light), 0.0);
+        float specular = diffuse > 0.0
+                ? pow(max(dot(normal, normalize(light + view)), 0.0), 32.0)
+                : 0.0;
+#ifdef ALBEDO_MAP
+        vec3 surface = texture(albedo, frag_texture).rgb;
+#else
+        vec3 surface = base_color.rgb;
+#endif
+        color = vec4(surface * (0.15 + 0.85 * diffuse) + vec3(0.3) * specular,
+                     base_color.a);
+}
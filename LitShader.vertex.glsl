@@ -0,0 +1,40 @@
+#version 410 core
+
+layout(location=0) in vec4 in_position;
+#ifdef VERTEX_TEXTURE
+layout(location=1) in vec2 in_texture;
+#endif
+layout(location=2) in vec3 in_normal;
+#ifdef VERTEX_TANGENT
+layout(location=3) in vec4 in_tangent;
+#endif
+
+out vec3 frag_normal;
+#ifdef VERTEX_TANGENT
+out vec3 frag_tangent;
+#endif
+#ifdef VERTEX_TEXTURE
+out vec2 frag_texture;
+#endif
+out vec3 frag_view_position;
+
+uniform mat4 model_matrix;
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+
+void main(void)
+{
+        mat4 model_view = view_matrix * model_matrix;
+        vec4 view_position = model_view * in_position;
+        // Models are only rotated, translated and uniformly scaled
+        mat3 normal_matrix = mat3(model_view);
+        frag_normal = normal_matrix * in_normal;
+#ifdef VERTEX_TANGENT
+        frag_tangent = normal_matrix * in_tangent.xyz * in_tangent.w;
+#endif
+#ifdef VERTEX_TEXTURE
+        frag_texture = in_texture;
+#endif
+        frag_view_position = view_position.xyz;
+        gl_Position = projection_matrix * view_position;
+}
@@ -0,0 +1,27 @@
+#version 410 core
+
+// MULTI_VIEW only: one invocation per view, each sending its own copy of the
+// triangle to that view's viewport. invocations is MultiView::kMaxViews.
+layout(triangles, invocations = 4) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+layout(std140) uniform Views {
+        mat4 view_projection[4];
+        int view_count;
+};
+
+in vec4 vertex_color[];
+out vec4 frag_color;
+
+void main(void)
+{
+        if (gl_InvocationID >= view_count)
+                return;
+        for (int i = 0; i < 3; i++) {
+                gl_Position = view_projection[gl_InvocationID] * gl_in[i].gl_Position;
+                gl_ViewportIndex = gl_InvocationID;
+                frag_color = vertex_color[i];
+                EmitVertex();
+        }
+        EndPrimitive();
+}
@@ -0,0 +1,42 @@
+#version 410 core
+
+// TESSELLATION only: splits every edge into pieces about kEdgePixels long on
+// screen. An edge's level depends on nothing but its two ends, so both
+// triangles sharing it agree and no cracks open between them.
+layout(vertices = 3) out;
+
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+uniform int viewport_height;
+
+in vec4 vertex_color[];
+out vec4 patch_color[];
+
+const float kEdgePixels = 8.0;
+const float kMaxLevel = 64.0; // the least GL_MAX_TESS_GEN_LEVEL allowed
+
+// The edge's world length as seen at its middle, in pixels. Unlike projecting
+// both ends, this stays sane for edges crossing the near plane and does not
+// change as the edge turns. w is the distance for perspective and 1 for
+// orthographic projections.
+float EdgeLevel(vec4 a, vec4 b)
+{
+        vec4 middle = projection_matrix * view_matrix * (0.5 * (a + b));
+        float pixels = distance(a.xyz, b.xyz) * projection_matrix[1][1] *
+                       0.5 * float(viewport_height) / max(middle.w, 1e-3);
+        return clamp(pixels / kEdgePixels, 1.0, kMaxLevel);
+}
+
+void main(void)
+{
+        gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;
+        patch_color[gl_InvocationID] = vertex_color[gl_InvocationID];
+        if (gl_InvocationID != 0)
+                return;
+        // Outer level i is for the edge facing vertex i
+        gl_TessLevelOuter[0] = EdgeLevel(gl_in[1].gl_Position, gl_in[2].gl_Position);
+        gl_TessLevelOuter[1] = EdgeLevel(gl_in[2].gl_Position, gl_in[0].gl_Position);
+        gl_TessLevelOuter[2] = EdgeLevel(gl_in[0].gl_Position, gl_in[1].gl_Position);
+        gl_TessLevelInner[0] = max(gl_TessLevelOuter[0],
+                                   max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
+}
@@ -0,0 +1,23 @@
+#version 410 core
+
+// TESSELLATION only: places the generated vertices on the base triangle,
+// the way MeshGenerator subdivides it, and projects them. Odd fractional
+// spacing lets the level change smoothly as the camera moves.
+layout(triangles, fractional_odd_spacing, ccw) in;
+
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+
+in vec4 patch_color[];
+out vec4 frag_color;
+
+void main(void)
+{
+        vec4 position = gl_TessCoord.x * gl_in[0].gl_Position +
+                        gl_TessCoord.y * gl_in[1].gl_Position +
+                        gl_TessCoord.z * gl_in[2].gl_Position;
+        gl_Position = projection_matrix * view_matrix * position;
+        frag_color = gl_TessCoord.x * patch_color[0] +
+                     gl_TessCoord.y * patch_color[1] +
+                     gl_TessCoord.z * patch_color[2];
+}
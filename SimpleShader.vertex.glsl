@@ -1,16 +1,28 @@
-#version 410 core
-
-layout(location=0) in vec4 in_position;
-layout(location=1) in vec4 in_color;
-
-out vec4 frag_color;
-
-uniform mat4 model_matrix;
-uniform mat4 view_matrix;
-uniform mat4 projection_matrix;
-
-void main(void)
-{
-        gl_Position = (projection_matrix * view_matrix * model_matrix) * in_position;
-        frag_color = in_color;
-}
+#version 410 core
+
+layout(location=0) in vec4 in_position;
+layout(location=1) in vec4 in_color;
+
+uniform mat4 model_matrix;
+
+#if defined(MULTI_VIEW) || defined(TESSELLATION)
+// World space; a later stage projects it
+out vec4 vertex_color;
+
+void main(void)
+{
+        gl_Position = model_matrix * in_position;
+        vertex_color = in_color;
+}
+#else
+out vec4 frag_color;
+
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+
+void main(void)
+{
+        gl_Position = (projection_matrix * view_matrix * model_matrix) * in_position;
+        frag_color = in_color;
+}
+#endif
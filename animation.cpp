@@ -0,0 +1,438 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifdef MATMA_HAVE_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+// Slerp segments turning less than this are treated as turning this much:
+// the weights then differ from lerp's by ~1e-7, and sin() stays well away
+// from 0 for identical keys.
+static const float kMinSlerpAngle = 1e-3f;
+// Keys searched forward from last frame's before giving up on the hint
+static const unsigned int kCursorSteps = 2;
+
+// One group's tracks and the channel they sample, as the kernels see them
+struct TrackLanes {
+    AnimationSet::Interpolation interpolation;
+    unsigned int components;
+    const float* times;
+    const float* values[4];
+    const float* out[3];
+    const float* in[3];
+    const float* angles;
+    const float* inv_sines;
+    const unsigned int* objects;
+    const unsigned int* first_keys;
+    const unsigned int* key_counts;
+    unsigned int* cursors;
+    const float* durations;
+    const float* time_offsets;
+    float* samples[4];
+    unsigned long long* searches;
+};
+
+// Where a looping track is at time: time - duration * floor(time / duration).
+// In double every step is exact, so this is fmodf's result (moved into
+// [0, duration) for negative times) without fmodf's bit-by-bit loop.
+static float WrapTime(float time, float duration) {
+    double x = time, d = duration;
+    return (float)(x - d * std::floor(x / d));
+}
+
+// The segment holding local time t, starting from the track's cursor
+static unsigned int Locate(const float* times, unsigned int count,
+                           unsigned int* cursor, float t,
+                           unsigned long long* searches) {
+    // Playback moves forward by less than a key most frames, so the segment
+    // is usually the one sampled last or just after it
+    unsigned int k = *cursor;
+    if (times[k] <= t) {
+        for (unsigned int step = 0; step <= kCursorSteps; step++, k++) {
+            if (k + 2 >= count || times[k + 1] > t) {
+                *cursor = k;
+                return k;
+            }
+        }
+    }
+    (*searches)++;
+    // Looped, jumped or skipped ahead: the segment before the first key
+    // past t, among the keys that start one
+    k = std::upper_bound(times + 1, times + count - 1, t) - times - 1;
+    *cursor = k;
+    return k;
+}
+
+// Tracks [begin, end) one at a time. The AVX2 version does the same
+// operations in the same order eight tracks at a time; this one takes the
+// blocks it leaves and the tail.
+static void EvaluateTracks(const TrackLanes& lanes, float time,
+                           unsigned int begin, unsigned int end) {
+    for (unsigned int i = begin; i < end; i++) {
+        unsigned int first = lanes.first_keys[i];
+        const float* times = lanes.times + first;
+        float t = WrapTime(time + lanes.time_offsets[i], lanes.durations[i]);
+        unsigned int k = Locate(times, lanes.key_counts[i], &lanes.cursors[i],
+                                t, lanes.searches);
+        float u = std::min(1.0f, (t - times[k]) / (times[k + 1] - times[k]));
+        unsigned int a = first + k, b = a + 1;
+        unsigned int object = lanes.objects[i];
+
+        if (lanes.interpolation == AnimationSet::Bezier) {
+            // From a to b through a's out and b's in control points
+            float s = 1.0f - u;
+            float s2 = s * s, u2 = u * u;
+            for (unsigned int c = 0; c < lanes.components; c++) {
+                float sum = lanes.values[c][a] * (s2 * s);
+                sum = sum + lanes.out[c][a] * (3.0f * s2 * u);
+                sum = sum + lanes.in[c][b] * (3.0f * s * u2);
+                lanes.samples[c][object] = sum + lanes.values[c][b] * (u2 * u);
+            }
+            continue;
+        }
+
+        float a_weight = 1.0f - u, b_weight = u;
+        if (lanes.interpolation == AnimationSet::Slerp) {
+            // sin((1 - u) angle) and sin(u angle) over sin(angle)
+            float angle = lanes.angles[a], inv_sine = lanes.inv_sines[a];
+            float a_sine, b_sine, cosine;
+            SinCos((1.0f - u) * angle, &a_sine, &cosine);
+            SinCos(u * angle, &b_sine, &cosine);
+            a_weight = a_sine * inv_sine;
+            b_weight = b_sine * inv_sine;
+        }
+        float result[4];
+        for (unsigned int c = 0; c < lanes.components; c++)
+            result[c] = lanes.values[c][a] * a_weight +
+                        lanes.values[c][b] * b_weight;
+        if (lanes.components == 4 &&
+            lanes.interpolation == AnimationSet::Linear) {
+            float length = sqrtf(result[0] * result[0] + result[1] * result[1] +
+                                 result[2] * result[2] + result[3] * result[3]);
+            for (int c = 0; c < 4; c++)
+                result[c] /= length;
+        }
+        for (unsigned int c = 0; c < lanes.components; c++)
+            lanes.samples[c][object] = result[c];
+    }
+}
+
+#ifdef MATMA_HAVE_AVX2_DISPATCH
+
+__attribute__((target("avx2"))) static inline __m256
+WrapTimesAvx2(__m256 time, __m256 duration) {
+    __m256d x[2] = {_mm256_cvtps_pd(_mm256_castps256_ps128(time)),
+                    _mm256_cvtps_pd(_mm256_extractf128_ps(time, 1))};
+    __m256d d[2] = {_mm256_cvtps_pd(_mm256_castps256_ps128(duration)),
+                    _mm256_cvtps_pd(_mm256_extractf128_ps(duration, 1))};
+    __m128 wrapped[2];
+    for (int h = 0; h < 2; h++) {
+        __m256d turns = _mm256_floor_pd(_mm256_div_pd(x[h], d[h]));
+        wrapped[h] = _mm256_cvtpd_ps(
+            _mm256_sub_pd(x[h], _mm256_mul_pd(d[h], turns)));
+    }
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(wrapped[0]),
+                                wrapped[1], 1);
+}
+
+// Tracks [begin, end), at most 64 blocks of eight, where every track is still
+// in last frame's segment. Returns a bit per block that had a track move on,
+// which EvaluateTracks() is left to do: calling Locate() from here has
+// measured several times slower than the same calls from the scalar loop.
+__attribute__((target("avx2"))) static unsigned long long
+EvaluateTracksAvx2(const TrackLanes& lanes, float time, unsigned int begin,
+                   unsigned int end) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 three = _mm256_set1_ps(3.0f);
+    const __m256i one_index = _mm256_set1_epi32(1);
+    unsigned long long moved_blocks = 0;
+    for (unsigned int i = begin; i < end; i += 8) {
+        __m256 t = WrapTimesAvx2(
+            _mm256_add_ps(_mm256_set1_ps(time),
+                          _mm256_loadu_ps(lanes.time_offsets + i)),
+            _mm256_loadu_ps(lanes.durations + i));
+
+        // Last frame's segment, if t is still in it
+        __m256i first =
+            _mm256_loadu_si256((const __m256i*)(lanes.first_keys + i));
+        __m256i k = _mm256_loadu_si256((const __m256i*)(lanes.cursors + i));
+        __m256i a = _mm256_add_epi32(first, k);
+        __m256 t0 = _mm256_i32gather_ps(lanes.times, a, 4);
+        __m256 t1 =
+            _mm256_i32gather_ps(lanes.times, _mm256_add_epi32(a, one_index), 4);
+        __m256i last_key = _mm256_sub_epi32(
+            _mm256_loadu_si256((const __m256i*)(lanes.key_counts + i)),
+            one_index);
+        __m256 last_segment = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+            _mm256_add_epi32(k, _mm256_set1_epi32(2)), last_key));
+        __m256 in_segment = _mm256_and_ps(
+            _mm256_cmp_ps(t0, t, _CMP_LE_OQ),
+            _mm256_or_ps(last_segment, _mm256_cmp_ps(t1, t, _CMP_GT_OQ)));
+        if (_mm256_movemask_ps(in_segment) != 0xff) {
+            moved_blocks |= 1ull << ((i - begin) / 8);
+            continue;
+        }
+        __m256 u = _mm256_min_ps(
+            _mm256_div_ps(_mm256_sub_ps(t, t0), _mm256_sub_ps(t1, t0)), one);
+        __m256i b = _mm256_add_epi32(a, one_index);
+
+        __m256 results[4];
+        if (lanes.interpolation == AnimationSet::Bezier) {
+            __m256 s = _mm256_sub_ps(one, u);
+            __m256 s2 = _mm256_mul_ps(s, s), u2 = _mm256_mul_ps(u, u);
+            __m256 w0 = _mm256_mul_ps(s2, s);
+            __m256 w1 = _mm256_mul_ps(_mm256_mul_ps(three, s2), u);
+            __m256 w2 = _mm256_mul_ps(_mm256_mul_ps(three, s), u2);
+            __m256 w3 = _mm256_mul_ps(u2, u);
+            for (unsigned int c = 0; c < lanes.components; c++) {
+                __m256 sum = _mm256_mul_ps(
+                    _mm256_i32gather_ps(lanes.values[c], a, 4), w0);
+                sum = _mm256_add_ps(
+                    sum,
+                    _mm256_mul_ps(_mm256_i32gather_ps(lanes.out[c], a, 4), w1));
+                sum = _mm256_add_ps(
+                    sum,
+                    _mm256_mul_ps(_mm256_i32gather_ps(lanes.in[c], b, 4), w2));
+                results[c] = _mm256_add_ps(
+                    sum, _mm256_mul_ps(
+                             _mm256_i32gather_ps(lanes.values[c], b, 4), w3));
+            }
+        } else {
+            __m256 a_weights = _mm256_sub_ps(one, u), b_weights = u;
+            if (lanes.interpolation == AnimationSet::Slerp) {
+                __m256 angles = _mm256_i32gather_ps(lanes.angles, a, 4);
+                __m256 inv_sines = _mm256_i32gather_ps(lanes.inv_sines, a, 4);
+                float arguments[16], sines[16], cosines[16];
+                _mm256_storeu_ps(arguments, _mm256_mul_ps(a_weights, angles));
+                _mm256_storeu_ps(arguments + 8, _mm256_mul_ps(u, angles));
+                SinCos(arguments, sines, cosines, 16);
+                a_weights = _mm256_mul_ps(_mm256_loadu_ps(sines), inv_sines);
+                b_weights =
+                    _mm256_mul_ps(_mm256_loadu_ps(sines + 8), inv_sines);
+            }
+            for (unsigned int c = 0; c < lanes.components; c++)
+                results[c] = _mm256_add_ps(
+                    _mm256_mul_ps(_mm256_i32gather_ps(lanes.values[c], a, 4),
+                                  a_weights),
+                    _mm256_mul_ps(_mm256_i32gather_ps(lanes.values[c], b, 4),
+                                  b_weights));
+            if (lanes.components == 4 &&
+                lanes.interpolation == AnimationSet::Linear) {
+                __m256 length = _mm256_sqrt_ps(_mm256_add_ps(
+                    _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(results[0], results[0]),
+                                      _mm256_mul_ps(results[1], results[1])),
+                        _mm256_mul_ps(results[2], results[2])),
+                    _mm256_mul_ps(results[3], results[3])));
+                for (int c = 0; c < 4; c++)
+                    results[c] = _mm256_div_ps(results[c], length);
+            }
+        }
+
+        // Objects only increase along a group, so eight of them spanning
+        // seven are a run
+        const unsigned int* objects = lanes.objects + i;
+        for (unsigned int c = 0; c < lanes.components; c++) {
+            if (objects[7] == objects[0] + 7) {
+                _mm256_storeu_ps(lanes.samples[c] + objects[0], results[c]);
+                continue;
+            }
+            float lane[8];
+            _mm256_storeu_ps(lane, results[c]);
+            for (unsigned int j = 0; j < 8; j++)
+                lanes.samples[c][objects[j]] = lane[j];
+        }
+    }
+    return moved_blocks;
+}
+
+#endif // MATMA_HAVE_AVX2_DISPATCH
+
+// How many tracks from the front the AVX2 kernel takes
+static unsigned int VectorLanes(unsigned int count) {
+    return CpuHasAvx2() ? count & ~7u : 0;
+}
+
+AnimationSet::AnimationSet() { Clear(); }
+
+void AnimationSet::ClearChannel(Channel* channel, unsigned int components) {
+    *channel = Channel();
+    channel->components = components;
+}
+
+void AnimationSet::Clear() {
+    ClearChannel(&positions_, 3);
+    ClearChannel(&rotations_, 4);
+    ClearChannel(&scales_, 3);
+    time_offsets_.clear();
+    stats_ = Stats();
+}
+
+unsigned int AnimationSet::AddObject(const Clip& clip, float time_offset) {
+    VectorKey still = VectorKey();
+    AddVectorTrack(&positions_, clip.position_interpolation,
+                   clip.positions.empty() ? std::vector<VectorKey>(1, still)
+                                          : clip.positions,
+                   time_offset);
+    AddRotationTrack(clip.rotation_interpolation,
+                     clip.rotations.empty()
+                         ? std::vector<RotationKey>(1, RotationKey{0, Quat()})
+                         : clip.rotations,
+                     time_offset);
+    for (int k = 0; k < 3; k++)
+        still.value[k] = 1;
+    AddVectorTrack(&scales_, clip.scale_interpolation,
+                   clip.scales.empty() ? std::vector<VectorKey>(1, still)
+                                       : clip.scales,
+                   time_offset);
+    time_offsets_.push_back(time_offset);
+    return time_offsets_.size() - 1;
+}
+
+void AnimationSet::AddTrack(TrackGroup* group, unsigned int object,
+                            unsigned int first_key, unsigned int key_count,
+                            float duration, float time_offset) {
+    group->objects.push_back(object);
+    group->first_keys.push_back(first_key);
+    group->key_counts.push_back(key_count);
+    group->cursors.push_back(0);
+    group->durations.push_back(duration);
+    group->time_offsets.push_back(time_offset);
+}
+
+void AnimationSet::AddVectorTrack(Channel* channel,
+                                  Interpolation interpolation,
+                                  const std::vector<VectorKey>& keys,
+                                  float time_offset) {
+    unsigned int first_key = channel->times.size();
+    for (const VectorKey& key : keys) {
+        channel->times.push_back(key.time);
+        for (int k = 0; k < 3; k++) {
+            channel->values[k].push_back(key.value[k]);
+            channel->out[k].push_back(key.out[k]);
+            channel->in[k].push_back(key.in[k]);
+        }
+    }
+    for (int k = 0; k < 3; k++)
+        channel->samples[k].push_back(keys[0].value[k]);
+    if (keys.size() > 1 && keys.back().time > 0)
+        AddTrack(&channel->groups[interpolation == Bezier ? Bezier : Linear],
+                 ObjectCount(), first_key, keys.size(), keys.back().time,
+                 time_offset);
+}
+
+void AnimationSet::AddRotationTrack(Interpolation interpolation,
+                                    const std::vector<RotationKey>& keys,
+                                    float time_offset) {
+    Channel* channel = &rotations_;
+    unsigned int first_key = channel->times.size();
+    // Flipping keys into the hemisphere of the one before makes every
+    // segment take the short way round, so sampling needs no sign test.
+    Quat previous = keys[0].value;
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        Quat value = keys[i].value;
+        if (previous.Dot(value) < 0)
+            value = Quat(-value.x(), -value.y(), -value.z(), -value.w());
+        channel->times.push_back(keys[i].time);
+        channel->values[0].push_back(value.x());
+        channel->values[1].push_back(value.y());
+        channel->values[2].push_back(value.z());
+        channel->values[3].push_back(value.w());
+        if (i > 0) {
+            float angle = acosf(std::min(1.0f, previous.Dot(value)));
+            angle = std::max(angle, kMinSlerpAngle);
+            channel->angles.back() = angle;
+            channel->inv_sines.back() = 1.0f / sinf(angle);
+        }
+        // The last key starts no segment; sampled on its own, its weight
+        // comes out as sin(angle) / sin(angle) = 1
+        channel->angles.push_back(kMinSlerpAngle);
+        channel->inv_sines.push_back(1.0f / sinf(kMinSlerpAngle));
+        previous = value;
+    }
+    float sample[4];
+    for (int k = 0; k < 4; k++)
+        sample[k] = channel->values[k][first_key];
+    if (keys.size() > 1 && keys.back().time > 0) {
+        AddTrack(&channel->groups[interpolation == Linear ? Linear : Slerp],
+                 ObjectCount(), first_key, keys.size(), keys.back().time,
+                 time_offset);
+    } else if (interpolation == Linear) {
+        // As evaluating would leave it
+        float length = sqrtf(sample[0] * sample[0] + sample[1] * sample[1] +
+                             sample[2] * sample[2] + sample[3] * sample[3]);
+        for (int k = 0; k < 4; k++)
+            sample[k] /= length;
+    }
+    for (int k = 0; k < 4; k++)
+        channel->samples[k].push_back(sample[k]);
+}
+
+void AnimationSet::Evaluate(float time) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    EvaluateChannel(&positions_, time);
+    EvaluateChannel(&rotations_, time);
+    EvaluateChannel(&scales_, time);
+    stats_.seconds += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+}
+
+void AnimationSet::EvaluateChannel(Channel* channel, float time) {
+    for (int interpolation = Linear; interpolation <= Slerp; interpolation++) {
+        TrackGroup& group = channel->groups[interpolation];
+        unsigned int count = group.objects.size();
+        if (count == 0)
+            continue;
+        TrackLanes lanes;
+        lanes.interpolation = (Interpolation)interpolation;
+        lanes.components = channel->components;
+        lanes.times = channel->times.data();
+        for (unsigned int c = 0; c < channel->components; c++) {
+            lanes.values[c] = channel->values[c].data();
+            lanes.samples[c] = channel->samples[c].data();
+        }
+        for (int c = 0; c < 3; c++) {
+            lanes.out[c] = channel->out[c].data();
+            lanes.in[c] = channel->in[c].data();
+        }
+        lanes.angles = channel->angles.data();
+        lanes.inv_sines = channel->inv_sines.data();
+        lanes.objects = group.objects.data();
+        lanes.first_keys = group.first_keys.data();
+        lanes.key_counts = group.key_counts.data();
+        lanes.cursors = group.cursors.data();
+        lanes.durations = group.durations.data();
+        lanes.time_offsets = group.time_offsets.data();
+        lanes.searches = &stats_.searches;
+
+        unsigned int done = VectorLanes(count);
+#ifdef MATMA_HAVE_AVX2_DISPATCH
+        for (unsigned int begin = 0; begin < done; begin += 64 * 8) {
+            unsigned int end = std::min(done, begin + 64 * 8);
+            unsigned long long moved =
+                EvaluateTracksAvx2(lanes, time, begin, end);
+            for (unsigned int block = 0; moved; block++, moved >>= 1)
+                if (moved & 1)
+                    EvaluateTracks(lanes, time, begin + block * 8,
+                                   begin + block * 8 + 8);
+        }
+#endif
+        EvaluateTracks(lanes, time, done, count);
+        stats_.samples += count;
+    }
+}
+
+void AnimationSet::BuildMatrices(Mat4* out) const {
+    const float* translations[3] = {positions(0), positions(1), positions(2)};
+    const float* rotations[4] = {this->rotations(0), this->rotations(1),
+                                 this->rotations(2), this->rotations(3)};
+    const float* scales[3] = {this->scales(0), this->scales(1),
+                              this->scales(2)};
+    Mat4::CreateTransforms(translations, rotations, scales, out,
+                           ObjectCount());
+}
@@ -0,0 +1,120 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+
+#include "matma.h"
+
+// Keyframed position, rotation and scale for many objects, sampled together
+// once a frame. Each channel keeps the keys of all its tracks in
+// structure-of-arrays form, track after track, and the tracks themselves in
+// one group per interpolation. A group is evaluated eight tracks at a time
+// with AVX2 when the CPU has it, reading each segment's keys in place, as
+// long as all eight are still in the segment they were in last frame; the
+// rest, and CPUs without AVX2, search and interpolate one track at a time.
+// Tracks that hold still are sampled once, when added.
+class AnimationSet {
+  public:
+    enum Interpolation {
+        Linear, // straight lines; rotations are lerped and renormalized
+        Bezier, // cubic through each key's out and the next key's in point
+        Slerp,  // rotations only: constant angular speed between keys
+    };
+    struct VectorKey {
+        float time; // seconds
+        float value[3];
+        // Bezier only: control points leaving and entering the key
+        float out[3];
+        float in[3];
+    };
+    struct RotationKey {
+        float time;
+        Quat value;
+    };
+    // One object's tracks, keys in time order starting at 0. A track with
+    // one key holds still; longer ones loop over the time of their last key.
+    struct Clip {
+        Interpolation position_interpolation; // Linear or Bezier
+        std::vector<VectorKey> positions;
+        Interpolation rotation_interpolation; // Linear or Slerp
+        std::vector<RotationKey> rotations;
+        Interpolation scale_interpolation; // Linear or Bezier
+        std::vector<VectorKey> scales;
+    };
+    struct Stats {
+        unsigned long long samples;  // tracks evaluated
+        unsigned long long searches; // binary searches, the cursor missing
+        double seconds;              // spent in Evaluate()
+    };
+
+    AnimationSet();
+    void Clear();
+    // Copies the clip's keys and returns the object's index. time_offset is
+    // added to the time the object is sampled at, so objects sharing a clip
+    // need not move in step.
+    unsigned int AddObject(const Clip& clip, float time_offset = 0);
+    unsigned int ObjectCount() const { return time_offsets_.size(); }
+
+    // Samples every track at time, in seconds
+    void Evaluate(float time);
+    // Translation * rotation * scale of every object, as last evaluated
+    void BuildMatrices(Mat4* out) const;
+    // Last samples, one array per component
+    const float* positions(int axis) const {
+        return positions_.samples[axis].data();
+    }
+    const float* rotations(int component) const {
+        return rotations_.samples[component].data();
+    }
+    const float* scales(int axis) const {
+        return scales_.samples[axis].data();
+    }
+
+    const Stats& stats() const { return stats_; }
+    void ResetStats() { stats_ = Stats(); }
+
+  private:
+    // The moving tracks of one interpolation, in the order of their objects
+    struct TrackGroup {
+        std::vector<unsigned int> objects;
+        std::vector<unsigned int> first_keys;
+        std::vector<unsigned int> key_counts;
+        std::vector<unsigned int> cursors; // segment sampled last
+        std::vector<float> durations;
+        std::vector<float> time_offsets;
+    };
+
+    // All the tracks of one channel, keys first to last, one sample each
+    struct Channel {
+        unsigned int components; // 3, or 4 for rotations
+        // Keys
+        std::vector<float> times;
+        std::vector<float> values[4];
+        std::vector<float> out[3]; // Bezier control points
+        std::vector<float> in[3];
+        std::vector<float> angles;    // Slerp: of the segment from each key
+        std::vector<float> inv_sines; // and 1 / sin of it
+        TrackGroup groups[3]; // by Interpolation
+        // Samples, by object
+        std::vector<float> samples[4];
+    };
+
+    static void ClearChannel(Channel* channel, unsigned int components);
+    static void AddTrack(TrackGroup* group, unsigned int object,
+                         unsigned int first_key, unsigned int key_count,
+                         float duration, float time_offset);
+    void AddVectorTrack(Channel* channel, Interpolation interpolation,
+                        const std::vector<VectorKey>& keys, float time_offset);
+    void AddRotationTrack(Interpolation interpolation,
+                          const std::vector<RotationKey>& keys,
+                          float time_offset);
+    void EvaluateChannel(Channel* channel, float time);
+
+    Channel positions_;
+    Channel rotations_;
+    Channel scales_;
+    std::vector<float> time_offsets_;
+    Stats stats_;
+};
+
+#endif // ANIMATION_H
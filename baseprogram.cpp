@@ -7,60 +7,143 @@
 #include <cstring>
 #include <cstdlib>
 
+#include "gpuresources.h"
+
 using namespace std;
 
+const GLenum BaseProgram::kStageTypes[kStageCount] = {
+    GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_GEOMETRY_SHADER,
+};
 
-void BaseProgram::Initialize(const char *vertex_shader_file, const char *fragment_shader_file){
-    vertex_shader_ = LoadAndCompileShaderOrDie(vertex_shader_file, GL_VERTEX_SHADER);
+BaseProgram::BaseProgram() {
+    program_ = vertex_shader_ = fragment_shader_ = 0;
+    for (int i = 0; i < kStageCount; i++) {
+        stage_files_[i] = nullptr;
+        stage_shaders_[i] = 0;
+    }
+    linked_ = false;
+    fatal_errors_ = true;
+    failed_ = false;
+}
 
-    fragment_shader_ = LoadAndCompileShaderOrDie(fragment_shader_file, GL_FRAGMENT_SHADER);
+void BaseProgram::Initialize(const char* vertex_shader_file,
+                             const char* fragment_shader_file,
+                             const std::string& defines) {
+    if (!program_)
+        StartCompile(vertex_shader_file, fragment_shader_file, defines);
+
+    if (!linked_ && !failed_) {
+        CheckShaderOrDie(vertex_shader_, GL_VERTEX_SHADER);
+        CheckShaderOrDie(fragment_shader_, GL_FRAGMENT_SHADER);
+        for (int i = 0; i < kStageCount; i++)
+            if (stage_shaders_[i])
+                CheckShaderOrDie(stage_shaders_[i], kStageTypes[i]);
+        if (!failed_)
+            CheckProgramOrDie();
+        linked_ = !failed_;
+    }
 
-    program_ = LinkProgramOrDie(vertex_shader_, fragment_shader_);
+    if (linked_)
+        glUseProgram(program_);
+}
 
-    glUseProgram(program_);
+void BaseProgram::StartCompile(const char* vertex_shader_file,
+                               const char* fragment_shader_file,
+                               const std::string& defines) {
+    vertex_shader_ = LoadAndCompileShaderOrDie(vertex_shader_file,
+                                               GL_VERTEX_SHADER, defines);
+
+    fragment_shader_ = LoadAndCompileShaderOrDie(fragment_shader_file,
+                                                 GL_FRAGMENT_SHADER, defines);
+
+    for (int i = 0; i < kStageCount; i++)
+        if (stage_files_[i])
+            stage_shaders_[i] = LoadAndCompileShaderOrDie(
+                stage_files_[i], kStageTypes[i], defines);
+
+    // Linking right away lets the driver carry on with it too; the compile
+    // status is only asked for once everything is done.
+    program_ = glCreateProgram();
+    GpuResources::Instance().Track(GpuResources::Programs, program_,
+                                   "programs");
+    glAttachShader(program_, vertex_shader_);
+    glAttachShader(program_, fragment_shader_);
+    for (int i = 0; i < kStageCount; i++)
+        if (stage_shaders_[i])
+            glAttachShader(program_, stage_shaders_[i]);
+    glLinkProgram(program_);
 }
 
+bool BaseProgram::CompileFinished() const {
+    if (linked_ || failed_)
+        return true;
+    if (!program_)
+        return false;
+    // Without the extension asking would block, so report it as done
+    if (!GLEW_ARB_parallel_shader_compile)
+        return true;
+    GLint finished;
+    glGetProgramiv(program_, GL_COMPLETION_STATUS_ARB, &finished);
+    return finished;
+}
 
-GLuint BaseProgram::LinkProgramOrDie(GLint vertex_shader, GLint fragment_shader){
-    GLuint new_program = glCreateProgram();
-    glAttachShader(new_program, vertex_shader);
-    glAttachShader(new_program, fragment_shader);
-    glLinkProgram(new_program);
 
+void BaseProgram::CheckProgramOrDie() {
     GLint  linked;
-    glGetProgramiv(new_program, GL_LINK_STATUS, &linked);
+    glGetProgramiv(program_, GL_LINK_STATUS, &linked);
     if ( !linked ) {
         cerr << "Shader program failed to link" << endl;
         GLint  log_size;
-        glGetProgramiv(new_program, GL_INFO_LOG_LENGTH, &log_size);
+        glGetProgramiv(program_, GL_INFO_LOG_LENGTH, &log_size);
         char* log_msg = new char[log_size];
-        glGetProgramInfoLog(new_program, log_size, NULL, log_msg);
+        glGetProgramInfoLog(program_, log_size, NULL, log_msg);
         cerr << log_msg << endl;
         delete [] log_msg;
+        FailOrDie();
+    }
+}
+
+void BaseProgram::FailOrDie() {
+    if (fatal_errors_) {
         glfwTerminate();
         exit(EXIT_FAILURE);
     }
-
-    return new_program;
+    failed_ = true;
 }
 
 BaseProgram::~BaseProgram(){
+    if (!program_) // never linked, e.g. recording-only use in benchmarks
+        return;
     glUseProgram(0);
 
     glDetachShader(program_, vertex_shader_);
     glDetachShader(program_, fragment_shader_);
+    for (int i = 0; i < kStageCount; i++) {
+        if (!stage_shaders_[i])
+            continue;
+        glDetachShader(program_, stage_shaders_[i]);
+        glDeleteShader(stage_shaders_[i]);
+        GpuResources::Instance().Untrack(GpuResources::Shaders,
+                                         stage_shaders_[i]);
+    }
 
     glDeleteShader(fragment_shader_);
     glDeleteShader(vertex_shader_);
+    GpuResources::Instance().Untrack(GpuResources::Shaders, fragment_shader_);
+    GpuResources::Instance().Untrack(GpuResources::Shaders, vertex_shader_);
 
     glDeleteProgram(program_);
+    GpuResources::Instance().Untrack(GpuResources::Programs, program_);
 
 }
 
-GLuint BaseProgram::LoadAndCompileShaderOrDie(const char * source_file, GLenum type){
+GLuint BaseProgram::LoadAndCompileShaderOrDie(const char* source_file,
+                                              GLenum type,
+                                              const std::string& defines) {
     int file_size;
     char * shader_code;
     GLuint shader=glCreateShader(type);
+    GpuResources::Instance().Track(GpuResources::Shaders, shader, "programs");
     ifstream file (source_file, ios::in|ios::ate|ios::binary);
     if (file.is_open()) {
         file_size = file.tellg();
@@ -70,17 +153,26 @@ GLuint BaseProgram::LoadAndCompileShaderOrDie(const char * source_file, GLenum t
         shader_code[file_size]='\0';
         file.close();
 
-        glShaderSource(shader, 1, (const GLchar**) &shader_code, NULL);
+        // #version has to come first, so the defines go after that line
+        const char* version_end = strchr(shader_code, '\n');
+        GLint version_length = version_end ? version_end - shader_code + 1 : 0;
+        const GLchar* sources[3] = {shader_code, defines.c_str(),
+                                    shader_code + version_length};
+        GLint lengths[3] = {version_length, (GLint)defines.size(),
+                            file_size - version_length};
+        glShaderSource(shader, 3, sources, lengths);
         glCompileShader(shader);
         delete[] shader_code;
 
     }
     else{ //file was not opened
         cerr<<"Could not open the file "<<source_file<<endl;
-         glfwTerminate();
-         exit(EXIT_FAILURE);
+        FailOrDie();
     }
+    return shader;
+}
 
+void BaseProgram::CheckShaderOrDie(GLuint shader, GLenum type) {
     GLint  compiled;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
     if (!compiled) {
@@ -91,6 +183,15 @@ GLuint BaseProgram::LoadAndCompileShaderOrDie(const char * source_file, GLenum t
         case GL_FRAGMENT_SHADER:
             cerr << "fragment ";
         break;
+        case GL_GEOMETRY_SHADER:
+            cerr << "geometry ";
+        break;
+        case GL_TESS_CONTROL_SHADER:
+            cerr << "tessellation control ";
+        break;
+        case GL_TESS_EVALUATION_SHADER:
+            cerr << "tessellation evaluation ";
+        break;
         }
         cerr << "shader is failed to compile:" << endl;
         GLint  log_size;
@@ -99,20 +200,23 @@ GLuint BaseProgram::LoadAndCompileShaderOrDie(const char * source_file, GLenum t
         glGetShaderInfoLog(shader, log_size, NULL, log_msg);
         cerr << log_msg << endl;
         delete [] log_msg;
-         glfwTerminate();
-         exit(EXIT_FAILURE);
+        FailOrDie();
     }
-    return shader;
 }
 
 
 GLint BaseProgram::GetUniformLocationOrDie(const char* var_name){
     GLint location=-1;
+    if (failed_)
+        return location;
     location = glGetUniformLocation(program_, var_name);
     if (location < 0){
         cerr << "ERROR: cannot find uniform location " << var_name << endl;
-        glfwTerminate();
-        exit(EXIT_FAILURE);
+        FailOrDie();
     }
     return location;
 }
+
+GLint BaseProgram::GetUniformLocation(const char* var_name) {
+    return failed_ ? -1 : glGetUniformLocation(program_, var_name);
+}
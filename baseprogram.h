@@ -1,25 +1,73 @@
 #ifndef BASEPROGRAM_H
 #define BASEPROGRAM_H
 
+#include <string>
+
 #include <GL/glew.h>
 
 #include "matma.h"
 
 class BaseProgram{
 public:
-    void Initialize(const char* vertex_shader_file, const char* fragment_shader_file);
+    BaseProgram();
+    // defines go right after the #version line, e.g. "#define ALBEDO_MAP\n"
+    virtual void Initialize(const char* vertex_shader_file,
+                            const char* fragment_shader_file,
+                            const std::string& defines = "");
+    // Initialize() in two steps, for compiling in the background:
+    // StartCompile() hands the sources to the driver and returns, and
+    // CompileFinished() polls whether Initialize() would still wait for it.
+    void StartCompile(const char* vertex_shader_file,
+                      const char* fragment_shader_file,
+                      const std::string& defines);
+    bool CompileFinished() const;
+    // Optional stages, compiled with the same defines; call first
+    void set_geometry_shader(const char* file) {
+        stage_files_[GeometryStage] = file;
+    }
+    void set_tessellation_shaders(const char* control_file,
+                                  const char* evaluation_file) {
+        stage_files_[TessControlStage] = control_file;
+        stage_files_[TessEvaluationStage] = evaluation_file;
+    }
+    // Draws must then send patches of 3 vertices instead of triangles
+    bool tessellated() const {
+        return stage_files_[TessEvaluationStage] != nullptr;
+    }
+    // Reloads must not take the application down: with this off, whatever
+    // the OrDie functions would exit on is logged and makes failed() true.
+    void set_fatal_errors(bool fatal) { fatal_errors_ = fatal; }
+    bool failed() const { return failed_; }
     operator GLuint() const{return program_;} // to be used in glUseFunction()
-    ~BaseProgram();
+    virtual ~BaseProgram();
 protected:
     GLuint program_;
 private:
+    enum Stage {
+        TessControlStage,
+        TessEvaluationStage,
+        GeometryStage,
+        kStageCount
+    };
+    static const GLenum kStageTypes[kStageCount];
+
     GLuint vertex_shader_;
     GLuint fragment_shader_;
+    const char* stage_files_[kStageCount]; // nullptr for stages not used
+    GLuint stage_shaders_[kStageCount];
+    bool linked_;
+    bool fatal_errors_;
+    bool failed_;
 
-    GLuint LoadAndCompileShaderOrDie(const char* source_file, GLenum type);
-    GLuint LinkProgramOrDie(GLint vertex_shader, GLint fragment_shader);
+    GLuint LoadAndCompileShaderOrDie(const char* source_file, GLenum type,
+                                     const std::string& defines);
+    void CheckShaderOrDie(GLuint shader, GLenum type);
+    void CheckProgramOrDie();
+    void FailOrDie();
 protected:
     GLint GetUniformLocationOrDie(const char *);
+    // -1 if the uniform is not there, e.g. compiled out of this variant
+    GLint GetUniformLocation(const char*);
 
 };
 
@@ -0,0 +1,36 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdio>
+
+// Tiny helpers shared by the programs in bench/. Each benchmark is its own
+// executable built by `make bench` against optimized copies of the objects.
+
+class Stopwatch {
+  public:
+    Stopwatch() { Restart(); }
+    void Restart() { start_ = std::chrono::steady_clock::now(); }
+    double ElapsedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start_)
+            .count();
+    }
+    double ElapsedMilliseconds() const { return ElapsedSeconds() * 1000.0; }
+
+  private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Keeps the optimizer from dropping work whose result is otherwise unused.
+template <typename T> inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ReportRate(const char* name, double items, double seconds,
+                       const char* unit) {
+    printf("%-40s %10.3f ms %14.1f %s/s\n", name, seconds * 1000.0,
+           items / seconds, unit);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,155 @@
+// Collision detection for many tumbling K-drons and cubes: broadphase and
+// narrowphase cost against object count at constant density, plus a check of
+// GJK/EPA against the exact separating axis test for boxes.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "collision.h"
+#include "cube.h"
+#include "jobsystem.h"
+#include "kdron.h"
+
+// Model matrix of a randomly scaled, rotated and placed unit shape
+static Mat4 RandomPose(std::mt19937& random, float extent) {
+    std::uniform_real_distribution<float> unit(0, 1);
+    Mat4 model;
+    model.Scale(0.5f + unit(random), 0.5f + unit(random),
+                0.5f + unit(random));
+    model.RotateAboutX(360 * unit(random));
+    model.RotateAboutY(360 * unit(random));
+    model.RotateAboutZ(360 * unit(random));
+    model.Translate(extent * (unit(random) - 0.5f),
+                    extent * (unit(random) - 0.5f),
+                    extent * (unit(random) - 0.5f));
+    return model;
+}
+
+// Minimum overlap over the 15 separating axes of two boxes, or -1 if apart
+static float BoxPenetration(const Mat4& a_model, const Mat4& b_model) {
+    const float* models[2] = {a_model, b_model};
+    float axes[2][3][3], half[2][3];
+    for (int s = 0; s < 2; s++)
+        for (int k = 0; k < 3; k++) {
+            const float* column = models[s] + 4 * k;
+            float length =
+                std::sqrt(column[0] * column[0] + column[1] * column[1] +
+                          column[2] * column[2]);
+            for (int r = 0; r < 3; r++)
+                axes[s][k][r] = column[r] / length;
+            half[s][k] = 0.5f * length;
+        }
+    float candidates[15][3];
+    int count = 0;
+    for (int s = 0; s < 2; s++)
+        for (int k = 0; k < 3; k++, count++)
+            for (int r = 0; r < 3; r++)
+                candidates[count][r] = axes[s][k][r];
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++, count++) {
+            const float* u = axes[0][i];
+            const float* v = axes[1][j];
+            candidates[count][0] = u[1] * v[2] - u[2] * v[1];
+            candidates[count][1] = u[2] * v[0] - u[0] * v[2];
+            candidates[count][2] = u[0] * v[1] - u[1] * v[0];
+        }
+    float best = INFINITY;
+    for (const float* axis : candidates) {
+        float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] +
+                                 axis[2] * axis[2]);
+        if (length < 1e-5f)
+            continue; // parallel edges, covered by the face axes
+        float radius = 0;
+        for (int s = 0; s < 2; s++)
+            for (int k = 0; k < 3; k++)
+                radius += half[s][k] *
+                          std::fabs(axis[0] * axes[s][k][0] +
+                                    axis[1] * axes[s][k][1] +
+                                    axis[2] * axes[s][k][2]) /
+                          length;
+        float distance = 0;
+        for (int r = 0; r < 3; r++)
+            distance += (models[1][12 + r] - models[0][12 + r]) * axis[r];
+        float overlap = radius - std::fabs(distance) / length;
+        if (overlap < 0)
+            return -1;
+        best = std::min(best, overlap);
+    }
+    return best;
+}
+
+static void CheckAgainstBoxes(unsigned int tests) {
+    std::mt19937 random(7);
+    ConvexShape cube(Cube::kVertices, Cube::kVertexCount);
+    unsigned int hits = 0, mismatches = 0;
+    float worst = 0;
+    for (unsigned int i = 0; i < tests; i++) {
+        Mat4 a = RandomPose(random, 1.6f), b = RandomPose(random, 1.6f);
+        float expected = BoxPenetration(a, b);
+        Contact contact;
+        bool found = CollideConvex(cube, a, cube, b, &contact);
+        // Grazing contacts may go either way
+        if (found != (expected > 0) && std::fabs(expected) > 1e-4f) {
+            mismatches++;
+            continue;
+        }
+        if (found && expected > 0) {
+            hits++;
+            worst = std::max(worst, std::fabs(contact.depth - expected));
+        }
+    }
+    printf("Boxes: %u/%u mismatches, %u overlapping, worst depth error %g\n",
+           mismatches, tests, hits, worst);
+}
+
+static void MeasureWorld(unsigned int count, int frames) {
+    ConvexShape kdron(KDron::kVertices, KDron::kVertexCount);
+    ConvexShape cube(Cube::kVertices, Cube::kVertexCount);
+    // Constant density: about one shape per 1.5 cubic units
+    float extent = std::cbrt(1.5f * count);
+    std::mt19937 random(count);
+    std::vector<Mat4> poses(count);
+    CollisionWorld world;
+    for (unsigned int i = 0; i < count; i++) {
+        poses[i] = RandomPose(random, extent);
+        world.AddBody(i % 4 ? &kdron : &cube, poses[i]);
+    }
+
+    double broadphase = 0, narrowphase = 0;
+    unsigned long long pairs = 0, contacts = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        // Everything tumbles a little between frames
+        for (unsigned int i = 0; i < count; i++) {
+            Mat4 step;
+            step.RotateAboutX(3);
+            step.RotateAboutY(2);
+            poses[i] = poses[i] * step;
+            poses[i].Translate(0.01f * ((i & 1) ? 1 : -1), 0, 0);
+            world.SetModelMatrix(i, poses[i]);
+        }
+        world.Update();
+        const CollisionWorld::Stats& stats = world.stats();
+        broadphase += stats.broadphase_seconds;
+        narrowphase += stats.narrowphase_seconds;
+        pairs += stats.candidate_pairs;
+        contacts += stats.contacts;
+    }
+    printf("%6u shapes: %8.1f pairs %7.1f contacts per frame, broadphase "
+           "%7.3f ms, narrowphase %8.3f ms, %6.2f M pairs/s\n",
+           count, (double)pairs / frames, (double)contacts / frames,
+           broadphase * 1000.0 / frames, narrowphase * 1000.0 / frames,
+           pairs / (broadphase + narrowphase) / 1e6);
+}
+
+int main() {
+    printf("%u worker threads\n", JobSystem::Instance().WorkerCount());
+    CheckAgainstBoxes(100000);
+    MeasureWorld(1000, 50);
+    MeasureWorld(4000, 30);
+    MeasureWorld(16000, 20);
+    MeasureWorld(64000, 10);
+    return 0;
+}
@@ -0,0 +1,204 @@
+// Per-frame arena allocation against the general heap: scattered small
+// allocations, containers growing through a frame, the same from job system
+// workers through their thread-local arenas, and what poisoning costs. Ends
+// with the collision world's scratch, which should stop taking heap blocks
+// once it has seen a frame or two.
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "collision.h"
+#include "framearena.h"
+#include "jobsystem.h"
+#include "kdron.h"
+
+const int kFrames = 200;
+const unsigned int kAllocationsPerFrame = 20000;
+
+static std::vector<unsigned int> RandomSizes() {
+    std::mt19937 random(3);
+    std::uniform_int_distribution<unsigned int> size(8, 512);
+    std::vector<unsigned int> sizes(kAllocationsPerFrame);
+    for (unsigned int& s : sizes)
+        s = size(random);
+    return sizes;
+}
+
+static void MeasureScattered(const std::vector<unsigned int>& sizes) {
+    std::vector<char*> blocks(sizes.size());
+    Stopwatch watch;
+    for (int frame = 0; frame < kFrames; frame++) {
+        for (size_t i = 0; i < sizes.size(); i++) {
+            blocks[i] = new char[sizes[i]];
+            blocks[i][0] = (char)i;
+        }
+        DoNotOptimize(blocks[frame % sizes.size()][0]);
+        for (char* block : blocks)
+            delete[] block;
+    }
+    ReportRate("new/delete", (double)kFrames * sizes.size(),
+               watch.ElapsedSeconds(), "allocations");
+
+    FrameArena arena(2);
+    arena.set_poison(false);
+    watch.Restart();
+    for (int frame = 0; frame < kFrames; frame++) {
+        for (size_t i = 0; i < sizes.size(); i++) {
+            blocks[i] = arena.Allocate<char>(sizes[i]);
+            blocks[i][0] = (char)i;
+        }
+        DoNotOptimize(blocks[frame % sizes.size()][0]);
+        if (frame == kFrames - 1)
+            arena.LogStats("  arena");
+        arena.NextFrame();
+    }
+    ReportRate("FrameArena", (double)kFrames * sizes.size(),
+               watch.ElapsedSeconds(), "allocations");
+}
+
+// A few hundred lists of a few hundred entries, built without reserve()
+template <typename Vector, typename MakeVector>
+static double BuildLists(MakeVector make_vector) {
+    Stopwatch watch;
+    for (int frame = 0; frame < kFrames; frame++) {
+        std::vector<Vector> lists;
+        lists.reserve(256);
+        for (unsigned int l = 0; l < 256; l++) {
+            lists.push_back(make_vector());
+            for (unsigned int i = 0; i < 64 + l; i++)
+                lists.back().push_back(i * l);
+        }
+        DoNotOptimize(lists[frame % 256].back());
+        make_vector.NextFrame();
+    }
+    return watch.ElapsedSeconds();
+}
+
+struct HeapVectors {
+    std::vector<unsigned int> operator()() const {
+        return std::vector<unsigned int>();
+    }
+    void NextFrame() {}
+};
+
+struct ArenaVectors {
+    FrameArena* arena;
+    FrameVector<unsigned int> operator()() const {
+        return FrameVector<unsigned int>(FrameAllocator<unsigned int>(arena));
+    }
+    void NextFrame() { arena->NextFrame(); }
+};
+
+static void MeasureContainers() {
+    double items = (double)kFrames * (256 * 64 + 255 * 256 / 2);
+    ReportRate("std::vector", items,
+               BuildLists<std::vector<unsigned int>>(HeapVectors()),
+               "push_backs");
+    FrameArena arena(2);
+    arena.set_poison(false);
+    ReportRate("FrameVector", items,
+               BuildLists<FrameVector<unsigned int>>(ArenaVectors{&arena}),
+               "push_backs");
+}
+
+static void MeasureWorkers(const std::vector<unsigned int>& sizes) {
+    JobSystem& jobs = JobSystem::Instance();
+    const unsigned int kGrain = 500;
+    Stopwatch watch;
+    for (int frame = 0; frame < kFrames; frame++)
+        jobs.ParallelFor(sizes.size(), kGrain,
+                         [&](unsigned int begin, unsigned int end) {
+                             std::vector<char*> blocks;
+                             blocks.reserve(kGrain);
+                             for (unsigned int i = begin; i < end; i++) {
+                                 blocks.push_back(new char[sizes[i]]);
+                                 blocks.back()[0] = (char)i;
+                             }
+                             for (char* block : blocks)
+                                 delete[] block;
+                         });
+    ReportRate("new/delete, workers", (double)kFrames * sizes.size(),
+               watch.ElapsedSeconds(), "allocations");
+
+    ThreadFrameArenas arenas(2);
+    arenas.set_poison(false);
+    watch.Restart();
+    for (int frame = 0; frame < kFrames; frame++) {
+        jobs.ParallelFor(sizes.size(), kGrain,
+                         [&](unsigned int begin, unsigned int end) {
+                             FrameArena& arena = arenas.Local();
+                             for (unsigned int i = begin; i < end; i++)
+                                 arena.Allocate<char>(sizes[i])[0] = (char)i;
+                         });
+        if (frame == kFrames - 1)
+            arenas.LogStats("  arenas");
+        arenas.NextFrame();
+    }
+    ReportRate("ThreadFrameArenas, workers", (double)kFrames * sizes.size(),
+               watch.ElapsedSeconds(), "allocations");
+}
+
+static void MeasurePoisoning(const std::vector<unsigned int>& sizes) {
+    FrameArena arena(2);
+    arena.set_poison(true);
+    float* stale = arena.Allocate<float>(16);
+    stale[0] = 1;
+    arena.NextFrame();
+    arena.NextFrame(); // back on the first frame, which is now released
+    printf("Stale read after release: %g (%s)\n", stale[0],
+           std::isnan(stale[0]) ? "poisoned" : "NOT poisoned");
+
+    size_t bytes = 0;
+    Stopwatch watch;
+    for (int frame = 0; frame < kFrames; frame++) {
+        for (unsigned int size : sizes)
+            arena.Allocate<char>(size)[0] = 1;
+        bytes += arena.stats().bytes;
+        arena.NextFrame();
+    }
+    ReportRate("FrameArena, poisoning", (double)kFrames * sizes.size(),
+               watch.ElapsedSeconds(), "allocations");
+    printf("  %.1f MB poisoned per frame\n", bytes / 1e6 / kFrames);
+}
+
+static void MeasureCollisionScratch() {
+    ConvexShape kdron(KDron::kVertices, KDron::kVertexCount);
+    CollisionWorld world;
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> unit(0, 1);
+    const unsigned int kBodies = 16000;
+    float extent = std::cbrt(1.5f * kBodies);
+    std::vector<Mat4> poses(kBodies);
+    for (Mat4& pose : poses) {
+        pose.RotateAboutX(360 * unit(random));
+        pose.RotateAboutY(360 * unit(random));
+        pose.Translate(extent * unit(random), extent * unit(random),
+                       extent * unit(random));
+        world.AddBody(&kdron, pose);
+    }
+    for (int frame = 0; frame < 20; frame++) {
+        for (unsigned int i = 0; i < kBodies; i++) {
+            poses[i].Translate(0.02f * ((i & 1) ? 1 : -1), 0, 0);
+            world.SetModelMatrix(i, poses[i]);
+        }
+        world.Update();
+        if (frame == 1 || frame == 19) {
+            printf("Collision world, frame %d: %u contacts\n", frame,
+                   world.stats().contacts);
+            world.scratch().LogStats("  scratch");
+        }
+    }
+}
+
+int main() {
+    printf("%u worker threads\n", JobSystem::Instance().WorkerCount());
+    std::vector<unsigned int> sizes = RandomSizes();
+    MeasureScattered(sizes);
+    MeasureContainers();
+    MeasureWorkers(sizes);
+    MeasurePoisoning(sizes);
+    MeasureCollisionScratch();
+    return 0;
+}
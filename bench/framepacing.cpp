@@ -0,0 +1,220 @@
+// Frame pacing: how close FramePacer starts frames to their time against a
+// plain sleep to the same deadline, and key press to present latency with
+// events polled before and after the wait for the frame.
+//
+// Presses come from a thread of their own at random times, stamped when they
+// are made, so the time they sit in the queue counts; the window's own
+// measurements only start at the poll. Each frame spends kWorkSeconds on
+// the CPU and clears a hidden window, so like the other GL benchmarks this
+// one needs a GL 4.1 context.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "bench.h"
+#include "framepacer.h"
+
+static const double kWorkSeconds = 3e-3; // simulation and recording
+static const double kMeasureSeconds = 3;
+static const double kMeanPressGap = 0.02;
+
+static void Work() {
+    double end = glfwGetTime() + kWorkSeconds;
+    while (glfwGetTime() < end)
+        ;
+}
+
+static double ThreadCpuSeconds() {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Start error of a sleep straight to each deadline, the way a frame limiter
+// without the spin would wait
+static void MeasureSleep(double rate, int frames) {
+    double period = 1.0 / rate;
+    double next = glfwGetTime();
+    double total_error = 0, max_error = 0;
+    for (int i = 0; i < frames; i++) {
+        double now = glfwGetTime();
+        if (next > now)
+            std::this_thread::sleep_for(
+                std::chrono::duration<double>(next - now));
+        double error = glfwGetTime() - next;
+        total_error += error;
+        max_error = std::max(max_error, error);
+        Work();
+        next += period;
+    }
+    printf("%6.0f fps  %-8s %10.3f ms %10.3f ms %12s\n", rate, "sleep",
+           total_error * 1000.0 / frames, max_error * 1000.0, "-");
+}
+
+static void MeasurePacer(double rate, int frames) {
+    FramePacer pacer;
+    pacer.SetTargetRate(rate);
+    double total_error = 0;
+    double next = 0;
+    for (int i = 0; i < frames; i++) {
+        pacer.WaitForFrame();
+        // The first frame sets the schedule
+        double now = glfwGetTime();
+        if (i == 0)
+            next = now;
+        total_error += now - next;
+        next += 1.0 / rate;
+        Work();
+    }
+    FramePacer::Stats stats = pacer.TakeStats();
+    printf("%6.0f fps  %-8s %10.3f ms %10.3f ms %9.3f ms\n", rate, "hybrid",
+           total_error * 1000.0 / frames, stats.max_start_error * 1000.0,
+           stats.spin_seconds * 1000.0 / frames);
+}
+
+// Stands in for the OS event queue
+class PressQueue {
+  public:
+    void Start() {
+        stopping_ = false;
+        thread_ = std::thread([this] {
+            std::mt19937 random(7);
+            std::exponential_distribution<double> gap(1.0 / kMeanPressGap);
+            while (!stopping_) {
+                std::this_thread::sleep_for(
+                    std::chrono::duration<double>(gap(random)));
+                std::lock_guard<std::mutex> lock(mutex_);
+                presses_.push_back(glfwGetTime());
+            }
+        });
+    }
+    void Stop() {
+        stopping_ = true;
+        thread_.join();
+        presses_.clear();
+    }
+    void Poll(FramePacer* pacer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (double time : presses_)
+            pacer->InputArrived(time);
+        presses_.clear();
+    }
+
+  private:
+    std::thread thread_;
+    std::atomic<bool> stopping_;
+    std::mutex mutex_;
+    std::deque<double> presses_;
+};
+
+static double Percentile(const std::vector<double>& sorted, double percent) {
+    size_t rank = (size_t)(percent / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1] *
+           1000.0;
+}
+
+static void MeasureLatency(GLFWwindow* window, double rate, bool late) {
+    FramePacer pacer;
+    pacer.SetSwapInterval(0);
+    pacer.SetTargetRate(rate);
+    if (pacer.late_polling() != late)
+        pacer.ToggleLatePolling();
+    PressQueue queue;
+    queue.Start();
+    double cpu_start = ThreadCpuSeconds();
+    double end = glfwGetTime() + kMeasureSeconds;
+    while (glfwGetTime() < end) {
+        if (!pacer.late_polling())
+            queue.Poll(&pacer);
+        pacer.WaitForFrame();
+        if (pacer.late_polling())
+            queue.Poll(&pacer);
+        Work();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        pacer.FrameRecorded();
+        glfwSwapBuffers(window);
+        FramePacer::FramePresented(&pacer);
+    }
+    // Lets the last measurements land
+    glFinish();
+    FramePacer::FramePresented(&pacer);
+    double cpu_seconds = ThreadCpuSeconds() - cpu_start;
+    queue.Stop();
+
+    FramePacer::Stats stats = pacer.TakeStats();
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    char name[32];
+    if (rate > 0)
+        snprintf(name, sizeof(name), "%.0f fps", rate);
+    else
+        snprintf(name, sizeof(name), "no limit");
+    if (stats.latencies.empty()) {
+        printf("%-9s %-7s no presses measured\n", name,
+               late ? "late" : "early");
+        return;
+    }
+    printf("%-9s %-7s %7u %7zu %8.2f ms %8.2f ms %8.2f ms %8.2f ms "
+           "%8.2f ms\n",
+           name, late ? "late" : "early", stats.frames,
+           stats.latencies.size(), Percentile(stats.latencies, 50),
+           Percentile(stats.latencies, 90), Percentile(stats.latencies, 99),
+           stats.latencies.back() * 1000.0,
+           cpu_seconds * 1000.0 / stats.frames);
+}
+
+int main() {
+    if (!glfwInit()) {
+        fprintf(stderr, "Could not initialize GLFW\n");
+        return EXIT_FAILURE;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window =
+        glfwCreateWindow(320, 240, "framepacing", nullptr, nullptr);
+    if (!window) {
+        fprintf(stderr, "Could not create a GL 4.1 context\n");
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        fprintf(stderr, "Could not initialize GLEW\n");
+        return EXIT_FAILURE;
+    }
+    printf("%s\n", (const char*)glGetString(GL_RENDERER));
+
+    printf("Frame start error, %.1f ms of work a frame\n",
+           kWorkSeconds * 1000.0);
+    printf("%-10s %-8s %13s %13s %12s\n", "rate", "wait", "mean error",
+           "max error", "spin/frame");
+    for (double rate : {60.0, 144.0, 240.0}) {
+        int frames = (int)(rate * 2);
+        MeasureSleep(rate, frames);
+        MeasurePacer(rate, frames);
+    }
+
+    printf("\nKey press to present, a press every %.0f ms on average\n",
+           kMeanPressGap * 1000.0);
+    printf("%-9s %-7s %7s %6s %11s %11s %11s %11s %11s\n", "rate", "poll",
+           "frames", "presses", "median", "90%", "99%", "max", "cpu/frame");
+    MeasureLatency(window, 0, true);
+    for (double rate : {60.0, 30.0})
+        for (bool late : {false, true})
+            MeasureLatency(window, rate, late);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
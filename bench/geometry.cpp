@@ -0,0 +1,170 @@
+// Bounding volumes on million-vertex buffers: the parallel box against the
+// serial one, both spheres on every vertex and on the hull's, the PCA box,
+// and the hull itself with its size and how far any vertex sticks out of it.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "geometry.h"
+#include "jobsystem.h"
+#include "meshgenerator.h"
+
+// Faces checked against every vertex; all of them would take minutes
+static const unsigned int kCheckedFaces = 200;
+
+static double SphereOverhang(const BoundingSphere& sphere,
+                             const std::vector<ColorVertex>& vertices) {
+    double worst = 0;
+    for (const ColorVertex& vertex : vertices) {
+        double d = 0;
+        for (int k = 0; k < 3; k++)
+            d += (vertex.position[k] - sphere.center[k]) *
+                 (vertex.position[k] - sphere.center[k]);
+        worst = std::max(worst, std::sqrt(d) - sphere.radius);
+    }
+    return worst;
+}
+
+static double ObbOverhang(const Obb& obb,
+                          const std::vector<ColorVertex>& vertices) {
+    double worst = 0;
+    for (const ColorVertex& vertex : vertices)
+        for (int a = 0; a < 3; a++) {
+            double t = 0;
+            for (int k = 0; k < 3; k++)
+                t += (vertex.position[k] - obb.center[k]) * obb.axes[a][k];
+            worst = std::max(worst, std::fabs(t) - obb.half_extents[a]);
+        }
+    return worst;
+}
+
+// Furthest any vertex is outside an evenly spread sample of hull faces
+static double HullOverhang(const ConvexHull& hull,
+                           const std::vector<ColorVertex>& vertices) {
+    double worst = 0;
+    size_t step = std::max<size_t>(1, hull.triangles.size() / kCheckedFaces);
+    for (size_t i = 0; i < hull.triangles.size(); i += step) {
+        const unsigned int* t = hull.triangles[i].indices;
+        const float* a = vertices[t[0]].position;
+        const float* b = vertices[t[1]].position;
+        const float* c = vertices[t[2]].position;
+        double u[3], v[3];
+        for (int k = 0; k < 3; k++) {
+            u[k] = b[k] - a[k];
+            v[k] = c[k] - a[k];
+        }
+        double n[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                       u[0] * v[1] - u[1] * v[0]};
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0)
+            continue;
+        for (const ColorVertex& vertex : vertices) {
+            double d = 0;
+            for (int k = 0; k < 3; k++)
+                d += n[k] * (vertex.position[k] - a[k]);
+            worst = std::max(worst, d / length);
+        }
+    }
+    return worst;
+}
+
+static void Measure(const char* name,
+                    const std::vector<ColorVertex>& vertices) {
+    unsigned int count = vertices.size();
+    printf("%s: %u vertices\n", name, count);
+
+    Stopwatch watch;
+    Aabb serial = ComputeAabb(vertices.data(), count);
+    ReportRate("  AABB serial", count, watch.ElapsedSeconds(), "vertices");
+    watch.Restart();
+    Aabb box = ComputeAabbParallel(vertices.data(), count);
+    ReportRate("  AABB parallel", count, watch.ElapsedSeconds(), "vertices");
+    DoNotOptimize(serial);
+
+    watch.Restart();
+    BoundingSphere ritter = ComputeRitterSphere(vertices.data(), count);
+    ReportRate("  Ritter sphere", count, watch.ElapsedSeconds(), "vertices");
+    watch.Restart();
+    BoundingSphere welzl = ComputeMinimalSphere(vertices.data(), count);
+    ReportRate("  Welzl sphere, every vertex", count, watch.ElapsedSeconds(),
+               "vertices");
+    watch.Restart();
+    Obb pca = ComputePcaObb(vertices.data(), count);
+    ReportRate("  PCA box, every vertex", count, watch.ElapsedSeconds(),
+               "vertices");
+
+    watch.Restart();
+    ConvexHull hull;
+    bool ok = ComputeConvexHull(vertices.data(), count, &hull);
+    ReportRate("  convex hull", count, watch.ElapsedSeconds(), "vertices");
+    if (!ok) {
+        printf("  no hull, the vertices are flat\n");
+        return;
+    }
+    printf("  %zu hull vertices, %zu triangles, up to %.2g out of them\n",
+           hull.vertices.size(), hull.triangles.size(),
+           HullOverhang(hull, vertices));
+
+    watch.Restart();
+    MeshBounds bounds;
+    ComputeMeshBounds(vertices.data(), count, &bounds);
+    ReportRate("  all bounds, from the hull", count, watch.ElapsedSeconds(),
+               "vertices");
+
+    double box_volume = 1;
+    for (int k = 0; k < 3; k++)
+        box_volume *= box.max[k] - box.min[k];
+    double pca_volume = 8 * pca.half_extents[0] * pca.half_extents[1] *
+                        pca.half_extents[2];
+    double hull_obb_volume = 8 * bounds.obb.half_extents[0] *
+                             bounds.obb.half_extents[1] *
+                             bounds.obb.half_extents[2];
+    printf("  sphere radius: Welzl %.5f, from the hull %.5f, Ritter %.3f%% "
+           "larger\n",
+           welzl.radius, bounds.sphere.radius,
+           (ritter.radius / welzl.radius - 1) * 100);
+    printf("  box volume against the AABB: PCA %.3f, PCA of the hull %.3f\n",
+           pca_volume / box_volume, hull_obb_volume / box_volume);
+    printf("  furthest out: Ritter %.2g, Welzl %.2g, hull sphere %.2g, "
+           "hull box %.2g\n",
+           SphereOverhang(ritter, vertices), SphereOverhang(welzl, vertices),
+           SphereOverhang(bounds.sphere, vertices),
+           ObbOverhang(bounds.obb, vertices));
+}
+
+static std::vector<ColorVertex> Generate(MeshGenerator::Shape shape,
+                                         unsigned int level) {
+    MeshGenerator generator(shape, level);
+    std::vector<ColorVertex> vertices(generator.VertexCount());
+    std::vector<Triangle> triangles(generator.TriangleCount());
+    generator.Generate(vertices.data(), triangles.data());
+    return vertices;
+}
+
+int main() {
+    printf("%u worker threads\n", JobSystem::Instance().WorkerCount());
+
+    // Most of a ball is inside its hull, the easy case for quickhull
+    std::mt19937 random(42);
+    std::normal_distribution<float> normal;
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<ColorVertex> ball(1000000);
+    for (ColorVertex& vertex : ball) {
+        float p[3] = {normal(random), normal(random), normal(random)};
+        float scale = std::cbrt(uniform(random)) /
+                      std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        for (int k = 0; k < 3; k++)
+            vertex.position[k] = p[k] * scale;
+        vertex.position[3] = 1;
+    }
+    Measure("ball", ball);
+
+    Measure("subdivided level 9", Generate(MeshGenerator::Subdivided, 9));
+    Measure("fractal level 5", Generate(MeshGenerator::Fractal, 5));
+    // Nearly every vertex of a convex surface is on the hull
+    Measure("parametric level 7", Generate(MeshGenerator::Parametric, 7));
+    return 0;
+}
@@ -0,0 +1,84 @@
+// Level of detail chains: simplification time and error per level on
+// million-triangle meshes, then a camera flying out and back with a jittery
+// zoom, counting triangles submitted and level switches.
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "meshgenerator.h"
+#include "meshsimplifier.h"
+
+// Coarsest level within the budget, with no memory of the previous frame
+static unsigned int LevelWithoutHysteresis(const LodChain& chain,
+                                           float pixels_per_unit,
+                                           float max_error_pixels) {
+    unsigned int level = 0;
+    while (level + 1 < chain.levels.size() &&
+           chain.levels[level + 1].error * pixels_per_unit <=
+               max_error_pixels)
+        level++;
+    return level;
+}
+
+static void Measure(MeshGenerator::Shape shape, unsigned int level) {
+    MeshGenerator generator(shape, level);
+    std::vector<ColorVertex> vertices(generator.VertexCount());
+    std::vector<Triangle> triangles(generator.TriangleCount());
+    generator.Generate(vertices.data(), triangles.data());
+    printf("%s level %u: %u vertices, %u triangles\n",
+           MeshGenerator::ShapeName(shape), generator.level(),
+           generator.VertexCount(), generator.TriangleCount());
+
+    LodChain chain;
+    Stopwatch watch;
+    BuildLodChain(vertices.data(), vertices.size(), triangles.data(),
+                  triangles.size(), &chain);
+    ReportRate("  LOD chain", triangles.size(), watch.ElapsedSeconds(),
+               "triangles");
+    for (unsigned int i = 0; i < chain.levels.size(); i++)
+        printf("  level %u: %8u triangles, error %.5f\n", i,
+               chain.levels[i].triangle_count, chain.levels[i].error);
+
+    const int kFrames = 1200;
+    const float kMaxErrorPixels = 0.33f; // as ProceduralModel uses
+    Mat4 projection =
+        Mat4::CreatePerspectiveProjectionMatrix(60, 800.0f / 600, 0.1f, 100);
+    unsigned long long with_lod = 0, without_lod = 0;
+    unsigned int current = 0, previous_raw = 0;
+    unsigned int switches = 0, raw_switches = 0;
+    for (int frame = 0; frame < kFrames; frame++) {
+        // Out from 1.5 to 40 units and back, wobbling by 3% every frame
+        float phase = (float)frame / kFrames;
+        float travel = phase < 0.5f ? 2 * phase : 2 - 2 * phase;
+        float distance = 1.5f * std::pow(40 / 1.5f, travel) *
+                         (1 + 0.03f * (frame % 2 ? 1 : -1));
+        Mat4 view;
+        view.Translate(0, 0, -distance);
+        float pixels_per_unit = PixelsPerUnit(chain, view, projection, 600);
+
+        unsigned int level =
+            SelectLod(chain, pixels_per_unit, kMaxErrorPixels, current);
+        switches += level != current;
+        current = level;
+        unsigned int raw =
+            LevelWithoutHysteresis(chain, pixels_per_unit, kMaxErrorPixels);
+        raw_switches += raw != previous_raw;
+        previous_raw = raw;
+
+        with_lod += chain.levels[level].triangle_count;
+        without_lod += chain.levels[0].triangle_count;
+    }
+    printf("  fly-out: %.0f triangles per frame with LOD, %.0f without "
+           "(%.1f%%)\n",
+           (double)with_lod / kFrames, (double)without_lod / kFrames,
+           100.0 * with_lod / without_lod);
+    printf("  level switches: %u with hysteresis, %u without\n", switches,
+           raw_switches);
+}
+
+int main() {
+    Measure(MeshGenerator::Subdivided, 8);
+    Measure(MeshGenerator::Parametric, 7);
+    return 0;
+}
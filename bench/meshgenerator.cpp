@@ -0,0 +1,51 @@
+// Procedural mesh generation: one thread vs. the job system, per shape.
+#include <cstdio>
+
+#include "bench.h"
+#include "jobsystem.h"
+#include "meshgenerator.h"
+
+static void Measure(MeshGenerator::Shape shape, unsigned int level) {
+    MeshGenerator generator(shape, level);
+    ColorVertex* vertices = new ColorVertex[generator.VertexCount()];
+    Triangle* triangles = new Triangle[generator.TriangleCount()];
+    printf("%s level %u: %u vertices, %u triangles, %u chunks\n",
+           MeshGenerator::ShapeName(shape), generator.level(),
+           generator.VertexCount(), generator.TriangleCount(),
+           generator.ChunkCount());
+
+    // Fault the pages in first so neither run pays for first touch
+    generator.Generate(vertices, triangles);
+
+    Stopwatch watch;
+    for (unsigned int i = 0; i < generator.ChunkCount(); i++)
+        generator.GenerateChunk(i, vertices, triangles);
+    double serial = watch.ElapsedSeconds();
+    ReportRate("  one thread", generator.TriangleCount(), serial, "triangles");
+
+    watch.Restart();
+    generator.Generate(vertices, triangles);
+    double parallel = watch.ElapsedSeconds();
+    ReportRate("  job system", generator.TriangleCount(), parallel,
+               "triangles");
+    printf("  speedup %.2fx on %u workers + caller\n", serial / parallel,
+           JobSystem::Instance().WorkerCount());
+
+    unsigned int out_of_range = 0;
+    for (unsigned int i = 0; i < generator.TriangleCount(); i++)
+        for (int k = 0; k < 3; k++)
+            if (triangles[i].indices[k] >= generator.VertexCount())
+                out_of_range++;
+    if (out_of_range)
+        printf("  ERROR: %u indices out of range\n", out_of_range);
+
+    delete[] vertices;
+    delete[] triangles;
+}
+
+int main() {
+    Measure(MeshGenerator::Subdivided, 10);
+    Measure(MeshGenerator::Fractal, 5);
+    Measure(MeshGenerator::Parametric, 9);
+    return 0;
+}
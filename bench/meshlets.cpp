@@ -0,0 +1,80 @@
+// Meshlets: how long splitting a generated mesh takes and how full the
+// meshlets come out, then how much of it per-meshlet culling drops each
+// frame while the model spins in front of the app's camera, from its
+// default distance and from close enough that part of it is off screen.
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "meshgenerator.h"
+#include "meshlets.h"
+
+static const unsigned int kFrames = 360;
+
+static void MeasureCulling(const std::vector<Meshlet>& meshlets,
+                           float distance) {
+    Mat4 projection =
+        Mat4::CreatePerspectiveProjectionMatrix(60, 4.0f / 3.0f, 0.1f, 100.0f);
+    Mat4 view;
+    view.Translate(0, 0, -distance);
+    Mat4 view_projection = projection * view;
+
+    MeshletDrawList draws;
+    MeshletCullStats stats = {};
+    double seconds = 0;
+    for (unsigned int frame = 0; frame < kFrames; frame++) {
+        Mat4 model;
+        model.RotateAboutX((float)frame);
+        model.RotateAboutY((float)frame * 2);
+        draws.Clear();
+        Stopwatch watch;
+        CullMeshlets(meshlets.data(), meshlets.size(), model,
+                     &view_projection, 1, &draws, &stats);
+        seconds += watch.ElapsedSeconds();
+    }
+    unsigned long long culled = stats.frustum_culled + stats.backface_culled;
+    printf("  camera at %.1f: %5.1f%% of the triangles culled "
+           "(%4.1f%% outside, %4.1f%% facing away), %6llu ranges, "
+           "%7.1f us a frame\n",
+           distance, culled * 100.0 / stats.triangles,
+           stats.frustum_culled * 100.0 / stats.triangles,
+           stats.backface_culled * 100.0 / stats.triangles,
+           stats.draws / kFrames, seconds * 1e6 / kFrames);
+}
+
+static void Measure(MeshGenerator::Shape shape, unsigned int level) {
+    MeshGenerator generator(shape, level);
+    std::vector<ColorVertex> vertices(generator.VertexCount());
+    std::vector<Triangle> triangles(generator.TriangleCount());
+    generator.Generate(vertices.data(), triangles.data());
+    printf("%s level %u: %u triangles\n", MeshGenerator::ShapeName(shape),
+           generator.level(), generator.TriangleCount());
+
+    std::vector<Meshlet> meshlets;
+    Stopwatch watch;
+    BuildMeshlets(vertices.data(), triangles.data(), 0, triangles.size(),
+                  &meshlets);
+    ReportRate("  build", triangles.size(), watch.ElapsedSeconds(),
+               "triangles");
+    unsigned long long vertex_total = 0;
+    unsigned int narrow = 0;
+    for (const Meshlet& meshlet : meshlets) {
+        vertex_total += meshlet.vertex_count;
+        narrow += meshlet.cone_cutoff < 1;
+    }
+    printf("  %zu meshlets, %.1f of %u vertices and %.1f of %u triangles on "
+           "average, %.1f%% can face away\n",
+           meshlets.size(), (double)vertex_total / meshlets.size(),
+           kMeshletMaxVertices, (double)triangles.size() / meshlets.size(),
+           kMeshletMaxTriangles, narrow * 100.0 / meshlets.size());
+
+    MeasureCulling(meshlets, 2.0f);
+    MeasureCulling(meshlets, 1.0f);
+}
+
+int main() {
+    Measure(MeshGenerator::Subdivided, 8);
+    Measure(MeshGenerator::Fractal, 5);
+    Measure(MeshGenerator::Parametric, 7);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Mip chain generation: SSE2 box filter against a plain reference, Kaiser
+// filter throughput, and a full decode + mipmap of a PPM file.
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "image.h"
+
+static std::vector<unsigned char> MakeImage(unsigned int width,
+                                            unsigned int height) {
+    std::vector<unsigned char> pixels((size_t)width * height * 4);
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < pixels.size(); i++) {
+        seed = seed * 1664525 + 1013904223;
+        pixels[i] = seed >> 24;
+    }
+    return pixels;
+}
+
+static unsigned int CheckBoxAgainstReference(unsigned int width,
+                                             unsigned int height) {
+    std::vector<unsigned char> src = MakeImage(width, height);
+    unsigned int dst_width = width > 1 ? width / 2 : 1;
+    unsigned int dst_height = height > 1 ? height / 2 : 1;
+    std::vector<unsigned char> dst((size_t)dst_width * dst_height * 4);
+    DownsampleBox(src.data(), width, height, dst.data());
+
+    unsigned int mismatches = 0;
+    for (unsigned int y = 0; y < dst_height; y++) {
+        unsigned int y0 = 2 * y, y1 = 2 * y + 1 < height ? 2 * y + 1 : y0;
+        for (unsigned int x = 0; x < dst_width; x++) {
+            unsigned int x0 = 2 * x, x1 = 2 * x + 1 < width ? 2 * x + 1 : x0;
+            for (int k = 0; k < 4; k++) {
+                unsigned int sum = src[(y0 * width + x0) * 4 + k] +
+                                   src[(y0 * width + x1) * 4 + k] +
+                                   src[(y1 * width + x0) * 4 + k] +
+                                   src[(y1 * width + x1) * 4 + k];
+                if (dst[(y * dst_width + x) * 4 + k] != (sum + 2) / 4)
+                    mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void MeasureFilter(const char* name, MipFilter filter,
+                          unsigned int size) {
+    std::vector<unsigned char> level = MakeImage(size, size);
+    std::vector<unsigned char> next(level.size() / 4 + 4);
+    double pixels = 0;
+    Stopwatch stopwatch;
+    for (unsigned int w = size; w > 1; w /= 2) {
+        if (filter == KaiserMipFilter)
+            DownsampleKaiser(level.data(), w, w, next.data());
+        else
+            DownsampleBox(level.data(), w, w, next.data());
+        pixels += (double)w * w;
+        level.swap(next);
+    }
+    ReportRate(name, pixels, stopwatch.ElapsedSeconds(), "source pixels");
+    DoNotOptimize(level[0]);
+}
+
+static void MeasureDecode(unsigned int size, MipFilter filter) {
+    const char* file = "bench/build/mipmaps.ppm";
+    std::vector<unsigned char> pixels = MakeImage(size, size);
+    FILE* out = fopen(file, "wb");
+    if (!out) {
+        printf("Could not write %s\n", file);
+        return;
+    }
+    fprintf(out, "P6\n# bench\n%u %u\n255\n", size, size);
+    for (size_t i = 0; i < pixels.size(); i += 4)
+        fwrite(&pixels[i], 1, 3, out);
+    fclose(out);
+
+    MipChain chain;
+    const char* error;
+    Stopwatch stopwatch;
+    if (!LoadMipChain(file, filter, &chain, &error)) {
+        printf("LoadMipChain failed: %s\n", error);
+        return;
+    }
+    printf("Decoded and mipmapped %ux%u PPM (%zu levels, %s) in %.3f ms\n",
+           size, size, chain.levels.size(),
+           filter == BoxMipFilter ? "box" : "Kaiser",
+           stopwatch.ElapsedMilliseconds());
+}
+
+int main() {
+    unsigned int mismatches = 0;
+    const unsigned int sizes[][2] = {{1, 1},   {1, 7},   {2, 2},
+                                     {7, 5},   {9, 16},  {17, 3},
+                                     {64, 64}, {333, 211}};
+    for (const auto& size : sizes)
+        mismatches += CheckBoxAgainstReference(size[0], size[1]);
+    printf("Box filter mismatches against the reference: %u\n", mismatches);
+
+    MeasureFilter("Box mip chain 4096^2", BoxMipFilter, 4096);
+    MeasureFilter("Kaiser mip chain 4096^2", KaiserMipFilter, 4096);
+    MeasureDecode(2048, BoxMipFilter);
+    MeasureDecode(2048, KaiserMipFilter);
+    return 0;
+}
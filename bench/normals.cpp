@@ -0,0 +1,53 @@
+// Normal and tangent generation on multi-million triangle meshes.
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "meshgenerator.h"
+#include "meshprocessing.h"
+
+static void Measure(MeshGenerator::Shape shape, unsigned int level) {
+    MeshGenerator generator(shape, level);
+    std::vector<ColorVertex> vertices(generator.VertexCount());
+    std::vector<Triangle> triangles(generator.TriangleCount());
+    generator.Generate(vertices.data(), triangles.data());
+    printf("%s level %u: %u vertices, %u triangles\n",
+           MeshGenerator::ShapeName(shape), generator.level(),
+           generator.VertexCount(), generator.TriangleCount());
+
+    std::vector<float> face_normals(3 * triangles.size());
+    Stopwatch watch;
+    ComputeFaceNormals(vertices.data(), triangles.data(), triangles.size(),
+                       face_normals.data());
+    ReportRate("  face normals", triangles.size(), watch.ElapsedSeconds(),
+               "triangles");
+
+    const float kCreases[] = {0, 30, 180};
+    for (float crease : kCreases) {
+        ShadedMesh mesh;
+        watch.Restart();
+        BuildShadedMesh(vertices.data(), vertices.size(), triangles.data(),
+                        triangles.size(), crease, nullptr, &mesh);
+        double seconds = watch.ElapsedSeconds();
+        char name[64];
+        snprintf(name, sizeof(name), "  shaded mesh, %3.0f degree crease",
+                 crease);
+        ReportRate(name, triangles.size(), seconds, "triangles");
+
+        unsigned int bad_normals = 0;
+        for (const NormalTextureVertex& vertex : mesh.vertices) {
+            const float* n = vertex.normal;
+            if (fabsf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] - 1) > 1e-4f)
+                bad_normals++;
+        }
+        printf("    %zu output vertices, %u non-unit normals\n",
+               mesh.vertices.size(), bad_normals);
+    }
+}
+
+int main() {
+    Measure(MeshGenerator::Subdivided, 9);
+    Measure(MeshGenerator::Parametric, 8);
+    return 0;
+}
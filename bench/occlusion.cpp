@@ -0,0 +1,42 @@
+// Occlusion culling of a dense K-dron crowd: cull rate and CPU cost per frame
+// for a few crowd sizes, seen through the default camera.
+#include <cstdio>
+
+#include "bench.h"
+#include "crowd.h"
+
+static void MeasureCrowd(unsigned int columns, unsigned int rows,
+                         unsigned int layers, int frames) {
+    Crowd crowd;
+    crowd.Layout(columns, rows, layers);
+    Mat4 view;
+    view.Translate(0, 0, -2);
+    Mat4 projection =
+        Mat4::CreatePerspectiveProjectionMatrix(60, 800.0f / 600, 0.1f, 100);
+
+    double cull_seconds = 0, raster_seconds = 0;
+    unsigned long long drawn = 0, frustum = 0, occluded = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        crowd.Update(1.0f / 60);
+        crowd.Cull(view, projection);
+        const OcclusionCuller::Stats& stats = crowd.culler().stats();
+        cull_seconds += crowd.cull_seconds();
+        raster_seconds += stats.raster_seconds;
+        drawn += crowd.draw_list().size();
+        frustum += stats.frustum_culled;
+        occluded += stats.occlusion_culled;
+    }
+    double total = (double)crowd.InstanceCount() * frames;
+    printf("%6u K-drons: draw %5.1f%%, frustum culled %5.1f%%, occluded "
+           "%5.1f%%, %.3f ms/frame (%.3f ms rasterizing)\n",
+           crowd.InstanceCount(), 100.0 * drawn / total,
+           100.0 * frustum / total, 100.0 * occluded / total,
+           cull_seconds * 1000.0 / frames, raster_seconds * 1000.0 / frames);
+}
+
+int main() {
+    MeasureCrowd(16, 12, 8, 100);
+    MeasureCrowd(24, 18, 24, 100);
+    MeasureCrowd(32, 24, 48, 50);
+    return 0;
+}
@@ -0,0 +1,180 @@
+// BVH ray picking: build time and query cost on multi-million triangle
+// meshes, checked against brute force, and the per-click cost of the
+// top-level hierarchy over a K-dron crowd.
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "bvh.h"
+#include "crowd.h"
+#include "kdron.h"
+#include "meshgenerator.h"
+
+// Rays start on a sphere around the mesh and aim at a point near the middle
+static std::vector<Ray> RandomRays(unsigned int count) {
+    std::mt19937 random(1234);
+    std::normal_distribution<float> normal;
+    std::uniform_real_distribution<float> target(-0.5f, 0.5f);
+    std::vector<Ray> rays(count);
+    for (Ray& ray : rays) {
+        float direction[3] = {normal(random), normal(random), normal(random)};
+        float length = std::sqrt(direction[0] * direction[0] +
+                                 direction[1] * direction[1] +
+                                 direction[2] * direction[2]);
+        for (int k = 0; k < 3; k++) {
+            ray.origin[k] = 3.0f * direction[k] / length;
+            ray.direction[k] = target(random) - ray.origin[k];
+        }
+    }
+    return rays;
+}
+
+static bool BruteForce(const Ray& ray, const ColorVertex* vertices,
+                       const Triangle* triangles, unsigned int count,
+                       RayHit* hit) {
+    bool found = false;
+    for (unsigned int i = 0; i < count; i++) {
+        const float* p0 = vertices[triangles[i].indices[0]].position;
+        const float* p1 = vertices[triangles[i].indices[1]].position;
+        const float* p2 = vertices[triangles[i].indices[2]].position;
+        float e1[3], e2[3], s[3];
+        for (int k = 0; k < 3; k++) {
+            e1[k] = p1[k] - p0[k];
+            e2[k] = p2[k] - p0[k];
+            s[k] = ray.origin[k] - p0[k];
+        }
+        const float* d = ray.direction;
+        float p[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2],
+                      d[0] * e2[1] - d[1] * e2[0]};
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (std::fabs(det) < 1e-12f)
+            continue;
+        float inv_det = 1.0f / det;
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+        float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2],
+                      s[0] * e1[1] - s[1] * e1[0]};
+        float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv_det;
+        float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+        if (u < 0 || v < 0 || u + v > 1 || t < 0 || t >= hit->distance)
+            continue;
+        hit->distance = t;
+        hit->triangle = i;
+        found = true;
+    }
+    return found;
+}
+
+static void MeasureMesh(MeshGenerator::Shape shape, unsigned int level) {
+    MeshGenerator generator(shape, level);
+    std::vector<ColorVertex> vertices(generator.VertexCount());
+    std::vector<Triangle> triangles(generator.TriangleCount());
+    generator.Generate(vertices.data(), triangles.data());
+    printf("%s level %u: %u triangles\n", MeshGenerator::ShapeName(shape),
+           generator.level(), generator.TriangleCount());
+
+    MeshBvh bvh;
+    Stopwatch watch;
+    bvh.Build(vertices.data(), triangles.data(), triangles.size());
+    ReportRate("  build", triangles.size(), watch.ElapsedSeconds(),
+               "triangles");
+    printf("  %u nodes\n", bvh.NodeCount());
+
+    const unsigned int kRays = 100000;
+    std::vector<Ray> rays = RandomRays(kRays);
+    unsigned int hits = 0;
+    watch.Restart();
+    for (const Ray& ray : rays) {
+        RayHit hit;
+        hit.distance = std::numeric_limits<float>::max();
+        hits += bvh.Intersect(ray, &hit);
+    }
+    double seconds = watch.ElapsedSeconds();
+    ReportRate("  BVH queries", kRays, seconds, "rays");
+    printf("  %.3f us/ray, %u hits\n", seconds * 1e6 / kRays, hits);
+
+    // Brute force only gets a small sample, it is slow at this size
+    const unsigned int kSample = 32;
+    unsigned int mismatches = 0;
+    watch.Restart();
+    for (unsigned int i = 0; i < kSample; i++) {
+        RayHit expected, actual;
+        expected.distance = actual.distance =
+            std::numeric_limits<float>::max();
+        bool expected_found =
+            BruteForce(rays[i], vertices.data(), triangles.data(),
+                       triangles.size(), &expected);
+        bool actual_found = bvh.Intersect(rays[i], &actual);
+        if (expected_found != actual_found ||
+            (expected_found &&
+             std::fabs(expected.distance - actual.distance) > 1e-5f))
+            mismatches++;
+    }
+    ReportRate("  brute force", kSample, watch.ElapsedSeconds(), "rays");
+    printf("  %u/%u mismatches against brute force\n", mismatches, kSample);
+}
+
+static void MeasureCrowd(unsigned int columns, unsigned int rows,
+                         unsigned int layers) {
+    Crowd crowd;
+    crowd.Layout(columns, rows, layers);
+    crowd.Update(1.0f / 60);
+    MeshBvh kdron;
+    kdron.Build(KDron::kVertices, KDron::kIndices, KDron::kTriangleCount);
+
+    const int kClicks = 20;
+    SceneBvh scene;
+    Stopwatch watch;
+    for (int click = 0; click < kClicks; click++) {
+        scene.Clear();
+        for (unsigned int i = 0; i < crowd.InstanceCount(); i++)
+            scene.AddInstance(&kdron, crowd.model_matrix(i), i);
+        scene.Build();
+    }
+    double build_seconds = watch.ElapsedSeconds() / kClicks;
+
+    // Rays through a grid of pixels of the default camera
+    Mat4 view;
+    view.Translate(0, 0, -2);
+    Mat4 projection =
+        Mat4::CreatePerspectiveProjectionMatrix(60, 800.0f / 600, 0.1f, 100);
+    Mat4 inverse;
+    (projection * view).Inverse(&inverse);
+    std::vector<Ray> rays;
+    for (int y = 0; y < 60; y++) {
+        for (int x = 0; x < 80; x++) {
+            float near_point[4], far_point[4];
+            float ndc_x = (x + 0.5f) / 40 - 1, ndc_y = (y + 0.5f) / 30 - 1;
+            inverse.Transform(ndc_x, ndc_y, -1, 1, near_point);
+            inverse.Transform(ndc_x, ndc_y, 1, 1, far_point);
+            Ray ray;
+            for (int k = 0; k < 3; k++) {
+                ray.origin[k] = near_point[k] / near_point[3];
+                ray.direction[k] = far_point[k] / far_point[3] - ray.origin[k];
+            }
+            rays.push_back(ray);
+        }
+    }
+    unsigned int hits = 0;
+    watch.Restart();
+    for (const Ray& ray : rays) {
+        RayHit hit;
+        hit.distance = std::numeric_limits<float>::max();
+        hits += scene.Intersect(ray, &hit);
+    }
+    double query_seconds = watch.ElapsedSeconds() / rays.size();
+    printf("%6u K-drons: top level build %.3f ms, %.3f us/ray, %u/%zu hit\n",
+           crowd.InstanceCount(), build_seconds * 1000.0,
+           query_seconds * 1e6, hits, rays.size());
+}
+
+int main() {
+    MeasureMesh(MeshGenerator::Subdivided, 8);
+    MeasureMesh(MeshGenerator::Subdivided, 9);
+    MeasureMesh(MeshGenerator::Fractal, 5);
+    MeasureCrowd(24, 18, 24);
+    MeasureCrowd(32, 24, 48);
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Orientation update paths: Euler angles rebuilt every tick vs. incremental
+// quaternion integration with lazy matrix conversion.
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "matma.h"
+
+static const float kDegreesPerSecond = 15;
+static const float kTimeStep = 1.0f / 60.0f;
+// |q| - 1 allowed after renormalizing every step: a few float ulps
+static const float kMaxNormError = 4.8e-7f;
+// Slack over the truncation error of one first-order step, and a floor for
+// the precision of the float comparison itself
+static const double kDriftSlack = 1.25;
+static const double kDriftFloorDegrees = 0.01;
+
+static float AngleBetween(const Quat& a, const Quat& b) {
+    float cosine = fabsf(a.Dot(b));
+    if (cosine > 1)
+        cosine = 1;
+    return 2.0f * acosf(cosine) * 180.0f / M_PI;
+}
+
+// Integrates a constant spin for a long time and compares with the closed form.
+// A normalized first-order step turns by 2 atan(w dt / 2) instead of w dt, so
+// the angle falls behind by about (w dt)^3 / 12 a step; fails when the drift
+// is well past that or |q| strays from 1.
+static bool MeasureDrift(int steps) {
+    const float kAxis = 1.0f / sqrtf(2.0f);
+    const float kRadians = kDegreesPerSecond * kDegreesToRadians;
+    const float omega[3] = {kAxis * kRadians, kAxis * kRadians, 0};
+
+    Quat integrated;
+    float max_norm_error = 0;
+    for (int i = 1; i <= steps; i++) {
+        integrated.Integrate(omega, kTimeStep);
+        float norm_error = fabsf(sqrtf(integrated.Dot(integrated)) - 1.0f);
+        if (norm_error > max_norm_error)
+            max_norm_error = norm_error;
+    }
+
+    double total_degrees =
+        fmod((double)steps * kTimeStep * kDegreesPerSecond, 720.0);
+    Quat exact = Quat::FromAxisAngle(kAxis, kAxis, 0, (float)total_degrees);
+    float drift = AngleBetween(integrated, exact);
+    double step_radians = (double)kRadians * kTimeStep;
+    double max_drift = steps * step_radians * step_radians * step_radians /
+                           12 * 180 / M_PI * kDriftSlack +
+                       kDriftFloorDegrees;
+    bool ok = drift <= max_drift && max_norm_error <= kMaxNormError;
+    printf("drift after %8d steps (%6.0f s): angle %.4f deg (max %.4f), "
+           "|q|-1 max %.2e %s\n",
+           steps, steps * kTimeStep, drift, max_drift, max_norm_error,
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static void MeasureThroughput(int objects, int frames) {
+    std::vector<float> angles(objects);
+    std::vector<Quat> orientations(objects);
+    std::vector<Mat4> matrices(objects);
+    for (int i = 0; i < objects; i++)
+        angles[i] = (float)(i % 360);
+
+    Stopwatch euler_watch;
+    for (int frame = 0; frame < frames; frame++) {
+        for (int i = 0; i < objects; i++) {
+            angles[i] += kTimeStep * kDegreesPerSecond;
+            clamp(&angles[i], -360.f, 360.f);
+            matrices[i].SetUnitMatrix();
+            matrices[i].RotateAboutX(angles[i]);
+            matrices[i].RotateAboutY(angles[i]);
+        }
+        DoNotOptimize(matrices[frame % objects]);
+    }
+    double euler_seconds = euler_watch.ElapsedSeconds();
+
+    const float kRadians = kDegreesPerSecond * kDegreesToRadians;
+    const float omega[3] = {kRadians, kRadians, 0};
+    Stopwatch quat_watch;
+    for (int frame = 0; frame < frames; frame++) {
+        for (int i = 0; i < objects; i++)
+            orientations[i].Integrate(omega, kTimeStep);
+        // Matrices are only built for what gets drawn; assume everything is.
+        for (int i = 0; i < objects; i++)
+            orientations[i].ToMat4(&matrices[i]);
+        DoNotOptimize(matrices[frame % objects]);
+    }
+    double quat_seconds = quat_watch.ElapsedSeconds();
+
+    double updates = (double)objects * frames;
+    ReportRate("euler: unit + RotateAboutX + RotateAboutY", updates,
+               euler_seconds, "updates");
+    ReportRate("quaternion: Integrate + ToMat4", updates, quat_seconds,
+               "updates");
+    printf("speedup: %.2fx\n", euler_seconds / quat_seconds);
+}
+
+int main() {
+    bool ok = MeasureDrift(60 * 60);       // one minute
+    ok &= MeasureDrift(60 * 60 * 60);      // one hour
+    ok &= MeasureDrift(60 * 60 * 60 * 24); // one day
+    MeasureThroughput(100000, 100);
+    return ok ? 0 : 1;
+}
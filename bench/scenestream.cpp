@@ -0,0 +1,184 @@
+// Scene streaming: a field of instances written in both scene formats and
+// loaded through SceneStreamer while frames are drawn, against waiting for
+// the whole file before the first one. Reports when the first instances were
+// on screen, when the last chunk arrived and the slowest frame on the way.
+//
+// Like the tessellation benchmark this one opens a hidden window for a GL 4.1
+// context and reads the lit shader from the working directory, so run it from
+// the repository root. The scene files are written there and removed after.
+#include <cstdio>
+#include <cstdlib>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "bench.h"
+#include "commandlist.h"
+#include "litprogram.h"
+#include "scene.h"
+#include "scenestreamer.h"
+
+static const int kWidth = 800;
+static const int kHeight = 600;
+// Instances on a kSide x kSide grid, one unit apart, in front of the camera
+static const int kSide = 200;
+static const float kChunkSize = 8;
+static const float kCameraHeight = 1;
+// Keeps the rasterizer's share of a frame small next to loading's
+static const float kFarPlane = 25;
+
+static bool WriteScene(const char* file, SceneWriter::Format format) {
+    SceneWriter writer;
+    writer.AddMesh({MeshGenerator::Subdivided, 1, 0});
+    writer.AddMesh({MeshGenerator::Parametric, 1, 180});
+    writer.AddMesh({MeshGenerator::Fractal, 1, 30});
+    writer.AddMesh({MeshGenerator::Subdivided, 3, 30});
+    for (int i = 0; i < 4; i++)
+        writer.AddMaterial({{0.3f + 0.2f * i, 0.7f, 0.9f - 0.2f * i, 1}});
+    AnimationSet::Clip turn;
+    turn.position_interpolation = AnimationSet::Linear;
+    turn.rotation_interpolation = AnimationSet::Slerp;
+    turn.scale_interpolation = AnimationSet::Linear;
+    for (int k = 0; k < 5; k++)
+        turn.rotations.push_back(
+            {k * 0.5f, Quat::FromAxisAngle(0, 1, 0, 90.0f * k)});
+    writer.AddClip(turn);
+
+    for (int row = 0; row < kSide; row++)
+        for (int column = 0; column < kSide; column++) {
+            int i = row * kSide + column;
+            SceneInstance instance;
+            instance.mesh = i * 7 % 4;
+            instance.material = i * 5 % 4;
+            instance.clip = i % 4 == 0 ? 0 : -1;
+            instance.time_offset = i % 8 * 0.25f;
+            instance.position[0] = column - kSide / 2.0f;
+            instance.position[1] = 0;
+            instance.position[2] = -row - 2.0f;
+            instance.rotation = Quat::FromAxisAngle(0, 1, 0, i * 37 % 360);
+            for (int k = 0; k < 3; k++)
+                instance.scale[k] = 0.3f;
+            writer.AddInstance(instance);
+        }
+    const char* error;
+    if (!writer.Write(file, format, kChunkSize, &error)) {
+        fprintf(stderr, "Could not write %s: %s\n", file, error);
+        return false;
+    }
+    return true;
+}
+
+struct Result {
+    double first_drawn_ms; // first frame with an instance on screen
+    double loaded_ms;      // last chunk in the scene
+    double worst_frame_ms; // while loading
+    unsigned int frames;   // while loading
+    SceneStreamer::Stats stats;
+};
+
+static Result Measure(const char* file, const LitProgram& program,
+                      bool wait_for_load) {
+    Mat4 view;
+    view.Translate(0, -kCameraHeight, 0);
+    Mat4 projection = Mat4::CreatePerspectiveProjectionMatrix(
+        60, (float)kWidth / kHeight, 0.1f, kFarPlane);
+    Mat4 view_projection = projection * view;
+    const float camera[3] = {0, kCameraHeight, 0};
+
+    SceneStreamer scene;
+    CommandList commands;
+    Result result = Result();
+    Stopwatch watch;
+    scene.SetFocus(camera);
+    scene.Open(file);
+    if (wait_for_load)
+        while (scene.loading())
+            Stopwatch().ElapsedSeconds(); // spin, as a loading screen would
+    for (;;) {
+        Stopwatch frame;
+        bool loading = scene.loading();
+        scene.Update(1.0f / 60);
+        scene.Stream();
+        scene.Cull(&view_projection, 1);
+        commands.Reset();
+        commands.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        commands.UseProgram(program);
+        program.SetViewMatrix(view, &commands);
+        program.SetProjectionMatrix(projection, &commands);
+        scene.Draw(program, &commands);
+        commands.Replay();
+        glFinish();
+        if (result.first_drawn_ms == 0 && scene.stats().drawn_instances)
+            result.first_drawn_ms = watch.ElapsedMilliseconds();
+        if (!loading)
+            break;
+        result.frames++;
+        if (frame.ElapsedMilliseconds() > result.worst_frame_ms)
+            result.worst_frame_ms = frame.ElapsedMilliseconds();
+    }
+    result.loaded_ms = scene.stats().load_seconds * 1000.0;
+    result.stats = scene.stats();
+    return result;
+}
+
+int main() {
+    if (!glfwInit()) {
+        fprintf(stderr, "Could not initialize GLFW\n");
+        return EXIT_FAILURE;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window =
+        glfwCreateWindow(kWidth, kHeight, "scenestream", nullptr, nullptr);
+    if (!window) {
+        fprintf(stderr, "Could not create a GL 4.1 context\n");
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        fprintf(stderr, "Could not initialize GLEW\n");
+        return EXIT_FAILURE;
+    }
+    printf("%s\n", (const char*)glGetString(GL_RENDERER));
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, kWidth, kHeight);
+
+    const char* files[] = {"scenestream.scene", "scenestream.txt"};
+    if (!WriteScene(files[0], SceneWriter::Binary) ||
+        !WriteScene(files[1], SceneWriter::Text))
+        return EXIT_FAILURE;
+    {
+        LitProgram program;
+        program.Initialize(
+            "LitShader.vertex.glsl", "LitShader.fragment.glsl",
+            ShaderDefines(kVertexTexture | kVertexNormal | kVertexTangent));
+        glUseProgram(program);
+        program.SetLightDirection(0.4f, 0.6f, 0.7f);
+        program.SetBumpStrength(0.08f);
+
+        // The first draw also compiles the shader in the driver
+        Measure(files[0], program, true);
+        printf("%d instances\n", kSide * kSide);
+        printf("%-8s %-10s %10s %12s %12s %10s %12s\n", "format", "load",
+               "bytes", "first drawn", "all loaded", "frames", "worst frame");
+        for (const char* file : files)
+            for (bool wait : {true, false}) {
+                Result result = Measure(file, program, wait);
+                printf("%-8s %-10s %10llu %9.1f ms %9.1f ms %10u %9.1f ms\n",
+                       file == files[0] ? "binary" : "text",
+                       wait ? "blocking" : "streamed",
+                       result.stats.bytes_read, result.first_drawn_ms,
+                       result.loaded_ms, result.frames,
+                       result.worst_frame_ms);
+            }
+    }
+    for (const char* file : files)
+        remove(file);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
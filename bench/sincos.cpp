@@ -0,0 +1,131 @@
+// Polynomial SinCos (scalar and AVX2 batch) against libm, plus batch rotation
+// matrix generation for a million objects.
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "bench.h"
+#include "matma.h"
+
+static int64_t UlpDistance(float value, double exact) {
+    float rounded = (float)exact;
+    int32_t a, b;
+    memcpy(&a, &value, sizeof(a));
+    memcpy(&b, &rounded, sizeof(b));
+    // Map sign-magnitude onto a monotonic integer line
+    if (a < 0)
+        a = INT32_MIN - a;
+    if (b < 0)
+        b = INT32_MIN - b;
+    return llabs((int64_t)a - (int64_t)b);
+}
+
+static void MeasureAccuracy(float range, unsigned int samples) {
+    std::vector<float> radians(samples), sines(samples), cosines(samples);
+    for (unsigned int i = 0; i < samples; i++)
+        radians[i] = -range + 2.0f * range * ((float)i / samples);
+    SinCos(radians.data(), sines.data(), cosines.data(), samples);
+
+    // Near the zeros of sin/cos the reduction error is tiny in absolute terms
+    // but large in ulps, so ulps are only counted for results >= 2^-10.
+    int64_t max_sin_ulp = 0, max_cos_ulp = 0;
+    double max_absolute = 0;
+    unsigned int mismatches = 0;
+    for (unsigned int i = 0; i < samples; i++) {
+        double exact_sin = sin(radians[i]), exact_cos = cos(radians[i]);
+        if (fabs(exact_sin) >= 1.0 / 1024)
+            max_sin_ulp =
+                std::max(max_sin_ulp, UlpDistance(sines[i], exact_sin));
+        if (fabs(exact_cos) >= 1.0 / 1024)
+            max_cos_ulp =
+                std::max(max_cos_ulp, UlpDistance(cosines[i], exact_cos));
+        max_absolute = std::max(max_absolute, fabs(sines[i] - exact_sin));
+        max_absolute = std::max(max_absolute, fabs(cosines[i] - exact_cos));
+        float s, c;
+        SinCos(radians[i], &s, &c);
+        if (s != sines[i] || c != cosines[i])
+            mismatches++;
+    }
+    printf("|x| <= %6.1f: sin %lld ulp, cos %lld ulp, absolute %.2e, "
+           "scalar/batch mismatches %u\n",
+           range, (long long)max_sin_ulp, (long long)max_cos_ulp, max_absolute,
+           mismatches);
+}
+
+static void MeasureSinCosThroughput(unsigned int count, int repeats) {
+    std::vector<float> radians(count), sines(count), cosines(count);
+    for (unsigned int i = 0; i < count; i++)
+        radians[i] = (float)i * 0.001f - 100.0f;
+    double calls = (double)count * repeats;
+
+    Stopwatch watch;
+    for (int r = 0; r < repeats; r++) {
+        for (unsigned int i = 0; i < count; i++) {
+            sines[i] = sinf(radians[i]);
+            cosines[i] = cosf(radians[i]);
+        }
+        DoNotOptimize(sines[r]);
+    }
+    ReportRate("libm sinf + cosf", calls, watch.ElapsedSeconds(), "sincos");
+
+    watch.Restart();
+    for (int r = 0; r < repeats; r++) {
+        for (unsigned int i = 0; i < count; i++)
+            SinCos(radians[i], &sines[i], &cosines[i]);
+        DoNotOptimize(sines[r]);
+    }
+    ReportRate("SinCos scalar", calls, watch.ElapsedSeconds(), "sincos");
+
+    watch.Restart();
+    for (int r = 0; r < repeats; r++) {
+        SinCos(radians.data(), sines.data(), cosines.data(), count);
+        DoNotOptimize(sines[r]);
+    }
+    ReportRate("SinCos batch", calls, watch.ElapsedSeconds(), "sincos");
+}
+
+static void MeasureRotationBuilders(unsigned int objects) {
+    std::vector<float> x_degrees(objects), y_degrees(objects);
+    std::vector<Mat4> matrices(objects);
+    for (unsigned int i = 0; i < objects; i++) {
+        x_degrees[i] = (float)(i % 720) - 360.0f;
+        y_degrees[i] = (float)(i % 360) * 0.5f;
+    }
+
+    Stopwatch watch;
+    for (unsigned int i = 0; i < objects; i++) {
+        matrices[i].SetUnitMatrix();
+        matrices[i].RotateAboutX(x_degrees[i]);
+        matrices[i].RotateAboutY(y_degrees[i]);
+    }
+    DoNotOptimize(matrices[objects / 2]);
+    ReportRate("per object SetUnit + RotateAboutX/Y", objects,
+               watch.ElapsedSeconds(), "matrices");
+
+    std::vector<Mat4> batch(objects);
+    watch.Restart();
+    Mat4::CreateRotationsAboutXY(x_degrees.data(), y_degrees.data(),
+                                 batch.data(), objects);
+    DoNotOptimize(batch[objects / 2]);
+    ReportRate("CreateRotationsAboutXY", objects, watch.ElapsedSeconds(),
+               "matrices");
+
+    float max_difference = 0;
+    for (unsigned int i = 0; i < objects; i++)
+        for (int j = 0; j < 16; j++)
+            max_difference = std::max(
+                max_difference, fabsf(((const float*)matrices[i])[j] -
+                                      ((const float*)batch[i])[j]));
+    printf("max element difference batch vs sequential: %g\n", max_difference);
+}
+
+int main() {
+    MeasureAccuracy(2 * M_PI, 1 << 24);
+    MeasureAccuracy(360, 1 << 24);
+    MeasureAccuracy(8192, 1 << 24);
+    MeasureSinCosThroughput(1 << 16, 200);
+    MeasureRotationBuilders(1000000);
+    return 0;
+}
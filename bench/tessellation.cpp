@@ -0,0 +1,178 @@
+// GPU tessellation against pre-tessellated buffers: the Subdivided K-dron
+// drawn from its 4^kLevel triangles per face in the index buffer, and from
+// the bare K-dron's faces refined by SimpleShader's tessellation stages to
+// the size their edges have on screen. Both give the same surface; the
+// camera backs away to show where each wins.
+//
+// Unlike the other benchmarks this one needs a GL 4.1 context, so it opens a
+// hidden window and reads the shaders from the working directory: run it
+// from the repository root. Frame times are to glFinish(), so they include
+// the GPU. On Mesa's llvmpipe (LIBGL_ALWAYS_SOFTWARE=1, under xvfb-run
+// without a display) they measure the CPU rasterizer, which is enough to
+// check the path works and how the triangle counts compare.
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "bench.h"
+#include "commandlist.h"
+#include "indexmodel.h"
+#include "meshgenerator.h"
+#include "modelprogram.h"
+#include "shadervariants.h"
+
+static const int kWidth = 800;
+static const int kHeight = 600;
+// 64 segments per edge, the most the tessellator is asked for
+static const unsigned int kLevel = 6;
+
+class Mesh : public IndexModel {
+  public:
+    void Initialize(const MeshGenerator& generator) {
+        std::vector<ColorVertex> vertices(generator.VertexCount());
+        std::vector<Triangle> triangles(generator.TriangleCount());
+        generator.Generate(vertices.data(), triangles.data());
+        triangle_count_ = triangles.size();
+        bytes_ = vertices.size() * sizeof(ColorVertex) +
+                 triangles.size() * sizeof(Triangle);
+
+        vao_.Create("bench");
+        glBindVertexArray(vao_);
+        vertex_buffer_.Create(GpuResources::VertexBuffers, "bench");
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+        vertex_buffer_.Allocate(GL_ARRAY_BUFFER,
+                                vertices.size() * sizeof(ColorVertex),
+                                vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ColorVertex),
+                              (GLvoid*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ColorVertex),
+                              (GLvoid*)sizeof(vertices[0].position));
+        glEnableVertexAttribArray(1);
+        index_buffer_.Create(GpuResources::IndexBuffers, "bench");
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+        index_buffer_.Allocate(GL_ELEMENT_ARRAY_BUFFER,
+                               triangles.size() * sizeof(Triangle),
+                               triangles.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+    }
+    void Draw(const ModelProgram& program, const Mat4& model_matrix,
+              CommandList* commands) const {
+        commands->BindVertexArray(vao_);
+        program.SetModelMatrix(model_matrix, commands);
+        DrawIndexed(program, triangle_count_ * 3, 0, commands);
+        commands->BindVertexArray(0);
+    }
+    size_t bytes() const { return bytes_; }
+
+  private:
+    unsigned int triangle_count_;
+    size_t bytes_;
+};
+
+struct Result {
+    double milliseconds; // per frame
+    GLuint triangles;    // rasterized per frame
+};
+
+static Result Measure(const Mesh& mesh, const ModelProgram& program,
+                      float distance, int frames) {
+    Mat4 view;
+    view.Translate(0, 0, -distance);
+    Mat4 projection = Mat4::CreatePerspectiveProjectionMatrix(
+        60, (float)kWidth / kHeight, 0.1f, 100.0f);
+    GLuint query;
+    glGenQueries(1, &query);
+    CommandList commands;
+    Result result = Result();
+
+    // The first frame also warms up the driver's shader caches
+    Stopwatch watch;
+    for (int frame = -1; frame < frames; frame++) {
+        if (frame == 0)
+            watch.Restart();
+        Mat4 model;
+        model.RotateAboutY(frame * 3.0f);
+        model.RotateAboutX(20.0f);
+        commands.Reset();
+        commands.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        commands.UseProgram(program);
+        program.SetViewMatrix(view, &commands);
+        program.SetProjectionMatrix(projection, &commands);
+        program.SetViewportHeight(kHeight, &commands);
+        mesh.Draw(program, model, &commands);
+        if (frame == 0)
+            glBeginQuery(GL_PRIMITIVES_GENERATED, query);
+        commands.Replay();
+        if (frame == 0)
+            glEndQuery(GL_PRIMITIVES_GENERATED);
+        glFinish();
+    }
+    result.milliseconds = watch.ElapsedMilliseconds() / frames;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &result.triangles);
+    glDeleteQueries(1, &query);
+    return result;
+}
+
+int main() {
+    if (!glfwInit()) {
+        fprintf(stderr, "Could not initialize GLFW\n");
+        return EXIT_FAILURE;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window =
+        glfwCreateWindow(kWidth, kHeight, "tessellation", nullptr, nullptr);
+    if (!window) {
+        fprintf(stderr, "Could not create a GL 4.1 context\n");
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        fprintf(stderr, "Could not initialize GLEW\n");
+        return EXIT_FAILURE;
+    }
+    printf("%s\n", (const char*)glGetString(GL_RENDERER));
+    glEnable(GL_DEPTH_TEST);
+    glPatchParameteri(GL_PATCH_VERTICES, 3);
+    glViewport(0, 0, kWidth, kHeight);
+
+    {
+        ModelProgram triangles, patches;
+        triangles.Initialize("SimpleShader.vertex.glsl",
+                             "SimpleShader.fragment.glsl",
+                             ShaderDefines(kVertexColor));
+        patches.set_tessellation_shaders("SimpleShader.tesscontrol.glsl",
+                                         "SimpleShader.tesseval.glsl");
+        patches.Initialize("SimpleShader.vertex.glsl",
+                           "SimpleShader.fragment.glsl",
+                           ShaderDefines(kVertexColor | kTessellation));
+
+        Mesh full, base;
+        full.Initialize(MeshGenerator(MeshGenerator::Subdivided, kLevel));
+        base.Initialize(MeshGenerator(MeshGenerator::Subdivided, 0));
+        printf("Buffers: %zu bytes pre-tessellated, %zu bytes of patches\n",
+               full.bytes(), base.bytes());
+
+        const int kFrames = 30;
+        printf("%8s %28s %28s\n", "distance", "pre-tessellated",
+               "GPU tessellation");
+        for (float distance : {1.5f, 3.0f, 6.0f, 12.0f, 24.0f}) {
+            Result pre = Measure(full, triangles, distance, kFrames);
+            Result gpu = Measure(base, patches, distance, kFrames);
+            printf("%8.1f %10.3f ms %9u tris %10.3f ms %9u tris\n", distance,
+                   pre.milliseconds, pre.triangles, gpu.milliseconds,
+                   gpu.triangles);
+        }
+    }
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
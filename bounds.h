@@ -0,0 +1,43 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "matma.h"
+#include "vertices.h"
+
+// Axis-aligned box in model space.
+struct Aabb {
+    float min[3];
+    float max[3];
+};
+
+inline Aabb ComputeAabb(const ColorVertex* vertices, unsigned int count) {
+    Aabb box = {{0, 0, 0}, {0, 0, 0}};
+    for (unsigned int i = 0; i < count; i++)
+        for (int k = 0; k < 3; k++) {
+            float value = vertices[i].position[k];
+            if (i == 0 || value < box.min[k])
+                box.min[k] = value;
+            if (i == 0 || value > box.max[k])
+                box.max[k] = value;
+        }
+    return box;
+}
+
+// World box around a model-space box under an affine model matrix (Arvo):
+// each output extent takes the smaller/larger product per matrix entry.
+inline Aabb TransformAabb(const Aabb& box, const Mat4& model_matrix) {
+    const float* m = model_matrix;
+    Aabb world;
+    for (int row = 0; row < 3; row++) {
+        world.min[row] = world.max[row] = m[12 + row];
+        for (int k = 0; k < 3; k++) {
+            float a = m[4 * k + row] * box.min[k];
+            float b = m[4 * k + row] * box.max[k];
+            world.min[row] += a < b ? a : b;
+            world.max[row] += a < b ? b : a;
+        }
+    }
+    return world;
+}
+
+#endif // BOUNDS_H
@@ -0,0 +1,679 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "jobsystem.h"
+
+static const unsigned int kMaxBins = 16;
+static const unsigned int kMaxLeafTriangles = 16;
+// Ranges larger than this are binned and split on several threads
+static const unsigned int kParallelRange = 16384;
+static const unsigned int kStackSize = 96;
+
+namespace {
+
+// Bounds are padded to four floats so they grow with one SSE op each; the
+// fourth lane is never read back.
+struct Primitive {
+    float min[4];
+    float max[4];
+    float centroid[3];
+    unsigned int triangle;
+};
+
+struct Bounds {
+    float min[4];
+    float max[4];
+
+    void Reset() {
+        for (int k = 0; k < 4; k++) {
+            min[k] = std::numeric_limits<float>::max();
+            max[k] = -std::numeric_limits<float>::max();
+        }
+    }
+    void Grow(const float* low, const float* high) {
+#ifdef __SSE2__
+        _mm_storeu_ps(min, _mm_min_ps(_mm_loadu_ps(min), _mm_loadu_ps(low)));
+        _mm_storeu_ps(max, _mm_max_ps(_mm_loadu_ps(max), _mm_loadu_ps(high)));
+#else
+        for (int k = 0; k < 3; k++) {
+            min[k] = std::min(min[k], low[k]);
+            max[k] = std::max(max[k], high[k]);
+        }
+#endif
+    }
+    void Grow(const Bounds& other) { Grow(other.min, other.max); }
+    float HalfArea() const {
+        float d[3] = {max[0] - min[0], max[1] - min[1], max[2] - min[2]};
+        if (d[0] < 0)
+            return 0;
+        return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+    }
+};
+
+struct Bin {
+    Bounds bounds;
+    unsigned int count;
+};
+
+struct BinSet {
+    Bin bins[3][kMaxBins]; // per axis
+    unsigned int count;     // bins in use, fewer for small nodes
+};
+
+// Entry distance of the ray into the node's box, or infinity on a miss
+inline float BoxEntry(const BvhNode& node, const float* origin,
+                      const float* inverse_direction, float t_max) {
+    float t_near = 0, t_far = t_max;
+    for (int k = 0; k < 3; k++) {
+        float a = (node.min[k] - origin[k]) * inverse_direction[k];
+        float b = (node.max[k] - origin[k]) * inverse_direction[k];
+        t_near = std::max(t_near, std::min(a, b));
+        t_far = std::min(t_far, std::max(a, b));
+    }
+    return t_near <= t_far ? t_near : std::numeric_limits<float>::infinity();
+}
+
+// Closest-hit traversal shared by both levels. intersect_leaf(node, ray,
+// hit) tests a leaf and returns true when it shrank hit->distance.
+template <typename LeafTest>
+bool Traverse(const std::vector<BvhNode>& nodes, const Ray& ray, RayHit* hit,
+              LeafTest intersect_leaf) {
+    if (nodes.empty())
+        return false;
+    float inverse_direction[3];
+    for (int k = 0; k < 3; k++)
+        inverse_direction[k] = 1.0f / ray.direction[k];
+
+    struct Entry {
+        unsigned int node;
+        float distance;
+    } stack[kStackSize];
+    unsigned int depth = 0;
+    bool found = false;
+
+    float root_distance =
+        BoxEntry(nodes[0], ray.origin, inverse_direction, hit->distance);
+    if (root_distance == std::numeric_limits<float>::infinity())
+        return false;
+    stack[depth++] = {0, root_distance};
+    while (depth > 0) {
+        Entry entry = stack[--depth];
+        if (entry.distance > hit->distance)
+            continue;
+        const BvhNode& node = nodes[entry.node];
+        if (node.count) {
+            found |= intersect_leaf(node, ray, hit);
+            continue;
+        }
+        float left = BoxEntry(nodes[node.first], ray.origin, inverse_direction,
+                              hit->distance);
+        float right = BoxEntry(nodes[node.first + 1], ray.origin,
+                               inverse_direction, hit->distance);
+        // Nearer child on top so it is visited first
+        Entry near = {node.first, left}, far = {node.first + 1, right};
+        if (right < left)
+            std::swap(near, far);
+        if (far.distance != std::numeric_limits<float>::infinity() &&
+            depth < kStackSize)
+            stack[depth++] = far;
+        if (near.distance != std::numeric_limits<float>::infinity() &&
+            depth < kStackSize)
+            stack[depth++] = near;
+    }
+    return found;
+}
+
+} // namespace
+
+class MeshBvh::Builder {
+  public:
+    Builder(MeshBvh* bvh, const ColorVertex* vertices,
+            const Triangle* triangles, unsigned int triangle_count);
+    void Run();
+
+  private:
+    Bounds RangeBounds(unsigned int begin, unsigned int end, bool centroids);
+    void BinRange(unsigned int begin, unsigned int end,
+                  const Bounds& centroids, BinSet* bins);
+    // bounds and centroids cover the primitives in [begin, end)
+    void BuildNode(unsigned int node, unsigned int begin, unsigned int end,
+                   const Bounds& bounds, const Bounds& centroids);
+    void MakeLeaf(unsigned int node, const Bounds& bounds, unsigned int begin,
+                  unsigned int end);
+    void FillPackets();
+
+    MeshBvh* bvh_;
+    const ColorVertex* vertices_;
+    const Triangle* triangles_;
+    std::vector<Primitive> primitives_;
+    std::atomic<unsigned int> node_count_;
+};
+
+MeshBvh::Builder::Builder(MeshBvh* bvh, const ColorVertex* vertices,
+                          const Triangle* triangles,
+                          unsigned int triangle_count) {
+    bvh_ = bvh;
+    vertices_ = vertices;
+    triangles_ = triangles;
+    primitives_.resize(triangle_count);
+    node_count_ = 1;
+}
+
+void MeshBvh::Builder::Run() {
+    unsigned int count = primitives_.size();
+    JobSystem::Instance().ParallelFor(
+        count, kParallelRange, [this](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                Primitive& primitive = primitives_[i];
+                const unsigned int* indices = triangles_[i].indices;
+                for (int k = 0; k < 3; k++) {
+                    float a = vertices_[indices[0]].position[k];
+                    float b = vertices_[indices[1]].position[k];
+                    float c = vertices_[indices[2]].position[k];
+                    primitive.min[k] = std::min({a, b, c});
+                    primitive.max[k] = std::max({a, b, c});
+                    primitive.centroid[k] =
+                        (primitive.min[k] + primitive.max[k]) * 0.5f;
+                }
+                primitive.min[3] = primitive.max[3] = 0;
+                primitive.triangle = i;
+            }
+        });
+
+    // A binary tree with at least one triangle per leaf
+    bvh_->nodes_.resize(2 * count);
+    BuildNode(0, 0, count, RangeBounds(0, count, false),
+              RangeBounds(0, count, true));
+    bvh_->nodes_.resize(node_count_);
+    bvh_->nodes_.shrink_to_fit();
+    FillPackets();
+}
+
+Bounds MeshBvh::Builder::RangeBounds(unsigned int begin, unsigned int end,
+                                     bool centroids) {
+    Bounds total;
+    total.Reset();
+    if (end - begin <= kParallelRange) {
+        for (unsigned int i = begin; i < end; i++) {
+            const Primitive& p = primitives_[i];
+            if (centroids)
+                total.Grow(p.centroid, p.centroid);
+            else
+                total.Grow(p.min, p.max);
+        }
+        return total;
+    }
+    unsigned int chunks = (end - begin + kParallelRange - 1) / kParallelRange;
+    std::vector<Bounds> partial(chunks);
+    JobSystem::Instance().ParallelFor(
+        chunks, 1, [&](unsigned int first, unsigned int last) {
+            for (unsigned int c = first; c < last; c++)
+                partial[c] = RangeBounds(
+                    begin + c * kParallelRange,
+                    std::min(end, begin + (c + 1) * kParallelRange),
+                    centroids);
+        });
+    for (const Bounds& bounds : partial)
+        total.Grow(bounds);
+    return total;
+}
+
+static unsigned int BinIndex(float value, float min, float scale,
+                             unsigned int bin_count) {
+    return std::min((unsigned int)((value - min) * scale), bin_count - 1);
+}
+
+void MeshBvh::Builder::BinRange(unsigned int begin, unsigned int end,
+                                const Bounds& centroids, BinSet* set) {
+    Bin(&bins)[3][kMaxBins] = set->bins;
+    unsigned int bin_count = set->count;
+    for (int axis = 0; axis < 3; axis++)
+        for (unsigned int b = 0; b < bin_count; b++) {
+            bins[axis][b].bounds.Reset();
+            bins[axis][b].count = 0;
+        }
+    if (end - begin <= kParallelRange) {
+        float scale[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroids.max[axis] - centroids.min[axis];
+            scale[axis] = extent > 0 ? bin_count / extent : 0;
+        }
+        for (unsigned int i = begin; i < end; i++) {
+            const Primitive& p = primitives_[i];
+            for (int axis = 0; axis < 3; axis++) {
+                Bin& bin = bins[axis][BinIndex(p.centroid[axis],
+                                               centroids.min[axis],
+                                               scale[axis], bin_count)];
+                bin.bounds.Grow(p.min, p.max);
+                bin.count++;
+            }
+        }
+        return;
+    }
+    unsigned int chunks = (end - begin + kParallelRange - 1) / kParallelRange;
+    std::vector<BinSet> partial(chunks);
+    for (BinSet& chunk : partial)
+        chunk.count = bin_count;
+    JobSystem::Instance().ParallelFor(
+        chunks, 1, [&](unsigned int first, unsigned int last) {
+            for (unsigned int c = first; c < last; c++)
+                BinRange(begin + c * kParallelRange,
+                         std::min(end, begin + (c + 1) * kParallelRange),
+                         centroids, &partial[c]);
+        });
+    for (unsigned int c = 0; c < chunks; c++)
+        for (int axis = 0; axis < 3; axis++)
+            for (unsigned int b = 0; b < bin_count; b++) {
+                const Bin& bin = partial[c].bins[axis][b];
+                bins[axis][b].bounds.Grow(bin.bounds);
+                bins[axis][b].count += bin.count;
+            }
+}
+
+static unsigned int PacketCount(unsigned int triangles) {
+    return (triangles + 3) / 4;
+}
+
+void MeshBvh::Builder::MakeLeaf(unsigned int node, const Bounds& bounds,
+                                unsigned int begin, unsigned int end) {
+    BvhNode& leaf = bvh_->nodes_[node];
+    for (int k = 0; k < 3; k++) {
+        leaf.min[k] = bounds.min[k];
+        leaf.max[k] = bounds.max[k];
+    }
+    // Primitive range for now, FillPackets turns it into packets
+    leaf.first = begin;
+    leaf.count = end - begin;
+}
+
+void MeshBvh::Builder::BuildNode(unsigned int node, unsigned int begin,
+                                 unsigned int end, const Bounds& bounds,
+                                 const Bounds& centroids) {
+    unsigned int count = end - begin;
+    if (count <= 4) {
+        MakeLeaf(node, bounds, begin, end);
+        return;
+    }
+
+    BinSet set;
+    // Small nodes are most of the tree; a full set of bins is wasted there
+    set.count = std::min(kMaxBins, std::max(4u, count / 2));
+    BinRange(begin, end, centroids, &set);
+    const Bin(&bins)[3][kMaxBins] = set.bins;
+    unsigned int bin_count = set.count;
+
+    // Cost in packet tests, relative to hitting this node's box
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    unsigned int best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (centroids.max[axis] <= centroids.min[axis])
+            continue;
+        float right_area[kMaxBins];
+        unsigned int right_count[kMaxBins];
+        Bounds right;
+        right.Reset();
+        unsigned int running = 0;
+        for (unsigned int b = bin_count - 1; b > 0; b--) {
+            right.Grow(bins[axis][b].bounds);
+            running += bins[axis][b].count;
+            right_area[b] = right.HalfArea();
+            right_count[b] = running;
+        }
+        Bounds left;
+        left.Reset();
+        running = 0;
+        for (unsigned int b = 1; b < bin_count; b++) {
+            left.Grow(bins[axis][b - 1].bounds);
+            running += bins[axis][b - 1].count;
+            if (running == 0 || right_count[b] == 0)
+                continue;
+            float cost = left.HalfArea() * PacketCount(running) +
+                         right_area[b] * PacketCount(right_count[b]);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    float area = bounds.HalfArea();
+    float leaf_cost = PacketCount(count);
+    float split_cost = 1 + (area > 0 ? best_cost / area : leaf_cost);
+    unsigned int middle;
+    Bounds child_bounds[2], child_centroids[2];
+    if (best_axis < 0) {
+        // All centroids coincide: no plane separates them
+        if (count <= kMaxLeafTriangles) {
+            MakeLeaf(node, bounds, begin, end);
+            return;
+        }
+        middle = begin + count / 2;
+        child_bounds[0] = RangeBounds(begin, middle, false);
+        child_bounds[1] = RangeBounds(middle, end, false);
+        child_centroids[0] = child_centroids[1] = centroids;
+    } else {
+        if (count <= kMaxLeafTriangles && leaf_cost <= split_cost) {
+            MakeLeaf(node, bounds, begin, end);
+            return;
+        }
+        // Child boxes come from the bins; child centroid bounds are
+        // collected while partitioning.
+        for (int side = 0; side < 2; side++) {
+            child_bounds[side].Reset();
+            child_centroids[side].Reset();
+        }
+        for (unsigned int b = 0; b < bin_count; b++)
+            child_bounds[b >= best_split].Grow(bins[best_axis][b].bounds);
+        float min = centroids.min[best_axis];
+        float scale = bin_count / (centroids.max[best_axis] - min);
+        unsigned int i = begin, j = end;
+        while (i < j) {
+            Primitive& p = primitives_[i];
+            if (BinIndex(p.centroid[best_axis], min, scale, bin_count) <
+                best_split) {
+                child_centroids[0].Grow(p.centroid, p.centroid);
+                i++;
+            } else {
+                std::swap(p, primitives_[--j]);
+                child_centroids[1].Grow(primitives_[j].centroid,
+                                        primitives_[j].centroid);
+            }
+        }
+        middle = i;
+    }
+
+    unsigned int left = node_count_.fetch_add(2);
+    BvhNode& inner = bvh_->nodes_[node];
+    for (int k = 0; k < 3; k++) {
+        inner.min[k] = bounds.min[k];
+        inner.max[k] = bounds.max[k];
+    }
+    inner.first = left;
+    inner.count = 0;
+
+    if (count > kParallelRange) {
+        JobSystem::Instance().ParallelFor(
+            2, 1, [&](unsigned int first, unsigned int last) {
+                for (unsigned int child = first; child < last; child++)
+                    if (child == 0)
+                        BuildNode(left, begin, middle, child_bounds[0],
+                                  child_centroids[0]);
+                    else
+                        BuildNode(left + 1, middle, end, child_bounds[1],
+                                  child_centroids[1]);
+            });
+    } else {
+        BuildNode(left, begin, middle, child_bounds[0], child_centroids[0]);
+        BuildNode(left + 1, middle, end, child_bounds[1], child_centroids[1]);
+    }
+}
+
+void MeshBvh::Builder::FillPackets() {
+    struct Leaf {
+        unsigned int node;
+        unsigned int begin;
+        unsigned int count;
+    };
+    std::vector<Leaf> leaves;
+    unsigned int packet_count = 0;
+    for (unsigned int i = 0; i < bvh_->nodes_.size(); i++) {
+        BvhNode& node = bvh_->nodes_[i];
+        if (!node.count)
+            continue;
+        leaves.push_back({i, node.first, node.count});
+        node.first = packet_count;
+        node.count = PacketCount(node.count);
+        packet_count += node.count;
+    }
+    bvh_->packets_.resize(packet_count);
+
+    JobSystem::Instance().ParallelFor(
+        leaves.size(), 1024, [&](unsigned int first, unsigned int last) {
+            for (unsigned int l = first; l < last; l++) {
+                const Leaf& leaf = leaves[l];
+                Packet* packet =
+                    &bvh_->packets_[bvh_->nodes_[leaf.node].first];
+                for (unsigned int i = 0; i < PacketCount(leaf.count) * 4;
+                     i++) {
+                    // Short packets repeat their last triangle
+                    unsigned int triangle =
+                        primitives_[leaf.begin + std::min(i, leaf.count - 1)]
+                            .triangle;
+                    const unsigned int* indices = triangles_[triangle].indices;
+                    const float* v0 = vertices_[indices[0]].position;
+                    const float* v1 = vertices_[indices[1]].position;
+                    const float* v2 = vertices_[indices[2]].position;
+                    Packet& p = packet[i / 4];
+                    for (int k = 0; k < 3; k++) {
+                        p.v0[k][i % 4] = v0[k];
+                        p.edge1[k][i % 4] = v1[k] - v0[k];
+                        p.edge2[k][i % 4] = v2[k] - v0[k];
+                    }
+                    p.triangles[i % 4] = triangle;
+                }
+            }
+        });
+}
+
+MeshBvh::MeshBvh() {
+    bounds_ = {{0, 0, 0}, {0, 0, 0}};
+    triangle_count_ = 0;
+}
+
+void MeshBvh::Build(const ColorVertex* vertices, const Triangle* triangles,
+                    unsigned int triangle_count) {
+    nodes_.clear();
+    packets_.clear();
+    triangle_count_ = triangle_count;
+    if (triangle_count == 0)
+        return;
+    Builder builder(this, vertices, triangles, triangle_count);
+    builder.Run();
+    for (int k = 0; k < 3; k++) {
+        bounds_.min[k] = nodes_[0].min[k];
+        bounds_.max[k] = nodes_[0].max[k];
+    }
+}
+
+bool MeshBvh::Intersect(const Ray& ray, RayHit* hit) const {
+    return Traverse(nodes_, ray, hit, [this](const BvhNode& leaf,
+                                             const Ray& ray, RayHit* hit) {
+        bool found = false;
+        for (unsigned int i = 0; i < leaf.count; i++) {
+            const Packet& p = packets_[leaf.first + i];
+            float t[4];
+            int mask = 0;
+#ifdef __SSE2__
+            __m128 d[3], e1[3], e2[3], s[3];
+            for (int k = 0; k < 3; k++) {
+                d[k] = _mm_set1_ps(ray.direction[k]);
+                e1[k] = _mm_load_ps(p.edge1[k]);
+                e2[k] = _mm_load_ps(p.edge2[k]);
+                s[k] = _mm_sub_ps(_mm_set1_ps(ray.origin[k]),
+                                  _mm_load_ps(p.v0[k]));
+            }
+#define CROSS(a, b, k1, k2)                                                    \
+    _mm_sub_ps(_mm_mul_ps(a[k1], b[k2]), _mm_mul_ps(a[k2], b[k1]))
+#define DOT(a, b)                                                              \
+    _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])),     \
+               _mm_mul_ps(a[2], b[2]))
+            __m128 pv[3] = {CROSS(d, e2, 1, 2), CROSS(d, e2, 2, 0),
+                            CROSS(d, e2, 0, 1)};
+            __m128 inverse_det = _mm_div_ps(_mm_set1_ps(1.0f), DOT(e1, pv));
+            __m128 u = _mm_mul_ps(DOT(s, pv), inverse_det);
+            __m128 qv[3] = {CROSS(s, e1, 1, 2), CROSS(s, e1, 2, 0),
+                            CROSS(s, e1, 0, 1)};
+            __m128 v = _mm_mul_ps(DOT(d, qv), inverse_det);
+            __m128 distance = _mm_mul_ps(DOT(e2, qv), inverse_det);
+#undef CROSS
+#undef DOT
+            // A zero determinant makes everything NaN, which fails each test
+            __m128 zero = _mm_setzero_ps();
+            __m128 inside = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+                _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+            __m128 in_range =
+                _mm_and_ps(_mm_cmpgt_ps(distance, zero),
+                           _mm_cmplt_ps(distance, _mm_set1_ps(hit->distance)));
+            mask = _mm_movemask_ps(_mm_and_ps(inside, in_range));
+            _mm_storeu_ps(t, distance);
+#else
+            for (int lane = 0; lane < 4; lane++) {
+                float d[3], e1[3], e2[3], s[3];
+                for (int k = 0; k < 3; k++) {
+                    d[k] = ray.direction[k];
+                    e1[k] = p.edge1[k][lane];
+                    e2[k] = p.edge2[k][lane];
+                    s[k] = ray.origin[k] - p.v0[k][lane];
+                }
+                float pv[3] = {d[1] * e2[2] - d[2] * e2[1],
+                               d[2] * e2[0] - d[0] * e2[2],
+                               d[0] * e2[1] - d[1] * e2[0]};
+                float inverse_det =
+                    1.0f / (e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2]);
+                float u = (s[0] * pv[0] + s[1] * pv[1] + s[2] * pv[2]) *
+                          inverse_det;
+                float qv[3] = {s[1] * e1[2] - s[2] * e1[1],
+                               s[2] * e1[0] - s[0] * e1[2],
+                               s[0] * e1[1] - s[1] * e1[0]};
+                float v = (d[0] * qv[0] + d[1] * qv[1] + d[2] * qv[2]) *
+                          inverse_det;
+                t[lane] = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) *
+                          inverse_det;
+                if (u >= 0 && v >= 0 && u + v <= 1 && t[lane] > 0 &&
+                    t[lane] < hit->distance)
+                    mask |= 1 << lane;
+            }
+#endif
+            for (int lane = 0; lane < 4; lane++)
+                if (mask & 1 << lane && t[lane] < hit->distance) {
+                    hit->distance = t[lane];
+                    hit->triangle = p.triangles[lane];
+                    found = true;
+                }
+        }
+        return found;
+    });
+}
+
+void SceneBvh::Clear() {
+    instances_.clear();
+    nodes_.clear();
+}
+
+void SceneBvh::AddInstance(const MeshBvh* mesh, const Mat4& model_matrix,
+                           unsigned int id) {
+    if (mesh->empty())
+        return;
+    Instance instance;
+    instance.mesh = mesh;
+    instance.id = id;
+    if (!model_matrix.Inverse(&instance.inverse_model_matrix))
+        return; // flattened to nothing, cannot be hit
+    const Aabb& local = mesh->bounds();
+    Bounds world;
+    world.Reset();
+    for (int corner = 0; corner < 8; corner++) {
+        float p[4];
+        model_matrix.Transform(corner & 1 ? local.max[0] : local.min[0],
+                               corner & 2 ? local.max[1] : local.min[1],
+                               corner & 4 ? local.max[2] : local.min[2], 1, p);
+        world.Grow(p, p);
+    }
+    for (int k = 0; k < 3; k++) {
+        instance.bounds.min[k] = world.min[k];
+        instance.bounds.max[k] = world.max[k];
+    }
+    instances_.push_back(instance);
+}
+
+void SceneBvh::Build() {
+    nodes_.clear();
+    if (instances_.empty())
+        return;
+    nodes_.reserve(2 * instances_.size());
+    nodes_.resize(1);
+    BuildNode(0, 0, instances_.size());
+}
+
+void SceneBvh::BuildNode(unsigned int node, unsigned int begin,
+                         unsigned int end) {
+    Bounds bounds, centroids;
+    bounds.Reset();
+    centroids.Reset();
+    for (unsigned int i = begin; i < end; i++) {
+        const Aabb& box = instances_[i].bounds;
+        float low[4] = {box.min[0], box.min[1], box.min[2], 0};
+        float high[4] = {box.max[0], box.max[1], box.max[2], 0};
+        float centroid[4];
+        for (int k = 0; k < 4; k++)
+            centroid[k] = (low[k] + high[k]) * 0.5f;
+        bounds.Grow(low, high);
+        centroids.Grow(centroid, centroid);
+    }
+    for (int k = 0; k < 3; k++) {
+        nodes_[node].min[k] = bounds.min[k];
+        nodes_[node].max[k] = bounds.max[k];
+    }
+    if (end - begin <= 2) {
+        nodes_[node].first = begin;
+        nodes_[node].count = end - begin;
+        return;
+    }
+
+    // Instances are few, a median split on the widest axis is enough
+    int axis = 0;
+    for (int k = 1; k < 3; k++)
+        if (centroids.max[k] - centroids.min[k] >
+            centroids.max[axis] - centroids.min[axis])
+            axis = k;
+    unsigned int middle = (begin + end) / 2;
+    std::nth_element(instances_.begin() + begin, instances_.begin() + middle,
+                     instances_.begin() + end,
+                     [axis](const Instance& a, const Instance& b) {
+                         return a.bounds.min[axis] + a.bounds.max[axis] <
+                                b.bounds.min[axis] + b.bounds.max[axis];
+                     });
+
+    unsigned int left = nodes_.size();
+    nodes_.resize(left + 2);
+    nodes_[node].first = left;
+    nodes_[node].count = 0;
+    BuildNode(left, begin, middle);
+    BuildNode(left + 1, middle, end);
+}
+
+bool SceneBvh::Intersect(const Ray& ray, RayHit* hit) const {
+    return Traverse(nodes_, ray, hit, [this](const BvhNode& leaf,
+                                             const Ray& ray, RayHit* hit) {
+        bool found = false;
+        for (unsigned int i = leaf.first; i < leaf.first + leaf.count; i++) {
+            const Instance& instance = instances_[i];
+            // Affine transforms keep the ray parameter, so distances compare
+            // directly across instances.
+            float origin[4], direction[4];
+            instance.inverse_model_matrix.Transform(
+                ray.origin[0], ray.origin[1], ray.origin[2], 1, origin);
+            instance.inverse_model_matrix.Transform(
+                ray.direction[0], ray.direction[1], ray.direction[2], 0,
+                direction);
+            Ray local = {{origin[0], origin[1], origin[2]},
+                         {direction[0], direction[1], direction[2]}};
+            if (instance.mesh->Intersect(local, hit)) {
+                hit->instance = instance.id;
+                found = true;
+            }
+        }
+        return found;
+    });
+}
@@ -0,0 +1,85 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+#include "bounds.h"
+#include "matma.h"
+#include "vertices.h"
+
+struct Ray {
+    float origin[3];
+    float direction[3]; // need not be normalized
+};
+
+struct RayHit {
+    float distance;        // along the ray, in multiples of its direction
+    unsigned int triangle; // index into the mesh's triangle list
+    unsigned int instance; // id passed to SceneBvh::AddInstance
+};
+
+struct BvhNode {
+    float min[3];
+    unsigned int first; // left child (right is first + 1), or first packet
+    float max[3];
+    unsigned int count; // packets or instances in a leaf, 0 for inner nodes
+};
+
+// Bounding volume hierarchy over one mesh. Built top-down with a binned
+// surface area heuristic; big subtrees are built in parallel on the job
+// system. Leaves keep their triangles in packets of four, laid out so that
+// one SSE Moller-Trumbore test covers a whole packet.
+class MeshBvh {
+  public:
+    MeshBvh();
+    void Build(const ColorVertex* vertices, const Triangle* triangles,
+               unsigned int triangle_count);
+    // Returns true and updates hit if a triangle is closer than
+    // hit->distance. Rays are in model space.
+    bool Intersect(const Ray& ray, RayHit* hit) const;
+
+    bool empty() const { return nodes_.empty(); }
+    const Aabb& bounds() const { return bounds_; }
+    unsigned int NodeCount() const { return nodes_.size(); }
+    unsigned int TriangleCount() const { return triangle_count_; }
+
+  private:
+    struct alignas(16) Packet {
+        float v0[3][4];    // x, y, z of the first vertex, one lane each
+        float edge1[3][4]; // v1 - v0
+        float edge2[3][4]; // v2 - v0
+        unsigned int triangles[4];
+    };
+    class Builder;
+
+    std::vector<BvhNode> nodes_;
+    std::vector<Packet> packets_;
+    Aabb bounds_;
+    unsigned int triangle_count_;
+};
+
+// Top level hierarchy over placed meshes. Rays are moved into each
+// instance's model space, so meshes are shared between instances.
+class SceneBvh {
+  public:
+    void Clear();
+    void AddInstance(const MeshBvh* mesh, const Mat4& model_matrix,
+                     unsigned int id);
+    void Build();
+    bool Intersect(const Ray& ray, RayHit* hit) const;
+    unsigned int InstanceCount() const { return instances_.size(); }
+
+  private:
+    struct Instance {
+        const MeshBvh* mesh;
+        Mat4 inverse_model_matrix;
+        Aabb bounds; // world space
+        unsigned int id;
+    };
+    void BuildNode(unsigned int node, unsigned int begin, unsigned int end);
+
+    std::vector<Instance> instances_;
+    std::vector<BvhNode> nodes_;
+};
+
+#endif // BVH_H
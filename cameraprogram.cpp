@@ -2,21 +2,43 @@
 using namespace std;
 
 #include "cameraprogram.h"
+#include "multiview.h"
 
 #include <GLFW/glfw3.h>
 
 
-void CameraProgram::Initialize(const char *vertex_shader_file, const char *fragment_shader_file){
+void CameraProgram::Initialize(const char* vertex_shader_file,
+                               const char* fragment_shader_file,
+                               const std::string& defines) {
 
-    BaseProgram::Initialize(vertex_shader_file, fragment_shader_file);
+    BaseProgram::Initialize(vertex_shader_file, fragment_shader_file, defines);
+    GLuint views = failed() ? GL_INVALID_INDEX
+                            : glGetUniformBlockIndex(program_, "Views");
+    multi_view_ = views != GL_INVALID_INDEX;
+    if (multi_view_) {
+        // The matrices come from MultiView's uniform buffer instead
+        glUniformBlockBinding(program_, views, MultiView::kBinding);
+        projection_matrix_location_ = view_matrix_location_ = -1;
+        viewport_height_location_ = -1;
+        return;
+    }
     projection_matrix_location_ = GetUniformLocationOrDie("projection_matrix");
     view_matrix_location_ = GetUniformLocationOrDie("view_matrix");
+    viewport_height_location_ = GetUniformLocation("viewport_height");
 }
 
-void CameraProgram::SetProjectionMatrix(const Mat4 & matrix) const{
-    glUniformMatrix4fv(projection_matrix_location_, 1, GL_FALSE, matrix);
+void CameraProgram::SetProjectionMatrix(const Mat4& matrix,
+                                        CommandList* commands) const {
+    commands->SetMatrix(projection_matrix_location_, matrix);
 }
 
-void CameraProgram::SetViewMatrix(const Mat4 & matrix) const{
-    glUniformMatrix4fv(view_matrix_location_, 1, GL_FALSE, matrix);
+void CameraProgram::SetViewMatrix(const Mat4& matrix,
+                                  CommandList* commands) const {
+    commands->SetMatrix(view_matrix_location_, matrix);
+}
+
+void CameraProgram::SetViewportHeight(GLsizei height,
+                                      CommandList* commands) const {
+    if (viewport_height_location_ >= 0)
+        commands->SetInteger(viewport_height_location_, height);
 }
@@ -4,18 +4,28 @@
 #include <GL/glew.h>
 
 #include "baseprogram.h"
+#include "commandlist.h"
 #include "matma.h"
 
 
 class CameraProgram : public BaseProgram
 {
 public:
-    void Initialize(const char* vertex_shader_file, const char* fragment_shader_file);
-    void SetViewMatrix(const Mat4 &) const;
-    void SetProjectionMatrix(const Mat4 &) const;
+    void Initialize(const char* vertex_shader_file,
+                    const char* fragment_shader_file,
+                    const std::string& defines = "") override;
+    // Record into the frame; the program must be in use by then
+    void SetViewMatrix(const Mat4&, CommandList* commands) const;
+    void SetProjectionMatrix(const Mat4&, CommandList* commands) const;
+    // In pixels; only tessellating programs use it, to size their edges
+    void SetViewportHeight(GLsizei height, CommandList* commands) const;
+    // Draws every MultiView view at once; the setters above do nothing
+    bool multi_view() const { return multi_view_; }
 private:
-    GLuint projection_matrix_location_;
-    GLuint view_matrix_location_;
+    GLint projection_matrix_location_;
+    GLint view_matrix_location_;
+    GLint viewport_height_location_; // -1 if not used
+    bool multi_view_;
 };
 
 #endif // CAMERAPROGRAM_H
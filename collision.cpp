@@ -0,0 +1,594 @@
+#include "collision.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "jobsystem.h"
+
+namespace {
+
+const int kMaxGjkIterations = 64;
+const int kMaxEpaIterations = 64;
+const int kMaxEpaVertices = 4 + kMaxEpaIterations;
+const int kMaxEpaFaces = 2 * kMaxEpaVertices;
+// EPA stops once the support point is this close to the nearest face
+const float kEpaTolerance = 1e-4f;
+const float kEpsilon = 1e-12f;
+// Items per job in both phases
+const unsigned int kBroadphaseGrain = 1024;
+const unsigned int kNarrowphaseGrain = 256;
+// Per axis of the broadphase grid
+const unsigned int kMaxGridColumns = 1024;
+
+struct Vec3 {
+    float x, y, z;
+};
+
+inline Vec3 operator+(Vec3 a, Vec3 b) {
+    return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+inline Vec3 operator-(Vec3 a, Vec3 b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+inline Vec3 operator-(Vec3 a) { return {-a.x, -a.y, -a.z}; }
+inline Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+inline float Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 Cross(Vec3 a, Vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x};
+}
+inline float LengthSquared(Vec3 a) { return Dot(a, a); }
+
+// Support of a posed shape: the direction goes into model space through the
+// transposed linear part, the vertex comes back through the full matrix.
+Vec3 WorldSupport(const ConvexShape& shape, const float* m, Vec3 d) {
+    float local[3] = {m[0] * d.x + m[1] * d.y + m[2] * d.z,
+                      m[4] * d.x + m[5] * d.y + m[6] * d.z,
+                      m[8] * d.x + m[9] * d.y + m[10] * d.z};
+    float p[3];
+    shape.Support(local, p);
+    return {m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+            m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+            m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]};
+}
+
+// A - B; the shapes overlap exactly when it contains the origin
+struct MinkowskiDifference {
+    const ConvexShape& a;
+    const float* a_matrix;
+    const ConvexShape& b;
+    const float* b_matrix;
+
+    Vec3 Support(Vec3 d) const {
+        return WorldSupport(a, a_matrix, d) - WorldSupport(b, b_matrix, -d);
+    }
+};
+
+// points[0] is always the most recently added point
+struct Simplex {
+    Vec3 points[4];
+    int size;
+
+    void PushFront(Vec3 point) {
+        for (int i = size; i > 0; i--)
+            points[i] = points[i - 1];
+        points[0] = point;
+        size++;
+    }
+    void Set(Vec3 a, Vec3 b) {
+        points[0] = a;
+        points[1] = b;
+        size = 2;
+    }
+    void Set(Vec3 a, Vec3 b, Vec3 c) {
+        Set(a, b);
+        points[2] = c;
+        size = 3;
+    }
+};
+
+// Each case keeps the feature nearest to the origin and aims the next search
+// at the origin from it. Only the tetrahedron can enclose the origin.
+bool LineCase(Simplex* simplex, Vec3* direction) {
+    Vec3 a = simplex->points[0], b = simplex->points[1];
+    Vec3 ab = b - a, ao = -a;
+    if (Dot(ab, ao) > 0) {
+        *direction = Cross(Cross(ab, ao), ab);
+    } else {
+        simplex->size = 1;
+        *direction = ao;
+    }
+    return false;
+}
+
+bool TriangleCase(Simplex* simplex, Vec3* direction) {
+    Vec3 a = simplex->points[0], b = simplex->points[1],
+         c = simplex->points[2];
+    Vec3 ab = b - a, ac = c - a, ao = -a;
+    Vec3 abc = Cross(ab, ac);
+    if (Dot(Cross(abc, ac), ao) > 0) {
+        if (Dot(ac, ao) > 0) {
+            simplex->Set(a, c);
+            *direction = Cross(Cross(ac, ao), ac);
+            return false;
+        }
+        simplex->Set(a, b);
+        return LineCase(simplex, direction);
+    }
+    if (Dot(Cross(ab, abc), ao) > 0) {
+        simplex->Set(a, b);
+        return LineCase(simplex, direction);
+    }
+    // Keep the winding so that the normal faces the origin
+    if (Dot(abc, ao) > 0) {
+        *direction = abc;
+    } else {
+        simplex->Set(a, c, b);
+        *direction = -abc;
+    }
+    return false;
+}
+
+bool TetrahedronCase(Simplex* simplex, Vec3* direction) {
+    Vec3 a = simplex->points[0], b = simplex->points[1],
+         c = simplex->points[2], d = simplex->points[3];
+    Vec3 ab = b - a, ac = c - a, ad = d - a, ao = -a;
+    // The base bcd was the previous triangle, the origin is not behind it
+    if (Dot(Cross(ab, ac), ao) > 0) {
+        simplex->Set(a, b, c);
+        return TriangleCase(simplex, direction);
+    }
+    if (Dot(Cross(ac, ad), ao) > 0) {
+        simplex->Set(a, c, d);
+        return TriangleCase(simplex, direction);
+    }
+    if (Dot(Cross(ad, ab), ao) > 0) {
+        simplex->Set(a, d, b);
+        return TriangleCase(simplex, direction);
+    }
+    return true;
+}
+
+bool Gjk(const MinkowskiDifference& shape, Vec3 direction, Simplex* simplex) {
+    if (LengthSquared(direction) < kEpsilon)
+        direction = {1, 0, 0};
+    simplex->size = 0;
+    simplex->PushFront(shape.Support(direction));
+    direction = -simplex->points[0];
+    for (int i = 0; i < kMaxGjkIterations; i++) {
+        // The origin lies on the simplex, so the shapes at least touch
+        if (LengthSquared(direction) < kEpsilon)
+            return true;
+        Vec3 point = shape.Support(direction);
+        if (Dot(point, direction) <= 0)
+            return false;
+        simplex->PushFront(point);
+        bool enclosed;
+        if (simplex->size == 2)
+            enclosed = LineCase(simplex, &direction);
+        else if (simplex->size == 3)
+            enclosed = TriangleCase(simplex, &direction);
+        else
+            enclosed = TetrahedronCase(simplex, &direction);
+        if (enclosed)
+            return true;
+    }
+    return false;
+}
+
+// GJK can stop on a point, segment or triangle when the origin lies on it.
+// EPA needs a solid start, so search for support points off that feature.
+bool CompleteTetrahedron(const MinkowskiDifference& shape, Simplex* simplex) {
+    const Vec3 kAxes[3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    const float kMinOffset = 1e-6f;
+    if (simplex->size == 1) {
+        for (int i = 0; i < 6 && simplex->size == 1; i++) {
+            Vec3 point = shape.Support(i < 3 ? kAxes[i] : -kAxes[i - 3]);
+            if (LengthSquared(point - simplex->points[0]) > kMinOffset)
+                simplex->PushFront(point);
+        }
+    }
+    if (simplex->size == 2) {
+        Vec3 line = simplex->points[0] - simplex->points[1];
+        for (int i = 0; i < 6 && simplex->size == 2; i++) {
+            Vec3 side = Cross(line, kAxes[i % 3]);
+            if (i >= 3)
+                side = -side;
+            if (LengthSquared(side) < kEpsilon)
+                continue;
+            Vec3 point = shape.Support(side);
+            Vec3 away = Cross(point - simplex->points[1], line);
+            if (LengthSquared(away) > kMinOffset * LengthSquared(line))
+                simplex->PushFront(point);
+        }
+    }
+    if (simplex->size == 3) {
+        Vec3 normal = Cross(simplex->points[1] - simplex->points[0],
+                            simplex->points[2] - simplex->points[0]);
+        for (int i = 0; i < 2 && simplex->size == 3; i++) {
+            Vec3 point = shape.Support(i ? -normal : normal);
+            float height = Dot(point - simplex->points[0], normal);
+            if (height * height > kMinOffset * LengthSquared(normal))
+                simplex->PushFront(point);
+        }
+    }
+    return simplex->size == 4;
+}
+
+struct EpaFace {
+    int a, b, c;
+    Vec3 normal; // unit, pointing out of the polytope
+    float distance;
+};
+
+// Expands the polytope towards the boundary of the Minkowski difference until
+// the face nearest to the origin is part of it.
+bool Epa(const MinkowskiDifference& shape, const Simplex& simplex,
+         Vec3* normal, float* depth) {
+    Vec3 vertices[kMaxEpaVertices];
+    EpaFace faces[kMaxEpaFaces];
+    int vertex_count = 4, face_count = 0;
+    Vec3 inside = {0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        vertices[i] = simplex.points[i];
+        inside = inside + vertices[i] * 0.25f;
+    }
+
+    // The polytope stays convex and keeps the starting centroid inside, so
+    // that point orients every face.
+    auto add_face = [&](int a, int b, int c) {
+        Vec3 n = Cross(vertices[b] - vertices[a], vertices[c] - vertices[a]);
+        float length_squared = LengthSquared(n);
+        if (length_squared < kEpsilon || face_count == kMaxEpaFaces)
+            return;
+        n = n * (1.0f / std::sqrt(length_squared));
+        if (Dot(n, vertices[a] - inside) < 0) {
+            n = -n;
+            std::swap(b, c);
+        }
+        faces[face_count++] = {a, b, c, n, Dot(n, vertices[a])};
+    };
+    add_face(0, 1, 2);
+    add_face(0, 3, 1);
+    add_face(0, 2, 3);
+    add_face(1, 3, 2);
+    if (face_count < 4)
+        return false;
+
+    int nearest = 0;
+    for (int iteration = 0; iteration < kMaxEpaIterations; iteration++) {
+        nearest = 0;
+        for (int i = 1; i < face_count; i++)
+            if (faces[i].distance < faces[nearest].distance)
+                nearest = i;
+        Vec3 point = shape.Support(faces[nearest].normal);
+        if (Dot(point, faces[nearest].normal) - faces[nearest].distance <
+                kEpaTolerance ||
+            vertex_count == kMaxEpaVertices)
+            break;
+
+        // Remove every face that sees the new point; the edges used by just
+        // one removed face form the horizon that gets stitched to it.
+        int horizon[3 * kMaxEpaFaces][2];
+        int horizon_count = 0;
+        for (int i = face_count - 1; i >= 0; i--) {
+            if (Dot(faces[i].normal, point - vertices[faces[i].a]) <= 0)
+                continue;
+            int corners[3] = {faces[i].a, faces[i].b, faces[i].c};
+            for (int e = 0; e < 3; e++) {
+                int from = corners[e], to = corners[(e + 1) % 3];
+                int shared = -1;
+                for (int h = 0; h < horizon_count; h++)
+                    if (horizon[h][0] == to && horizon[h][1] == from)
+                        shared = h;
+                if (shared >= 0) {
+                    horizon[shared][0] = horizon[horizon_count - 1][0];
+                    horizon[shared][1] = horizon[horizon_count - 1][1];
+                    horizon_count--;
+                } else {
+                    horizon[horizon_count][0] = from;
+                    horizon[horizon_count][1] = to;
+                    horizon_count++;
+                }
+            }
+            faces[i] = faces[--face_count];
+        }
+        vertices[vertex_count] = point;
+        for (int h = 0; h < horizon_count; h++)
+            add_face(horizon[h][0], horizon[h][1], vertex_count);
+        vertex_count++;
+        if (face_count == 0)
+            return false;
+    }
+    nearest = 0;
+    for (int i = 1; i < face_count; i++)
+        if (faces[i].distance < faces[nearest].distance)
+            nearest = i;
+    *normal = faces[nearest].normal;
+    *depth = faces[nearest].distance;
+    return true;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+} // namespace
+
+ConvexShape::ConvexShape(const ColorVertex* vertices, unsigned int count) {
+    bounds_ = ComputeAabb(vertices, count);
+    for (unsigned int i = 0; i < count; i++) {
+        const float* p = vertices[i].position;
+        bool duplicate = false;
+        for (unsigned int j = 0; j < points_.size() && !duplicate; j += 3)
+            duplicate = points_[j] == p[0] && points_[j + 1] == p[1] &&
+                        points_[j + 2] == p[2];
+        if (!duplicate)
+            points_.insert(points_.end(), p, p + 3);
+    }
+}
+
+void ConvexShape::Support(const float direction[3], float out[3]) const {
+    unsigned int best = 0;
+    float best_distance = -INFINITY;
+    for (unsigned int i = 0; i < points_.size(); i += 3) {
+        float distance = points_[i] * direction[0] +
+                         points_[i + 1] * direction[1] +
+                         points_[i + 2] * direction[2];
+        if (distance > best_distance) {
+            best_distance = distance;
+            best = i;
+        }
+    }
+    out[0] = points_[best];
+    out[1] = points_[best + 1];
+    out[2] = points_[best + 2];
+}
+
+bool CollideConvex(const ConvexShape& a, const Mat4& a_model_matrix,
+                   const ConvexShape& b, const Mat4& b_model_matrix,
+                   Contact* contact) {
+    const float* a_matrix = a_model_matrix;
+    const float* b_matrix = b_model_matrix;
+    MinkowskiDifference difference = {a, a_matrix, b, b_matrix};
+    // Start along the line between the origins of the two models
+    Vec3 direction = {b_matrix[12] - a_matrix[12], b_matrix[13] - a_matrix[13],
+                      b_matrix[14] - a_matrix[14]};
+    Simplex simplex;
+    if (!Gjk(difference, direction, &simplex))
+        return false;
+    Vec3 normal;
+    float depth;
+    if (!CompleteTetrahedron(difference, &simplex) ||
+        !Epa(difference, simplex, &normal, &depth) || depth <= 0)
+        return false;
+    contact->normal[0] = normal.x;
+    contact->normal[1] = normal.y;
+    contact->normal[2] = normal.z;
+    contact->depth = depth;
+    return true;
+}
+
+CollisionWorld::CollisionWorld() : scratch_(1) {
+    axis_ = 0;
+    stats_ = Stats();
+}
+
+void CollisionWorld::Clear() {
+    bodies_.clear();
+    entries_.clear();
+    pairs_.clear();
+    contacts_.clear();
+    stats_ = Stats();
+}
+
+unsigned int CollisionWorld::AddBody(const ConvexShape* shape,
+                                     const Mat4& model_matrix) {
+    Body body;
+    body.shape = shape;
+    body.model_matrix = model_matrix;
+    body.bounds = TransformAabb(shape->bounds(), model_matrix);
+    bodies_.push_back(body);
+    return bodies_.size() - 1;
+}
+
+void CollisionWorld::SetModelMatrix(unsigned int body,
+                                    const Mat4& model_matrix) {
+    bodies_[body].model_matrix = model_matrix;
+}
+
+// Sweeping along the axis with the most spread keeps the candidate runs
+// short (Gottschalk's variance heuristic).
+void CollisionWorld::ChooseSweepAxis() {
+    double sum[3] = {0, 0, 0}, sum_squares[3] = {0, 0, 0};
+    for (const Body& body : bodies_)
+        for (int k = 0; k < 3; k++) {
+            double centre = 0.5 * (body.bounds.min[k] + body.bounds.max[k]);
+            sum[k] += centre;
+            sum_squares[k] += centre * centre;
+        }
+    double best = -1;
+    for (int k = 0; k < 3; k++) {
+        double variance = sum_squares[k] - sum[k] * sum[k] / bodies_.size();
+        if (variance > best) {
+            best = variance;
+            axis_ = k;
+        }
+    }
+}
+
+void CollisionWorld::FindPairs() {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    unsigned int count = bodies_.size();
+    pairs_.clear();
+    // Nothing may point into the last update's scratch once it is released
+    chunk_pairs_.clear();
+    chunk_contacts_.clear();
+    scratch_.NextFrame();
+    stats_.bodies = count;
+    if (count == 0) {
+        stats_.candidate_pairs = 0;
+        stats_.broadphase_seconds = 0;
+        return;
+    }
+    JobSystem& jobs = JobSystem::Instance();
+    jobs.ParallelFor(count, kBroadphaseGrain,
+                     [this](unsigned int begin, unsigned int end) {
+                         for (unsigned int i = begin; i < end; i++)
+                             bodies_[i].bounds = TransformAabb(
+                                 bodies_[i].shape->bounds(),
+                                 bodies_[i].model_matrix);
+                     });
+    ChooseSweepAxis();
+
+    // A single sweep over a 3D crowd compares every body with a whole slab
+    // of others. Splitting space into columns along the sweep axis, about
+    // two boxes wide, keeps each sweep local.
+    const int grid_axes[2] = {(axis_ + 1) % 3, (axis_ + 2) % 3};
+    float low[2] = {INFINITY, INFINITY}, high[2] = {-INFINITY, -INFINITY};
+    float mean_size = 0;
+    for (const Body& body : bodies_)
+        for (int g = 0; g < 2; g++) {
+            low[g] = std::min(low[g], body.bounds.min[grid_axes[g]]);
+            high[g] = std::max(high[g], body.bounds.max[grid_axes[g]]);
+            mean_size += body.bounds.max[grid_axes[g]] -
+                         body.bounds.min[grid_axes[g]];
+        }
+    mean_size /= 2 * count;
+    // No more columns than bodies, however small the boxes are
+    float cell = std::max(
+        {2 * mean_size, std::sqrt((high[0] - low[0]) * (high[1] - low[1]) /
+                                  count),
+         1e-6f});
+    unsigned int columns[2];
+    for (int g = 0; g < 2; g++)
+        columns[g] = std::min(kMaxGridColumns,
+                              (unsigned int)((high[g] - low[g]) / cell) + 1);
+    unsigned int cell_count = columns[0] * columns[1];
+    auto column = [&](float coordinate, int g) {
+        int index = (int)((coordinate - low[g]) / cell);
+        return (unsigned int)std::max(0, std::min(index, (int)columns[g] - 1));
+    };
+
+    // Counting sort of body references into every cell their box touches
+    cell_starts_.assign(cell_count + 1, 0);
+    for (const Body& body : bodies_) {
+        unsigned int u0 = column(body.bounds.min[grid_axes[0]], 0);
+        unsigned int u1 = column(body.bounds.max[grid_axes[0]], 0);
+        unsigned int v0 = column(body.bounds.min[grid_axes[1]], 1);
+        unsigned int v1 = column(body.bounds.max[grid_axes[1]], 1);
+        for (unsigned int v = v0; v <= v1; v++)
+            for (unsigned int u = u0; u <= u1; u++)
+                cell_starts_[v * columns[0] + u + 1]++;
+    }
+    for (unsigned int c = 0; c < cell_count; c++)
+        cell_starts_[c + 1] += cell_starts_[c];
+    entries_.resize(cell_starts_[cell_count]);
+    FrameVector<unsigned int> cursor(
+        cell_starts_.begin(), cell_starts_.end() - 1,
+        FrameAllocator<unsigned int>(&scratch_.Local()));
+    for (unsigned int i = 0; i < count; i++) {
+        const Aabb& box = bodies_[i].bounds;
+        unsigned int u0 = column(box.min[grid_axes[0]], 0);
+        unsigned int u1 = column(box.max[grid_axes[0]], 0);
+        unsigned int v0 = column(box.min[grid_axes[1]], 1);
+        unsigned int v1 = column(box.max[grid_axes[1]], 1);
+        for (unsigned int v = v0; v <= v1; v++)
+            for (unsigned int u = u0; u <= u1; u++)
+                entries_[cursor[v * columns[0] + u]++] =
+                    std::make_pair(box.min[axis_], i);
+    }
+
+    // Sweep each cell: a body is compared with the ones starting before it
+    // ends on the sweep axis. A pair sharing several cells is only reported
+    // by the one holding the lower corner of the boxes' overlap.
+    unsigned int grain =
+        std::max(1u, (unsigned int)((unsigned long long)cell_count *
+                                    kBroadphaseGrain / entries_.size()));
+    chunk_pairs_.resize((cell_count + grain - 1) / grain);
+    jobs.ParallelFor(cell_count, grain, [&](unsigned int begin,
+                                            unsigned int end) {
+        FrameVector<std::pair<unsigned int, unsigned int>>& out =
+            chunk_pairs_[begin / grain];
+        out = FrameVector<std::pair<unsigned int, unsigned int>>(
+            FrameAllocator<std::pair<unsigned int, unsigned int>>(
+                &scratch_.Local()));
+        for (unsigned int c = begin; c < end; c++) {
+            std::pair<float, unsigned int>* first = &entries_[cell_starts_[c]];
+            std::pair<float, unsigned int>* last =
+                &entries_[0] + cell_starts_[c + 1];
+            std::sort(first, last);
+            for (std::pair<float, unsigned int>* s = first; s < last; s++) {
+                unsigned int i = s->second;
+                const Aabb& box = bodies_[i].bounds;
+                for (std::pair<float, unsigned int>* t = s + 1;
+                     t < last && t->first <= box.max[axis_]; t++) {
+                    unsigned int j = t->second;
+                    const Aabb& other = bodies_[j].bounds;
+                    bool apart = false;
+                    for (int g = 0; g < 2; g++)
+                        apart = apart ||
+                                other.min[grid_axes[g]] >
+                                    box.max[grid_axes[g]] ||
+                                other.max[grid_axes[g]] < box.min[grid_axes[g]];
+                    if (apart)
+                        continue;
+                    unsigned int owner =
+                        column(std::max(box.min[grid_axes[1]],
+                                        other.min[grid_axes[1]]),
+                               1) *
+                            columns[0] +
+                        column(std::max(box.min[grid_axes[0]],
+                                        other.min[grid_axes[0]]),
+                               0);
+                    if (owner != c)
+                        continue;
+                    out.push_back(i < j ? std::make_pair(i, j)
+                                        : std::make_pair(j, i));
+                }
+            }
+        }
+    });
+    for (const FrameVector<std::pair<unsigned int, unsigned int>>& chunk :
+         chunk_pairs_)
+        pairs_.insert(pairs_.end(), chunk.begin(), chunk.end());
+    stats_.candidate_pairs = pairs_.size();
+    stats_.broadphase_seconds = SecondsSince(start);
+}
+
+void CollisionWorld::Update() {
+    FindPairs();
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    contacts_.clear();
+    chunk_contacts_.resize((pairs_.size() + kNarrowphaseGrain - 1) /
+                           kNarrowphaseGrain);
+    JobSystem::Instance().ParallelFor(
+        pairs_.size(), kNarrowphaseGrain,
+        [this](unsigned int begin, unsigned int end) {
+            FrameVector<Contact>& out =
+                chunk_contacts_[begin / kNarrowphaseGrain];
+            out = FrameVector<Contact>(
+                FrameAllocator<Contact>(&scratch_.Local()));
+            out.reserve(end - begin); // at most one contact per pair
+            for (unsigned int p = begin; p < end; p++) {
+                const Body& a = bodies_[pairs_[p].first];
+                const Body& b = bodies_[pairs_[p].second];
+                Contact contact;
+                if (!CollideConvex(*a.shape, a.model_matrix, *b.shape,
+                                   b.model_matrix, &contact))
+                    continue;
+                contact.a = pairs_[p].first;
+                contact.b = pairs_[p].second;
+                out.push_back(contact);
+            }
+        });
+    for (const FrameVector<Contact>& chunk : chunk_contacts_)
+        contacts_.insert(contacts_.end(), chunk.begin(), chunk.end());
+    stats_.contacts = contacts_.size();
+    stats_.narrowphase_seconds = SecondsSince(start);
+}
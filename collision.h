@@ -0,0 +1,97 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <utility>
+#include <vector>
+
+#include "bounds.h"
+#include "framearena.h"
+#include "matma.h"
+#include "vertices.h"
+
+// Convex hull of a vertex table as GJK sees it: the support point in any
+// direction is always one of the table's vertices, so the hull never has to
+// be built explicitly and concave models collide as their hull.
+class ConvexShape {
+  public:
+    ConvexShape(const ColorVertex* vertices, unsigned int count);
+    // Farthest vertex along direction, in model space
+    void Support(const float direction[3], float out[3]) const;
+    const Aabb& bounds() const { return bounds_; }
+
+  private:
+    std::vector<float> points_; // x, y, z per vertex
+    Aabb bounds_;
+};
+
+struct Contact {
+    unsigned int a, b; // body indices, a < b
+    float normal[3];   // unit, pointing from a towards b
+    float depth;       // moving b this far along normal separates the pair
+};
+
+// GJK overlap test of two posed shapes followed by EPA for the penetration
+// normal and depth. Returns false when they are apart or merely touching;
+// contact->a and contact->b are left to the caller.
+bool CollideConvex(const ConvexShape& a, const Mat4& a_model_matrix,
+                   const ConvexShape& b, const Mat4& b_model_matrix,
+                   Contact* contact);
+
+// Many moving convex bodies. Update() runs a sweep-and-prune broadphase over
+// the world AABBs, split into grid cells across the sweep axis, and GJK/EPA on
+// the surviving pairs; both phases are spread over the job system.
+class CollisionWorld {
+  public:
+    struct Stats {
+        unsigned int bodies;
+        unsigned int candidate_pairs; // overlapping AABBs
+        unsigned int contacts;
+        double broadphase_seconds;
+        double narrowphase_seconds;
+    };
+
+    CollisionWorld();
+    void Clear();
+    unsigned int AddBody(const ConvexShape* shape, const Mat4& model_matrix);
+    void SetModelMatrix(unsigned int body, const Mat4& model_matrix);
+    // Broadphase only; fills pairs()
+    void FindPairs();
+    // FindPairs() followed by the narrowphase; fills contacts()
+    void Update();
+
+    unsigned int BodyCount() const { return bodies_.size(); }
+    const std::vector<std::pair<unsigned int, unsigned int>>& pairs() const {
+        return pairs_;
+    }
+    const std::vector<Contact>& contacts() const { return contacts_; }
+    const Stats& stats() const { return stats_; }
+    const ThreadFrameArenas& scratch() const { return scratch_; }
+
+  private:
+    struct Body {
+        const ConvexShape* shape;
+        Mat4 model_matrix;
+        Aabb bounds; // world space, refreshed by FindPairs
+    };
+
+    void ChooseSweepAxis();
+
+    std::vector<Body> bodies_;
+    // Broadphase grid: body references grouped by cell, each group sorted
+    // by the lower end of the box along the sweep axis
+    std::vector<std::pair<float, unsigned int>> entries_;
+    std::vector<unsigned int> cell_starts_;
+    int axis_;
+    std::vector<std::pair<unsigned int, unsigned int>> pairs_;
+    std::vector<Contact> contacts_;
+    // Per-job outputs, concatenated in job order so results are repeatable.
+    // They and the broadphase temporaries live in each thread's scratch
+    // arena, which FindPairs() releases.
+    std::vector<FrameVector<std::pair<unsigned int, unsigned int>>>
+        chunk_pairs_;
+    std::vector<FrameVector<Contact>> chunk_contacts_;
+    ThreadFrameArenas scratch_;
+    Stats stats_;
+};
+
+#endif // COLLISION_H
@@ -0,0 +1,209 @@
+#include "commandlist.h"
+
+#include <cstring>
+
+// Enough for a frame of the crowd without growing
+const size_t kInitialCommands = 8192;
+
+CommandList::CommandList() { commands_.reserve(kInitialCommands); }
+
+CommandList::Command& CommandList::Append(Op op) {
+    commands_.emplace_back();
+    Command& command = commands_.back();
+    command.op = op;
+    return command;
+}
+
+void CommandList::Clear(GLbitfield mask) { Append(ClearOp).mask = mask; }
+
+void CommandList::Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    Command& command = Append(ViewportOp);
+    command.rectangle[0] = x;
+    command.rectangle[1] = y;
+    command.rectangle[2] = width;
+    command.rectangle[3] = height;
+}
+
+void CommandList::ViewportIndexed(GLuint index, GLint x, GLint y,
+                                  GLsizei width, GLsizei height) {
+    Command& command = Append(ViewportIndexedOp);
+    command.viewport.index = index;
+    command.viewport.rectangle[0] = x;
+    command.viewport.rectangle[1] = y;
+    command.viewport.rectangle[2] = width;
+    command.viewport.rectangle[3] = height;
+}
+
+void CommandList::UseProgram(GLuint program) {
+    Append(UseProgramOp).name = program;
+}
+
+void CommandList::BindVertexArray(GLuint vao) {
+    Append(BindVertexArrayOp).name = vao;
+}
+
+void CommandList::BindTexture(GLenum unit, GLuint texture) {
+    Command& command = Append(BindTextureOp);
+    command.texture.unit = unit;
+    command.texture.texture = texture;
+}
+
+void CommandList::SetMatrix(GLint location, const Mat4& matrix) {
+    Command& command = Append(SetMatrixOp);
+    command.matrix.location = location;
+    memcpy(command.matrix.values, (const float*)matrix,
+           sizeof(command.matrix.values));
+}
+
+void CommandList::SetInteger(GLint location, GLint value) {
+    Command& command = Append(SetIntegerOp);
+    command.integer.location = location;
+    command.integer.value = value;
+}
+
+void CommandList::SetVector(GLint location, const float values[4]) {
+    Command& command = Append(SetVectorOp);
+    command.vector.location = location;
+    memcpy(command.vector.values, values, sizeof(command.vector.values));
+}
+
+void CommandList::UpdateBuffer(GLenum target, GLuint buffer, const void* data,
+                               size_t bytes) {
+    Command& command = Append(UpdateBufferOp);
+    command.upload.target = target;
+    command.upload.buffer = buffer;
+    command.upload.offset = data_.size();
+    command.upload.bytes = bytes;
+    data_.insert(data_.end(), (const unsigned char*)data,
+                 (const unsigned char*)data + bytes);
+}
+
+void CommandList::BindUniformBuffer(GLuint binding, GLuint buffer) {
+    Command& command = Append(BindUniformBufferOp);
+    command.uniform_buffer.binding = binding;
+    command.uniform_buffer.buffer = buffer;
+}
+
+void CommandList::DrawTriangles(GLsizei index_count, size_t first_index) {
+    Command& command = Append(DrawTrianglesOp);
+    command.draw.count = index_count;
+    command.draw.first = first_index;
+}
+
+void CommandList::DrawPatches(GLsizei index_count, size_t first_index) {
+    Command& command = Append(DrawPatchesOp);
+    command.draw.count = index_count;
+    command.draw.first = first_index;
+}
+
+void CommandList::MultiDrawTriangles(const GLsizei* index_counts,
+                                     const size_t* first_indices,
+                                     GLsizei draw_count) {
+    AppendMultiDraw(MultiDrawTrianglesOp, index_counts, first_indices,
+                    draw_count);
+}
+
+void CommandList::MultiDrawPatches(const GLsizei* index_counts,
+                                   const size_t* first_indices,
+                                   GLsizei draw_count) {
+    AppendMultiDraw(MultiDrawPatchesOp, index_counts, first_indices,
+                    draw_count);
+}
+
+void CommandList::AppendMultiDraw(Op op, const GLsizei* index_counts,
+                                  const size_t* first_indices,
+                                  GLsizei draw_count) {
+    Command& command = Append(op);
+    command.multi_draw.draw_count = draw_count;
+    command.multi_draw.counts = data_.size();
+    data_.insert(data_.end(), (const unsigned char*)index_counts,
+                 (const unsigned char*)(index_counts + draw_count));
+    // The pointers are read in place at replay, so they start aligned
+    data_.resize((data_.size() + sizeof(GLvoid*) - 1) / sizeof(GLvoid*) *
+                 sizeof(GLvoid*));
+    command.multi_draw.offsets = data_.size();
+    data_.resize(data_.size() + draw_count * sizeof(GLvoid*));
+    GLvoid** pointers = (GLvoid**)(data_.data() + command.multi_draw.offsets);
+    for (GLsizei i = 0; i < draw_count; i++)
+        pointers[i] = (GLvoid*)(first_indices[i] * sizeof(GLuint));
+}
+
+void CommandList::Call(Callback callback, void* context) {
+    Command& command = Append(CallOp);
+    command.call.callback = callback;
+    command.call.context = context;
+}
+
+void CommandList::Replay() const {
+    for (const Command& command : commands_) {
+        switch (command.op) {
+        case ClearOp:
+            glClear(command.mask);
+            break;
+        case ViewportOp:
+            glViewport(command.rectangle[0], command.rectangle[1],
+                       command.rectangle[2], command.rectangle[3]);
+            break;
+        case ViewportIndexedOp:
+            glViewportIndexedf(command.viewport.index,
+                               command.viewport.rectangle[0],
+                               command.viewport.rectangle[1],
+                               command.viewport.rectangle[2],
+                               command.viewport.rectangle[3]);
+            break;
+        case UseProgramOp:
+            glUseProgram(command.name);
+            break;
+        case BindVertexArrayOp:
+            glBindVertexArray(command.name);
+            break;
+        case BindTextureOp:
+            glActiveTexture(command.texture.unit);
+            glBindTexture(GL_TEXTURE_2D, command.texture.texture);
+            break;
+        case SetMatrixOp:
+            glUniformMatrix4fv(command.matrix.location, 1, GL_FALSE,
+                               command.matrix.values);
+            break;
+        case SetIntegerOp:
+            glUniform1i(command.integer.location, command.integer.value);
+            break;
+        case SetVectorOp:
+            glUniform4fv(command.vector.location, 1, command.vector.values);
+            break;
+        case UpdateBufferOp:
+            glBindBuffer(command.upload.target, command.upload.buffer);
+            glBufferSubData(command.upload.target, 0, command.upload.bytes,
+                            data_.data() + command.upload.offset);
+            break;
+        case BindUniformBufferOp:
+            glBindBufferBase(GL_UNIFORM_BUFFER,
+                             command.uniform_buffer.binding,
+                             command.uniform_buffer.buffer);
+            break;
+        case DrawTrianglesOp:
+            glDrawElements(
+                GL_TRIANGLES, command.draw.count, GL_UNSIGNED_INT,
+                (GLvoid*)(command.draw.first * sizeof(GLuint)));
+            break;
+        case DrawPatchesOp:
+            glDrawElements(
+                GL_PATCHES, command.draw.count, GL_UNSIGNED_INT,
+                (GLvoid*)(command.draw.first * sizeof(GLuint)));
+            break;
+        case MultiDrawTrianglesOp:
+        case MultiDrawPatchesOp:
+            glMultiDrawElements(
+                command.op == MultiDrawTrianglesOp ? GL_TRIANGLES : GL_PATCHES,
+                (const GLsizei*)(data_.data() + command.multi_draw.counts),
+                GL_UNSIGNED_INT,
+                (const GLvoid* const*)(data_.data() +
+                                       command.multi_draw.offsets),
+                command.multi_draw.draw_count);
+            break;
+        case CallOp:
+            command.call.callback(command.call.context);
+            break;
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef COMMANDLIST_H
+#define COMMANDLIST_H
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "matma.h"
+
+// A frame's GL work written down on one thread and replayed on another (or
+// straight after, on the same one). Commands are fixed-size records in a
+// vector that Reset() empties without freeing, so once a list has grown to
+// the size of a frame, recording does not allocate. Data uploaded by the list
+// is copied into it and kept until Reset() the same way.
+class CommandList {
+  public:
+    // For GL work whose arguments are only known on the GL thread, such as
+    // streaming uploads. Runs there, in order with the other commands.
+    typedef void (*Callback)(void* context);
+
+    CommandList();
+    void Reset() {
+        commands_.clear();
+        data_.clear();
+    }
+
+    void Clear(GLbitfield mask);
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    // One of the viewport array, for geometry shaders writing
+    // gl_ViewportIndex
+    void ViewportIndexed(GLuint index, GLint x, GLint y, GLsizei width,
+                         GLsizei height);
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vao);
+    void BindTexture(GLenum unit, GLuint texture); // GL_TEXTURE_2D
+    void SetMatrix(GLint location, const Mat4& matrix);
+    void SetInteger(GLint location, GLint value);
+    void SetVector(GLint location, const float values[4]); // vec4
+    // glBufferSubData from offset 0 with a copy of data; leaves the buffer
+    // bound to target
+    void UpdateBuffer(GLenum target, GLuint buffer, const void* data,
+                      size_t bytes);
+    void BindUniformBuffer(GLuint binding, GLuint buffer);
+    // Triangles from the bound element buffer, first_index counted in indices
+    void DrawTriangles(GLsizei index_count, size_t first_index = 0);
+    // The same indices as 3-vertex patches, for tessellating programs
+    void DrawPatches(GLsizei index_count, size_t first_index = 0);
+    // Several ranges of the element buffer in one glMultiDrawElements, with
+    // copies of the arrays
+    void MultiDrawTriangles(const GLsizei* index_counts,
+                            const size_t* first_indices, GLsizei draw_count);
+    void MultiDrawPatches(const GLsizei* index_counts,
+                          const size_t* first_indices, GLsizei draw_count);
+    void Call(Callback callback, void* context);
+
+    // Needs a current GL context.
+    void Replay() const;
+    size_t size() const { return commands_.size(); }
+    size_t capacity() const { return commands_.capacity(); }
+
+  private:
+    enum Op {
+        ClearOp,
+        ViewportOp,
+        ViewportIndexedOp,
+        UseProgramOp,
+        BindVertexArrayOp,
+        BindTextureOp,
+        SetMatrixOp,
+        SetIntegerOp,
+        SetVectorOp,
+        UpdateBufferOp,
+        BindUniformBufferOp,
+        DrawTrianglesOp,
+        DrawPatchesOp,
+        MultiDrawTrianglesOp,
+        MultiDrawPatchesOp,
+        CallOp,
+    };
+    struct Command {
+        Op op;
+        union {
+            GLbitfield mask;
+            GLint rectangle[4];
+            struct {
+                GLuint index;
+                GLint rectangle[4];
+            } viewport;
+            GLuint name;
+            struct {
+                GLenum unit;
+                GLuint texture;
+            } texture;
+            struct {
+                GLint location;
+                float values[16];
+            } matrix;
+            struct {
+                GLint location;
+                GLint value;
+            } integer;
+            struct {
+                GLint location;
+                float values[4];
+            } vector;
+            struct {
+                GLenum target;
+                GLuint buffer;
+                size_t offset; // into data_
+                size_t bytes;
+            } upload;
+            struct {
+                GLuint binding;
+                GLuint buffer;
+            } uniform_buffer;
+            struct {
+                GLsizei count;
+                size_t first;
+            } draw;
+            struct {
+                GLsizei draw_count;
+                size_t counts;  // offsets into data_
+                size_t offsets; // of the index pointers glMultiDraw* takes
+            } multi_draw;
+            struct {
+                Callback callback;
+                void* context;
+            } call;
+        };
+    };
+
+    Command& Append(Op op);
+    void AppendMultiDraw(Op op, const GLsizei* index_counts,
+                         const size_t* first_indices, GLsizei draw_count);
+
+    std::vector<Command> commands_;
+    std::vector<unsigned char> data_;
+};
+
+#endif // COMMANDLIST_H
@@ -0,0 +1,338 @@
+#include "crowd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "kdron.h"
+
+static const float kSpacing = 0.6f;
+static const float kInstanceScale = 0.5f;
+// The layers nearest to the camera hide most of what is behind them
+static const unsigned int kOccluderLayers = 2;
+// Tumbling: drift speed in units per second and the room left around the block
+static const float kTumbleSpeed = 0.4f;
+static const float kTumbleMargin = 2 * kSpacing;
+// Keyframed: the velocity at which clips play at the speed they were keyed
+static const float kClipVelocity = 15;
+static const float kBobHeight = 0.1f;
+static const float kSquash = 0.15f;
+
+Crowd::Crowd(float init_velocity)
+    : shape_(KDron::kVertices, KDron::kVertexCount) {
+    velocity_ = init_velocity;
+    animated_ = true;
+    culling_ = true;
+    tumbling_ = false;
+    keyframed_ = false;
+    animation_time_ = 0;
+    cull_seconds_ = 0;
+    bounds_ = ComputeAabb(KDron::kVertices, KDron::kVertexCount);
+}
+
+void Crowd::Layout(unsigned int columns, unsigned int rows,
+                   unsigned int layers) {
+    unsigned int count = columns * rows * layers;
+    positions_.resize(count * 3);
+    angles_x_.resize(count);
+    angles_y_.resize(count);
+    spins_.resize(count);
+    model_matrices_.resize(count);
+    velocities_.assign(count * 3, 0);
+    occluders_.clear();
+    draw_list_.clear();
+
+    unsigned int i = 0;
+    for (unsigned int layer = 0; layer < layers; layer++) {
+        // Every other layer is shifted by half a cell to cover the gaps
+        float shift = layer % 2 ? kSpacing / 2 : 0;
+        for (unsigned int row = 0; row < rows; row++)
+            for (unsigned int column = 0; column < columns; column++, i++) {
+                positions_[i * 3] =
+                    (column - (columns - 1) / 2.0f) * kSpacing + shift;
+                positions_[i * 3 + 1] =
+                    (row - (rows - 1) / 2.0f) * kSpacing + shift;
+                positions_[i * 3 + 2] = -(float)layer * kSpacing;
+                angles_x_[i] = (i * 37) % 360;
+                angles_y_[i] = (i * 71) % 360;
+                spins_[i] = 0.5f + (i * 13 % 10) / 10.0f;
+                if (layer < kOccluderLayers)
+                    occluders_.push_back(i);
+            }
+    }
+    for (int k = 0; k < 3; k++) {
+        box_min_[k] = -kTumbleMargin;
+        box_max_[k] = kTumbleMargin;
+    }
+    for (unsigned int j = 0; j < positions_.size(); j++) {
+        float& low = box_min_[j % 3];
+        float& high = box_max_[j % 3];
+        low = std::min(low, positions_[j] - kTumbleMargin);
+        high = std::max(high, positions_[j] + kTumbleMargin);
+    }
+    BuildClips();
+    UpdateModelMatrices();
+    collisions_.Clear();
+    for (unsigned int j = 0; j < count; j++)
+        collisions_.AddBody(&shape_, model_matrices_[j]);
+}
+
+void Crowd::Initialize(unsigned int columns, unsigned int rows,
+                       unsigned int layers) {
+    Layout(columns, rows, layers);
+
+    vao_.Create("crowd");
+    glBindVertexArray(vao_);
+
+    vertex_buffer_.Create(GpuResources::VertexBuffers, "crowd");
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    vertex_buffer_.Allocate(GL_ARRAY_BUFFER, sizeof(KDron::kVertices),
+                            KDron::kVertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ColorVertex),
+                          (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ColorVertex),
+                          (GLvoid*)sizeof(KDron::kVertices[0].position));
+    glEnableVertexAttribArray(1);
+
+    index_buffer_.Create(GpuResources::IndexBuffers, "crowd");
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+    index_buffer_.Allocate(GL_ELEMENT_ARRAY_BUFFER, sizeof(KDron::kIndices),
+                           KDron::kIndices, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    BuildBounds(KDron::kVertices, KDron::kVertexCount);
+
+    std::cout << "Crowd of " << InstanceCount() << " K-drons, "
+              << occluders_.size() << " occluders" << std::endl;
+}
+
+void Crowd::UpdateModelMatrices() {
+    Mat4::CreateRotationsAboutXY(angles_x_.data(), angles_y_.data(),
+                                 model_matrices_.data(),
+                                 model_matrices_.size());
+    for (unsigned int i = 0; i < model_matrices_.size(); i++) {
+        model_matrices_[i].Scale(kInstanceScale, kInstanceScale,
+                                 kInstanceScale);
+        model_matrices_[i].Translate(positions_[i * 3], positions_[i * 3 + 1],
+                                     positions_[i * 3 + 2]);
+    }
+}
+
+// Every instance gets its own copy of the clips, around its place in the
+// block and out of step with its neighbours
+void Crowd::BuildClips() {
+    animation_.Clear();
+    AnimationSet::Clip clip;
+    clip.position_interpolation = AnimationSet::Bezier;
+    clip.rotation_interpolation = AnimationSet::Slerp;
+    clip.scale_interpolation = AnimationSet::Bezier;
+    clip.positions.resize(3);
+    clip.rotations.resize(5);
+    clip.scales.resize(3);
+    for (unsigned int i = 0; i < spins_.size(); i++) {
+        const float* position = &positions_[i * 3];
+        // A loop up and back down, leaving and arriving sideways
+        for (unsigned int k = 0; k < 3; k++) {
+            AnimationSet::VectorKey& key = clip.positions[k];
+            key.time = k * 1.5f;
+            float height = k == 1 ? kBobHeight : 0;
+            float side = k == 1 ? -kBobHeight : kBobHeight;
+            for (int axis = 0; axis < 3; axis++) {
+                key.value[axis] = key.out[axis] = key.in[axis] =
+                    position[axis];
+            }
+            key.value[1] += height;
+            key.out[1] += height;
+            key.in[1] += height;
+            key.out[0] += side;
+            key.in[0] -= side;
+        }
+        // A turn about y in quarters, rocking about x on the way
+        float phase = angles_y_[i];
+        for (unsigned int k = 0; k < 5; k++) {
+            clip.rotations[k].time = k / spins_[i];
+            clip.rotations[k].value =
+                Quat::FromAxisAngle(0, 1, 0, phase + 90.0f * k) *
+                Quat::FromAxisAngle(1, 0, 0, k % 2 ? 25.0f : -25.0f);
+        }
+        // Squashed and stretched, easing in and out of both
+        for (unsigned int k = 0; k < 3; k++) {
+            AnimationSet::VectorKey& key = clip.scales[k];
+            key.time = k * 0.4f;
+            float squash = k == 1 ? kSquash : 0;
+            key.value[0] = key.value[2] = kInstanceScale * (1 + squash);
+            key.value[1] = kInstanceScale * (1 - squash);
+            for (int axis = 0; axis < 3; axis++)
+                key.out[axis] = key.in[axis] = key.value[axis];
+        }
+        animation_.AddObject(clip, (i * 7 % 16) * 0.25f);
+    }
+}
+
+void Crowd::Update(float delta_t) {
+    if (!animated_)
+        return;
+    if (keyframed_) {
+        animation_time_ += delta_t * velocity_ / kClipVelocity;
+        animation_.Evaluate(animation_time_);
+        animation_.BuildMatrices(model_matrices_.data());
+        return;
+    }
+    for (unsigned int i = 0; i < spins_.size(); i++) {
+        angles_x_[i] += velocity_ * spins_[i] * delta_t;
+        angles_y_[i] += velocity_ * spins_[i] * delta_t * 0.7f;
+    }
+    if (tumbling_)
+        Move(delta_t);
+    UpdateModelMatrices();
+    if (tumbling_)
+        ResolveCollisions();
+}
+
+void Crowd::ToggleKeyframed() {
+    keyframed_ = !keyframed_;
+    if (!keyframed_) // back to the spinning angles
+        UpdateModelMatrices();
+}
+
+void Crowd::ToggleTumbling() {
+    tumbling_ = !tumbling_;
+    if (!tumbling_)
+        return;
+    // Fixed pseudo-random headings so every run tumbles the same way
+    for (unsigned int i = 0; i < spins_.size(); i++) {
+        float heading = (i * 137) % 360 * kDegreesToRadians;
+        float pitch = ((i * 59) % 180 - 90.0f) * kDegreesToRadians;
+        velocities_[i * 3] = kTumbleSpeed * std::cos(pitch) * std::cos(heading);
+        velocities_[i * 3 + 1] = kTumbleSpeed * std::sin(pitch);
+        velocities_[i * 3 + 2] =
+            kTumbleSpeed * std::cos(pitch) * std::sin(heading);
+    }
+}
+
+void Crowd::Move(float delta_t) {
+    for (unsigned int j = 0; j < positions_.size(); j++) {
+        positions_[j] += velocities_[j] * delta_t;
+        if (positions_[j] < box_min_[j % 3] && velocities_[j] < 0)
+            velocities_[j] = -velocities_[j];
+        if (positions_[j] > box_max_[j % 3] && velocities_[j] > 0)
+            velocities_[j] = -velocities_[j];
+    }
+}
+
+// Equal masses: overlapping pairs are pushed apart by half the depth each and
+// approaching ones swap their velocities along the contact normal.
+void Crowd::ResolveCollisions() {
+    for (unsigned int i = 0; i < model_matrices_.size(); i++)
+        collisions_.SetModelMatrix(i, model_matrices_[i]);
+    collisions_.Update();
+    for (const Contact& contact : collisions_.contacts()) {
+        float* a_position = &positions_[contact.a * 3];
+        float* b_position = &positions_[contact.b * 3];
+        float* a_velocity = &velocities_[contact.a * 3];
+        float* b_velocity = &velocities_[contact.b * 3];
+        const float* n = contact.normal;
+        float approach = 0;
+        for (int k = 0; k < 3; k++) {
+            a_position[k] -= n[k] * contact.depth * 0.5f;
+            b_position[k] += n[k] * contact.depth * 0.5f;
+            approach += (b_velocity[k] - a_velocity[k]) * n[k];
+        }
+        if (approach >= 0)
+            continue;
+        for (int k = 0; k < 3; k++) {
+            a_velocity[k] += n[k] * approach;
+            b_velocity[k] -= n[k] * approach;
+        }
+    }
+}
+
+void Crowd::Cull(const Mat4& view_matrix, const Mat4& projection_matrix) {
+    Mat4 view_projection = projection_matrix * view_matrix;
+    Cull(&view_projection, 1);
+}
+
+void Crowd::Cull(const Mat4* view_projections, unsigned int view_count) {
+    draw_list_.clear();
+    if (!culling_) {
+        for (unsigned int i = 0; i < model_matrices_.size(); i++)
+            draw_list_.push_back(i);
+        cull_seconds_ = 0;
+        return;
+    }
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    visible_.assign(model_matrices_.size(), 0);
+    for (unsigned int view = 0; view < view_count; view++) {
+        culler_.BeginFrame(view_projections[view]);
+        for (unsigned int i : occluders_)
+            culler_.AddOccluder(KDron::kVertices, KDron::kVertexCount,
+                                KDron::kIndices, KDron::kTriangleCount,
+                                model_matrices_[i]);
+        culler_.BuildPyramid();
+        for (unsigned int i = 0; i < model_matrices_.size(); i++)
+            if (!visible_[i] && culler_.IsVisible(bounds_, model_matrices_[i]))
+                visible_[i] = 1;
+    }
+    for (unsigned int i = 0; i < model_matrices_.size(); i++)
+        if (visible_[i])
+            draw_list_.push_back(i);
+    cull_seconds_ = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+}
+
+void Crowd::LogStats() const {
+    std::cout << "Occlusion culling " << (culling_ ? "on" : "off")
+              << ": drawing " << draw_list_.size() << " of " << InstanceCount()
+              << " K-drons";
+    if (culling_) {
+        const OcclusionCuller::Stats& stats = culler_.stats();
+        std::cout << " (" << stats.frustum_culled << " outside the frustum, "
+                  << stats.occlusion_culled << " occluded), rasterizing "
+                  << stats.occluder_triangles << " triangles took "
+                  << stats.raster_seconds * 1000.0 << " ms of "
+                  << cull_seconds_ * 1000.0 << " ms";
+    }
+    std::cout << std::endl;
+    if (keyframed_) {
+        const AnimationSet::Stats& stats = animation_.stats();
+        std::cout << "Keyframes: " << stats.samples << " tracks sampled, "
+                  << stats.searches << " needing a search, "
+                  << (stats.samples ? stats.seconds * 1e9 / stats.samples : 0)
+                  << " ns per track" << std::endl;
+    }
+    if (tumbling_) {
+        const CollisionWorld::Stats& stats = collisions_.stats();
+        std::cout << "Collisions: " << stats.candidate_pairs
+                  << " overlapping boxes, " << stats.contacts
+                  << " contacts, broadphase "
+                  << stats.broadphase_seconds * 1000.0 << " ms, narrowphase "
+                  << stats.narrowphase_seconds * 1000.0 << " ms" << std::endl;
+        collisions_.scratch().LogStats("Collision scratch");
+    }
+}
+
+void Crowd::SpeedUp() { velocity_ *= kSpeedStep; }
+
+void Crowd::SlowDown() { velocity_ /= kSpeedStep; }
+
+void Crowd::ToggleAnimated() { animated_ = !animated_; }
+
+void Crowd::Draw(const ModelProgram& program,
+                 CommandList* commands) const {
+
+    commands->UseProgram(program);
+    commands->BindVertexArray(vao_);
+
+    for (unsigned int i : draw_list_) {
+        program.SetModelMatrix(model_matrices_[i], commands);
+        DrawIndexed(program, KDron::kTriangleCount * 3, 0, commands);
+    }
+
+    commands->BindVertexArray(0);
+    commands->UseProgram(0);
+}
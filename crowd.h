@@ -0,0 +1,89 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "animation.h"
+#include "bounds.h"
+#include "collision.h"
+#include "indexmodel.h"
+#include "matma.h"
+#include "modelprogram.h"
+#include "occlusionculler.h"
+
+// A dense block of spinning K-drons sharing one vertex buffer. Every frame the
+// instances are culled against the frustum and against the front layers,
+// which are rasterized as occluders, and only the survivors are drawn. When
+// tumbling, the K-drons also drift around the block and bounce off each other.
+// Keyframed, they play looping clips instead: bobbing, squashing and turning.
+class Crowd : public IndexModel {
+  public:
+    Crowd(float init_velocity = 15);
+    void Initialize(unsigned int columns, unsigned int rows,
+                    unsigned int layers);
+    // CPU side of Initialize, enough for Cull
+    void Layout(unsigned int columns, unsigned int rows, unsigned int layers);
+    void Update(float delta_t);
+    // Rebuilds the draw list for this camera.
+    void Cull(const Mat4& view_matrix, const Mat4& projection_matrix);
+    // Keeps what any of the cameras sees, for drawing them all at once.
+    // Culler stats are the last camera's.
+    void Cull(const Mat4* view_projections, unsigned int view_count);
+    void Draw(const ModelProgram& program, CommandList* commands) const;
+    void SpeedUp();
+    void SlowDown();
+    void ToggleAnimated();
+    void ToggleCulling() { culling_ = !culling_; }
+    void ToggleTumbling();
+    void ToggleKeyframed();
+    void LogStats() const;
+
+    bool culling() const { return culling_; }
+    bool tumbling() const { return tumbling_; }
+    bool keyframed() const { return keyframed_; }
+    unsigned int InstanceCount() const { return model_matrices_.size(); }
+    const std::vector<unsigned int>& draw_list() const { return draw_list_; }
+    const Mat4& model_matrix(unsigned int i) const {
+        return model_matrices_[i];
+    }
+    const OcclusionCuller& culler() const { return culler_; }
+    double cull_seconds() const { return cull_seconds_; }
+    const CollisionWorld& collisions() const { return collisions_; }
+
+  private:
+    void UpdateModelMatrices();
+    void Move(float delta_t);
+    void ResolveCollisions();
+    void BuildClips();
+
+    std::vector<float> positions_; // x, y, z per instance
+    std::vector<float> angles_x_;
+    std::vector<float> angles_y_;
+    std::vector<float> spins_;
+    std::vector<Mat4> model_matrices_;
+    std::vector<unsigned int> occluders_;
+    std::vector<unsigned int> draw_list_;
+    std::vector<unsigned char> visible_; // scratch for Cull
+    Aabb bounds_;
+    OcclusionCuller culler_;
+    bool culling_;
+    double cull_seconds_;
+
+    ConvexShape shape_;
+    CollisionWorld collisions_;
+    std::vector<float> velocities_; // x, y, z per instance
+    float box_min_[3];              // where tumbling K-drons bounce back
+    float box_max_[3];
+    bool tumbling_;
+
+    AnimationSet animation_; // one object per instance
+    float animation_time_;
+    bool keyframed_;
+
+    float velocity_;
+    bool animated_;
+};
+
+#endif // CROWD_H
@@ -3,7 +3,29 @@
 #include "cube.h"
 #include "vertices.h"
 
-#define TRIANGLE_COUNT 12
+// clang-format off
+const ColorVertex Cube::kVertices[Cube::kVertexCount] = {
+    // Bottom
+    {{ -.5f,  -.5f,   .5f,  1.0f}, {1, 1, 1, 1}},
+    {{ -.5f,   .5f,   .5f,  1.0f}, {1, 0, 0, 1}},
+    {{  .5f,   .5f,   .5f,  1.0f}, {0, 1, 0, 1}},
+    {{  .5f,  -.5f,   .5f,  1.0f}, {1, 1, 0, 1}},
+    // Top
+    {{ -.5f,  -.5f,  -.5f,  1.0f}, {0, 0, 1, 1}},
+    {{ -.5f,   .5f,  -.5f,  1.0f}, {1, 0, 0, 1}},
+    {{  .5f,   .5f,  -.5f,  1.0f}, {1, 0, 1, 1}},
+    {{  .5f,  -.5f,  -.5f,  1.0f}, {0, 0, 0, 1}}
+};
+
+const Triangle Cube::kIndices[Cube::kTriangleCount] = {
+    {0, 1, 2}, {0, 2, 3},
+    {4, 0, 3}, {4, 3, 7},
+    {4, 5, 1}, {4, 1, 0},
+    {3, 2, 6}, {3, 6, 7},
+    {1, 5, 6}, {1, 6, 2},
+    {7, 6, 5}, {7, 5, 4},
+};
+// clang-format on
 
 Cube::Cube(float init_velocity, float init_angle) {
     velocity_ = init_velocity;
@@ -14,6 +36,12 @@ Cube::Cube(float init_velocity, float init_angle) {
 void Cube::Update(float delta_t) {
     if (!animated_)
         return;
+    if (orientation_mode() == Quaternion) {
+        angular_velocity_[0] = angular_velocity_[1] =
+            velocity_ * kDegreesToRadians;
+        IntegrateOrientation(delta_t);
+        return;
+    }
     angle_ += delta_t * velocity_;
     if (angle_ > 360)
         angle_ -= 360;
@@ -24,43 +52,25 @@ void Cube::Update(float delta_t) {
     model_matrix_.RotateAboutY(angle_);
 }
 
-void Cube::SpeedUp() { velocity_ *= 1.09544511501; }
+Quat Cube::CurrentEulerOrientation() const {
+    return Quat::FromAxisAngle(0, 1, 0, angle_) *
+           Quat::FromAxisAngle(1, 0, 0, angle_);
+}
+
+void Cube::SpeedUp() { velocity_ *= kSpeedStep; }
 
-void Cube::SlowDown() { velocity_ /= 1.09544511501; }
+void Cube::SlowDown() { velocity_ /= kSpeedStep; }
 
 void Cube::ToggleAnimated() { animated_ = !animated_; }
 
 void Cube::Initialize() {
-    // clang-format off
-    const ColorVertex kVertices[8] = {
-        // Bottom
-        {{ -.5f,  -.5f,   .5f,  1.0f}, {1, 1, 1, 1}},
-        {{ -.5f,   .5f,   .5f,  1.0f}, {1, 0, 0, 1}},
-        {{  .5f,   .5f,   .5f,  1.0f}, {0, 1, 0, 1}},
-        {{  .5f,  -.5f,   .5f,  1.0f}, {1, 1, 0, 1}},
-        // Top
-        {{ -.5f,  -.5f,  -.5f,  1.0f}, {0, 0, 1, 1}},
-        {{ -.5f,   .5f,  -.5f,  1.0f}, {1, 0, 0, 1}},
-        {{  .5f,   .5f,  -.5f,  1.0f}, {1, 0, 1, 1}},
-        {{  .5f,  -.5f,  -.5f,  1.0f}, {0, 0, 0, 1}}
-    };
-
-    const Triangle kIndices[TRIANGLE_COUNT] = {
-        {0, 1, 2}, {0, 2, 3},
-        {4, 0, 3}, {4, 3, 7},
-        {4, 5, 1}, {4, 1, 0},
-        {3, 2, 6}, {3, 6, 7},
-        {1, 5, 6}, {1, 6, 2},
-        {7, 6, 5}, {7, 5, 4},
-    };
-    // clang-format on
-
-    glGenVertexArrays(1, &vao_);
+    vao_.Create("cube");
     glBindVertexArray(vao_);
 
-    glGenBuffers(1, &vertex_buffer_);
+    vertex_buffer_.Create(GpuResources::VertexBuffers, "cube");
     glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(kVertices), kVertices, GL_STATIC_DRAW);
+    vertex_buffer_.Allocate(GL_ARRAY_BUFFER, sizeof(kVertices), kVertices,
+                            GL_STATIC_DRAW);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(kVertices[0]),
                           (GLvoid*)0);
     glEnableVertexAttribArray(0);
@@ -68,25 +78,27 @@ void Cube::Initialize() {
                           (GLvoid*)sizeof(kVertices[0].position));
     glEnableVertexAttribArray(1);
 
-    glGenBuffers(1, &index_buffer_);
+    index_buffer_.Create(GpuResources::IndexBuffers, "cube");
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(kIndices), kIndices,
-                 GL_STATIC_DRAW);
+    index_buffer_.Allocate(GL_ELEMENT_ARRAY_BUFFER, sizeof(kIndices), kIndices,
+                           GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    BuildBounds(kVertices, kVertexCount);
 }
 
-void Cube::Draw(const ModelProgram& program) const {
+void Cube::Draw(const ModelProgram& program,
+                CommandList* commands) const {
 
-    glUseProgram(program);
-    glBindVertexArray(vao_);
+    commands->UseProgram(program);
+    commands->BindVertexArray(vao_);
 
-    program.SetModelMatrix(model_matrix_);
+    program.SetModelMatrix(ModelMatrix(), commands);
 
-    glDrawElements(GL_TRIANGLES, TRIANGLE_COUNT * sizeof(Triangle),
-                   GL_UNSIGNED_INT, 0);
+    DrawIndexed(program, kTriangleCount * 3, 0, commands);
 
-    glBindVertexArray(0);
-    glUseProgram(0);
+    commands->BindVertexArray(0);
+    commands->UseProgram(0);
 }
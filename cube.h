@@ -6,18 +6,26 @@
 #include "indexmodel.h"
 #include "modelprogram.h"
 #include "movablemodel.h"
+#include "vertices.h"
 
 class Cube : public IndexModel, public MovableModel {
   public:
     Cube(float init_velocity = 15, float init_angle = 45);
     void Initialize();
-    void Draw(const ModelProgram& program) const;
+    void Draw(const ModelProgram& program, CommandList* commands) const;
     void Update(float delta_t);
     void SpeedUp();
     void SlowDown();
     void ToggleAnimated();
 
+    static const unsigned int kVertexCount = 8;
+    static const unsigned int kTriangleCount = 12;
+    static const ColorVertex kVertices[kVertexCount];
+    static const Triangle kIndices[kTriangleCount];
+
   private:
+    Quat CurrentEulerOrientation() const;
+
     float angle_;
     float velocity_;
     bool animated_;
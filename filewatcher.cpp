@@ -0,0 +1,96 @@
+#include "filewatcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+static time_t ModificationTime(const std::string& file) {
+    struct stat status;
+    return stat(file.c_str(), &status) == 0 ? status.st_mtime : 0;
+}
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_ < 0)
+        std::cerr << "WARNING: inotify unavailable (" << strerror(errno)
+                  << "), polling file modification times" << std::endl;
+#else
+    inotify_ = -1;
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+    if (inotify_ >= 0)
+        close(inotify_);
+#endif
+}
+
+bool FileWatcher::Watch(const char* file) {
+    Watched watched;
+    watched.file = file;
+    size_t slash = watched.file.find_last_of("/\\");
+    watched.directory =
+        slash == std::string::npos ? "." : watched.file.substr(0, slash);
+    watched.name = slash == std::string::npos ? watched.file
+                                              : watched.file.substr(slash + 1);
+    watched.watch = -1;
+    watched.modified = ModificationTime(watched.file);
+#ifdef __linux__
+    if (inotify_ >= 0) {
+        // Adding a directory twice hands back the same descriptor
+        watched.watch = inotify_add_watch(inotify_, watched.directory.c_str(),
+                                          IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watched.watch < 0) {
+            std::cerr << "ERROR: Cannot watch " << watched.directory << ": "
+                      << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+#endif
+    files_.push_back(watched);
+    return true;
+}
+
+std::vector<std::string> FileWatcher::Poll() {
+    std::vector<std::string> changed;
+    if (inotify_ < 0) {
+        for (Watched& watched : files_) {
+            time_t modified = ModificationTime(watched.file);
+            if (modified != watched.modified) {
+                watched.modified = modified;
+                changed.push_back(watched.file);
+            }
+        }
+        return changed;
+    }
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t length = read(inotify_, buffer, sizeof(buffer));
+        if (length <= 0) // EAGAIN once the queue is empty
+            break;
+        for (char* next = buffer; next < buffer + length;) {
+            const inotify_event* event = (const inotify_event*)next;
+            next += sizeof(inotify_event) + event->len;
+            if (!event->len)
+                continue;
+            for (const Watched& watched : files_)
+                if (watched.watch == event->wd && watched.name == event->name &&
+                    std::find(changed.begin(), changed.end(), watched.file) ==
+                        changed.end())
+                    changed.push_back(watched.file);
+        }
+    }
+#endif
+    return changed;
+}
@@ -0,0 +1,35 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Tells which of a set of files were written since it was last asked,
+// without blocking. Uses inotify on Linux, watching the directories so that
+// editors saving by renaming a new file over the old one are seen too;
+// elsewhere it compares modification times on every Poll().
+class FileWatcher {
+  public:
+    FileWatcher();
+    ~FileWatcher();
+    // Logs and returns false if the file cannot be watched
+    bool Watch(const char* file);
+    // Files finished writing since the last call, each once, as passed to
+    // Watch()
+    std::vector<std::string> Poll();
+
+  private:
+    struct Watched {
+        std::string file;
+        std::string directory;
+        std::string name; // within directory
+        int watch;        // inotify watch descriptor of directory
+        time_t modified;
+    };
+
+    int inotify_; // -1 when polling modification times
+    std::vector<Watched> files_;
+};
+
+#endif // FILEWATCHER_H
@@ -0,0 +1,167 @@
+#include "framearena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+// All bits set: NaN as a float, -1 or a huge index as an integer, and an
+// address nothing is mapped at as a pointer
+static const unsigned char kPoison = 0xff;
+
+FrameArena::FrameArena(unsigned int frames_in_flight, size_t block_bytes)
+    : frames_(std::max(frames_in_flight, 1u)) {
+    for (Frame& frame : frames_)
+        frame.current = 0;
+    frame_ = 0;
+    block_bytes_ = block_bytes;
+#ifdef DEBUG
+    poison_ = true;
+#else
+    poison_ = false;
+#endif
+    stats_ = Stats();
+}
+
+FrameArena::~FrameArena() {
+    for (Frame& frame : frames_)
+        for (Block& block : frame.blocks)
+            delete[] block.memory;
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment) {
+    Frame& frame = frames_[frame_];
+    for (;;) {
+        if (frame.current == frame.blocks.size()) {
+            // Big requests get a block of their own, which stays for reuse
+            Block block;
+            block.size = std::max(block_bytes_, bytes + alignment);
+            block.memory = new unsigned char[block.size];
+            block.used = 0;
+            frame.blocks.push_back(block);
+            stats_.reserved_bytes += block.size;
+            stats_.heap_blocks++;
+        }
+        Block& block = frame.blocks[frame.current];
+        uintptr_t address = (uintptr_t)block.memory + block.used;
+        size_t padding = (alignment - address % alignment) % alignment;
+        if (block.used + padding + bytes <= block.size) {
+            block.used += padding + bytes;
+            stats_.allocations++;
+            stats_.bytes += padding + bytes;
+            stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.bytes);
+            return block.memory + block.used - bytes;
+        }
+        frame.current++;
+    }
+}
+
+void FrameArena::Release(Frame* frame) {
+    for (Block& block : frame->blocks) {
+        if (poison_)
+            memset(block.memory, kPoison, block.used);
+        block.used = 0;
+    }
+    frame->current = 0;
+}
+
+void FrameArena::NextFrame() {
+    frame_ = (frame_ + 1) % frames_.size();
+    Release(&frames_[frame_]);
+    stats_.allocations = 0;
+    stats_.bytes = 0;
+}
+
+void FrameArena::LogStats(const char* name) const {
+    std::cout << name << ": " << stats_.allocations << " allocations, "
+              << stats_.bytes / 1024.0 << " KiB this frame, peak "
+              << stats_.peak_bytes / 1024.0 << " KiB, "
+              << stats_.reserved_bytes / 1024.0 << " KiB reserved in "
+              << stats_.heap_blocks << " blocks over " << frames_.size()
+              << " frames" << (poison_ ? ", poisoning" : "") << std::endl;
+}
+
+static std::atomic<unsigned long long> next_arenas_id(1);
+
+ThreadFrameArenas::ThreadFrameArenas(unsigned int frames_in_flight,
+                                     size_t block_bytes)
+    : id_(next_arenas_id.fetch_add(1)), frames_in_flight_(frames_in_flight),
+      block_bytes_(block_bytes) {
+#ifdef DEBUG
+    poison_ = true;
+#else
+    poison_ = false;
+#endif
+}
+
+FrameArena& ThreadFrameArenas::Local() {
+    // Threads mostly stick to one set of arenas, so one entry is enough
+    thread_local unsigned long long cached_id = 0;
+    thread_local FrameArena* cached_arena = nullptr;
+    if (cached_id == id_)
+        return *cached_arena;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::thread::id thread = std::this_thread::get_id();
+    FrameArena* arena = nullptr;
+    for (Entry& entry : arenas_)
+        if (entry.thread == thread)
+            arena = entry.arena.get();
+    if (!arena) {
+        arena = new FrameArena(frames_in_flight_, block_bytes_);
+        arena->set_poison(poison_);
+        arenas_.push_back({thread, std::unique_ptr<FrameArena>(arena)});
+    }
+    cached_id = id_;
+    cached_arena = arena;
+    return *arena;
+}
+
+void ThreadFrameArenas::NextFrame() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Entry& entry : arenas_)
+        entry.arena->NextFrame();
+}
+
+void ThreadFrameArenas::set_poison(bool poison) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    poison_ = poison;
+    for (Entry& entry : arenas_)
+        entry.arena->set_poison(poison);
+}
+
+FrameArena::Stats ThreadFrameArenas::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FrameArena::Stats total = FrameArena::Stats();
+    for (const Entry& entry : arenas_) {
+        const FrameArena::Stats& stats = entry.arena->stats();
+        total.allocations += stats.allocations;
+        total.bytes += stats.bytes;
+        total.peak_bytes += stats.peak_bytes;
+        total.reserved_bytes += stats.reserved_bytes;
+        total.heap_blocks += stats.heap_blocks;
+    }
+    return total;
+}
+
+unsigned int ThreadFrameArenas::ThreadCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return arenas_.size();
+}
+
+void ThreadFrameArenas::LogStats(const char* name) const {
+    FrameArena::Stats total = stats();
+    unsigned int threads;
+    bool poison; // set_poison() may run on another thread
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads = arenas_.size();
+        poison = poison_;
+    }
+    std::cout << name << ": " << total.allocations << " allocations, "
+              << total.bytes / 1024.0 << " KiB this frame over " << threads
+              << " threads, " << total.reserved_bytes / 1024.0
+              << " KiB reserved in " << total.heap_blocks << " blocks"
+              << (poison ? ", poisoning" : "") << std::endl;
+}
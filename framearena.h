@@ -0,0 +1,131 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Bump allocator for data that lives for a frame or a few. Allocating moves a
+// pointer through blocks that are kept from frame to frame, and nothing is
+// freed on its own: NextFrame() drops everything allocated frames_in_flight
+// frames ago at once, so data handed to the render thread can outlive the
+// frame that made it. Not thread safe; workers use ThreadFrameArenas.
+class FrameArena {
+  public:
+    struct Stats {
+        size_t allocations;    // this frame
+        size_t bytes;          // this frame, alignment padding included
+        size_t peak_bytes;     // largest frame so far
+        size_t reserved_bytes; // in blocks, over all frames
+        size_t heap_blocks;    // blocks ever taken from the heap
+    };
+
+    explicit FrameArena(unsigned int frames_in_flight = 2,
+                        size_t block_bytes = 64 << 10);
+    ~FrameArena();
+
+    void* Allocate(size_t bytes,
+                   size_t alignment = alignof(std::max_align_t));
+    template <typename T> T* Allocate(size_t count) {
+        return (T*)Allocate(count * sizeof(T), alignof(T));
+    }
+    // Moves on to the memory of the oldest frame, releasing what it held.
+    void NextFrame();
+
+    // Fills released frames with a pattern that reads as NaN, a huge index or
+    // an unmapped pointer, so stale use shows up. On by default in DEBUG.
+    void set_poison(bool poison) { poison_ = poison; }
+    bool poison() const { return poison_; }
+    unsigned int frames_in_flight() const { return frames_.size(); }
+    const Stats& stats() const { return stats_; }
+    void LogStats(const char* name) const;
+
+  private:
+    struct Block {
+        unsigned char* memory;
+        size_t size;
+        size_t used;
+    };
+    struct Frame {
+        std::vector<Block> blocks;
+        unsigned int current; // block being bumped through
+    };
+
+    void Release(Frame* frame);
+
+    std::vector<Frame> frames_;
+    unsigned int frame_;
+    size_t block_bytes_;
+    bool poison_;
+    Stats stats_;
+};
+
+// A FrameArena for each thread that allocates, so job system workers bump
+// their own pointers without locking. NextFrame() advances all of them and
+// must not overlap with allocations, so call it between frames.
+class ThreadFrameArenas {
+  public:
+    explicit ThreadFrameArenas(unsigned int frames_in_flight = 2,
+                               size_t block_bytes = 64 << 10);
+    // The calling thread's arena, made on first use
+    FrameArena& Local();
+    void NextFrame();
+    void set_poison(bool poison);
+    // Sums over the threads; peak_bytes adds up each thread's own peak
+    FrameArena::Stats stats() const;
+    unsigned int ThreadCount() const;
+    void LogStats(const char* name) const;
+
+  private:
+    struct Entry {
+        std::thread::id thread;
+        std::unique_ptr<FrameArena> arena;
+    };
+
+    const unsigned long long id_; // tells instances apart in Local()'s cache
+    const unsigned int frames_in_flight_;
+    const size_t block_bytes_;
+    mutable std::mutex mutex_; // guards poison_ and arenas_
+    bool poison_;
+    std::vector<Entry> arenas_;
+};
+
+// Lets standard containers allocate from a FrameArena. Deallocation does
+// nothing; the memory goes when the arena's frame is released, so a
+// container must not be used, or destroyed with elements, after that.
+template <typename T> class FrameAllocator {
+  public:
+    typedef T value_type;
+    // Containers take their arena along when moved or copied
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    FrameAllocator() : arena_(nullptr) {}
+    explicit FrameAllocator(FrameArena* arena) : arena_(arena) {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t count) { return arena_->Allocate<T>(count); }
+    void deallocate(T*, size_t) {}
+    FrameArena* arena() const { return arena_; }
+
+  private:
+    FrameArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+    return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+    return a.arena() != b.arena();
+}
+
+template <typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+#endif // FRAMEARENA_H
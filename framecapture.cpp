@@ -0,0 +1,355 @@
+#include "framecapture.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#include <GLFW/glfw3.h>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+FrameCapture::FrameCapture() {
+    active_ = false;
+    format_ = PpmSequence;
+    width_ = height_ = 0;
+    pipe_ = nullptr;
+    for (unsigned int i = 0; i < kRingSize; i++) {
+        fences_[i] = nullptr;
+        frame_indices_[i] = 0;
+    }
+    next_slot_ = in_flight_ = next_index_ = 0;
+    stopping_ = false;
+}
+
+FrameCapture::~FrameCapture() { Stop(); }
+
+bool FrameCapture::Start(Format format, const std::string& target, int width,
+                         int height) {
+    Stop();
+    if (format == EncoderPipe) {
+#ifndef _WIN32
+        // A dying encoder should end the capture, not the program
+        signal(SIGPIPE, SIG_IGN);
+#endif
+        pipe_ = popen(target.c_str(), "w");
+        if (!pipe_) {
+            std::cerr << "ERROR: Could not start the encoder: " << target
+                      << std::endl;
+            return false;
+        }
+    }
+    format_ = format;
+    target_ = target;
+    width_ = width;
+    height_ = height;
+    next_slot_ = in_flight_ = next_index_ = 0;
+
+    size_t frame_bytes = (size_t)width_ * height_ * 4;
+    for (unsigned int i = 0; i < kRingSize; i++) {
+        pixel_buffers_[i].Create(GpuResources::PixelBuffers, "frame capture");
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers_[i]);
+        pixel_buffers_[i].Allocate(GL_PIXEL_PACK_BUFFER, frame_bytes, nullptr,
+                                   GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    frames_.assign(kFramePoolSize, Frame());
+    free_frames_.clear();
+    for (Frame& frame : frames_) {
+        frame.pixels.resize(frame_bytes);
+        free_frames_.push_back(&frame);
+    }
+    queue_.clear();
+
+    capture_seconds_ = max_capture_seconds_ = 0;
+    ring_stall_seconds_ = writer_wait_seconds_ = 0;
+    ring_stalls_ = 0;
+    write_seconds_ = 0;
+    frames_written_ = 0;
+    write_failed_ = false;
+    stopping_ = false;
+    writer_ = std::thread(&FrameCapture::WriterLoop, this);
+    active_ = true;
+
+    std::cout << "Capturing " << width_ << "x" << height_ << " frames to "
+              << target_ << std::endl;
+    return true;
+}
+
+void FrameCapture::Stop() {
+    if (!active_)
+        return;
+    active_ = false;
+    while (in_flight_ > 0)
+        Collect(true);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    frame_queued_.notify_one();
+    writer_.join();
+    if (pipe_) {
+        pclose(pipe_);
+        pipe_ = nullptr;
+    }
+    for (GpuBuffer& pixel_buffer : pixel_buffers_)
+        pixel_buffer.Reset();
+    frames_.clear();
+    free_frames_.clear();
+
+    unsigned int frames = next_index_;
+    std::cout << "Captured " << frames_written_ << " of " << frames
+              << " frames to " << target_ << std::endl;
+    if (frames == 0)
+        return;
+    std::cout << "  render thread: " << capture_seconds_ * 1000.0 / frames
+              << " ms/frame (max " << max_capture_seconds_ * 1000.0
+              << " ms), " << ring_stalls_ << " ring stalls ("
+              << ring_stall_seconds_ * 1000.0 << " ms), "
+              << writer_wait_seconds_ * 1000.0 << " ms waiting for the writer"
+              << std::endl;
+    if (frames_written_ > 0)
+        std::cout << "  writer thread: "
+                  << write_seconds_ * 1000.0 / frames_written_ << " ms/frame"
+                  << std::endl;
+    if (write_failed_)
+        std::cerr << "ERROR: Some frames could not be written" << std::endl;
+}
+
+void FrameCapture::CaptureFrame() {
+    if (!active_)
+        return;
+    double start = glfwGetTime();
+
+    // Only a full ring forces the CPU to wait on the GPU
+    if (in_flight_ == kRingSize) {
+        double stall_start = glfwGetTime();
+        Collect(true);
+        ring_stall_seconds_ += glfwGetTime() - stall_start;
+        ring_stalls_++;
+    }
+
+    unsigned int slot = next_slot_;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers_[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_indices_[slot] = next_index_++;
+    next_slot_ = (slot + 1) % kRingSize;
+    in_flight_++;
+
+    // Hand over whatever older frames the GPU has finished with
+    while (in_flight_ > 0 && Collect(false)) {
+    }
+
+    double elapsed = glfwGetTime() - start;
+    capture_seconds_ += elapsed;
+    max_capture_seconds_ = std::max(max_capture_seconds_, elapsed);
+}
+
+bool FrameCapture::Collect(bool wait) {
+    unsigned int slot = (next_slot_ + kRingSize - in_flight_) % kRingSize;
+    GLenum status =
+        glClientWaitSync(fences_[slot], GL_SYNC_FLUSH_COMMANDS_BIT,
+                         wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(fences_[slot]);
+    fences_[slot] = nullptr;
+    in_flight_--;
+
+    Frame* frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (free_frames_.empty()) {
+            double wait_start = glfwGetTime();
+            frame_freed_.wait(lock, [this] { return !free_frames_.empty(); });
+            writer_wait_seconds_ += glfwGetTime() - wait_start;
+        }
+        frame = free_frames_.back();
+        free_frames_.pop_back();
+    }
+
+    // GL 4.1 has no persistent mapping, so the frame is copied out once and
+    // the buffer unmapped before the next GL call.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers_[slot]);
+    const void* mapped = glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, frame->pixels.size(), GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(frame->pixels.data(), mapped, frame->pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    frame->index = frame_indices_[slot];
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (mapped)
+            queue_.push_back(frame);
+        else
+            free_frames_.push_back(frame);
+    }
+    frame_queued_.notify_one();
+    return true;
+}
+
+void FrameCapture::WriterLoop() {
+    for (;;) {
+        Frame* frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            frame_queued_.wait(lock,
+                               [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            frame = queue_.front();
+            queue_.pop_front();
+        }
+
+        double start = glfwGetTime();
+        if (!write_failed_) {
+            if (WriteFrame(*frame))
+                frames_written_++;
+            else
+                write_failed_ = true;
+        }
+        write_seconds_ += glfwGetTime() - start;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_frames_.push_back(frame);
+        }
+        frame_freed_.notify_one();
+    }
+}
+
+bool FrameCapture::WriteFrame(const Frame& frame) {
+    if (format_ != EncoderPipe)
+        return WriteImage(frame);
+    // GL reads bottom-up; encoders expect the top row first
+    size_t row_bytes = (size_t)width_ * 4;
+    for (int y = height_ - 1; y >= 0; y--)
+        if (fwrite(frame.pixels.data() + y * row_bytes, 1, row_bytes, pipe_) !=
+            row_bytes)
+            return false;
+    return true;
+}
+
+static void PutBigEndian(std::vector<unsigned char>* out, unsigned int value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out->push_back(value >> shift);
+}
+
+static unsigned int Crc32(const unsigned char* data, size_t size) {
+    static unsigned int table[256];
+    static bool table_ready = false;
+    if (!table_ready) {
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        table_ready = true;
+    }
+    unsigned int crc = 0xffffffffu;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+static unsigned int Adler32(const unsigned char* data, size_t size) {
+    unsigned int a = 1, b = 0;
+    while (size > 0) {
+        // 5552 bytes is the most that cannot overflow b before the modulo
+        size_t block = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < block; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += block;
+        size -= block;
+    }
+    return b << 16 | a;
+}
+
+static void PutPngChunk(std::vector<unsigned char>* out, const char* type,
+                        const std::vector<unsigned char>& data) {
+    PutBigEndian(out, data.size());
+    size_t start = out->size();
+    out->insert(out->end(), type, type + 4);
+    out->insert(out->end(), data.begin(), data.end());
+    PutBigEndian(out, Crc32(out->data() + start, out->size() - start));
+}
+
+bool FrameCapture::WriteImage(const Frame& frame) {
+    char name[32];
+    snprintf(name, sizeof(name), "%05u.%s", frame.index,
+             format_ == PngSequence ? "png" : "ppm");
+    std::string file_name = target_ + name;
+    FILE* file = fopen(file_name.c_str(), "wb");
+    if (!file) {
+        std::cerr << "ERROR: Could not open the file " << file_name
+                  << std::endl;
+        return false;
+    }
+
+    // Top row first, RGB with a leading filter byte per row for PNG
+    bool png = format_ == PngSequence;
+    size_t row_bytes = (size_t)width_ * 3 + (png ? 1 : 0);
+    std::vector<unsigned char> rgb(row_bytes * height_);
+    for (int y = 0; y < height_; y++) {
+        const unsigned char* in =
+            frame.pixels.data() + (size_t)(height_ - 1 - y) * width_ * 4;
+        unsigned char* out = rgb.data() + y * row_bytes;
+        if (png)
+            *out++ = 0;
+        for (int x = 0; x < width_; x++) {
+            out[3 * x] = in[4 * x];
+            out[3 * x + 1] = in[4 * x + 1];
+            out[3 * x + 2] = in[4 * x + 2];
+        }
+    }
+
+    bool ok;
+    if (!png) {
+        fprintf(file, "P6\n%d %d\n255\n", width_, height_);
+        ok = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+    } else {
+        // Stored (uncompressed) deflate blocks keep the writer cheap and the
+        // file readable by any PNG decoder.
+        std::vector<unsigned char> png_file = {0x89, 'P',  'N',  'G',
+                                               '\r', '\n', 0x1a, '\n'};
+        std::vector<unsigned char> header;
+        PutBigEndian(&header, width_);
+        PutBigEndian(&header, height_);
+        header.insert(header.end(), {8, 2, 0, 0, 0}); // 8-bit RGB
+        PutPngChunk(&png_file, "IHDR", header);
+
+        std::vector<unsigned char> zlib = {0x78, 0x01};
+        for (size_t offset = 0; offset < rgb.size(); offset += 65535) {
+            unsigned int length =
+                std::min<size_t>(65535, rgb.size() - offset);
+            zlib.push_back(offset + length == rgb.size()); // final block
+            zlib.insert(zlib.end(), {(unsigned char)length,
+                                     (unsigned char)(length >> 8),
+                                     (unsigned char)~length,
+                                     (unsigned char)(~length >> 8)});
+            zlib.insert(zlib.end(), rgb.begin() + offset,
+                        rgb.begin() + offset + length);
+        }
+        PutBigEndian(&zlib, Adler32(rgb.data(), rgb.size()));
+        PutPngChunk(&png_file, "IDAT", zlib);
+        PutPngChunk(&png_file, "IEND", {});
+        ok = fwrite(png_file.data(), 1, png_file.size(), file) ==
+             png_file.size();
+    }
+    return fclose(file) == 0 && ok;
+}
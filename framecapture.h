@@ -0,0 +1,90 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gpuresources.h"
+
+// Records the back buffer without stalling the render loop. Each frame is read
+// into one of a ring of pixel buffer objects and fenced; frames whose fence
+// has signalled are copied out and handed to a writer thread that saves image
+// sequences or feeds raw RGBA frames to an encoder process.
+class FrameCapture {
+  public:
+    enum Format {
+        PpmSequence,
+        PngSequence, // uncompressed deflate, no zlib needed
+        EncoderPipe,
+    };
+
+    FrameCapture();
+    ~FrameCapture();
+    // target is a file name prefix for image sequences, or a shell command
+    // that reads top-down RGBA frames of width x height from its stdin.
+    bool Start(Format format, const std::string& target, int width,
+               int height);
+    // Waits for frames still in flight, then logs the capture overhead.
+    void Stop();
+    bool active() const { return active_; }
+    // Call after the frame is drawn and before the buffers are swapped.
+    void CaptureFrame();
+
+  private:
+    struct Frame {
+        std::vector<unsigned char> pixels; // bottom row first, as read
+        unsigned int index;
+    };
+
+    bool Collect(bool wait);
+    void WriterLoop();
+    bool WriteFrame(const Frame& frame);
+    bool WriteImage(const Frame& frame);
+
+    static const unsigned int kRingSize = 4;
+    static const unsigned int kFramePoolSize = 8;
+
+    bool active_;
+    Format format_;
+    std::string target_;
+    int width_;
+    int height_;
+    FILE* pipe_;
+
+    GpuBuffer pixel_buffers_[kRingSize];
+    GLsync fences_[kRingSize];
+    unsigned int frame_indices_[kRingSize];
+    unsigned int next_slot_;
+    unsigned int in_flight_;
+    unsigned int next_index_;
+
+    // Frames cycle between free_frames_ and queue_ under mutex_
+    std::vector<Frame> frames_;
+    std::vector<Frame*> free_frames_;
+    std::deque<Frame*> queue_;
+    std::mutex mutex_;
+    std::condition_variable frame_queued_;
+    std::condition_variable frame_freed_;
+    std::thread writer_;
+    bool stopping_;
+
+    // Render thread costs
+    double capture_seconds_;
+    double max_capture_seconds_;
+    double ring_stall_seconds_;
+    unsigned int ring_stalls_;
+    double writer_wait_seconds_;
+    // Writer thread costs, read after it is joined
+    double write_seconds_;
+    unsigned int frames_written_;
+    bool write_failed_;
+};
+
+#endif // FRAMECAPTURE_H
@@ -0,0 +1,228 @@
+#include "framepacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+// Sleeps are cut this much short, at least, and spun out instead
+static const double kMinSpinSeconds = 0.25e-3;
+static const double kMaxSpinSeconds = 4e-3;
+// How fast the spin margin forgets a long oversleep, per frame
+static const double kSpinMarginDecay = 0.99;
+
+FramePacer::FramePacer() {
+    swap_interval_ = 1;
+    target_rate_ = 0;
+    late_polling_ = true;
+    next_start_ = 0;
+    spin_margin_ = 1e-3;
+    recorded_frames_ = 0;
+    presented_frames_ = 0;
+    stats_ = Stats();
+}
+
+FramePacer::~FramePacer() {
+    for (Measurement& measurement : in_flight_)
+        glDeleteSync(measurement.fence);
+    if (!queries_.empty())
+        glDeleteQueries(queries_.size(), queries_.data());
+}
+
+void FramePacer::SetSwapInterval(int interval) {
+    swap_interval_ = interval;
+    glfwSwapInterval(interval);
+}
+
+void FramePacer::NextSwapInterval() {
+    bool adaptive = glfwExtensionSupported("GLX_EXT_swap_control_tear") ||
+                    glfwExtensionSupported("WGL_EXT_swap_control_tear");
+    if (swap_interval_ == 1)
+        SetSwapInterval(0);
+    else if (swap_interval_ == 0 && adaptive)
+        SetSwapInterval(-1);
+    else
+        SetSwapInterval(1);
+}
+
+void FramePacer::SetTargetRate(double frames_per_second) {
+    target_rate_ = frames_per_second;
+    next_start_ = 0;
+}
+
+void FramePacer::WaitForFrame() {
+    double now = glfwGetTime();
+    if (target_rate_ <= 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.frames++;
+        return;
+    }
+    double period = 1.0 / target_rate_;
+    bool late = false;
+    if (next_start_ == 0 || now > next_start_ + period) {
+        // Too far behind to catch up without a burst of frames
+        late = next_start_ != 0;
+        next_start_ = now;
+    }
+
+    double sleep_seconds = 0;
+    if (next_start_ - now > spin_margin_) {
+        double asked = next_start_ - now - spin_margin_;
+        std::this_thread::sleep_for(std::chrono::duration<double>(asked));
+        double woke = glfwGetTime();
+        // Enough margin for the last oversleep, shrinking back slowly
+        double overslept = woke - now - asked;
+        spin_margin_ = std::max(overslept, spin_margin_ * kSpinMarginDecay);
+        spin_margin_ =
+            std::min(std::max(spin_margin_, kMinSpinSeconds), kMaxSpinSeconds);
+        sleep_seconds = woke - now;
+        now = woke;
+    }
+    double spin_start = now;
+    while (now < next_start_) {
+        std::this_thread::yield();
+        now = glfwGetTime();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.frames++;
+    stats_.late_frames += late;
+    stats_.sleep_seconds += sleep_seconds;
+    stats_.spin_seconds += now - spin_start;
+    stats_.max_start_error =
+        std::max(stats_.max_start_error, now - next_start_);
+    next_start_ += period;
+}
+
+void FramePacer::InputArrived(double time) { unrecorded_.push_back(time); }
+
+void FramePacer::FrameRecorded() {
+    unsigned long long frame = recorded_frames_++;
+    if (unrecorded_.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (double time : unrecorded_)
+        recorded_.push_back({time, frame});
+    unrecorded_.clear();
+}
+
+void FramePacer::FramePresented(void* pacer) {
+    ((FramePacer*)pacer)->Presented();
+}
+
+void FramePacer::Presented() {
+    unsigned long long frame = presented_frames_++;
+    std::vector<double> press_times;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!recorded_.empty() && recorded_.front().frame <= frame) {
+            if (recorded_.front().frame == frame)
+                press_times.push_back(recorded_.front().time);
+            else
+                stats_.dropped++;
+            recorded_.pop_front();
+        }
+        if (!press_times.empty() && in_flight_.size() == kMaxInFlight) {
+            stats_.dropped += press_times.size();
+            press_times.clear();
+        }
+    }
+
+    if (!press_times.empty()) {
+        Measurement measurement;
+        if (free_queries_.empty()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            queries_.push_back(query);
+            free_queries_.push_back(query);
+        }
+        measurement.query = free_queries_.back();
+        free_queries_.pop_back();
+        // The two clocks read back to back, to turn GPU times into ours
+        glGetInteger64v(GL_TIMESTAMP, &measurement.calibration_gpu);
+        measurement.calibration_cpu = glfwGetTime();
+        glQueryCounter(measurement.query, GL_TIMESTAMP);
+        measurement.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        measurement.press_times.swap(press_times);
+        in_flight_.push_back(std::move(measurement));
+    }
+
+    while (!in_flight_.empty() && Collect()) {
+    }
+}
+
+bool FramePacer::Collect() {
+    Measurement& measurement = in_flight_.front();
+    GLenum status = glClientWaitSync(measurement.fence,
+                                     GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(measurement.fence);
+
+    GLuint64 gpu_time = 0;
+    if (status != GL_WAIT_FAILED)
+        glGetQueryObjectui64v(measurement.query, GL_QUERY_RESULT, &gpu_time);
+    double presented =
+        measurement.calibration_cpu +
+        (double)((GLint64)gpu_time - measurement.calibration_gpu) * 1e-9;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (double time : measurement.press_times) {
+            if (status == GL_WAIT_FAILED)
+                stats_.dropped++;
+            else
+                stats_.latencies.push_back(presented - time);
+        }
+    }
+    free_queries_.push_back(measurement.query);
+    in_flight_.pop_front();
+    return true;
+}
+
+FramePacer::Stats FramePacer::TakeStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = std::move(stats_);
+    stats_ = Stats();
+    return stats;
+}
+
+// Nearest rank, in milliseconds; sorted holds at least one value
+static double Percentile(const std::vector<double>& sorted, double percent) {
+    size_t rank = (size_t)(percent / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1] *
+           1000.0;
+}
+
+void FramePacer::LogStats() {
+    Stats stats = TakeStats();
+    std::cout << "Frame pacing: swap interval " << swap_interval_ << ", ";
+    if (target_rate_ > 0)
+        std::cout << target_rate_ << " fps";
+    else
+        std::cout << "no rate limit";
+    std::cout << ", events polled "
+              << (late_polling_ ? "after the wait" : "before the wait")
+              << std::endl;
+    if (stats.frames > 0)
+        std::cout << "  " << stats.frames << " frames, " << stats.late_frames
+                  << " late, " << stats.sleep_seconds * 1000.0 / stats.frames
+                  << " ms sleeping and "
+                  << stats.spin_seconds * 1000.0 / stats.frames
+                  << " ms spinning a frame, starts up to "
+                  << stats.max_start_error * 1000.0 << " ms off" << std::endl;
+    if (stats.latencies.empty()) {
+        std::cout << "  No key presses presented yet" << std::endl;
+        return;
+    }
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    std::cout << "  Key press to present over " << stats.latencies.size()
+              << " presses: median " << Percentile(stats.latencies, 50)
+              << " ms, 90% " << Percentile(stats.latencies, 90) << " ms, 99% "
+              << Percentile(stats.latencies, 99) << " ms, max "
+              << stats.latencies.back() * 1000.0 << " ms";
+    if (stats.dropped > 0)
+        std::cout << " (" << stats.dropped << " not measured)";
+    std::cout << std::endl;
+}
@@ -0,0 +1,106 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Paces the render loop and measures how long key presses take to reach the
+// screen. Frames start at a fixed rate: the main thread sleeps most of the
+// way to the next start and spins the rest, since sleeps overshoot by
+// whatever the scheduler likes. Events are then polled right before the
+// simulation, so input that came in during the wait still makes the frame.
+//
+// Each press is tagged with the frame recorded after it, and once that frame
+// is presented a fence and a timestamp query go in behind the swap. The
+// fence says when the query can be read without stalling; the query says
+// when the GPU got there, which is taken as the moment of presentation.
+// GLFW has no event timestamps, so a press counts from when it was polled,
+// not from when the OS queued it.
+class FramePacer {
+  public:
+    struct Stats {
+        unsigned int frames;
+        unsigned int late_frames; // started a whole period after their time
+        double sleep_seconds;
+        double spin_seconds;
+        double max_start_error; // seconds from the intended start
+        // Key press to present, in seconds
+        std::vector<double> latencies;
+        unsigned int dropped; // presses whose frame was never measured
+    };
+
+    FramePacer();
+    ~FramePacer(); // GL thread: deletes the queries
+
+    // GL thread. 0 presents at once, 1 on every vertical blank and -1 on
+    // the next one unless it was already missed, where the driver allows.
+    void SetSwapInterval(int interval);
+    int swap_interval() const { return swap_interval_; }
+    // Steps 1 -> 0 -> -1 -> 1, skipping -1 where it is not supported
+    void NextSwapInterval();
+    // Frames per second; 0 leaves pacing to the swap interval
+    void SetTargetRate(double frames_per_second);
+    double target_rate() const { return target_rate_; }
+    // Polling before the wait instead, to compare against
+    void ToggleLatePolling() { late_polling_ = !late_polling_; }
+    bool late_polling() const { return late_polling_; }
+
+    // Main thread, once a frame before its simulation: waits for the frame's
+    // start time.
+    void WaitForFrame();
+    // Main thread: a key press, at time in glfwGetTime() seconds
+    void InputArrived(double time);
+    // Main thread, once the frame is recorded: the presses since the last
+    // call are on it.
+    void FrameRecorded();
+    // GL thread, right after each swap, in the order frames were recorded
+    static void FramePresented(void* pacer);
+
+    // Totals since the last call
+    Stats TakeStats();
+    // Takes them and logs the latency percentiles, then the pacing
+    void LogStats();
+
+  private:
+    struct Press {
+        double time;
+        unsigned long long frame;
+    };
+    struct Measurement {
+        GLsync fence;
+        GLuint query;
+        double calibration_cpu; // glfwGetTime() when the GPU clock read
+        GLint64 calibration_gpu;
+        std::vector<double> press_times;
+    };
+
+    void Presented(); // GL thread
+    bool Collect();   // GL thread; false while the oldest is in flight
+
+    static const unsigned int kMaxInFlight = 8;
+
+    int swap_interval_;
+    double target_rate_;
+    bool late_polling_;
+
+    // Main thread
+    double next_start_;
+    double spin_margin_; // sleeps end this long before the start
+    std::vector<double> unrecorded_;
+    unsigned long long recorded_frames_;
+
+    // GL thread
+    unsigned long long presented_frames_;
+    std::deque<Measurement> in_flight_;
+    std::vector<GLuint> free_queries_;
+    std::vector<GLuint> queries_; // every one made, deleted at the end
+
+    std::mutex mutex_; // guards what the threads hand each other
+    std::deque<Press> recorded_;
+    Stats stats_;
+};
+
+#endif // FRAMEPACER_H
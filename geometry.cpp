@@ -0,0 +1,835 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "jobsystem.h"
+
+namespace {
+
+// Vertices per job in the passes over the whole buffer
+const unsigned int kParallelRange = 16384;
+// Fixed directions whose extreme vertices make the first hull: the axes and
+// the cube diagonals
+const unsigned int kDirectionCount = 7;
+const float kDirections[kDirectionCount][3] = {
+    {1, 0, 0}, {0, 1, 0}, {0, 0, 1},  {1, 1, 1},
+    {1, 1, -1}, {1, -1, 1}, {-1, 1, 1},
+};
+// Relative slack of the sphere containment tests
+const double kSphereTolerance = 1e-9;
+const unsigned int kJacobiSweeps = 32;
+
+// Doubles, so the plane and sphere tests keep the precision of the floats
+// they are fed
+struct Vec3 {
+    double x, y, z;
+};
+
+inline Vec3 operator+(Vec3 a, Vec3 b) {
+    return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+inline Vec3 operator-(Vec3 a, Vec3 b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+inline Vec3 operator*(Vec3 a, double s) { return {a.x * s, a.y * s, a.z * s}; }
+inline double Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 Cross(Vec3 a, Vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x};
+}
+inline double LengthSquared(Vec3 a) { return Dot(a, a); }
+
+inline Vec3 Position(const ColorVertex& vertex) {
+    return {vertex.position[0], vertex.position[1], vertex.position[2]};
+}
+
+// Chunks of kParallelRange vertices, each reduced by body(begin, end, out)
+// into its own slot of the returned vector
+template <typename T, typename Body>
+std::vector<T> ReduceChunks(unsigned int count, const T& initial,
+                            const Body& body) {
+    unsigned int chunks = (count + kParallelRange - 1) / kParallelRange;
+    std::vector<T> partial(chunks, initial);
+    JobSystem::Instance().ParallelFor(
+        chunks, 1, [&](unsigned int first, unsigned int last) {
+            for (unsigned int c = first; c < last; c++)
+                body(c * kParallelRange,
+                     std::min(count, (c + 1) * kParallelRange), &partial[c]);
+        });
+    return partial;
+}
+
+// Spheres through the points given, which are all on the boundary
+
+struct Sphere {
+    Vec3 center;
+    double radius_squared;
+
+    bool Contains(Vec3 p) const {
+        return LengthSquared(p - center) <=
+               radius_squared * (1 + kSphereTolerance) + DBL_MIN;
+    }
+};
+
+Sphere SphereThrough(Vec3 a) { return {a, 0}; }
+
+Sphere SphereThrough(Vec3 a, Vec3 b) {
+    Vec3 center = (a + b) * 0.5;
+    return {center, LengthSquared(a - center)};
+}
+
+Sphere SphereThrough(Vec3 a, Vec3 b, Vec3 c) {
+    Vec3 ab = b - a, ac = c - a;
+    Vec3 normal = Cross(ab, ac);
+    double denominator = 2 * LengthSquared(normal);
+    if (denominator <= DBL_EPSILON * LengthSquared(ab) * LengthSquared(ac)) {
+        // In a line: the two furthest apart
+        Sphere spheres[3] = {SphereThrough(a, b), SphereThrough(a, c),
+                             SphereThrough(b, c)};
+        return *std::max_element(spheres, spheres + 3,
+                                 [](const Sphere& x, const Sphere& y) {
+                                     return x.radius_squared <
+                                            y.radius_squared;
+                                 });
+    }
+    Vec3 offset = (Cross(normal, ab) * LengthSquared(ac) +
+                   Cross(ac, normal) * LengthSquared(ab)) *
+                  (1 / denominator);
+    return {a + offset, LengthSquared(offset)};
+}
+
+Sphere SphereThrough(Vec3 a, Vec3 b, Vec3 c, Vec3 d) {
+    Vec3 u = b - a, v = c - a, w = d - a;
+    double determinant = 2 * Dot(u, Cross(v, w));
+    double scale = std::sqrt(LengthSquared(u) * LengthSquared(v) *
+                             LengthSquared(w));
+    if (std::fabs(determinant) <= 1e-12 * scale) {
+        // In a plane: no sphere goes through all four, so the smallest
+        // circle through three that holds the fourth
+        Sphere best = {a, std::numeric_limits<double>::max()};
+        Vec3 points[4] = {a, b, c, d};
+        for (int skip = 0; skip < 4; skip++) {
+            Vec3 p[3];
+            for (int i = 0, n = 0; i < 4; i++)
+                if (i != skip)
+                    p[n++] = points[i];
+            Sphere sphere = SphereThrough(p[0], p[1], p[2]);
+            if (sphere.radius_squared < best.radius_squared &&
+                sphere.Contains(points[skip]))
+                best = sphere;
+        }
+        if (best.radius_squared == std::numeric_limits<double>::max())
+            best = SphereThrough(a, b, c); // not reached unless rounding
+        return best;
+    }
+    Vec3 offset = (Cross(v, w) * LengthSquared(u) +
+                   Cross(w, u) * LengthSquared(v) +
+                   Cross(u, v) * LengthSquared(w)) *
+                  (1 / determinant);
+    return {a + offset, LengthSquared(offset)};
+}
+
+// Faces of the hull under construction. Neighbor i is across the edge from
+// v[i] to v[(i + 1) % 3]; the neighbor has the same edge the other way.
+struct HullFace {
+    unsigned int v[3];
+    unsigned int neighbors[3];
+    Vec3 normal; // unit, outwards
+    double offset;
+    // Vertices outside this face and not yet on the hull
+    std::vector<unsigned int> conflicts;
+    unsigned int furthest;
+    double furthest_distance;
+    bool removed;
+    bool merged; // taken as seen by the eye, whatever its distance
+};
+
+class HullBuilder {
+  public:
+    HullBuilder(const ColorVertex* vertices, unsigned int count)
+        : vertices_(vertices), count_(count), epsilon_(0) {}
+    bool Build(ConvexHull* hull);
+
+  private:
+    struct HorizonEdge {
+        unsigned int a, b;    // along the removed face's winding
+        unsigned int outside; // the face that stays
+    };
+
+    Vec3 Point(unsigned int i) const { return Position(vertices_[i]); }
+    double Distance(const HullFace& face, unsigned int point) const {
+        return Dot(face.normal, Point(point)) - face.offset;
+    }
+    unsigned int AddFace(unsigned int a, unsigned int b, unsigned int c);
+    bool BuildSimplex(const std::vector<unsigned int>& candidates);
+    // Gives each point to the first of faces it is outside of; points is
+    // null for every vertex
+    void Assign(const unsigned int* points, unsigned int point_count,
+                const std::vector<unsigned int>& faces);
+    void Expand();
+    bool FindHorizon(unsigned int face, unsigned int eye);
+    bool FindConvexHorizon(unsigned int face, unsigned int eye);
+
+    const ColorVertex* vertices_;
+    unsigned int count_;
+    double epsilon_;
+    std::vector<HullFace> faces_;
+    std::vector<unsigned int> pending_; // faces that may have conflicts
+    // Scratch of FindHorizon() and Expand()
+    std::vector<unsigned int> visible_;
+    std::vector<HorizonEdge> horizon_;
+    std::vector<unsigned int> merged_;
+    std::vector<unsigned int> corners_;
+};
+
+unsigned int HullBuilder::AddFace(unsigned int a, unsigned int b,
+                                  unsigned int c) {
+    HullFace face;
+    face.v[0] = a;
+    face.v[1] = b;
+    face.v[2] = c;
+    // Linked up by the caller
+    face.neighbors[0] = face.neighbors[1] = face.neighbors[2] = ~0u;
+    Vec3 normal = Cross(Point(b) - Point(a), Point(c) - Point(a));
+    double length = std::sqrt(LengthSquared(normal));
+    face.normal = length > 0 ? normal * (1 / length) : Vec3{0, 0, 0};
+    face.offset = Dot(face.normal, Point(a));
+    face.furthest = 0;
+    face.furthest_distance = 0;
+    face.removed = false;
+    face.merged = false;
+    faces_.push_back(std::move(face));
+    return faces_.size() - 1;
+}
+
+bool HullBuilder::BuildSimplex(const std::vector<unsigned int>& candidates) {
+    // The two extremes furthest apart
+    unsigned int a = candidates[0], b = candidates[0];
+    double best = 0;
+    for (unsigned int i : candidates)
+        for (unsigned int j : candidates) {
+            double d = LengthSquared(Point(i) - Point(j));
+            if (d > best) {
+                best = d;
+                a = i;
+                b = j;
+            }
+        }
+    if (best <= epsilon_ * epsilon_)
+        return false;
+
+    // Then the vertex furthest from their line and the one furthest from
+    // the plane of the three. Ties can leave the extremes flat when the
+    // vertices are not, so both searches fall back on every vertex.
+    auto furthest = [&](const std::vector<unsigned int>* list,
+                        const auto& distance, unsigned int* found) {
+        double best = 0;
+        unsigned int n = list ? list->size() : count_;
+        for (unsigned int i = 0; i < n; i++) {
+            unsigned int point = list ? (*list)[i] : i;
+            double d = distance(point);
+            if (d > best) {
+                best = d;
+                *found = point;
+            }
+        }
+        return best;
+    };
+    Vec3 direction = Point(b) - Point(a);
+    direction = direction * (1 / std::sqrt(LengthSquared(direction)));
+    auto from_line = [&](unsigned int i) {
+        return std::sqrt(LengthSquared(Cross(Point(i) - Point(a), direction)));
+    };
+    unsigned int c = a;
+    if (furthest(&candidates, from_line, &c) <= epsilon_ &&
+        furthest(nullptr, from_line, &c) <= epsilon_)
+        return false;
+    Vec3 normal = Cross(Point(b) - Point(a), Point(c) - Point(a));
+    normal = normal * (1 / std::sqrt(LengthSquared(normal)));
+    auto from_plane = [&](unsigned int i) {
+        return std::fabs(Dot(normal, Point(i) - Point(a)));
+    };
+    unsigned int d = a;
+    if (furthest(&candidates, from_plane, &d) <= epsilon_ &&
+        furthest(nullptr, from_plane, &d) <= epsilon_)
+        return false;
+
+    // Wound so that d is below the first face
+    if (Dot(normal, Point(d) - Point(a)) > 0)
+        std::swap(b, c);
+    AddFace(a, b, c);
+    AddFace(a, d, b);
+    AddFace(b, d, c);
+    AddFace(c, d, a);
+    for (unsigned int f = 0; f < 4; f++)
+        for (unsigned int e = 0; e < 3; e++) {
+            unsigned int from = faces_[f].v[e];
+            unsigned int to = faces_[f].v[(e + 1) % 3];
+            for (unsigned int g = 0; g < 4; g++)
+                for (unsigned int k = 0; k < 3; k++)
+                    if (faces_[g].v[k] == to &&
+                        faces_[g].v[(k + 1) % 3] == from)
+                        faces_[f].neighbors[e] = g;
+        }
+    return true;
+}
+
+void HullBuilder::Assign(const unsigned int* points, unsigned int point_count,
+                         const std::vector<unsigned int>& faces) {
+    const unsigned int kInside = std::numeric_limits<unsigned int>::max();
+    auto owner_of = [&](unsigned int point, double* distance) {
+        for (unsigned int f : faces) {
+            double d = Distance(faces_[f], point);
+            if (d > epsilon_) {
+                *distance = d;
+                return f;
+            }
+        }
+        return kInside;
+    };
+    auto add = [&](unsigned int point, unsigned int f, double distance) {
+        HullFace& face = faces_[f];
+        if (face.conflicts.empty())
+            pending_.push_back(f);
+        face.conflicts.push_back(point);
+        if (distance > face.furthest_distance) {
+            face.furthest_distance = distance;
+            face.furthest = point;
+        }
+    };
+
+    if (point_count <= kParallelRange) {
+        for (unsigned int i = 0; i < point_count; i++) {
+            unsigned int point = points ? points[i] : i;
+            double distance;
+            unsigned int f = owner_of(point, &distance);
+            if (f != kInside)
+                add(point, f, distance);
+        }
+        return;
+    }
+    // The tests in parallel, the lists filled in order afterwards
+    std::vector<unsigned int> owners(point_count);
+    std::vector<double> distances(point_count);
+    JobSystem::Instance().ParallelFor(
+        point_count, kParallelRange,
+        [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+                owners[i] =
+                    owner_of(points ? points[i] : i, &distances[i]);
+        });
+    for (unsigned int i = 0; i < point_count; i++)
+        if (owners[i] != kInside)
+            add(points ? points[i] : i, owners[i], distances[i]);
+}
+
+// Marks the faces eye sees, starting from face, as removed and fills
+// horizon_ with the edges around them in order. Gives up, with nothing
+// changed, if rounding made the visible faces anything but a disc.
+bool HullBuilder::FindHorizon(unsigned int face, unsigned int eye) {
+    struct Step {
+        unsigned int face;
+        unsigned int first_edge;
+        unsigned int edges_done;
+    };
+    std::vector<Step> stack(1, Step{face, 0, 0});
+    visible_.assign(1, face);
+    horizon_.clear();
+    faces_[face].removed = true;
+    while (!stack.empty()) {
+        Step& step = stack.back();
+        if (step.edges_done == 3) {
+            stack.pop_back();
+            continue;
+        }
+        unsigned int current = step.face;
+        unsigned int edge = (step.first_edge + step.edges_done++) % 3;
+        unsigned int neighbor = faces_[current].neighbors[edge];
+        if (faces_[neighbor].removed)
+            continue;
+        if (faces_[neighbor].merged ||
+            Distance(faces_[neighbor], eye) > epsilon_) {
+            faces_[neighbor].removed = true;
+            visible_.push_back(neighbor);
+            // Around the neighbor starting after the edge crossed
+            unsigned int back = 0;
+            while (faces_[neighbor].neighbors[back] != current)
+                back++;
+            stack.push_back(Step{neighbor, back + 1, 0});
+        } else {
+            const HullFace& removed = faces_[current];
+            horizon_.push_back(HorizonEdge{
+                removed.v[edge], removed.v[(edge + 1) % 3], neighbor});
+        }
+    }
+
+    bool closed = horizon_.size() >= 3;
+    for (size_t i = 0; closed && i < horizon_.size(); i++)
+        closed = horizon_[i].b == horizon_[(i + 1) % horizon_.size()].a;
+    if (!closed)
+        for (unsigned int f : visible_)
+            faces_[f].removed = false;
+    return closed;
+}
+
+// FindHorizon(), widened while a new face would fold back over the face
+// across its horizon edge, or be too thin to have a normal. Both come of an
+// eye nearly level with a face, and left in they turn the hull inside out
+// around them.
+bool HullBuilder::FindConvexHorizon(unsigned int face, unsigned int eye) {
+    merged_.clear();
+    bool found;
+    while ((found = FindHorizon(face, eye))) {
+        bool widened = false;
+        for (const HorizonEdge& edge : horizon_) {
+            const HullFace& outside = faces_[edge.outside];
+            unsigned int far = outside.v[0];
+            for (unsigned int k = 1; k < 3; k++)
+                if (far == edge.a || far == edge.b)
+                    far = outside.v[k];
+            Vec3 along = Point(edge.b) - Point(edge.a);
+            Vec3 normal = Cross(along, Point(eye) - Point(edge.a));
+            double length = std::sqrt(LengthSquared(normal));
+            if (length <= epsilon_ * std::sqrt(LengthSquared(along)) ||
+                Dot(normal, Point(far) - Point(edge.a)) > epsilon_ * length) {
+                faces_[edge.outside].merged = true;
+                merged_.push_back(edge.outside);
+                widened = true;
+            }
+        }
+        if (!widened)
+            break;
+        for (unsigned int v : visible_)
+            faces_[v].removed = false;
+    }
+    for (unsigned int f : merged_)
+        faces_[f].merged = false;
+    return found;
+}
+
+void HullBuilder::Expand() {
+    std::vector<unsigned int> orphans;
+    std::vector<unsigned int> new_faces;
+    while (!pending_.empty()) {
+        unsigned int f = pending_.back();
+        pending_.pop_back();
+        if (faces_[f].removed || faces_[f].conflicts.empty())
+            continue;
+        unsigned int eye = faces_[f].furthest;
+        if (!FindConvexHorizon(f, eye)) {
+            // Too close to call: the vertex is taken as on the hull
+            HullFace& face = faces_[f];
+            face.conflicts.erase(std::find(face.conflicts.begin(),
+                                           face.conflicts.end(), eye));
+            face.furthest_distance = 0;
+            for (unsigned int point : face.conflicts) {
+                double d = Distance(face, point);
+                if (d > face.furthest_distance) {
+                    face.furthest_distance = d;
+                    face.furthest = point;
+                }
+            }
+            if (!face.conflicts.empty())
+                pending_.push_back(f);
+            continue;
+        }
+
+        orphans.clear();
+        for (unsigned int v : visible_) {
+            for (unsigned int point : faces_[v].conflicts)
+                if (point != eye)
+                    orphans.push_back(point);
+            std::vector<unsigned int>().swap(faces_[v].conflicts);
+        }
+        // Vertices of merged faces need not be under the new ones, so every
+        // vertex leaving the hull goes back in with the conflicts
+        corners_.clear();
+        for (unsigned int v : visible_)
+            corners_.insert(corners_.end(), faces_[v].v, faces_[v].v + 3);
+        std::sort(corners_.begin(), corners_.end());
+        corners_.erase(std::unique(corners_.begin(), corners_.end()),
+                       corners_.end());
+        for (const HorizonEdge& edge : horizon_)
+            *std::lower_bound(corners_.begin(), corners_.end(), edge.a) = eye;
+        for (unsigned int corner : corners_)
+            if (corner != eye)
+                orphans.push_back(corner);
+
+        // A fan from the eye to the horizon, each new face joined to the
+        // one before it and to the face across its horizon edge
+        new_faces.clear();
+        for (const HorizonEdge& edge : horizon_) {
+            unsigned int added = AddFace(edge.a, edge.b, eye);
+            faces_[added].neighbors[0] = edge.outside;
+            HullFace& outside = faces_[edge.outside];
+            for (unsigned int k = 0; k < 3; k++)
+                if (outside.v[k] == edge.b && outside.v[(k + 1) % 3] == edge.a)
+                    outside.neighbors[k] = added;
+            new_faces.push_back(added);
+        }
+        unsigned int n = new_faces.size();
+        for (unsigned int i = 0; i < n; i++) {
+            faces_[new_faces[i]].neighbors[1] = new_faces[(i + 1) % n];
+            faces_[new_faces[i]].neighbors[2] = new_faces[(i + n - 1) % n];
+        }
+        Assign(orphans.data(), orphans.size(), new_faces);
+    }
+}
+
+bool HullBuilder::Build(ConvexHull* hull) {
+    hull->vertices.clear();
+    hull->triangles.clear();
+    if (count_ < 4)
+        return false;
+
+    // Extremes along the fixed directions, and the largest coordinates for
+    // the tolerance
+    struct Extremes {
+        unsigned int min[kDirectionCount];
+        unsigned int max[kDirectionCount];
+        float magnitude[3];
+    };
+    Extremes initial = {};
+    std::vector<Extremes> partial = ReduceChunks(
+        count_, initial,
+        [this](unsigned int begin, unsigned int end, Extremes* out) {
+            float low[kDirectionCount], high[kDirectionCount];
+            for (unsigned int d = 0; d < kDirectionCount; d++) {
+                out->min[d] = out->max[d] = begin;
+                low[d] = std::numeric_limits<float>::max();
+                high[d] = -std::numeric_limits<float>::max();
+            }
+            for (unsigned int i = begin; i < end; i++) {
+                const float* p = vertices_[i].position;
+                for (unsigned int d = 0; d < kDirectionCount; d++) {
+                    float t = p[0] * kDirections[d][0] +
+                              p[1] * kDirections[d][1] +
+                              p[2] * kDirections[d][2];
+                    if (t < low[d]) {
+                        low[d] = t;
+                        out->min[d] = i;
+                    }
+                    if (t > high[d]) {
+                        high[d] = t;
+                        out->max[d] = i;
+                    }
+                }
+                for (int k = 0; k < 3; k++)
+                    out->magnitude[k] =
+                        std::max(out->magnitude[k], std::fabs(p[k]));
+            }
+        });
+    std::vector<unsigned int> candidates;
+    double magnitude[3] = {0, 0, 0};
+    for (const Extremes& extremes : partial) {
+        for (unsigned int d = 0; d < kDirectionCount; d++) {
+            candidates.push_back(extremes.min[d]);
+            candidates.push_back(extremes.max[d]);
+        }
+        for (int k = 0; k < 3; k++)
+            magnitude[k] =
+                std::max(magnitude[k], (double)extremes.magnitude[k]);
+    }
+    // The tolerance qhull uses for float input
+    epsilon_ = 3 * FLT_EPSILON * (magnitude[0] + magnitude[1] + magnitude[2]);
+    auto along = [this](unsigned int i, unsigned int d) {
+        const float* p = vertices_[i].position;
+        return p[0] * kDirections[d][0] + p[1] * kDirections[d][1] +
+               p[2] * kDirections[d][2];
+    };
+    if (partial.size() > 1) {
+        // Only each chunk's winners are candidates so far
+        std::vector<unsigned int> winners;
+        for (unsigned int d = 0; d < kDirectionCount; d++) {
+            unsigned int low = candidates[2 * d], high = candidates[2 * d + 1];
+            for (size_t c = 0; c < partial.size(); c++) {
+                unsigned int i = partial[c].min[d], j = partial[c].max[d];
+                if (along(i, d) < along(low, d))
+                    low = i;
+                if (along(j, d) > along(high, d))
+                    high = j;
+            }
+            winners.push_back(low);
+            winners.push_back(high);
+        }
+        candidates.swap(winners);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+
+    if (!BuildSimplex(candidates)) {
+        faces_.clear();
+        return false;
+    }
+    std::vector<unsigned int> all_faces = {0, 1, 2, 3};
+    Assign(candidates.data(), candidates.size(), all_faces);
+    Expand();
+
+    // Everything against the hull of the extremes, which most of it is in
+    all_faces.clear();
+    for (unsigned int f = 0; f < faces_.size(); f++)
+        if (!faces_[f].removed)
+            all_faces.push_back(f);
+    Assign(nullptr, count_, all_faces);
+    Expand();
+
+    for (const HullFace& face : faces_) {
+        if (face.removed)
+            continue;
+        hull->triangles.push_back(Triangle{{face.v[0], face.v[1], face.v[2]}});
+        hull->vertices.insert(hull->vertices.end(), face.v, face.v + 3);
+    }
+    std::sort(hull->vertices.begin(), hull->vertices.end());
+    hull->vertices.erase(
+        std::unique(hull->vertices.begin(), hull->vertices.end()),
+        hull->vertices.end());
+    return true;
+}
+
+// Eigenvectors of a symmetric matrix by cyclic Jacobi rotations, as the
+// columns of vectors
+void SymmetricEigenvectors(double a[3][3], double vectors[3][3]) {
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            vectors[i][j] = i == j;
+    double scale = std::fabs(a[0][0]) + std::fabs(a[1][1]) + std::fabs(a[2][2]);
+    for (unsigned int sweep = 0; sweep < kJacobiSweeps; sweep++) {
+        double off =
+            std::fabs(a[0][1]) + std::fabs(a[0][2]) + std::fabs(a[1][2]);
+        if (off <= 1e-15 * scale || off == 0)
+            return;
+        for (int p = 0; p < 2; p++)
+            for (int q = p + 1; q < 3; q++) {
+                if (a[p][q] == 0)
+                    continue;
+                double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                double t = (theta >= 0 ? 1 : -1) /
+                           (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int k = 0; k < 3; k++) {
+                    double kp = a[k][p], kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for (int k = 0; k < 3; k++) {
+                    double pk = a[p][k], qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                }
+                for (int k = 0; k < 3; k++) {
+                    double kp = vectors[k][p], kq = vectors[k][q];
+                    vectors[k][p] = c * kp - s * kq;
+                    vectors[k][q] = s * kp + c * kq;
+                }
+            }
+    }
+}
+
+} // namespace
+
+Aabb ComputeAabbParallel(const ColorVertex* vertices, unsigned int count) {
+    if (count <= kParallelRange)
+        return ComputeAabb(vertices, count);
+    std::vector<Aabb> partial = ReduceChunks(
+        count, Aabb(), [vertices](unsigned int begin, unsigned int end,
+                                  Aabb* out) {
+            *out = ComputeAabb(vertices + begin, end - begin);
+        });
+    Aabb box = partial[0];
+    for (const Aabb& part : partial)
+        for (int k = 0; k < 3; k++) {
+            box.min[k] = std::min(box.min[k], part.min[k]);
+            box.max[k] = std::max(box.max[k], part.max[k]);
+        }
+    return box;
+}
+
+BoundingSphere ComputeRitterSphere(const ColorVertex* vertices,
+                                   unsigned int count) {
+    BoundingSphere result = {{0, 0, 0}, 0};
+    if (count == 0)
+        return result;
+    auto furthest = [&](Vec3 from) {
+        unsigned int best = 0;
+        double best_distance = -1;
+        for (unsigned int i = 0; i < count; i++) {
+            double d = LengthSquared(Position(vertices[i]) - from);
+            if (d > best_distance) {
+                best_distance = d;
+                best = i;
+            }
+        }
+        return Position(vertices[best]);
+    };
+    Vec3 a = furthest(Position(vertices[0]));
+    Vec3 b = furthest(a);
+    Vec3 center = (a + b) * 0.5;
+    double radius = std::sqrt(LengthSquared(b - center));
+    for (unsigned int i = 0; i < count; i++) {
+        Vec3 p = Position(vertices[i]);
+        double d = std::sqrt(LengthSquared(p - center));
+        if (d > radius) {
+            // Just wide enough to take p and keep the far side
+            double grown = (radius + d) * 0.5;
+            center = center + (p - center) * ((grown - radius) / d);
+            radius = grown;
+        }
+    }
+    result.center[0] = center.x;
+    result.center[1] = center.y;
+    result.center[2] = center.z;
+    result.radius = radius;
+    return result;
+}
+
+BoundingSphere ComputeMinimalSphere(const ColorVertex* vertices,
+                                    unsigned int count) {
+    BoundingSphere result = {{0, 0, 0}, 0};
+    if (count == 0)
+        return result;
+    // Shuffled with a fixed seed, so the result does not change between runs
+    std::vector<Vec3> p(count);
+    for (unsigned int i = 0; i < count; i++)
+        p[i] = Position(vertices[i]);
+    std::shuffle(p.begin(), p.end(), std::mt19937(count));
+
+    // Each level fixes one more point on the boundary
+    Sphere sphere = SphereThrough(p[0]);
+    for (unsigned int i = 1; i < count; i++) {
+        if (sphere.Contains(p[i]))
+            continue;
+        sphere = SphereThrough(p[i]);
+        for (unsigned int j = 0; j < i; j++) {
+            if (sphere.Contains(p[j]))
+                continue;
+            sphere = SphereThrough(p[i], p[j]);
+            for (unsigned int k = 0; k < j; k++) {
+                if (sphere.Contains(p[k]))
+                    continue;
+                sphere = SphereThrough(p[i], p[j], p[k]);
+                for (unsigned int l = 0; l < k; l++)
+                    if (!sphere.Contains(p[l]))
+                        sphere = SphereThrough(p[i], p[j], p[k], p[l]);
+            }
+        }
+    }
+    result.center[0] = sphere.center.x;
+    result.center[1] = sphere.center.y;
+    result.center[2] = sphere.center.z;
+    result.radius = std::sqrt(sphere.radius_squared);
+    return result;
+}
+
+Obb ComputePcaObb(const ColorVertex* vertices, unsigned int count) {
+    Obb obb = {};
+    for (int k = 0; k < 3; k++)
+        obb.axes[k][k] = 1;
+    if (count == 0)
+        return obb;
+
+    // Sums of the coordinates and of their products, one chunk at a time
+    struct Moments {
+        double sum[3];
+        double products[3][3];
+    };
+    std::vector<Moments> partial = ReduceChunks(
+        count, Moments(),
+        [vertices](unsigned int begin, unsigned int end, Moments* out) {
+            for (unsigned int i = begin; i < end; i++) {
+                const float* p = vertices[i].position;
+                for (int r = 0; r < 3; r++) {
+                    out->sum[r] += p[r];
+                    for (int c = r; c < 3; c++)
+                        out->products[r][c] += (double)p[r] * p[c];
+                }
+            }
+        });
+    Moments total = {};
+    for (const Moments& part : partial)
+        for (int r = 0; r < 3; r++) {
+            total.sum[r] += part.sum[r];
+            for (int c = r; c < 3; c++)
+                total.products[r][c] += part.products[r][c];
+        }
+    double mean[3], covariance[3][3];
+    for (int r = 0; r < 3; r++)
+        mean[r] = total.sum[r] / count;
+    for (int r = 0; r < 3; r++)
+        for (int c = r; c < 3; c++)
+            covariance[r][c] = covariance[c][r] =
+                total.products[r][c] / count - mean[r] * mean[c];
+
+    double vectors[3][3];
+    SymmetricEigenvectors(covariance, vectors);
+    Vec3 axes[3];
+    for (int k = 0; k < 2; k++) {
+        axes[k] = {vectors[0][k], vectors[1][k], vectors[2][k]};
+        axes[k] = axes[k] * (1 / std::sqrt(LengthSquared(axes[k])));
+    }
+    axes[2] = Cross(axes[0], axes[1]); // right-handed
+
+    struct Range {
+        double low[3];
+        double high[3];
+    };
+    Range empty;
+    for (int k = 0; k < 3; k++) {
+        empty.low[k] = std::numeric_limits<double>::max();
+        empty.high[k] = -std::numeric_limits<double>::max();
+    }
+    std::vector<Range> ranges = ReduceChunks(
+        count, empty,
+        [vertices, &axes](unsigned int begin, unsigned int end, Range* out) {
+            for (unsigned int i = begin; i < end; i++) {
+                Vec3 p = Position(vertices[i]);
+                for (int k = 0; k < 3; k++) {
+                    double t = Dot(axes[k], p);
+                    out->low[k] = std::min(out->low[k], t);
+                    out->high[k] = std::max(out->high[k], t);
+                }
+            }
+        });
+    Range range = empty;
+    for (const Range& part : ranges)
+        for (int k = 0; k < 3; k++) {
+            range.low[k] = std::min(range.low[k], part.low[k]);
+            range.high[k] = std::max(range.high[k], part.high[k]);
+        }
+    Vec3 center = {0, 0, 0};
+    for (int k = 0; k < 3; k++) {
+        center = center + axes[k] * ((range.low[k] + range.high[k]) * 0.5);
+        obb.half_extents[k] = (range.high[k] - range.low[k]) * 0.5;
+        obb.axes[k][0] = axes[k].x;
+        obb.axes[k][1] = axes[k].y;
+        obb.axes[k][2] = axes[k].z;
+    }
+    obb.center[0] = center.x;
+    obb.center[1] = center.y;
+    obb.center[2] = center.z;
+    return obb;
+}
+
+bool ComputeConvexHull(const ColorVertex* vertices, unsigned int count,
+                       ConvexHull* hull) {
+    return HullBuilder(vertices, count).Build(hull);
+}
+
+void ComputeMeshBounds(const ColorVertex* vertices, unsigned int count,
+                       MeshBounds* bounds) {
+    bounds->box = ComputeAabbParallel(vertices, count);
+    if (!ComputeConvexHull(vertices, count, &bounds->hull)) {
+        bounds->sphere = ComputeMinimalSphere(vertices, count);
+        bounds->obb = ComputePcaObb(vertices, count);
+        return;
+    }
+    std::vector<ColorVertex> corners(bounds->hull.vertices.size());
+    for (size_t i = 0; i < corners.size(); i++)
+        corners[i] = vertices[bounds->hull.vertices[i]];
+    bounds->sphere = ComputeMinimalSphere(corners.data(), corners.size());
+    bounds->obb = ComputePcaObb(corners.data(), corners.size());
+}
@@ -0,0 +1,71 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <vector>
+
+#include "bounds.h"
+#include "vertices.h"
+
+// Bounding volumes of a vertex buffer, all in model space. The passes over
+// every vertex are spread over the job system; what is left after them works
+// on the few vertices that can matter.
+
+struct BoundingSphere {
+    float center[3];
+    float radius;
+};
+
+// Box along three orthonormal axes
+struct Obb {
+    float center[3];
+    float axes[3][3];
+    float half_extents[3]; // along each axis
+};
+
+// Triangles wind counter-clockwise seen from outside and index the vertex
+// buffer the hull was built from, so it can be drawn with the same buffer.
+struct ConvexHull {
+    std::vector<unsigned int> vertices; // on the hull, ascending
+    std::vector<Triangle> triangles;
+};
+
+// Everything below for one vertex buffer
+struct MeshBounds {
+    Aabb box;
+    BoundingSphere sphere; // the smallest one
+    Obb obb;
+    ConvexHull hull; // empty when the vertices span no volume
+};
+
+// ComputeAabb() over several threads
+Aabb ComputeAabbParallel(const ColorVertex* vertices, unsigned int count);
+
+// Ritter's sphere: one pass to grow a first guess from two far apart
+// vertices. A few percent larger than the smallest, at the cost of two
+// scans for the guess and one more to grow it.
+BoundingSphere ComputeRitterSphere(const ColorVertex* vertices,
+                                   unsigned int count);
+// Welzl's smallest enclosing sphere, as the randomized incremental version
+// so deep inputs do not recurse. Expected linear time, but best run on the
+// hull's vertices, which enclose the same sphere.
+BoundingSphere ComputeMinimalSphere(const ColorVertex* vertices,
+                                    unsigned int count);
+
+// Axes from the principal components of the vertices, extents from their
+// projections. The covariance follows where vertices are dense rather than
+// the shape, so it too does better on the hull's vertices.
+Obb ComputePcaObb(const ColorVertex* vertices, unsigned int count);
+
+// Quickhull. Extreme vertices along a few fixed directions make a first
+// hull; every vertex is then tested against it in parallel, which drops
+// most of them, and the rest are added one furthest vertex at a time, with
+// large conflict lists redistributed in parallel too. Returns false, with
+// hull emptied, when the vertices are coplanar or fewer than four.
+bool ComputeConvexHull(const ColorVertex* vertices, unsigned int count,
+                       ConvexHull* hull);
+
+// Hull first, then the sphere and the box from the hull's vertices
+void ComputeMeshBounds(const ColorVertex* vertices, unsigned int count,
+                       MeshBounds* bounds);
+
+#endif // GEOMETRY_H
@@ -0,0 +1,269 @@
+#include "gpuresources.h"
+
+#include <iostream>
+
+const char* GpuResources::CategoryName(Category category) {
+    switch (category) {
+    case VertexArrays:
+        return "vertex arrays";
+    case VertexBuffers:
+        return "vertex buffers";
+    case IndexBuffers:
+        return "index buffers";
+    case PixelBuffers:
+        return "pixel buffers";
+    case UniformBuffers:
+        return "uniform buffers";
+    case Textures:
+        return "textures";
+    case Programs:
+        return "programs";
+    case Shaders:
+        return "shaders";
+    default:
+        return "unknown";
+    }
+}
+
+GpuResources& GpuResources::Instance() {
+    // Never destroyed, so handles in static objects can still report to it
+    static GpuResources* instance = new GpuResources();
+    return *instance;
+}
+
+GpuResources::GpuResources() {
+    for (Totals& totals : totals_)
+        totals = Totals();
+    bytes_ = 0;
+    budget_ = 0;
+    errors_ = 0;
+}
+
+void GpuResources::Track(Category category, GLuint name, const char* owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Record& record = records_[Key(category, name)];
+    if (!record.owner.empty()) {
+        // GL only hands out a live name again if it was deleted behind our back
+        std::cerr << "ERROR: " << CategoryName(category) << " " << name
+                  << " of " << record.owner << " created again by " << owner
+                  << " without being untracked" << std::endl;
+        errors_++;
+        totals_[category].count--;
+        totals_[category].bytes -= record.bytes;
+        owner_bytes_[record.owner] -= record.bytes;
+        bytes_ -= record.bytes;
+    }
+    record.owner = owner;
+    record.bytes = 0;
+    totals_[category].count++;
+}
+
+void GpuResources::Resize(Category category, GLuint name, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<unsigned long long, Record>::iterator found =
+        records_.find(Key(category, name));
+    if (found == records_.end()) {
+        std::cerr << "ERROR: Sizing untracked " << CategoryName(category)
+                  << " " << name << std::endl;
+        errors_++;
+        return;
+    }
+    Record& record = found->second;
+    totals_[category].bytes += bytes - record.bytes;
+    owner_bytes_[record.owner] += bytes - record.bytes;
+    bytes_ += bytes - record.bytes;
+    record.bytes = bytes;
+    WarnIfOverBudget(record.owner);
+}
+
+void GpuResources::Untrack(Category category, GLuint name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<unsigned long long, Record>::iterator found =
+        records_.find(Key(category, name));
+    if (found == records_.end()) {
+        std::cerr << "ERROR: Deleting " << CategoryName(category) << " "
+                  << name << " that is already deleted or was never created"
+                  << std::endl;
+        errors_++;
+        return;
+    }
+    const Record& record = found->second;
+    totals_[category].count--;
+    totals_[category].bytes -= record.bytes;
+    owner_bytes_[record.owner] -= record.bytes;
+    bytes_ -= record.bytes;
+    records_.erase(found);
+}
+
+size_t GpuResources::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+size_t GpuResources::bytes(Category category) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totals_[category].bytes;
+}
+
+size_t GpuResources::OwnerBytes(const char* owner) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, size_t>::const_iterator found =
+        owner_bytes_.find(owner);
+    return found == owner_bytes_.end() ? 0 : found->second;
+}
+
+unsigned int GpuResources::count(Category category) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totals_[category].count;
+}
+
+unsigned int GpuResources::errors() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return errors_;
+}
+
+void GpuResources::SetBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = bytes;
+}
+
+void GpuResources::SetOwnerBudget(const char* owner, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    owner_budgets_[owner] = bytes;
+}
+
+bool GpuResources::Fits(const char* owner, size_t bytes,
+                        size_t released_bytes) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (budget_ && bytes_ - released_bytes + bytes > budget_)
+        return false;
+    std::map<std::string, size_t>::const_iterator budget =
+        owner_budgets_.find(owner);
+    if (budget == owner_budgets_.end() || budget->second == 0)
+        return true;
+    std::map<std::string, size_t>::const_iterator used =
+        owner_bytes_.find(owner);
+    size_t owner_bytes = used == owner_bytes_.end() ? 0 : used->second;
+    return owner_bytes - released_bytes + bytes <= budget->second;
+}
+
+void GpuResources::WarnIfOverBudget(const std::string& owner) const {
+    if (budget_ && bytes_ > budget_)
+        std::cerr << "WARNING: GPU memory " << bytes_ / 1048576.0
+                  << " MiB is over the " << budget_ / 1048576.0
+                  << " MiB budget" << std::endl;
+    std::map<std::string, size_t>::const_iterator budget =
+        owner_budgets_.find(owner);
+    if (budget != owner_budgets_.end() && budget->second &&
+        owner_bytes_.at(owner) > budget->second)
+        std::cerr << "WARNING: " << owner << " holds "
+                  << owner_bytes_.at(owner) / 1048576.0 << " MiB, over its "
+                  << budget->second / 1048576.0 << " MiB budget" << std::endl;
+}
+
+void GpuResources::LogReport() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << "GPU memory: " << bytes_ / 1048576.0 << " MiB";
+    if (budget_)
+        std::cout << " of " << budget_ / 1048576.0 << " MiB budget";
+    std::cout << ", " << records_.size() << " objects, " << errors_
+              << " errors" << std::endl;
+    for (int c = 0; c < kCategoryCount; c++)
+        if (totals_[c].count)
+            std::cout << "  " << CategoryName((Category)c) << ": "
+                      << totals_[c].count << ", "
+                      << totals_[c].bytes / 1048576.0 << " MiB" << std::endl;
+    for (const std::pair<const std::string, size_t>& owner : owner_bytes_) {
+        std::cout << "  " << owner.first << ": "
+                  << owner.second / 1048576.0 << " MiB";
+        std::map<std::string, size_t>::const_iterator budget =
+            owner_budgets_.find(owner.first);
+        if (budget != owner_budgets_.end() && budget->second)
+            std::cout << " of " << budget->second / 1048576.0 << " MiB";
+        std::cout << std::endl;
+    }
+}
+
+unsigned int GpuResources::CheckLeaks() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::pair<const unsigned long long, Record>& entry : records_)
+        std::cerr << "LEAK: " << CategoryName((Category)(entry.first >> 32))
+                  << " " << (GLuint)entry.first << " of "
+                  << entry.second.owner << ", " << entry.second.bytes
+                  << " bytes" << std::endl;
+    if (errors_)
+        std::cerr << errors_ << " GPU object errors during the run"
+                  << std::endl;
+    return records_.size();
+}
+
+GpuObject::GpuObject(GpuObject&& other)
+    : name_(other.name_), category_(other.category_) {
+    other.name_ = 0;
+}
+
+void GpuObject::Adopt(GpuResources::Category category, GLuint name,
+                      const char* owner) {
+    name_ = name;
+    category_ = category;
+    GpuResources::Instance().Track(category, name, owner);
+}
+
+GLuint GpuObject::Disown() {
+    GLuint name = name_;
+    GpuResources::Instance().Untrack(category_, name);
+    name_ = 0;
+    return name;
+}
+
+void GpuVertexArray::Create(const char* owner) {
+    Reset();
+    GLuint name;
+    glGenVertexArrays(1, &name);
+    Adopt(GpuResources::VertexArrays, name, owner);
+}
+
+void GpuVertexArray::Reset() {
+    if (!name_)
+        return;
+    GLuint name = Disown();
+    glDeleteVertexArrays(1, &name);
+}
+
+void GpuBuffer::Create(GpuResources::Category category, const char* owner) {
+    Reset();
+    GLuint name;
+    glGenBuffers(1, &name);
+    Adopt(category, name, owner);
+}
+
+void GpuBuffer::Allocate(GLenum target, size_t bytes, const void* data,
+                         GLenum usage) {
+    glBufferData(target, (GLsizeiptr)bytes, data, usage);
+    GpuResources::Instance().Resize(category_, name_, bytes);
+}
+
+void GpuBuffer::Reset() {
+    if (!name_)
+        return;
+    GLuint name = Disown();
+    glDeleteBuffers(1, &name);
+}
+
+void GpuTexture::Create(const char* owner) {
+    Reset();
+    GLuint name;
+    glGenTextures(1, &name);
+    Adopt(GpuResources::Textures, name, owner);
+}
+
+void GpuTexture::SetBytes(size_t bytes) {
+    GpuResources::Instance().Resize(GpuResources::Textures, name_, bytes);
+}
+
+void GpuTexture::Reset() {
+    if (!name_)
+        return;
+    GLuint name = Disown();
+    glDeleteTextures(1, &name);
+}
@@ -0,0 +1,138 @@
+#ifndef GPURESOURCES_H
+#define GPURESOURCES_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <GL/glew.h>
+
+// Registry of the GL objects the program owns: what each one is, who made it
+// and how many bytes it holds. The handles below report to it on their own;
+// objects created some other way call Track() and Untrack() directly. Also
+// keeps memory budgets, and at shutdown reports objects never deleted.
+class GpuResources {
+  public:
+    enum Category {
+        VertexArrays,
+        VertexBuffers,
+        IndexBuffers,
+        PixelBuffers,
+        UniformBuffers,
+        Textures,
+        Programs,
+        Shaders,
+        kCategoryCount,
+    };
+    static const char* CategoryName(Category category);
+
+    static GpuResources& Instance();
+
+    void Track(Category category, GLuint name, const char* owner);
+    void Resize(Category category, GLuint name, size_t bytes);
+    // Deleting an object twice, or one that was never tracked, is logged
+    void Untrack(Category category, GLuint name);
+
+    size_t bytes() const;
+    size_t bytes(Category category) const;
+    size_t OwnerBytes(const char* owner) const;
+    unsigned int count(Category category) const;
+    unsigned int errors() const; // double deletes and reused names
+
+    // 0 means no limit. Going over only warns; callers about to make
+    // something big ask Fits() first.
+    void SetBudget(size_t bytes);
+    void SetOwnerBudget(const char* owner, size_t bytes);
+    // Whether owner can take bytes more once released_bytes of its current
+    // ones are deleted, within the total and the owner's budgets.
+    bool Fits(const char* owner, size_t bytes,
+              size_t released_bytes = 0) const;
+
+    void LogReport() const;
+    // Logs every object still alive; call once everything should be gone.
+    // Returns how many there were.
+    unsigned int CheckLeaks() const;
+
+  private:
+    struct Record {
+        std::string owner;
+        size_t bytes;
+    };
+    struct Totals {
+        unsigned int count;
+        size_t bytes;
+    };
+
+    GpuResources();
+    static unsigned long long Key(Category category, GLuint name) {
+        return (unsigned long long)category << 32 | name;
+    }
+    void WarnIfOverBudget(const std::string& owner) const;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<unsigned long long, Record> records_;
+    Totals totals_[kCategoryCount];
+    std::map<std::string, size_t> owner_bytes_;
+    std::map<std::string, size_t> owner_budgets_;
+    size_t bytes_;
+    size_t budget_;
+    unsigned int errors_;
+};
+
+// Owns one GL object for its lifetime, deleting it from the destructor or
+// Reset(). Move only. Converts to the GL name for binding; 0 while empty.
+class GpuObject {
+  public:
+    GpuObject(const GpuObject&) = delete;
+    GpuObject& operator=(const GpuObject&) = delete;
+    operator GLuint() const { return name_; }
+
+  protected:
+    GpuObject() : name_(0), category_(GpuResources::VertexArrays) {}
+    GpuObject(GpuObject&& other);
+    void Adopt(GpuResources::Category category, GLuint name,
+               const char* owner);
+    // Takes the name out of the registry and returns it for deletion
+    GLuint Disown();
+
+    GLuint name_;
+    GpuResources::Category category_;
+};
+
+class GpuVertexArray : public GpuObject {
+  public:
+    GpuVertexArray() {}
+    GpuVertexArray(GpuVertexArray&& other) : GpuObject(std::move(other)) {}
+    ~GpuVertexArray() { Reset(); }
+    void Create(const char* owner);
+    void Reset();
+};
+
+class GpuBuffer : public GpuObject {
+  public:
+    GpuBuffer() {}
+    GpuBuffer(GpuBuffer&& other) : GpuObject(std::move(other)) {}
+    ~GpuBuffer() { Reset(); }
+    // category is one of the buffer categories
+    void Create(GpuResources::Category category, const char* owner);
+    // glBufferData on target, which must have this buffer bound
+    void Allocate(GLenum target, size_t bytes, const void* data,
+                  GLenum usage);
+    void Reset();
+};
+
+class GpuTexture : public GpuObject {
+  public:
+    GpuTexture() {}
+    GpuTexture(GpuTexture&& other) : GpuObject(std::move(other)) {}
+    ~GpuTexture() { Reset(); }
+    void Create(const char* owner);
+    // Storage of all levels, once they have been specified
+    void SetBytes(size_t bytes);
+    void Reset();
+};
+
+#endif // GPURESOURCES_H
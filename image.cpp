@@ -0,0 +1,361 @@
+#include "image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Rows are stored bottom row first, the way glTexImage2D expects them.
+
+static bool ReadPnmToken(std::ifstream& file, unsigned int* value) {
+    int c = file.get();
+    while (c != EOF && (isspace(c) || c == '#')) {
+        if (c == '#')
+            while (c != EOF && c != '\n')
+                c = file.get();
+        c = file.get();
+    }
+    if (c == EOF || !isdigit(c))
+        return false;
+    *value = 0;
+    while (c != EOF && isdigit(c)) {
+        // Anything this long is rejected anyway; stop before it wraps
+        if (*value <= kMaxImageSize)
+            *value = *value * 10 + (c - '0');
+        c = file.get();
+    }
+    return true; // the single whitespace after the token is consumed
+}
+
+// Checked before anything is allocated for the pixels
+static bool CheckImageSize(unsigned int width, unsigned int height,
+                           const char** error) {
+    if (width > kMaxImageSize || height > kMaxImageSize) {
+        *error = "image larger than 16384 pixels on a side";
+        return false;
+    }
+    return true;
+}
+
+static bool DecodePnm(std::ifstream& file, bool color, unsigned int* width,
+                      unsigned int* height, std::vector<unsigned char>* rgba,
+                      const char** error) {
+    unsigned int max_value;
+    if (!ReadPnmToken(file, width) || !ReadPnmToken(file, height) ||
+        !ReadPnmToken(file, &max_value)) {
+        *error = "malformed PNM header";
+        return false;
+    }
+    if (max_value == 0 || max_value > 255) {
+        *error = "only 8-bit PNM files are supported";
+        return false;
+    }
+    if (!CheckImageSize(*width, *height, error))
+        return false;
+    unsigned int channels = color ? 3 : 1;
+    std::vector<unsigned char> row(*width * channels);
+    rgba->resize((size_t)*width * *height * 4);
+    for (unsigned int y = 0; y < *height; y++) {
+        if (!file.read((char*)row.data(), row.size())) {
+            *error = "truncated PNM data";
+            return false;
+        }
+        unsigned char* out =
+            rgba->data() + (size_t)(*height - 1 - y) * *width * 4;
+        for (unsigned int x = 0; x < *width; x++) {
+            for (int k = 0; k < 3; k++)
+                out[4 * x + k] = row[x * channels + (color ? k : 0)];
+            out[4 * x + 3] = 255;
+        }
+    }
+    return true;
+}
+
+static bool DecodeTga(std::ifstream& file, unsigned int* width,
+                      unsigned int* height, std::vector<unsigned char>* rgba,
+                      const char** error) {
+    unsigned char header[18];
+    if (!file.read((char*)header, sizeof(header))) {
+        *error = "truncated TGA header";
+        return false;
+    }
+    unsigned int type = header[2];
+    bool rle = type == 10 || type == 11;
+    bool gray = type == 3 || type == 11;
+    unsigned int depth = header[16];
+    *width = header[12] | header[13] << 8;
+    *height = header[14] | header[15] << 8;
+    bool top_origin = header[17] & 0x20;
+    if (header[1] != 0 || !(type == 2 || type == 3 || rle) ||
+        (gray ? depth != 8 : depth != 24 && depth != 32)) {
+        *error = "unsupported TGA type";
+        return false;
+    }
+    if (!CheckImageSize(*width, *height, error))
+        return false;
+    file.seekg(header[0], std::ios::cur); // image id
+
+    unsigned int bytes = depth / 8;
+    size_t pixel_count = (size_t)*width * *height;
+    rgba->resize(pixel_count * 4);
+    unsigned char pixel[4] = {0, 0, 0, 255};
+    size_t done = 0;
+    while (done < pixel_count) {
+        unsigned int run = 1;
+        bool repeat = false;
+        if (rle) {
+            int packet = file.get();
+            run = (packet & 0x7f) + 1;
+            repeat = packet & 0x80;
+        }
+        for (unsigned int i = 0; i < run && done < pixel_count; i++, done++) {
+            if (!repeat || i == 0) {
+                if (!file.read((char*)pixel, bytes)) {
+                    *error = "truncated TGA data";
+                    return false;
+                }
+            }
+            size_t x = done % *width, y = done / *width;
+            if (top_origin)
+                y = *height - 1 - y;
+            unsigned char* out = rgba->data() + (y * *width + x) * 4;
+            if (gray) {
+                out[0] = out[1] = out[2] = pixel[0];
+                out[3] = 255;
+            } else { // stored as BGR(A)
+                out[0] = pixel[2];
+                out[1] = pixel[1];
+                out[2] = pixel[0];
+                out[3] = bytes == 4 ? pixel[3] : 255;
+            }
+        }
+    }
+    return true;
+}
+
+bool DecodeImage(const char* file_name, unsigned int* width,
+                 unsigned int* height, std::vector<unsigned char>* rgba,
+                 const char** error) {
+    std::ifstream file(file_name, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        *error = "could not open the file";
+        return false;
+    }
+    const char* extension = strrchr(file_name, '.');
+    bool ok;
+    if (extension &&
+        (!strcmp(extension, ".tga") || !strcmp(extension, ".TGA"))) {
+        ok = DecodeTga(file, width, height, rgba, error);
+    } else {
+        char magic[2];
+        if (!file.read(magic, 2) || magic[0] != 'P' ||
+            (magic[1] != '5' && magic[1] != '6')) {
+            *error = "unknown image format";
+            return false;
+        }
+        ok = DecodePnm(file, magic[1] == '6', width, height, rgba, error);
+    }
+    if (ok && (*width == 0 || *height == 0)) {
+        *error = "empty image";
+        return false;
+    }
+    return ok;
+}
+
+void DownsampleBox(const unsigned char* src, unsigned int width,
+                   unsigned int height, unsigned char* dst) {
+    unsigned int dst_width = std::max(1u, width / 2);
+    unsigned int dst_height = std::max(1u, height / 2);
+    for (unsigned int y = 0; y < dst_height; y++) {
+        const unsigned char* row0 = src + (size_t)(2 * y) * width * 4;
+        const unsigned char* row1 =
+            src + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+        unsigned char* out = dst + (size_t)y * dst_width * 4;
+        unsigned int x = 0;
+#ifdef __SSE2__
+        // Four output pixels from 2 x 8 source pixels per iteration
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(2);
+        for (; width >= 2 && x + 4 <= dst_width; x += 4) {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x));
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 8 * x + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x));
+            __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 8 * x + 16));
+            // Vertical sums in 16 bits: s01 holds pixels 0 and 1, and so on
+            __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                                        _mm_unpacklo_epi8(b0, zero));
+            __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                                        _mm_unpackhi_epi8(b0, zero));
+            __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+                                        _mm_unpacklo_epi8(b1, zero));
+            __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+                                        _mm_unpackhi_epi8(b1, zero));
+            // Horizontal pairs: even pixels + odd pixels
+            __m128i out01 = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23),
+                                          _mm_unpackhi_epi64(s01, s23));
+            __m128i out23 = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67),
+                                          _mm_unpackhi_epi64(s45, s67));
+            out01 = _mm_srli_epi16(_mm_add_epi16(out01, rounding), 2);
+            out23 = _mm_srli_epi16(_mm_add_epi16(out23, rounding), 2);
+            _mm_storeu_si128((__m128i*)(out + 4 * x),
+                             _mm_packus_epi16(out01, out23));
+        }
+#endif
+        for (; x < dst_width; x++) {
+            unsigned int x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+            for (int k = 0; k < 4; k++)
+                out[4 * x + k] = (row0[4 * x0 + k] + row0[4 * x1 + k] +
+                                  row1[4 * x0 + k] + row1[4 * x1 + k] + 2) >>
+                                 2;
+        }
+    }
+}
+
+// Kaiser window, alpha = 4, over a 6-tap half-band lowpass. Taps sit at
+// +-0.5, +-1.5 and +-2.5 source pixels from the output pixel center.
+static float BesselI0(float x) {
+    float sum = 1, term = 1;
+    for (int k = 1; k < 16; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void KaiserWeights(float* weights) {
+    const float kAlpha = 4.0f, kHalfWidth = 3.0f;
+    float total = 0;
+    for (int i = 0; i < 6; i++) {
+        float x = i - 2.5f;
+        float t = x / kHalfWidth;
+        float window = BesselI0(kAlpha * sqrtf(1 - t * t)) / BesselI0(kAlpha);
+        float sinc = sinf(M_PI * x / 2) / (M_PI * x / 2);
+        weights[i] = sinc * window;
+        total += weights[i];
+    }
+    for (int i = 0; i < 6; i++)
+        weights[i] /= total;
+}
+
+void DownsampleKaiser(const unsigned char* src, unsigned int width,
+                      unsigned int height, unsigned char* dst) {
+    static float weights[6];
+    static bool weights_ready = (KaiserWeights(weights), true);
+    (void)weights_ready;
+
+    unsigned int dst_width = std::max(1u, width / 2);
+    unsigned int dst_height = std::max(1u, height / 2);
+    // Horizontal pass into floats, one RGBA quad per pixel
+    std::vector<float> horizontal((size_t)dst_width * height * 4);
+    for (unsigned int y = 0; y < height; y++) {
+        const unsigned char* row = src + (size_t)y * width * 4;
+        float* out = horizontal.data() + (size_t)y * dst_width * 4;
+        for (unsigned int x = 0; x < dst_width; x++) {
+#ifdef __SSE2__
+            const __m128i zero = _mm_setzero_si128();
+            __m128 sum = _mm_setzero_ps();
+            for (int i = 0; i < 6; i += 2) {
+                // Two neighbouring taps per load unless clamped at an edge
+                int sx = (int)(2 * x) + i - 2;
+                __m128i pair;
+                if (sx >= 0 && sx + 1 < (int)width) {
+                    pair = _mm_loadl_epi64((const __m128i*)(row + 4 * sx));
+                } else {
+                    int packed[2];
+                    for (int j = 0; j < 2; j++) {
+                        int cx = std::min(std::max(sx + j, 0), (int)width - 1);
+                        memcpy(&packed[j], row + 4 * cx, 4);
+                    }
+                    pair = _mm_loadl_epi64((const __m128i*)packed);
+                }
+                __m128i words = _mm_unpacklo_epi8(pair, zero);
+                sum = _mm_add_ps(
+                    sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(words,
+                                                                       zero)),
+                                    _mm_set1_ps(weights[i])));
+                sum = _mm_add_ps(
+                    sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(words,
+                                                                       zero)),
+                                    _mm_set1_ps(weights[i + 1])));
+            }
+            _mm_storeu_ps(out + 4 * x, sum);
+#else
+            for (int k = 0; k < 4; k++) {
+                float sum = 0;
+                for (int i = 0; i < 6; i++) {
+                    int sx = std::min(std::max((int)(2 * x) + i - 2, 0),
+                                      (int)width - 1);
+                    sum += row[4 * sx + k] * weights[i];
+                }
+                out[4 * x + k] = sum;
+            }
+#endif
+        }
+    }
+    // Vertical pass, clamped and rounded back to bytes
+    for (unsigned int y = 0; y < dst_height; y++) {
+        const float* rows[6];
+        for (int i = 0; i < 6; i++) {
+            int sy = std::min(std::max((int)(2 * y) + i - 2, 0),
+                              (int)height - 1);
+            rows[i] = horizontal.data() + (size_t)sy * dst_width * 4;
+        }
+        unsigned char* out = dst + (size_t)y * dst_width * 4;
+        for (unsigned int x = 0; x < dst_width; x++) {
+#ifdef __SSE2__
+            __m128 sum = _mm_setzero_ps();
+            for (int i = 0; i < 6; i++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[i] + 4 * x),
+                                                 _mm_set1_ps(weights[i])));
+            // cvtps rounds to nearest; the packs saturate to [0, 255]
+            __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(sum),
+                                            _mm_setzero_si128());
+            int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            memcpy(out + 4 * x, &packed, 4);
+#else
+            for (int k = 0; k < 4; k++) {
+                float sum = 0;
+                for (int i = 0; i < 6; i++)
+                    sum += rows[i][4 * x + k] * weights[i];
+                out[4 * x + k] = (unsigned char)std::min(
+                    std::max(sum + 0.5f, 0.0f), 255.0f);
+            }
+#endif
+        }
+    }
+}
+
+bool LoadMipChain(const char* file, MipFilter filter, MipChain* chain,
+                  const char** error) {
+    unsigned int width, height;
+    std::vector<unsigned char> base;
+    if (!DecodeImage(file, &width, &height, &base, error))
+        return false;
+
+    chain->levels.clear();
+    unsigned int offset = 0;
+    for (unsigned int w = width, h = height;; w = std::max(1u, w / 2),
+                      h = std::max(1u, h / 2)) {
+        chain->levels.push_back({w, h, offset});
+        offset += w * h * 4;
+        if (w == 1 && h == 1)
+            break;
+    }
+    chain->pixels.resize(offset);
+    memcpy(chain->pixels.data(), base.data(), base.size());
+
+    for (unsigned int i = 1; i < chain->levels.size(); i++) {
+        const MipChain::Level& parent = chain->levels[i - 1];
+        const unsigned char* src = chain->pixels.data() + parent.offset;
+        unsigned char* dst = chain->pixels.data() + chain->levels[i].offset;
+        if (filter == KaiserMipFilter)
+            DownsampleKaiser(src, parent.width, parent.height, dst);
+        else
+            DownsampleBox(src, parent.width, parent.height, dst);
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <vector>
+
+// RGBA8 image with its whole mip chain in one allocation, level 0 first.
+struct MipChain {
+    struct Level {
+        unsigned int width;
+        unsigned int height;
+        unsigned int offset; // bytes into pixels
+    };
+    std::vector<Level> levels;
+    std::vector<unsigned char> pixels;
+
+    const unsigned char* LevelPixels(unsigned int level) const {
+        return pixels.data() + levels[level].offset;
+    }
+};
+
+enum MipFilter {
+    BoxMipFilter,    // 2x2 average, SSE2
+    KaiserMipFilter, // 6-tap Kaiser-windowed sinc, sharper minification
+};
+
+// Largest width or height accepted; a bad header fails instead of
+// allocating gigabytes.
+const unsigned int kMaxImageSize = 16384;
+
+// Decodes binary PPM/PGM (P6/P5) and uncompressed or RLE TGA files to RGBA8.
+// Returns false and fills error on failure. Safe to call from any thread.
+bool DecodeImage(const char* file, unsigned int* width, unsigned int* height,
+                 std::vector<unsigned char>* rgba, const char** error);
+
+// Decodes a file and builds every mip level down to 1x1.
+bool LoadMipChain(const char* file, MipFilter filter, MipChain* chain,
+                  const char** error);
+
+// Downsamples src (width x height RGBA8) by two in each direction into dst.
+void DownsampleBox(const unsigned char* src, unsigned int width,
+                   unsigned int height, unsigned char* dst);
+void DownsampleKaiser(const unsigned char* src, unsigned int width,
+                      unsigned int height, unsigned char* dst);
+
+#endif // IMAGE_H
@@ -1,15 +0,0 @@
-#include "indexmodel.h"
-
-IndexModel::~IndexModel(){
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    glDeleteBuffers(1, &index_buffer_);
-    glDeleteBuffers(1, &vertex_buffer_);
-
-    glBindVertexArray(0);
-    glDeleteVertexArrays(1, &vao_);
-}
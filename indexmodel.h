@@ -1,15 +1,68 @@
 #ifndef INDEXMODEL_H
 #define INDEXMODEL_H
 
+#include <atomic>
+#include <utility>
+
 #include <GL/glew.h>
 
+#include "baseprogram.h"
+#include "commandlist.h"
+#include "geometry.h"
+#include "gpuresources.h"
+
 class IndexModel{
 public:
-    ~IndexModel();
+    // Model space bounds of the vertex buffer, null until they are built
+    const MeshBounds* bounds() const {
+        return bounds_ready_.load(std::memory_order_acquire) ? &bounds_
+                                                             : nullptr;
+    }
+
 protected:
-    GLuint vao_;
-    GLuint vertex_buffer_;
-    GLuint index_buffer_;
+    IndexModel() : bounds_ready_(false) {}
+
+    // From the same vertices the buffer was filled with. Any thread, as long
+    // as nothing else builds or resets them at the same time.
+    void BuildBounds(const ColorVertex* vertices, unsigned int count) {
+        ComputeMeshBounds(vertices, count, &bounds_);
+        bounds_ready_.store(true, std::memory_order_release);
+    }
+    // Ones built elsewhere, under the same rule
+    void SetBounds(MeshBounds&& bounds) {
+        bounds_ = std::move(bounds);
+        bounds_ready_.store(true, std::memory_order_release);
+    }
+    void ResetBounds() { bounds_ready_.store(false); }
+
+    // Triangles from index_buffer_, as patches if the program tessellates
+    static void DrawIndexed(const BaseProgram& program, GLsizei index_count,
+                            size_t first_index, CommandList* commands) {
+        if (program.tessellated())
+            commands->DrawPatches(index_count, first_index);
+        else
+            commands->DrawTriangles(index_count, first_index);
+    }
+    // The same for several ranges in one call
+    static void MultiDrawIndexed(const BaseProgram& program,
+                                 const GLsizei* index_counts,
+                                 const size_t* first_indices,
+                                 GLsizei draw_count, CommandList* commands) {
+        if (program.tessellated())
+            commands->MultiDrawPatches(index_counts, first_indices,
+                                       draw_count);
+        else
+            commands->MultiDrawTriangles(index_counts, first_indices,
+                                         draw_count);
+    }
+
+    GpuVertexArray vao_;
+    GpuBuffer vertex_buffer_;
+    GpuBuffer index_buffer_;
+
+private:
+    MeshBounds bounds_;
+    std::atomic<bool> bounds_ready_;
 };
 
 
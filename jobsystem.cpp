@@ -0,0 +1,116 @@
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+JobSystem& JobSystem::Instance() {
+    static JobSystem instance;
+    return instance;
+}
+
+JobSystem::JobSystem() {
+    stopping_ = false;
+    unsigned int hardware_threads = std::thread::hardware_concurrency();
+    // Leave one core for the thread that owns the GL context
+    unsigned int worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+    for (unsigned int i = 0; i < worker_count; i++)
+        workers_.emplace_back(&JobSystem::WorkerLoop, this);
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_)
+        worker.join();
+}
+
+void JobSystem::Submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+}
+
+void JobSystem::WorkerLoop() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_ && queue_.empty())
+                return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        job();
+    }
+}
+
+namespace {
+
+// Lives until the last helper job has looked at it, which may be after
+// ParallelFor itself has returned.
+struct ParallelForState {
+    std::function<void(unsigned int, unsigned int)> body;
+    unsigned int count;
+    unsigned int grain;
+    unsigned int chunk_count;
+    std::atomic<unsigned int> next_chunk;
+    std::atomic<unsigned int> finished_chunks;
+    std::mutex mutex;
+    std::condition_variable done;
+
+    void RunChunks() {
+        for (;;) {
+            unsigned int chunk = next_chunk.fetch_add(1);
+            if (chunk >= chunk_count)
+                return;
+            unsigned int begin = chunk * grain;
+            body(begin, std::min(count, begin + grain));
+            if (finished_chunks.fetch_add(1) + 1 == chunk_count) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace
+
+void JobSystem::ParallelFor(
+    unsigned int count, unsigned int grain,
+    const std::function<void(unsigned int, unsigned int)>& body) {
+    if (count == 0)
+        return;
+    grain = std::max(grain, 1u);
+    unsigned int chunk_count = (count + grain - 1) / grain;
+    if (chunk_count == 1) {
+        body(0, count);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state =
+        std::make_shared<ParallelForState>();
+    state->body = body;
+    state->count = count;
+    state->grain = grain;
+    state->chunk_count = chunk_count;
+    state->next_chunk = 0;
+    state->finished_chunks = 0;
+
+    unsigned int helpers =
+        std::min<unsigned int>(workers_.size(), chunk_count - 1);
+    for (unsigned int i = 0; i < helpers; i++)
+        Submit([state] { state->RunChunks(); });
+
+    state->RunChunks();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state] {
+        return state->finished_chunks.load() == state->chunk_count;
+    });
+}
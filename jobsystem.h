@@ -0,0 +1,38 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Shared pool of worker threads. Fire-and-forget jobs go through Submit;
+// data-parallel loops use ParallelFor, in which the calling thread helps out so
+// it is safe to call from inside a job as well.
+class JobSystem {
+  public:
+    static JobSystem& Instance();
+    ~JobSystem();
+
+    void Submit(std::function<void()> job);
+    // Runs body(begin, end) over [0, count) in chunks of at most grain items
+    // and returns once every chunk has finished.
+    void
+    ParallelFor(unsigned int count, unsigned int grain,
+                const std::function<void(unsigned int, unsigned int)>& body);
+    unsigned int WorkerCount() const { return workers_.size(); }
+
+  private:
+    JobSystem();
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> queue_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+};
+
+#endif // JOBSYSTEM_H
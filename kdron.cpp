@@ -4,7 +4,42 @@
 #include "matma.h"
 #include "vertices.h"
 
-#define TRIANGLE_COUNT 17
+// clang-format off
+const ColorVertex KDron::kVertices[KDron::kVertexCount] = {
+   { { -0.5f, -0.5f, -0.5f,  1.0f }, {1, 0, 0, 1} },
+   { {  0.5f, -0.5f, -0.5f,  1.0f }, {1, 1, 0, 1} },
+   { { -0.5f,  0.5f, -0.5f,  1.0f }, {0, 0, 1, 1} },
+   { {  0.5f,  0.5f, -0.5f,  1.0f }, {0, 1, 1, 1} },
+   { {  0.0f, -0.5f, -0.5f,  1.0f }, {1, 0, 1, 1} },
+   { { -0.5f, -0.5f,  0.0f,  1.0f }, {0, 1, 0, 1} },
+   { {  0.5f, -0.5f,  0.0f,  1.0f }, {1, 1, 1, 1} },
+   { { -0.5f,  0.5f,  0.0f,  1.0f }, {0, 1, 1, 1} },
+   { {  0.5f,  0.5f,  0.0f,  1.0f }, {1, 0, 1, 1} },
+   { {  0.0f,  0.5f,  0.5f,  1.0f }, {1, 1, 1, 1} },
+   { { -0.5f,  0.0f,  0.0f,  1.0f }, {1, 1, 0, 1} },
+   { {  0.5f,  0.0f,  0.0f,  1.0f }, {0, 1, 0, 1} },
+};
+
+const Triangle KDron::kIndices[KDron::kTriangleCount] = {
+    {  2,   8,   7 },
+    {  3,   8,   2 },
+    {  3,   0,   1 },
+    {  0,   3,   2 },
+    { 11,  10,   9 },
+    {  4,  11,  10 },
+    {  1,   6,   4 },
+    {  5,   4,  10 },
+    {  7,   0,   5 },
+    {  2,   7,   0 },
+    {  9,   8,   7 },
+    { 11,   4,   6 },
+    {  1,   8,   6 },
+    {  4,   5,   0 },
+    {  3,   1,   8 },
+    {  9,   7,  10 },
+    { 11,   8,   9 },
+};
+// clang-format on
 
 KDron::KDron(float init_velocity, float init_angle) {
     angle_x_ = init_angle;
@@ -17,6 +52,13 @@ void KDron::Update(float delta_t) {
     if (!animated_)
         return;
 
+    if (orientation_mode() == Quaternion) {
+        angular_velocity_[0] = angular_velocity_[1] =
+            velocity_ * kDegreesToRadians;
+        IntegrateOrientation(delta_t);
+        return;
+    }
+
     angle_x_ += delta_t * velocity_;
     angle_y_ += delta_t * velocity_;
     clamp(&angle_x_, -360.f, 360.f);
@@ -25,12 +67,20 @@ void KDron::Update(float delta_t) {
 }
 
 void KDron::RotateVertical(float amount) {
+    if (orientation_mode() == Quaternion) {
+        RotateOrientation(Quat::FromAxisAngle(1, 0, 0, amount), true);
+        return;
+    }
     angle_x_ += amount;
     clamp(&angle_x_, -360.f, 360.f);
     ApplyTransform();
 }
 
 void KDron::RotateHorizontal(float amount) {
+    if (orientation_mode() == Quaternion) {
+        RotateOrientation(Quat::FromAxisAngle(0, 1, 0, amount), false);
+        return;
+    }
     angle_y_ += amount;
     clamp(&angle_y_, -360.f, 360.f);
     ApplyTransform();
@@ -42,56 +92,26 @@ void KDron::ApplyTransform() {
     model_matrix_.RotateAboutY(angle_y_);
 }
 
-void KDron::SpeedUp() { velocity_ *= 1.09544511501; }
+Quat KDron::CurrentEulerOrientation() const {
+    // Same order as ApplyTransform: rotate about X first, then about Y
+    return Quat::FromAxisAngle(0, 1, 0, angle_y_) *
+           Quat::FromAxisAngle(1, 0, 0, angle_x_);
+}
 
-void KDron::SlowDown() { velocity_ /= 1.09544511501; }
+void KDron::SpeedUp() { velocity_ *= kSpeedStep; }
+
+void KDron::SlowDown() { velocity_ /= kSpeedStep; }
 
 void KDron::ToggleAnimated() { animated_ = !animated_; }
 
 void KDron::Initialize() {
-    // clang-format off
-    const ColorVertex kVertices[] = {
-       { { -0.5f, -0.5f, -0.5f,  1.0f }, {1, 0, 0, 1} },
-       { {  0.5f, -0.5f, -0.5f,  1.0f }, {1, 1, 0, 1} },
-       { { -0.5f,  0.5f, -0.5f,  1.0f }, {0, 0, 1, 1} },
-       { {  0.5f,  0.5f, -0.5f,  1.0f }, {0, 1, 1, 1} },
-       { {  0.0f, -0.5f, -0.5f,  1.0f }, {1, 0, 1, 1} },
-       { { -0.5f, -0.5f,  0.0f,  1.0f }, {0, 1, 0, 1} },
-       { {  0.5f, -0.5f,  0.0f,  1.0f }, {1, 1, 1, 1} },
-       { { -0.5f,  0.5f,  0.0f,  1.0f }, {0, 1, 1, 1} },
-       { {  0.5f,  0.5f,  0.0f,  1.0f }, {1, 0, 1, 1} },
-       { {  0.0f,  0.5f,  0.5f,  1.0f }, {1, 1, 1, 1} },
-       { { -0.5f,  0.0f,  0.0f,  1.0f }, {1, 1, 0, 1} },
-       { {  0.5f,  0.0f,  0.0f,  1.0f }, {0, 1, 0, 1} },
-    };
-
-    const Triangle kIndices[TRIANGLE_COUNT] = {
-        {  2,   8,   7 },
-        {  3,   8,   2 },
-        {  3,   0,   1 },
-        {  0,   3,   2 },
-        { 11,  10,   9 },
-        {  4,  11,  10 },
-        {  1,   6,   4 },
-        {  5,   4,  10 },
-        {  7,   0,   5 },
-        {  2,   7,   0 },
-        {  9,   8,   7 },
-        { 11,   4,   6 },
-        {  1,   8,   6 },
-        {  4,   5,   0 },
-        {  3,   1,   8 },
-        {  9,   7,  10 },
-        { 11,   8,   9 },
-    };
-    // clang-format on
-
-    glGenVertexArrays(1, &vao_);
+    vao_.Create("k-dron");
     glBindVertexArray(vao_);
 
-    glGenBuffers(1, &vertex_buffer_);
+    vertex_buffer_.Create(GpuResources::VertexBuffers, "k-dron");
     glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(kVertices), kVertices, GL_STATIC_DRAW);
+    vertex_buffer_.Allocate(GL_ARRAY_BUFFER, sizeof(kVertices), kVertices,
+                            GL_STATIC_DRAW);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(kVertices[0]),
                           (GLvoid*)0);
     glEnableVertexAttribArray(0);
@@ -99,25 +119,27 @@ void KDron::Initialize() {
                           (GLvoid*)sizeof(kVertices[0].position));
     glEnableVertexAttribArray(1);
 
-    glGenBuffers(1, &index_buffer_);
+    index_buffer_.Create(GpuResources::IndexBuffers, "k-dron");
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(kIndices), kIndices,
-                 GL_STATIC_DRAW);
+    index_buffer_.Allocate(GL_ELEMENT_ARRAY_BUFFER, sizeof(kIndices), kIndices,
+                           GL_STATIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    BuildBounds(kVertices, kVertexCount);
 }
 
-void KDron::Draw(const ModelProgram& program) const {
+void KDron::Draw(const ModelProgram& program,
+                 CommandList* commands) const {
 
-    glUseProgram(program);
-    glBindVertexArray(vao_);
+    commands->UseProgram(program);
+    commands->BindVertexArray(vao_);
 
-    program.SetModelMatrix(model_matrix_);
+    program.SetModelMatrix(ModelMatrix(), commands);
 
-    glDrawElements(GL_TRIANGLES, TRIANGLE_COUNT * sizeof(Triangle),
-                   GL_UNSIGNED_INT, 0);
+    DrawIndexed(program, kTriangleCount * 3, 0, commands);
 
-    glBindVertexArray(0);
-    glUseProgram(0);
+    commands->BindVertexArray(0);
+    commands->UseProgram(0);
 }
@@ -6,12 +6,13 @@
 #include "indexmodel.h"
 #include "modelprogram.h"
 #include "movablemodel.h"
+#include "vertices.h"
 
 class KDron : public IndexModel, public MovableModel {
   public:
     KDron(float init_velocity = 15, float init_angle = 45);
     void Initialize();
-    void Draw(const ModelProgram& program) const;
+    void Draw(const ModelProgram& program, CommandList* commands) const;
     void Update(float delta_t);
     void RotateVertical(float amount);
     void RotateHorizontal(float amount);
@@ -23,8 +24,15 @@ class KDron : public IndexModel, public MovableModel {
     void SlowDown();
     void ToggleAnimated();
 
+    // Base geometry, shared with the procedural generators
+    static const unsigned int kVertexCount = 12;
+    static const unsigned int kTriangleCount = 17;
+    static const ColorVertex kVertices[kVertexCount];
+    static const Triangle kIndices[kTriangleCount];
+
   private:
     void ApplyTransform();
+    Quat CurrentEulerOrientation() const;
 
     float angle_x_;
     float angle_y_;
@@ -0,0 +1,109 @@
+#include "litmodel.h"
+
+#include <cstddef>
+#include <iostream>
+
+#include <GLFW/glfw3.h>
+
+LitModel::LitModel(float init_velocity) : MovableModel(Quaternion) {
+    velocity_ = init_velocity;
+    animated_ = true;
+    crease_degrees_ = 0;
+    triangle_count_ = 0;
+    albedo_ = 0;
+}
+
+void LitModel::Initialize(const ColorVertex* vertices,
+                          unsigned int vertex_count, const Triangle* triangles,
+                          unsigned int triangle_count, float crease_degrees) {
+    source_vertices_.assign(vertices, vertices + vertex_count);
+    source_triangles_.assign(triangles, triangles + triangle_count);
+    bvh_.Build(vertices, triangles, triangle_count);
+    BuildBounds(vertices, vertex_count);
+    SetCreaseAngle(crease_degrees);
+}
+
+void LitModel::SetCreaseAngle(float degrees) {
+    crease_degrees_ = degrees;
+
+    double start = glfwGetTime();
+    ShadedMesh mesh;
+    BuildShadedMesh(source_vertices_.data(), source_vertices_.size(),
+                    source_triangles_.data(), source_triangles_.size(),
+                    crease_degrees_, nullptr, &mesh);
+    std::cout << "Shaded " << mesh.triangles.size() << " triangles with a "
+              << crease_degrees_ << " degree crease angle: "
+              << source_vertices_.size() << " -> " << mesh.vertices.size()
+              << " vertices in " << (glfwGetTime() - start) * 1000.0 << " ms"
+              << std::endl;
+    Upload(mesh);
+}
+
+void LitModel::Upload(const ShadedMesh& mesh) {
+    if (!vao_) {
+        vao_.Create("lit");
+        vertex_buffer_.Create(GpuResources::VertexBuffers, "lit");
+        tangent_buffer_.Create(GpuResources::VertexBuffers, "lit");
+        index_buffer_.Create(GpuResources::IndexBuffers, "lit");
+    }
+    glBindVertexArray(vao_);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    vertex_buffer_.Allocate(GL_ARRAY_BUFFER,
+                            mesh.vertices.size() * sizeof(NormalTextureVertex),
+                            mesh.vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(NormalTextureVertex),
+                          (GLvoid*)offsetof(NormalTextureVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(NormalTextureVertex),
+                          (GLvoid*)offsetof(NormalTextureVertex, texture));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(NormalTextureVertex),
+                          (GLvoid*)offsetof(NormalTextureVertex, normal));
+    glEnableVertexAttribArray(2);
+
+    glBindBuffer(GL_ARRAY_BUFFER, tangent_buffer_);
+    tangent_buffer_.Allocate(GL_ARRAY_BUFFER,
+                             mesh.tangents.size() * sizeof(float),
+                             mesh.tangents.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                          (GLvoid*)0);
+    glEnableVertexAttribArray(3);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+    index_buffer_.Allocate(GL_ELEMENT_ARRAY_BUFFER,
+                           mesh.triangles.size() * sizeof(Triangle),
+                           mesh.triangles.data(), GL_STATIC_DRAW);
+    triangle_count_ = mesh.triangles.size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void LitModel::Update(float delta_t) {
+    if (!animated_)
+        return;
+    angular_velocity_[0] = angular_velocity_[1] = velocity_ * kDegreesToRadians;
+    IntegrateOrientation(delta_t);
+}
+
+void LitModel::SpeedUp() { velocity_ *= kSpeedStep; }
+
+void LitModel::SlowDown() { velocity_ /= kSpeedStep; }
+
+void LitModel::ToggleAnimated() { animated_ = !animated_; }
+
+void LitModel::Draw(const LitProgram& program, GLuint albedo,
+                    CommandList* commands) const {
+
+    commands->UseProgram(program);
+    commands->BindVertexArray(vao_);
+
+    program.SetModelMatrix(ModelMatrix(), commands);
+    program.SetAlbedo(albedo, commands);
+
+    commands->DrawTriangles(triangle_count_ * 3);
+
+    commands->BindVertexArray(0);
+    commands->UseProgram(0);
+}
@@ -0,0 +1,58 @@
+#ifndef LITMODEL_H
+#define LITMODEL_H
+
+#include <atomic>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "bvh.h"
+#include "indexmodel.h"
+#include "litprogram.h"
+#include "meshprocessing.h"
+#include "movablemodel.h"
+
+// Any ColorVertex mesh run through the normal pass and drawn with lighting.
+// Keeps the source mesh so the crease angle can be changed at run time.
+class LitModel : public IndexModel, public MovableModel {
+  public:
+    LitModel(float init_velocity = 15);
+    void Initialize(const ColorVertex* vertices, unsigned int vertex_count,
+                    const Triangle* triangles, unsigned int triangle_count,
+                    float crease_degrees);
+    void SetCreaseAngle(float degrees);
+    float crease_angle() const { return crease_degrees_; }
+    // Vertex attributes the lit shader variants get from this model
+    static const unsigned int kLayout =
+        kVertexTexture | kVertexNormal | kVertexTangent;
+    // albedo is what albedo() returned when the variant was picked
+    void Draw(const LitProgram& program, GLuint albedo,
+              CommandList* commands) const;
+    void Update(float delta_t);
+    void SpeedUp();
+    void SlowDown();
+    void ToggleAnimated();
+    // May be called from the render thread while a frame is recorded
+    void SetAlbedo(GLuint texture) {
+        albedo_.store(texture, std::memory_order_relaxed);
+    }
+    GLuint albedo() const { return albedo_.load(std::memory_order_relaxed); }
+    const MeshBvh& bvh() const { return bvh_; }
+
+  private:
+    Quat CurrentEulerOrientation() const { return orientation_; }
+    void Upload(const ShadedMesh& mesh);
+
+    std::vector<ColorVertex> source_vertices_;
+    std::vector<Triangle> source_triangles_;
+    float crease_degrees_;
+    MeshBvh bvh_; // positions do not depend on the crease angle
+    GpuBuffer tangent_buffer_;
+    std::atomic<GLuint> albedo_;
+    unsigned int triangle_count_;
+
+    float velocity_;
+    bool animated_;
+};
+
+#endif // LITMODEL_H
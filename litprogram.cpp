@@ -0,0 +1,36 @@
+#include "litprogram.h"
+
+void LitProgram::Initialize(const char* vertex_shader_file,
+                            const char* fragment_shader_file,
+                            const std::string& defines) {
+    ModelProgram::Initialize(vertex_shader_file, fragment_shader_file,
+                             defines);
+    light_direction_location_ = GetUniformLocationOrDie("light_direction");
+    base_color_location_ = GetUniformLocationOrDie("base_color");
+    bump_strength_location_ = GetUniformLocation("bump_strength");
+    albedo_location_ = GetUniformLocation("albedo");
+}
+
+void LitProgram::SetLightDirection(float x, float y, float z) const {
+    glUniform3f(light_direction_location_, x, y, z);
+}
+
+void LitProgram::SetBaseColor(float r, float g, float b, float a) const {
+    glUniform4f(base_color_location_, r, g, b, a);
+}
+
+void LitProgram::SetBaseColor(const float color[4],
+                              CommandList* commands) const {
+    commands->SetVector(base_color_location_, color);
+}
+
+void LitProgram::SetBumpStrength(float strength) const {
+    glUniform1f(bump_strength_location_, strength);
+}
+
+void LitProgram::SetAlbedo(GLuint texture, CommandList* commands) const {
+    if (albedo_location_ < 0)
+        return;
+    commands->BindTexture(GL_TEXTURE0, texture);
+    commands->SetInteger(albedo_location_, 0);
+}
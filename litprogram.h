@@ -0,0 +1,33 @@
+#ifndef LITPROGRAM_H
+#define LITPROGRAM_H
+
+#include "modelprogram.h"
+#include "shadervariants.h"
+
+// LitShader; variants are built through ProgramVariants<LitProgram>, and
+// uniforms a variant compiles out are ignored.
+class LitProgram : public ModelProgram {
+  public:
+    // Features the lit shader sources are specialised on
+    static const unsigned int kFeatures =
+        kVertexTexture | kVertexNormal | kVertexTangent | kAlbedoMap;
+
+    void Initialize(const char* vertex_shader_file,
+                    const char* fragment_shader_file,
+                    const std::string& defines = "") override;
+    void SetLightDirection(float x, float y, float z) const;
+    void SetBaseColor(float r, float g, float b, float a) const;
+    // Per draw, for meshes with materials of their own; rgba
+    void SetBaseColor(const float color[4], CommandList* commands) const;
+    void SetBumpStrength(float strength) const;
+    // Binds texture to unit 0 as the albedo map of ALBEDO_MAP variants
+    void SetAlbedo(GLuint texture, CommandList* commands) const;
+
+  private:
+    GLuint light_direction_location_;
+    GLuint base_color_location_;
+    GLint bump_strength_location_;
+    GLint albedo_location_;
+};
+
+#endif // LITPROGRAM_H
@@ -1,3 +1,4 @@
+#include "gpuresources.h"
 #include "window.h"
 
 #include <iostream>
@@ -9,27 +10,42 @@
 const int kMajorGLVersion = 4;
 const int kMinorGLVersion = 1;
 
-static Window window("Postawy OpenGL", 800, 600);
+// Deleted before glfwTerminate() so the GL objects it owns go first
+static Window* window = new Window("Postawy OpenGL", 800, 600);
 
 /*** Callbacks   ***/
 void Resize (GLFWwindow* /*window*/, int new_width, int new_height){
-    window.Resize(new_width, new_height);
+    window->Resize(new_width, new_height);
 }
 
 void KeyPressed(GLFWwindow* /*window*/, int key, int scancode, int action, int mods){
-    window.KeyEvent(key, scancode, action, mods);
+    window->KeyEvent(key, scancode, action, mods);
+}
+
+void MouseButton(GLFWwindow* /*window*/, int button, int action, int mods) {
+    window->MouseButtonEvent(button, action, mods);
 }
 
 /*******************/
 
 
 
-int main(void){
-    window.Initialize(kMajorGLVersion, kMinorGLVersion);
-    glfwSetWindowSizeCallback(window, Resize);
-    glfwSetKeyCallback(window, KeyPressed);
+int main(int argc, char** argv) {
+    // An optional scene file, streamed in on D: the first argument that is
+    // not an option like make run's -sync and -gldebug
+    for (int i = 1; i < argc; i++)
+        if (argv[i][0] != '-') {
+            window->SetSceneFile(argv[i]);
+            break;
+        }
+    window->Initialize(kMajorGLVersion, kMinorGLVersion);
+    glfwSetWindowSizeCallback(*window, Resize);
+    glfwSetKeyCallback(*window, KeyPressed);
+    glfwSetMouseButtonCallback(*window, MouseButton);
 
-    window.Run();
+    window->Run();
+    delete window;
+    GpuResources::Instance().CheckLeaks();
     glfwTerminate();
     exit(EXIT_SUCCESS);
 }
@@ -1,8 +1,16 @@
 #include "matma.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef MATMA_HAVE_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 void Mat4::Log() {
@@ -19,6 +27,80 @@ Mat4::Mat4() { // Unit matrix
     matrix_[0] = matrix_[5] = matrix_[10] = matrix_[15] = 1;
 }
 
+Mat4 Mat4::operator*(const Mat4& right) const {
+    Mat4 product = right;
+    product.MultiplyBy(*this);
+    return product;
+}
+
+bool Mat4::Inverse(Mat4* out) const {
+    // Cofactor expansion; the same formula works for either storage order
+    const float* m = matrix_;
+    float inverse[16];
+    inverse[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] -
+                 m[9] * m[6] * m[15] + m[9] * m[7] * m[14] +
+                 m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inverse[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] +
+                 m[8] * m[6] * m[15] - m[8] * m[7] * m[14] -
+                 m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inverse[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] -
+                 m[8] * m[5] * m[15] + m[8] * m[7] * m[13] +
+                 m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inverse[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] +
+                  m[8] * m[5] * m[14] - m[8] * m[6] * m[13] -
+                  m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inverse[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] +
+                 m[9] * m[2] * m[15] - m[9] * m[3] * m[14] -
+                 m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inverse[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] -
+                 m[8] * m[2] * m[15] + m[8] * m[3] * m[14] +
+                 m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inverse[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] +
+                 m[8] * m[1] * m[15] - m[8] * m[3] * m[13] -
+                 m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inverse[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] -
+                  m[8] * m[1] * m[14] + m[8] * m[2] * m[13] +
+                  m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inverse[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] -
+                 m[5] * m[2] * m[15] + m[5] * m[3] * m[14] +
+                 m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inverse[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] +
+                 m[4] * m[2] * m[15] - m[4] * m[3] * m[14] -
+                 m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inverse[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] -
+                  m[4] * m[1] * m[15] + m[4] * m[3] * m[13] +
+                  m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inverse[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] +
+                  m[4] * m[1] * m[14] - m[4] * m[2] * m[13] -
+                  m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inverse[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] +
+                 m[5] * m[2] * m[11] - m[5] * m[3] * m[10] -
+                 m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inverse[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] -
+                 m[4] * m[2] * m[11] + m[4] * m[3] * m[10] +
+                 m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inverse[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] +
+                  m[4] * m[1] * m[11] - m[4] * m[3] * m[9] -
+                  m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inverse[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] -
+                  m[4] * m[1] * m[10] + m[4] * m[2] * m[9] +
+                  m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float determinant = m[0] * inverse[0] + m[1] * inverse[4] +
+                        m[2] * inverse[8] + m[3] * inverse[12];
+    if (determinant == 0)
+        return false;
+    for (int i = 0; i < 16; i++)
+        out->matrix_[i] = inverse[i] / determinant;
+    return true;
+}
+
+void Mat4::Transform(float x, float y, float z, float w, float out[4]) const {
+    for (int r = 0; r < 4; r++)
+        out[r] = matrix_[r] * x + matrix_[4 + r] * y + matrix_[8 + r] * z +
+                 matrix_[12 + r] * w;
+}
+
 void Mat4::SetUnitMatrix() { // Unit matrix
     for (int i = 0; i < 16; i++)
         matrix_[i] = 0;
@@ -62,9 +144,8 @@ void Mat4::Translate(float x, float y, float z) {
 
 void Mat4::RotateAboutX(float degrees) {
     Mat4 rotation;
-    float radians = degrees * M_PI / 180.0f;
-    float sine = (float)sin(radians);
-    float cosine = (float)cos(radians);
+    float sine, cosine;
+    SinCos(degrees * kDegreesToRadians, &sine, &cosine);
 
     rotation.matrix_[5] = cosine;
     rotation.matrix_[6] = sine;
@@ -76,9 +157,8 @@ void Mat4::RotateAboutX(float degrees) {
 
 void Mat4::RotateAboutY(float degrees) {
     Mat4 rotation;
-    float radians = degrees * M_PI / 180.0f;
-    float sine = (float)sin(radians);
-    float cosine = (float)cos(radians);
+    float sine, cosine;
+    SinCos(degrees * kDegreesToRadians, &sine, &cosine);
 
     rotation.matrix_[0] = cosine;
     rotation.matrix_[2] = -sine;
@@ -90,9 +170,8 @@ void Mat4::RotateAboutY(float degrees) {
 
 void Mat4::RotateAboutZ(float degrees) {
     Mat4 rotation;
-    float radians = degrees * M_PI / 180.0f;
-    float sine = (float)sin(radians);
-    float cosine = (float)cos(radians);
+    float sine, cosine;
+    SinCos(degrees * kDegreesToRadians, &sine, &cosine);
 
     rotation.matrix_[0] = cosine;
     rotation.matrix_[1] = sine;
@@ -102,6 +181,114 @@ void Mat4::RotateAboutZ(float degrees) {
     MultiplyBy(rotation);
 }
 
+// Batch builders work in blocks so the angles, sines and cosines of one block
+// stay in L1 between the SinCos pass and the matrix write pass.
+static const unsigned int kRotationBlock = 256;
+
+void Mat4::CreateRotationsAboutX(const float* degrees, Mat4* out,
+                                 unsigned int count) {
+    float radians[kRotationBlock], sines[kRotationBlock],
+        cosines[kRotationBlock];
+    for (unsigned int base = 0; base < count; base += kRotationBlock) {
+        unsigned int block = min(kRotationBlock, count - base);
+        for (unsigned int i = 0; i < block; i++)
+            radians[i] = degrees[base + i] * kDegreesToRadians;
+        SinCos(radians, sines, cosines, block);
+        for (unsigned int i = 0; i < block; i++) {
+            float* m = out[base + i].matrix_;
+            m[0] = 1, m[1] = 0, m[2] = 0, m[3] = 0;
+            m[4] = 0, m[5] = cosines[i], m[6] = sines[i], m[7] = 0;
+            m[8] = 0, m[9] = -sines[i], m[10] = cosines[i], m[11] = 0;
+            m[12] = 0, m[13] = 0, m[14] = 0, m[15] = 1;
+        }
+    }
+}
+
+void Mat4::CreateRotationsAboutY(const float* degrees, Mat4* out,
+                                 unsigned int count) {
+    float radians[kRotationBlock], sines[kRotationBlock],
+        cosines[kRotationBlock];
+    for (unsigned int base = 0; base < count; base += kRotationBlock) {
+        unsigned int block = min(kRotationBlock, count - base);
+        for (unsigned int i = 0; i < block; i++)
+            radians[i] = degrees[base + i] * kDegreesToRadians;
+        SinCos(radians, sines, cosines, block);
+        for (unsigned int i = 0; i < block; i++) {
+            float* m = out[base + i].matrix_;
+            m[0] = cosines[i], m[1] = 0, m[2] = -sines[i], m[3] = 0;
+            m[4] = 0, m[5] = 1, m[6] = 0, m[7] = 0;
+            m[8] = sines[i], m[9] = 0, m[10] = cosines[i], m[11] = 0;
+            m[12] = 0, m[13] = 0, m[14] = 0, m[15] = 1;
+        }
+    }
+}
+
+void Mat4::CreateRotationsAboutZ(const float* degrees, Mat4* out,
+                                 unsigned int count) {
+    float radians[kRotationBlock], sines[kRotationBlock],
+        cosines[kRotationBlock];
+    for (unsigned int base = 0; base < count; base += kRotationBlock) {
+        unsigned int block = min(kRotationBlock, count - base);
+        for (unsigned int i = 0; i < block; i++)
+            radians[i] = degrees[base + i] * kDegreesToRadians;
+        SinCos(radians, sines, cosines, block);
+        for (unsigned int i = 0; i < block; i++) {
+            float* m = out[base + i].matrix_;
+            m[0] = cosines[i], m[1] = sines[i], m[2] = 0, m[3] = 0;
+            m[4] = -sines[i], m[5] = cosines[i], m[6] = 0, m[7] = 0;
+            m[8] = 0, m[9] = 0, m[10] = 1, m[11] = 0;
+            m[12] = 0, m[13] = 0, m[14] = 0, m[15] = 1;
+        }
+    }
+}
+
+void Mat4::CreateRotationsAboutXY(const float* x_degrees,
+                                  const float* y_degrees, Mat4* out,
+                                  unsigned int count) {
+    float radians[2 * kRotationBlock], sines[2 * kRotationBlock],
+        cosines[2 * kRotationBlock];
+    for (unsigned int base = 0; base < count; base += kRotationBlock) {
+        unsigned int block = min(kRotationBlock, count - base);
+        for (unsigned int i = 0; i < block; i++) {
+            radians[i] = x_degrees[base + i] * kDegreesToRadians;
+            radians[kRotationBlock + i] =
+                y_degrees[base + i] * kDegreesToRadians;
+        }
+        SinCos(radians, sines, cosines, block);
+        SinCos(radians + kRotationBlock, sines + kRotationBlock,
+               cosines + kRotationBlock, block);
+        for (unsigned int i = 0; i < block; i++) {
+            // Ry * Rx
+            const float sx = sines[i], cx = cosines[i];
+            const float sy = sines[kRotationBlock + i],
+                        cy = cosines[kRotationBlock + i];
+            float* m = out[base + i].matrix_;
+            m[0] = cy, m[1] = 0, m[2] = -sy, m[3] = 0;
+            m[4] = sy * sx, m[5] = cx, m[6] = cy * sx, m[7] = 0;
+            m[8] = sy * cx, m[9] = -sx, m[10] = cy * cx, m[11] = 0;
+            m[12] = 0, m[13] = 0, m[14] = 0, m[15] = 1;
+        }
+    }
+}
+
+void Mat4::CreateTransforms(const float* const translations[3],
+                            const float* const rotations[4],
+                            const float* const scales[3], Mat4* out,
+                            unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        Quat(rotations[0][i], rotations[1][i], rotations[2][i],
+             rotations[3][i])
+            .ToMat4(&out[i]);
+        float* m = out[i].matrix_;
+        for (int column = 0; column < 3; column++)
+            for (int row = 0; row < 3; row++)
+                m[column * 4 + row] *= scales[column][i];
+        m[12] = translations[0][i];
+        m[13] = translations[1][i];
+        m[14] = translations[2][i];
+    }
+}
+
 Mat4 Mat4::CreatePerspectiveProjectionMatrix(float fovy, float aspect_ratio,
                                              float near_plane,
                                              float far_plane) {
@@ -154,3 +341,292 @@ Mat4::Mat4(float val) {
         matrix_[i] = val;
     }
 }
+
+Quat::Quat() { // Identity
+    q_[0] = q_[1] = q_[2] = 0;
+    q_[3] = 1;
+}
+
+Quat::Quat(float x, float y, float z, float w) {
+    q_[0] = x;
+    q_[1] = y;
+    q_[2] = z;
+    q_[3] = w;
+}
+
+Quat Quat::FromAxisAngle(float axis_x, float axis_y, float axis_z,
+                         float degrees) {
+    float sine, cosine;
+    SinCos(degrees * 0.5f * kDegreesToRadians, &sine, &cosine);
+    return Quat(axis_x * sine, axis_y * sine, axis_z * sine, cosine);
+}
+
+#ifdef __SSE2__
+
+// Hamilton product on (x, y, z, w) registers. Each term is one lane of the
+// left quaternion broadcast against a shuffled, sign-flipped copy of the right.
+static inline __m128 Multiply(__m128 left, __m128 right) {
+    const __m128 w_term =
+        _mm_mul_ps(_mm_shuffle_ps(left, left, _MM_SHUFFLE(3, 3, 3, 3)), right);
+    const __m128 x_term = _mm_mul_ps(
+        _mm_mul_ps(_mm_shuffle_ps(left, left, _MM_SHUFFLE(0, 0, 0, 0)),
+                   _mm_shuffle_ps(right, right, _MM_SHUFFLE(0, 1, 2, 3))),
+        _mm_setr_ps(1, -1, 1, -1));
+    const __m128 y_term = _mm_mul_ps(
+        _mm_mul_ps(_mm_shuffle_ps(left, left, _MM_SHUFFLE(1, 1, 1, 1)),
+                   _mm_shuffle_ps(right, right, _MM_SHUFFLE(1, 0, 3, 2))),
+        _mm_setr_ps(1, 1, -1, -1));
+    const __m128 z_term = _mm_mul_ps(
+        _mm_mul_ps(_mm_shuffle_ps(left, left, _MM_SHUFFLE(2, 2, 2, 2)),
+                   _mm_shuffle_ps(right, right, _MM_SHUFFLE(2, 3, 0, 1))),
+        _mm_setr_ps(-1, 1, 1, -1));
+    return _mm_add_ps(_mm_add_ps(w_term, x_term), _mm_add_ps(y_term, z_term));
+}
+
+static inline __m128 BroadcastDot(__m128 a, __m128 b) {
+    __m128 products = _mm_mul_ps(a, b);
+    products = _mm_add_ps(
+        products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(
+        products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// Full precision sqrt + div: rsqrt would feed its own error back into every
+// integration step.
+static inline __m128 Normalized(__m128 value) {
+    return _mm_div_ps(value, _mm_sqrt_ps(BroadcastDot(value, value)));
+}
+
+Quat Quat::operator*(const Quat& b) const {
+    Quat out;
+    _mm_store_ps(out.q_, Multiply(_mm_load_ps(q_), _mm_load_ps(b.q_)));
+    return out;
+}
+
+void Quat::Normalize() { _mm_store_ps(q_, Normalized(_mm_load_ps(q_))); }
+
+float Quat::Dot(const Quat& other) const {
+    return _mm_cvtss_f32(
+        BroadcastDot(_mm_load_ps(q_), _mm_load_ps(other.q_)));
+}
+
+void Quat::Integrate(const float angular_velocity[3], float delta_t) {
+    // q' = q + dt/2 * q * (omega, 0)
+    const __m128 value = _mm_load_ps(q_);
+    const __m128 half_step_omega = _mm_mul_ps(
+        _mm_setr_ps(angular_velocity[0], angular_velocity[1],
+                    angular_velocity[2], 0),
+        _mm_set1_ps(0.5f * delta_t));
+    _mm_store_ps(q_, Normalized(_mm_add_ps(
+                         value, Multiply(value, half_step_omega))));
+}
+
+#else // Scalar fallback for targets without SSE2
+
+Quat Quat::operator*(const Quat& b) const {
+    const float* a = q_;
+    return Quat(a[3] * b.q_[0] + a[0] * b.q_[3] + a[1] * b.q_[2] -
+                    a[2] * b.q_[1],
+                a[3] * b.q_[1] - a[0] * b.q_[2] + a[1] * b.q_[3] +
+                    a[2] * b.q_[0],
+                a[3] * b.q_[2] + a[0] * b.q_[1] - a[1] * b.q_[0] +
+                    a[2] * b.q_[3],
+                a[3] * b.q_[3] - a[0] * b.q_[0] - a[1] * b.q_[1] -
+                    a[2] * b.q_[2]);
+}
+
+void Quat::Normalize() {
+    float length = sqrtf(Dot(*this));
+    for (int i = 0; i < 4; i++)
+        q_[i] /= length;
+}
+
+float Quat::Dot(const Quat& other) const {
+    return q_[0] * other.q_[0] + q_[1] * other.q_[1] + q_[2] * other.q_[2] +
+           q_[3] * other.q_[3];
+}
+
+void Quat::Integrate(const float angular_velocity[3], float delta_t) {
+    Quat omega(angular_velocity[0], angular_velocity[1], angular_velocity[2],
+               0);
+    Quat derivative = *this * omega;
+    for (int i = 0; i < 4; i++)
+        q_[i] += derivative.q_[i] * 0.5f * delta_t;
+    Normalize();
+}
+
+#endif // __SSE2__
+
+Quat Quat::Slerp(const Quat& from, const Quat& to, float t) {
+    float cosine = from.Dot(to);
+    float sign = 1;
+    if (cosine < 0) { // Take the short way around
+        cosine = -cosine;
+        sign = -1;
+    }
+
+    float from_weight = 1 - t;
+    float to_weight = t * sign;
+    if (cosine < 0.9995f) {
+        float angle = acosf(cosine);
+        float inv_sine = 1.0f / sinf(angle);
+        from_weight = sinf(from_weight * angle) * inv_sine;
+        to_weight = sinf(t * angle) * inv_sine * sign;
+    }
+
+    Quat out(from.q_[0] * from_weight + to.q_[0] * to_weight,
+             from.q_[1] * from_weight + to.q_[1] * to_weight,
+             from.q_[2] * from_weight + to.q_[2] * to_weight,
+             from.q_[3] * from_weight + to.q_[3] * to_weight);
+    out.Normalize(); // Only matters on the nlerp path
+    return out;
+}
+
+void Quat::ToMat4(Mat4* out) const {
+    const float x = q_[0], y = q_[1], z = q_[2], w = q_[3];
+    const float xx = x * x, yy = y * y, zz = z * z;
+    const float xy = x * y, xz = x * z, yz = y * z;
+    const float wx = w * x, wy = w * y, wz = w * z;
+    float* m = out->matrix_;
+
+    // Col 1
+    m[0] = 1 - 2 * (yy + zz);
+    m[1] = 2 * (xy + wz);
+    m[2] = 2 * (xz - wy);
+    m[3] = 0;
+    // Col 2
+    m[4] = 2 * (xy - wz);
+    m[5] = 1 - 2 * (xx + zz);
+    m[6] = 2 * (yz + wx);
+    m[7] = 0;
+    // Col 3
+    m[8] = 2 * (xz + wy);
+    m[9] = 2 * (yz - wx);
+    m[10] = 1 - 2 * (xx + yy);
+    m[11] = 0;
+    // Col 4
+    m[12] = m[13] = m[14] = 0;
+    m[15] = 1;
+}
+
+// Cephes single precision sin/cos, as in sinf.c: the argument is reduced
+// modulo pi/4 with a three-part Cody-Waite constant, then one of two minimax
+// polynomials is picked per octant. Every operation below is mirrored exactly
+// in the AVX2 path so both give the same bits.
+static const float kFourOverPi = 1.27323954473516f;
+static const float kPiOver4Part1 = 0.78515625f;
+static const float kPiOver4Part2 = 2.4187564849853515625e-4f;
+static const float kPiOver4Part3 = 3.77489497744594108e-8f;
+static const float kCos0 = 2.443315711809948e-5f;
+static const float kCos1 = -1.388731625493765e-3f;
+static const float kCos2 = 4.166664568298827e-2f;
+static const float kSin0 = -1.9515295891e-4f;
+static const float kSin1 = 8.3321608736e-3f;
+static const float kSin2 = -1.6666654611e-1f;
+
+void SinCos(float radians, float* sine, float* cosine) {
+    float x = fabsf(radians);
+    int octant = (int)(x * kFourOverPi);
+    octant = (octant + 1) & ~1;
+    float y = (float)octant;
+    x = ((x - y * kPiOver4Part1) - y * kPiOver4Part2) - y * kPiOver4Part3;
+
+    float z = x * x;
+    float cos_poly = kCos0;
+    cos_poly = cos_poly * z + kCos1;
+    cos_poly = cos_poly * z + kCos2;
+    cos_poly = cos_poly * z * z - z * 0.5f + 1.0f;
+    float sin_poly = kSin0;
+    sin_poly = sin_poly * z + kSin1;
+    sin_poly = sin_poly * z + kSin2;
+    sin_poly = sin_poly * z * x + x;
+
+    bool swap = octant & 2;
+    float s = swap ? cos_poly : sin_poly;
+    float c = swap ? sin_poly : cos_poly;
+    bool negate_sine = (radians < 0) != ((octant & 4) != 0);
+    bool negate_cosine = ((octant - 2) & 4) == 0;
+    *sine = negate_sine ? -s : s;
+    *cosine = negate_cosine ? -c : c;
+}
+
+#ifdef MATMA_HAVE_AVX2_DISPATCH
+
+__attribute__((target("avx2"))) static void
+SinCosAvx2(const float* radians, float* sines, float* cosines,
+           unsigned int count) {
+    const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i four = _mm256_set1_epi32(4);
+
+    for (unsigned int i = 0; i < count; i += 8) {
+        __m256 input = _mm256_loadu_ps(radians + i);
+        __m256 sine_sign = _mm256_and_ps(input, sign_mask);
+        __m256 x = _mm256_andnot_ps(sign_mask, input);
+
+        __m256i octant =
+            _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(kFourOverPi)));
+        octant = _mm256_andnot_si256(one, _mm256_add_epi32(octant, one));
+        __m256 y = _mm256_cvtepi32_ps(octant);
+        x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(kPiOver4Part1)));
+        x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(kPiOver4Part2)));
+        x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(kPiOver4Part3)));
+
+        __m256 z = _mm256_mul_ps(x, x);
+        __m256 cos_poly = _mm256_set1_ps(kCos0);
+        cos_poly = _mm256_add_ps(_mm256_mul_ps(cos_poly, z),
+                                 _mm256_set1_ps(kCos1));
+        cos_poly = _mm256_add_ps(_mm256_mul_ps(cos_poly, z),
+                                 _mm256_set1_ps(kCos2));
+        cos_poly = _mm256_add_ps(
+            _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(cos_poly, z), z),
+                          _mm256_mul_ps(z, _mm256_set1_ps(0.5f))),
+            _mm256_set1_ps(1.0f));
+        __m256 sin_poly = _mm256_set1_ps(kSin0);
+        sin_poly = _mm256_add_ps(_mm256_mul_ps(sin_poly, z),
+                                 _mm256_set1_ps(kSin1));
+        sin_poly = _mm256_add_ps(_mm256_mul_ps(sin_poly, z),
+                                 _mm256_set1_ps(kSin2));
+        sin_poly =
+            _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sin_poly, z), x), x);
+
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+            _mm256_and_si256(octant, two), two));
+        __m256 s = _mm256_blendv_ps(sin_poly, cos_poly, swap);
+        __m256 c = _mm256_blendv_ps(cos_poly, sin_poly, swap);
+
+        sine_sign = _mm256_xor_ps(
+            sine_sign, _mm256_castsi256_ps(_mm256_slli_epi32(
+                           _mm256_and_si256(octant, four), 29)));
+        __m256 cosine_sign = _mm256_castsi256_ps(_mm256_slli_epi32(
+            _mm256_andnot_si256(_mm256_sub_epi32(octant, two), four), 29));
+
+        _mm256_storeu_ps(sines + i, _mm256_xor_ps(s, sine_sign));
+        _mm256_storeu_ps(cosines + i, _mm256_xor_ps(c, cosine_sign));
+    }
+}
+
+#endif // MATMA_HAVE_AVX2_DISPATCH
+
+bool CpuHasAvx2() {
+#ifdef MATMA_HAVE_AVX2_DISPATCH
+    static const bool kHasAvx2 = __builtin_cpu_supports("avx2");
+    return kHasAvx2;
+#else
+    return false;
+#endif
+}
+
+void SinCos(const float* radians, float* sines, float* cosines,
+            unsigned int count) {
+    unsigned int done = 0;
+#ifdef MATMA_HAVE_AVX2_DISPATCH
+    if (CpuHasAvx2()) {
+        done = count & ~7u;
+        SinCosAvx2(radians, sines, cosines, done);
+    }
+#endif
+    for (unsigned int i = done; i < count; i++)
+        SinCos(radians[i], &sines[i], &cosines[i]);
+}
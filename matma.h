@@ -2,9 +2,34 @@
 #define MATMA_H
 
 #ifndef M_PI
-#define M_PI 3.14159265
+#define M_PI 3.14159265358979323846
 #endif
 
+const float kDegreesToRadians = (float)(M_PI / 180.0);
+// What SpeedUp() and SlowDown() scale speeds by: sqrt(1.2), so two steps
+// make a 20% change
+const float kSpeedStep = 1.09544511501f;
+
+// Kernels built with __attribute__((target("avx2"))) can be compiled in and
+// picked at run time when CpuHasAvx2() says so; it is false everywhere else.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MATMA_HAVE_AVX2_DISPATCH
+#endif
+bool CpuHasAvx2();
+
+// Polynomial sine and cosine: Cody-Waite reduction to [-pi/4, pi/4] followed
+// by the Cephes minimax polynomials. For |radians| <= 8192 the error is at most
+// 2 ulp for results of magnitude >= 2^-10 and below 8e-8 absolute everywhere
+// (closer to the zeros the ulp count grows; see bench/sincos.cpp). Beyond 8192
+// the reduction loses precision. The batch version runs eight lanes at a time
+// with AVX2 when the CPU has it and produces bit-identical results to the
+// scalar path.
+void SinCos(float radians, float* sine, float* cosine);
+void SinCos(const float* radians, float* sines, float* cosines,
+            unsigned int count);
+
+class Quat;
+
 class Mat4 {
   public:
     Mat4(); // Unit matrix
@@ -19,10 +44,34 @@ class Mat4 {
     void RotateAboutX(float angle); // gedrees
     void RotateAboutY(float angle); // gedrees
     void RotateAboutZ(float angle); // gedrees
+    // Batch builders: out[i] is the pure rotation for degrees[i], equal to
+    // SetUnitMatrix() followed by the matching RotateAbout calls.
+    static void CreateRotationsAboutX(const float* degrees, Mat4* out,
+                                      unsigned int count);
+    static void CreateRotationsAboutY(const float* degrees, Mat4* out,
+                                      unsigned int count);
+    static void CreateRotationsAboutZ(const float* degrees, Mat4* out,
+                                      unsigned int count);
+    // RotateAboutX(x_degrees[i]) then RotateAboutY(y_degrees[i]), as KDron does
+    static void CreateRotationsAboutXY(const float* x_degrees,
+                                       const float* y_degrees, Mat4* out,
+                                       unsigned int count);
+    // out[i] = T * R * S: scaled along the object's axes, rotated by the unit
+    // quaternion, then translated. One array per component, as
+    // AnimationSet samples them.
+    static void CreateTransforms(const float* const translations[3],
+                                 const float* const rotations[4],
+                                 const float* const scales[3], Mat4* out,
+                                 unsigned int count);
     void Scale(float x_scale, float y_scale, float z_scale);
     void Translate(float delta_x, float delta_y, float delta_z);
     void SetUnitMatrix();
     void Log();
+    Mat4 operator*(const Mat4& right) const; // applies right first
+    // Returns false and leaves out untouched for a singular matrix
+    bool Inverse(Mat4* out) const;
+    // out = this * (x, y, z, w)
+    void Transform(float x, float y, float z, float w, float out[4]) const;
 
   private:
     // 0  4  8 12
@@ -32,6 +81,33 @@ class Mat4 {
     float matrix_[16]; // column-major
     void MultiplyBy(const Mat4&);
     explicit Mat4(float);
+
+    friend class Quat;
+};
+
+// Unit quaternion used as an orientation. Stored as (x, y, z, w) in one
+// 16-byte aligned register so the hot operations map onto SSE when available.
+class Quat {
+  public:
+    Quat(); // Identity
+    Quat(float x, float y, float z, float w);
+    static Quat FromAxisAngle(float axis_x, float axis_y, float axis_z,
+                              float degrees); // axis must be normalized
+    static Quat Slerp(const Quat& from, const Quat& to, float t);
+    Quat operator*(const Quat&) const; // (a * b) applies b first, then a
+    void Normalize();
+    // Advances the orientation by a body-frame angular velocity given in
+    // radians per second. First order, renormalized; no trigonometry.
+    void Integrate(const float angular_velocity[3], float delta_t);
+    void ToMat4(Mat4* out) const;
+    float Dot(const Quat&) const;
+    float x() const { return q_[0]; }
+    float y() const { return q_[1]; }
+    float z() const { return q_[2]; }
+    float w() const { return q_[3]; }
+
+  private:
+    alignas(16) float q_[4];
 };
 
 template <typename T> void clamp(T* val, T min, T max) {
@@ -0,0 +1,321 @@
+#include "meshgenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "jobsystem.h"
+#include "kdron.h"
+#include "matma.h"
+
+static const unsigned int kTrianglesPerChunk = 1 << 16;
+static const float kFractalChildScale = 0.4f;
+static const float kSuperellipsoidExponent = 0.35f;
+
+MeshGenerator::MeshGenerator(Shape shape, unsigned int level) {
+    shape_ = shape;
+    level_ = level;
+    while (level_ > 0 && CountTriangles(shape_, level_) > kMaxTriangles)
+        level_--;
+    if (level_ != level)
+        std::cerr << "MeshGenerator: level " << level << " of "
+                  << ShapeName(shape) << " exceeds " << kMaxTriangles
+                  << " triangles, using level " << level_ << std::endl;
+
+    switch (shape_) {
+    case Subdivided:
+        segments_ = 1u << level_;
+        vertex_count_ =
+            KDron::kTriangleCount * (segments_ + 1) * (segments_ + 2) / 2;
+        break;
+    case Fractal:
+        segments_ = 0;
+        vertex_count_ = KDron::kVertexCount;
+        for (unsigned int i = 0; i < level_; i++)
+            vertex_count_ *= KDron::kVertexCount;
+        break;
+    case Parametric: {
+        segments_ = 4u << level_;
+        unsigned int sectors = 2 * segments_;
+        vertex_count_ = (segments_ + 1) * (sectors + 1);
+
+        // One SinCos pass for the whole ring; rows only vary in v.
+        std::vector<float> angles(sectors + 1), sines(sectors + 1),
+            cosines(sectors + 1);
+        for (unsigned int i = 0; i <= sectors; i++)
+            angles[i] = -M_PI + 2.0f * M_PI * i / sectors;
+        SinCos(angles.data(), sines.data(), cosines.data(), sectors + 1);
+        sector_x_.resize(sectors + 1);
+        sector_z_.resize(sectors + 1);
+        for (unsigned int i = 0; i <= sectors; i++) {
+            sector_x_[i] = copysignf(
+                powf(fabsf(cosines[i]), kSuperellipsoidExponent), cosines[i]);
+            sector_z_[i] = copysignf(
+                powf(fabsf(sines[i]), kSuperellipsoidExponent), sines[i]);
+        }
+        break;
+    }
+    }
+    triangle_count_ = CountTriangles(shape_, level_);
+    BuildChunks();
+}
+
+const char* MeshGenerator::ShapeName(Shape shape) {
+    switch (shape) {
+    case Subdivided:
+        return "subdivided";
+    case Fractal:
+        return "fractal";
+    case Parametric:
+        return "parametric";
+    }
+    return "unknown";
+}
+
+unsigned long long MeshGenerator::CountTriangles(Shape shape,
+                                                 unsigned int level) {
+    unsigned long long count = KDron::kTriangleCount;
+    switch (shape) {
+    case Subdivided:
+        return count << (2 * level);
+    case Fractal:
+        for (unsigned int i = 0; i < level; i++)
+            count *= KDron::kVertexCount;
+        return count;
+    case Parametric: {
+        unsigned long long rings = 4ull << level;
+        return 4 * rings * rings;
+    }
+    }
+    return 0;
+}
+
+void MeshGenerator::BuildChunks() {
+    Chunk chunk;
+    switch (shape_) {
+    case Subdivided: {
+        // Rows 0..n of every patch, banded; strip r joins rows r and r + 1.
+        unsigned int n = segments_;
+        unsigned int rows_per_chunk =
+            std::max(1u, kTrianglesPerChunk / (2 * n));
+        unsigned int patch_vertices = (n + 1) * (n + 2) / 2;
+        for (unsigned int patch = 0; patch < KDron::kTriangleCount; patch++) {
+            for (unsigned int row = 0; row <= n; row += rows_per_chunk) {
+                unsigned int end = std::min(row + rows_per_chunk, n + 1);
+                unsigned int strip_end = std::min(end, n);
+                chunk.patch = patch;
+                chunk.begin = row;
+                chunk.end = end;
+                chunk.first_vertex = patch * patch_vertices +
+                                     row * (n + 1) - row * (row - 1) / 2;
+                chunk.vertex_count = (end - row) * (n + 1) -
+                                     (end * (end - 1) - row * (row - 1)) / 2;
+                chunk.first_triangle = patch * n * n + 2 * n * row - row * row;
+                chunk.triangle_count =
+                    row < strip_end ? 2 * n * (strip_end - row) -
+                                          (strip_end * strip_end - row * row)
+                                    : 0;
+                chunks_.push_back(chunk);
+            }
+        }
+        break;
+    }
+    case Fractal: {
+        unsigned int copies = vertex_count_ / KDron::kVertexCount;
+        unsigned int copies_per_chunk =
+            std::max(1u, kTrianglesPerChunk / KDron::kTriangleCount);
+        for (unsigned int copy = 0; copy < copies; copy += copies_per_chunk) {
+            unsigned int end = std::min(copy + copies_per_chunk, copies);
+            chunk.patch = 0;
+            chunk.begin = copy;
+            chunk.end = end;
+            chunk.first_vertex = copy * KDron::kVertexCount;
+            chunk.vertex_count = (end - copy) * KDron::kVertexCount;
+            chunk.first_triangle = copy * KDron::kTriangleCount;
+            chunk.triangle_count = (end - copy) * KDron::kTriangleCount;
+            chunks_.push_back(chunk);
+        }
+        break;
+    }
+    case Parametric: {
+        unsigned int rings = segments_;
+        unsigned int sectors = 2 * rings;
+        unsigned int rows_per_chunk =
+            std::max(1u, kTrianglesPerChunk / (2 * sectors));
+        for (unsigned int row = 0; row <= rings; row += rows_per_chunk) {
+            unsigned int end = std::min(row + rows_per_chunk, rings + 1);
+            unsigned int strip_end = std::min(end, rings);
+            chunk.patch = 0;
+            chunk.begin = row;
+            chunk.end = end;
+            chunk.first_vertex = row * (sectors + 1);
+            chunk.vertex_count = (end - row) * (sectors + 1);
+            chunk.first_triangle = row * 2 * sectors;
+            chunk.triangle_count =
+                row < strip_end ? (strip_end - row) * 2 * sectors : 0;
+            chunks_.push_back(chunk);
+        }
+        break;
+    }
+    }
+}
+
+void MeshGenerator::GenerateChunk(unsigned int index, ColorVertex* vertices,
+                                  Triangle* triangles) const {
+    const Chunk& chunk = chunks_[index];
+    switch (shape_) {
+    case Subdivided:
+        GenerateSubdivided(chunk, vertices, triangles);
+        break;
+    case Fractal:
+        GenerateFractal(chunk, vertices, triangles);
+        break;
+    case Parametric:
+        GenerateParametric(chunk, vertices, triangles);
+        break;
+    }
+}
+
+void MeshGenerator::Generate(ColorVertex* vertices, Triangle* triangles) const {
+    JobSystem::Instance().ParallelFor(
+        chunks_.size(), 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+                GenerateChunk(i, vertices, triangles);
+        });
+}
+
+void MeshGenerator::GenerateSubdivided(const Chunk& chunk,
+                                       ColorVertex* vertices,
+                                       Triangle* triangles) const {
+    const unsigned int n = segments_;
+    const Triangle& face = KDron::kIndices[chunk.patch];
+    const ColorVertex& a = KDron::kVertices[face.indices[0]];
+    const ColorVertex& b = KDron::kVertices[face.indices[1]];
+    const ColorVertex& c = KDron::kVertices[face.indices[2]];
+    const unsigned int patch_base = chunk.patch * (n + 1) * (n + 2) / 2;
+    const float inv_n = 1.0f / n;
+
+    ColorVertex* out = vertices + chunk.first_vertex;
+    for (unsigned int row = chunk.begin; row < chunk.end; row++) {
+        float u = row * inv_n; // towards c
+        for (unsigned int column = 0; column <= n - row; column++) {
+            float v = column * inv_n; // towards b
+            float w = 1.0f - u - v;
+            for (int k = 0; k < 4; k++) {
+                out->position[k] =
+                    a.position[k] * w + b.position[k] * v + c.position[k] * u;
+                out->color[k] =
+                    a.color[k] * w + b.color[k] * v + c.color[k] * u;
+            }
+            out++;
+        }
+    }
+
+    Triangle* tri = triangles + chunk.first_triangle;
+    unsigned int strip_end = std::min(chunk.end, n);
+    for (unsigned int row = chunk.begin; row < strip_end; row++) {
+        unsigned int this_row =
+            patch_base + row * (n + 1) - row * (row - 1) / 2;
+        unsigned int next_row = this_row + (n + 1 - row);
+        for (unsigned int column = 0; column < n - row; column++) {
+            tri->indices[0] = this_row + column;
+            tri->indices[1] = this_row + column + 1;
+            tri->indices[2] = next_row + column;
+            tri++;
+            if (column + 1 < n - row) {
+                tri->indices[0] = this_row + column + 1;
+                tri->indices[1] = next_row + column + 1;
+                tri->indices[2] = next_row + column;
+                tri++;
+            }
+        }
+    }
+}
+
+void MeshGenerator::GenerateFractal(const Chunk& chunk, ColorVertex* vertices,
+                                    Triangle* triangles) const {
+    ColorVertex* out = vertices + chunk.first_vertex;
+    Triangle* tri = triangles + chunk.first_triangle;
+    for (unsigned int copy = chunk.begin; copy < chunk.end; copy++) {
+        // Base-12 digits of the copy index pick a vertex at every level,
+        // most significant digit first.
+        float offset[3] = {0, 0, 0};
+        float scale = 1.0f;
+        unsigned int divisor = 1;
+        for (unsigned int i = 1; i < level_; i++)
+            divisor *= KDron::kVertexCount;
+        for (unsigned int i = 0; i < level_; i++) {
+            const ColorVertex& anchor =
+                KDron::kVertices[(copy / divisor) % KDron::kVertexCount];
+            for (int k = 0; k < 3; k++)
+                offset[k] +=
+                    anchor.position[k] * scale * (1 - kFractalChildScale);
+            scale *= kFractalChildScale;
+            divisor /= KDron::kVertexCount;
+        }
+
+        for (unsigned int j = 0; j < KDron::kVertexCount; j++) {
+            const ColorVertex& base = KDron::kVertices[j];
+            for (int k = 0; k < 3; k++)
+                out->position[k] = offset[k] + base.position[k] * scale;
+            out->position[3] = 1.0f;
+            for (int k = 0; k < 4; k++)
+                out->color[k] = base.color[k];
+            out++;
+        }
+        unsigned int first = copy * KDron::kVertexCount;
+        for (unsigned int j = 0; j < KDron::kTriangleCount; j++) {
+            for (int k = 0; k < 3; k++)
+                tri->indices[k] = first + KDron::kIndices[j].indices[k];
+            tri++;
+        }
+    }
+}
+
+void MeshGenerator::GenerateParametric(const Chunk& chunk,
+                                       ColorVertex* vertices,
+                                       Triangle* triangles) const {
+    const unsigned int rings = segments_;
+    const unsigned int sectors = 2 * rings;
+
+    ColorVertex* out = vertices + chunk.first_vertex;
+    for (unsigned int row = chunk.begin; row < chunk.end; row++) {
+        float sine, cosine;
+        SinCos(-M_PI / 2 + M_PI * row / rings, &sine, &cosine);
+        float ring_radius =
+            copysignf(powf(fabsf(cosine), kSuperellipsoidExponent), cosine);
+        float height =
+            copysignf(powf(fabsf(sine), kSuperellipsoidExponent), sine);
+        for (unsigned int sector = 0; sector <= sectors; sector++) {
+            float x = 0.5f * ring_radius * sector_x_[sector];
+            float y = 0.5f * height;
+            float z = 0.5f * ring_radius * sector_z_[sector];
+            out->position[0] = x;
+            out->position[1] = y;
+            out->position[2] = z;
+            out->position[3] = 1.0f;
+            out->color[0] = 0.5f + x;
+            out->color[1] = 0.5f + y;
+            out->color[2] = 0.5f + z;
+            out->color[3] = 1.0f;
+            out++;
+        }
+    }
+
+    Triangle* tri = triangles + chunk.first_triangle;
+    unsigned int strip_end = std::min(chunk.end, rings);
+    for (unsigned int row = chunk.begin; row < strip_end; row++) {
+        unsigned int this_row = row * (sectors + 1);
+        unsigned int next_row = this_row + sectors + 1;
+        for (unsigned int sector = 0; sector < sectors; sector++) {
+            tri->indices[0] = this_row + sector;
+            tri->indices[1] = next_row + sector;
+            tri->indices[2] = this_row + sector + 1;
+            tri++;
+            tri->indices[0] = this_row + sector + 1;
+            tri->indices[1] = next_row + sector;
+            tri->indices[2] = next_row + sector + 1;
+            tri++;
+        }
+    }
+}
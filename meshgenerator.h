@@ -0,0 +1,73 @@
+#ifndef MESHGENERATOR_H
+#define MESHGENERATOR_H
+
+#include <vector>
+
+#include "vertices.h"
+
+// Procedural stress-test geometry. All sizes are known up front, so callers
+// allocate the vertex and index storage once and the generator writes straight
+// into it. The work is split into independent chunks that can be generated in
+// any order and on any thread; chunk i's triangles only reference vertices of
+// chunks i and i + 1.
+class MeshGenerator {
+  public:
+    enum Shape {
+        Subdivided, // every K-dron face split into 4^level triangles
+        Fractal,    // K-dron of K-drons, 12^level copies
+        Parametric, // superellipsoid on a (4 << level) x (8 << level) grid
+    };
+
+    struct Chunk {
+        unsigned int first_vertex;
+        unsigned int vertex_count;
+        unsigned int first_triangle;
+        unsigned int triangle_count;
+        unsigned int patch; // base triangle, Subdivided only
+        unsigned int begin; // first row, or first copy for Fractal
+        unsigned int end;
+    };
+
+    static const unsigned int kMaxTriangles = 100000000;
+
+    // Levels that would exceed kMaxTriangles are lowered to the largest one
+    // that fits.
+    MeshGenerator(Shape shape, unsigned int level);
+    Shape shape() const { return shape_; }
+    unsigned int level() const { return level_; }
+    unsigned int VertexCount() const { return vertex_count_; }
+    unsigned int TriangleCount() const { return triangle_count_; }
+    unsigned int ChunkCount() const { return chunks_.size(); }
+    const Chunk& GetChunk(unsigned int index) const { return chunks_[index]; }
+
+    void GenerateChunk(unsigned int index, ColorVertex* vertices,
+                       Triangle* triangles) const;
+    // Generates every chunk on the job system and waits for all of them.
+    void Generate(ColorVertex* vertices, Triangle* triangles) const;
+
+    static const char* ShapeName(Shape shape);
+    // Triangles at a level, before any lowering. Past level 16 the count can
+    // overflow.
+    static unsigned long long CountTriangles(Shape shape, unsigned int level);
+
+  private:
+    void BuildChunks();
+    void GenerateSubdivided(const Chunk& chunk, ColorVertex* vertices,
+                            Triangle* triangles) const;
+    void GenerateFractal(const Chunk& chunk, ColorVertex* vertices,
+                         Triangle* triangles) const;
+    void GenerateParametric(const Chunk& chunk, ColorVertex* vertices,
+                            Triangle* triangles) const;
+
+    Shape shape_;
+    unsigned int level_;
+    unsigned int segments_; // edge segments (Subdivided) or rings (Parametric)
+    unsigned int vertex_count_;
+    unsigned int triangle_count_;
+    std::vector<Chunk> chunks_;
+    // Parametric only: per-sector x and z factors of the superellipsoid
+    std::vector<float> sector_x_;
+    std::vector<float> sector_z_;
+};
+
+#endif // MESHGENERATOR_H
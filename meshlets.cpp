@@ -0,0 +1,390 @@
+#include "meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "geometry.h"
+#include "jobsystem.h"
+
+namespace {
+
+// Triangles clustered by one job. Meshlets do not cross blocks, which costs
+// a few partly filled ones at each seam.
+const unsigned int kBlockTriangles = 65536;
+const unsigned int kNone = std::numeric_limits<unsigned int>::max();
+// How much further a candidate counts for each triangle its corners have
+// left. Finishing off vertices first keeps the rim of a meshlet short, so
+// more triangles fit in its vertices.
+const double kLivePenalty = 0.5;
+
+struct Vec3 {
+    double x, y, z;
+};
+
+inline Vec3 operator+(Vec3 a, Vec3 b) {
+    return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+inline Vec3 operator-(Vec3 a, Vec3 b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+inline Vec3 operator*(Vec3 a, double s) { return {a.x * s, a.y * s, a.z * s}; }
+inline double Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 Cross(Vec3 a, Vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x};
+}
+inline double Length(Vec3 a) { return std::sqrt(Dot(a, a)); }
+
+inline Vec3 Position(const ColorVertex& vertex) {
+    return {vertex.position[0], vertex.position[1], vertex.position[2]};
+}
+
+// Clusters one block at a time; the scratch is kept between blocks
+class MeshletBuilder {
+  public:
+    MeshletBuilder(const ColorVertex* vertices, double outward)
+        : vertices_(vertices), outward_(outward) {}
+    void Build(Triangle* triangles, unsigned int first, unsigned int count,
+               std::vector<Meshlet>* meshlets);
+
+  private:
+    Vec3 Point(unsigned int triangle, int corner) const {
+        return Position(vertices_[block_[triangle].indices[corner]]);
+    }
+    void Add(unsigned int triangle);
+    void Finish(unsigned int first, std::vector<Meshlet>* meshlets);
+
+    const ColorVertex* vertices_;
+    double outward_;
+    std::vector<Triangle> block_;
+    // The block's vertices, numbered from its lowest index: the triangles
+    // around each, and the meshlet it was last taken into
+    unsigned int lowest_;
+    std::vector<unsigned int> offsets_;
+    std::vector<unsigned int> adjacent_;
+    std::vector<unsigned int> vertex_meshlet_;
+    std::vector<unsigned int> candidate_meshlet_;
+    std::vector<bool> used_;
+    std::vector<unsigned int> live_; // triangles around it not yet taken
+    std::vector<unsigned int> order_; // block triangles, meshlet by meshlet
+
+    // The meshlet being grown
+    unsigned int meshlet_;
+    unsigned int meshlet_start_; // in order_
+    std::vector<unsigned int> corners_;
+    Vec3 corner_sum_;
+    std::vector<unsigned int> candidates_; // next to it, may be used since
+};
+
+void MeshletBuilder::Build(Triangle* triangles, unsigned int first,
+                           unsigned int count,
+                           std::vector<Meshlet>* meshlets) {
+    block_.assign(triangles + first, triangles + first + count);
+    lowest_ = kNone;
+    unsigned int highest = 0;
+    for (const Triangle& triangle : block_)
+        for (unsigned int v : triangle.indices) {
+            lowest_ = std::min(lowest_, v);
+            highest = std::max(highest, v);
+        }
+    unsigned int span = highest - lowest_ + 1;
+    offsets_.assign(span + 1, 0);
+    for (const Triangle& triangle : block_)
+        for (unsigned int v : triangle.indices)
+            offsets_[v - lowest_ + 1]++;
+    for (unsigned int i = 0; i < span; i++)
+        offsets_[i + 1] += offsets_[i];
+    adjacent_.resize(count * 3);
+    std::vector<unsigned int> cursor(offsets_.begin(), offsets_.end() - 1);
+    for (unsigned int t = 0; t < count; t++)
+        for (unsigned int v : block_[t].indices)
+            adjacent_[cursor[v - lowest_]++] = t;
+    vertex_meshlet_.assign(span, kNone);
+    live_.resize(span);
+    for (unsigned int i = 0; i < span; i++)
+        live_[i] = offsets_[i + 1] - offsets_[i];
+    candidate_meshlet_.assign(count, kNone);
+    used_.assign(count, false);
+    order_.clear();
+
+    // Seeds are taken in order, so each meshlet starts next to the last
+    unsigned int seed = 0;
+    while (order_.size() < count) {
+        while (used_[seed])
+            seed++;
+        meshlet_ = meshlets->size();
+        meshlet_start_ = order_.size();
+        corners_.clear();
+        corner_sum_ = {0, 0, 0};
+        candidates_.clear();
+        Add(seed);
+        while (order_.size() - meshlet_start_ < kMeshletMaxTriangles) {
+            Vec3 center = corner_sum_ * (1.0 / corners_.size());
+            unsigned int best = kNone, best_fresh = 4;
+            double best_distance = 0;
+            for (size_t i = 0; i < candidates_.size();) {
+                unsigned int t = candidates_[i];
+                if (used_[t]) {
+                    candidates_[i] = candidates_.back();
+                    candidates_.pop_back();
+                    continue;
+                }
+                i++;
+                unsigned int fresh = 0;
+                for (unsigned int v : block_[t].indices)
+                    fresh += vertex_meshlet_[v - lowest_] != meshlet_;
+                if (fresh > best_fresh ||
+                    corners_.size() + fresh > kMeshletMaxVertices)
+                    continue;
+                Vec3 centroid =
+                    (Point(t, 0) + Point(t, 1) + Point(t, 2)) * (1.0 / 3);
+                double distance = Dot(centroid - center, centroid - center);
+                for (unsigned int v : block_[t].indices)
+                    distance *= 1 + kLivePenalty * live_[v - lowest_];
+                if (fresh < best_fresh || distance < best_distance) {
+                    best = t;
+                    best_fresh = fresh;
+                    best_distance = distance;
+                }
+            }
+            if (best == kNone && candidates_.empty()) {
+                // Nothing connected is left: the next triangle in order, if
+                // it fits, so small pieces share meshlets
+                while (seed < count && used_[seed])
+                    seed++;
+                unsigned int fresh = 0;
+                if (seed < count)
+                    for (unsigned int v : block_[seed].indices)
+                        fresh += vertex_meshlet_[v - lowest_] != meshlet_;
+                if (seed < count &&
+                    corners_.size() + fresh <= kMeshletMaxVertices)
+                    best = seed;
+            }
+            if (best == kNone)
+                break;
+            Add(best);
+        }
+        Finish(first, meshlets);
+    }
+
+    for (unsigned int i = 0; i < count; i++)
+        triangles[first + i] = block_[order_[i]];
+}
+
+void MeshletBuilder::Add(unsigned int triangle) {
+    used_[triangle] = true;
+    for (unsigned int v : block_[triangle].indices)
+        live_[v - lowest_]--;
+    order_.push_back(triangle);
+    for (unsigned int v : block_[triangle].indices) {
+        unsigned int local = v - lowest_;
+        if (vertex_meshlet_[local] == meshlet_)
+            continue;
+        vertex_meshlet_[local] = meshlet_;
+        corners_.push_back(v);
+        corner_sum_ = corner_sum_ + Position(vertices_[v]);
+        for (unsigned int a = offsets_[local]; a < offsets_[local + 1]; a++) {
+            unsigned int t = adjacent_[a];
+            if (!used_[t] && candidate_meshlet_[t] != meshlet_) {
+                candidate_meshlet_[t] = meshlet_;
+                candidates_.push_back(t);
+            }
+        }
+    }
+}
+
+void MeshletBuilder::Finish(unsigned int first,
+                            std::vector<Meshlet>* meshlets) {
+    Meshlet meshlet;
+    meshlet.first_triangle = first + meshlet_start_;
+    meshlet.triangle_count = order_.size() - meshlet_start_;
+    meshlet.vertex_count = corners_.size();
+
+    ColorVertex points[kMeshletMaxVertices];
+    for (size_t i = 0; i < corners_.size(); i++)
+        points[i] = vertices_[corners_[i]];
+    BoundingSphere sphere = ComputeMinimalSphere(points, corners_.size());
+    for (int k = 0; k < 3; k++)
+        meshlet.center[k] = sphere.center[k];
+    meshlet.radius = sphere.radius;
+
+    // The cone around the mean normal that holds them all; triangles with
+    // no area have no say
+    Vec3 normals[kMeshletMaxTriangles];
+    unsigned int normal_count = 0;
+    Vec3 axis = {0, 0, 0};
+    for (size_t i = meshlet_start_; i < order_.size(); i++) {
+        unsigned int t = order_[i];
+        Vec3 normal =
+            Cross(Point(t, 1) - Point(t, 0), Point(t, 2) - Point(t, 0));
+        double length = Length(normal);
+        if (length == 0)
+            continue;
+        normals[normal_count] = normal * (outward_ / length);
+        axis = axis + normals[normal_count++];
+    }
+    double axis_length = Length(axis);
+    meshlet.cone_cutoff = 1;
+    if (axis_length > 0) {
+        axis = axis * (1 / axis_length);
+        double lowest = 1;
+        for (unsigned int i = 0; i < normal_count; i++)
+            lowest = std::min(lowest, Dot(normals[i], axis));
+        if (lowest > 0)
+            meshlet.cone_cutoff = std::sqrt(1 - lowest * lowest);
+    }
+    meshlet.cone_axis[0] = axis.x;
+    meshlet.cone_axis[1] = axis.y;
+    meshlet.cone_axis[2] = axis.z;
+    meshlets->push_back(meshlet);
+}
+
+// One view in model space. The camera is at eye when eye_w is 1 and
+// infinitely far along eye when it is 0.
+struct ViewTest {
+    double planes[6][4]; // inside where dot(xyz, p) + w >= 0
+    Vec3 eye;
+    double eye_w;
+    bool backfaces; // false when the matrix could not be inverted
+};
+
+ViewTest MakeViewTest(const Mat4& model_view_projection) {
+    ViewTest test;
+    const float* m = model_view_projection;
+    // Gribb and Hartmann: the planes are sums and differences of the rows
+    for (int axis = 0; axis < 3; axis++)
+        for (int side = 0; side < 2; side++) {
+            double* plane = test.planes[axis * 2 + side];
+            double sign = side ? -1 : 1;
+            for (int c = 0; c < 4; c++)
+                plane[c] = m[4 * c + 3] + sign * m[4 * c + axis];
+            double length = std::sqrt(plane[0] * plane[0] +
+                                      plane[1] * plane[1] +
+                                      plane[2] * plane[2]);
+            for (int c = 0; c < 4; c++)
+                plane[c] = length > 0 ? plane[c] / length : c == 3;
+        }
+
+    // The camera is what clip space (0, 0, -1, 0) comes from: its position
+    // for a perspective, the direction back towards it for an orthographic
+    Mat4 inverse;
+    float eye[4] = {0, 0, 0, 0};
+    if (model_view_projection.Inverse(&inverse))
+        inverse.Transform(0, 0, -1, 0, eye);
+    test.eye = {eye[0], eye[1], eye[2]};
+    double length = Length(test.eye);
+    test.backfaces = true;
+    if (std::fabs(eye[3]) > 1e-6 * length) {
+        test.eye = test.eye * (1.0 / eye[3]);
+        test.eye_w = 1;
+    } else if (length > 0) {
+        test.eye = test.eye * (1 / length);
+        test.eye_w = 0;
+    } else {
+        test.eye_w = 0;
+        test.backfaces = false;
+    }
+    return test;
+}
+
+bool InFrustum(const ViewTest& test, Vec3 center, double radius) {
+    for (const double* plane : test.planes)
+        if (plane[0] * center.x + plane[1] * center.y + plane[2] * center.z +
+                plane[3] <
+            -radius)
+            return false;
+    return true;
+}
+
+// Every triangle faces away from the camera, wherever in the sphere it is
+// and whichever way in the cone its normal points
+bool FacesAway(const ViewTest& test, const Meshlet& meshlet, Vec3 center) {
+    if (!test.backfaces || meshlet.cone_cutoff >= 1)
+        return false;
+    Vec3 axis = {meshlet.cone_axis[0], meshlet.cone_axis[1],
+                 meshlet.cone_axis[2]};
+    Vec3 view = center * test.eye_w - test.eye;
+    return Dot(view, axis) >= meshlet.cone_cutoff * Length(view) +
+                                  meshlet.radius * test.eye_w;
+}
+
+} // namespace
+
+void BuildMeshlets(const ColorVertex* vertices, Triangle* triangles,
+                   unsigned int first_triangle, unsigned int triangle_count,
+                   std::vector<Meshlet>* meshlets) {
+    if (triangle_count == 0)
+        return;
+    double volume = 0;
+    for (unsigned int i = first_triangle; i < first_triangle + triangle_count;
+         i++) {
+        const unsigned int* t = triangles[i].indices;
+        volume += Dot(Position(vertices[t[0]]),
+                      Cross(Position(vertices[t[1]]),
+                            Position(vertices[t[2]])));
+    }
+    double outward = volume < 0 ? -1 : 1;
+
+    unsigned int blocks =
+        (triangle_count + kBlockTriangles - 1) / kBlockTriangles;
+    std::vector<std::vector<Meshlet>> partial(blocks);
+    JobSystem::Instance().ParallelFor(
+        blocks, 1, [&](unsigned int begin, unsigned int end) {
+            MeshletBuilder builder(vertices, outward);
+            for (unsigned int b = begin; b < end; b++) {
+                unsigned int first = b * kBlockTriangles;
+                builder.Build(
+                    triangles, first_triangle + first,
+                    std::min(kBlockTriangles, triangle_count - first),
+                    &partial[b]);
+            }
+        });
+    for (const std::vector<Meshlet>& part : partial)
+        meshlets->insert(meshlets->end(), part.begin(), part.end());
+}
+
+void CullMeshlets(const Meshlet* meshlets, unsigned int count,
+                  const Mat4& model_matrix, const Mat4* view_projections,
+                  unsigned int view_count, MeshletDrawList* draws,
+                  MeshletCullStats* stats) {
+    std::vector<ViewTest> tests;
+    for (unsigned int view = 0; view < view_count; view++)
+        tests.push_back(MakeViewTest(view_projections[view] * model_matrix));
+
+    size_t previous_draws = draws->index_counts.size();
+    for (unsigned int i = 0; i < count; i++) {
+        const Meshlet& meshlet = meshlets[i];
+        Vec3 center = {meshlet.center[0], meshlet.center[1],
+                       meshlet.center[2]};
+        bool in_frustum = false, kept = false;
+        for (const ViewTest& test : tests) {
+            if (!InFrustum(test, center, meshlet.radius))
+                continue;
+            in_frustum = true;
+            if (!FacesAway(test, meshlet, center)) {
+                kept = true;
+                break;
+            }
+        }
+        stats->triangles += meshlet.triangle_count;
+        if (!kept) {
+            if (in_frustum)
+                stats->backface_culled += meshlet.triangle_count;
+            else
+                stats->frustum_culled += meshlet.triangle_count;
+            continue;
+        }
+        size_t first_index = (size_t)meshlet.first_triangle * 3;
+        if (draws->index_counts.size() > previous_draws &&
+            draws->first_indices.back() + draws->index_counts.back() ==
+                first_index) {
+            draws->index_counts.back() += meshlet.triangle_count * 3;
+        } else {
+            draws->index_counts.push_back(meshlet.triangle_count * 3);
+            draws->first_indices.push_back(first_index);
+        }
+    }
+    stats->meshlets += count;
+    stats->draws += draws->index_counts.size() - previous_draws;
+}
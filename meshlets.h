@@ -0,0 +1,72 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "matma.h"
+#include "vertices.h"
+
+// Small clusters of a mesh's triangles, culled a cluster at a time. The
+// sizes are the ones mesh shaders are tuned for; here each meshlet is a run
+// of the index buffer and the ones left are drawn with one
+// glMultiDrawElements.
+const unsigned int kMeshletMaxVertices = 64;
+const unsigned int kMeshletMaxTriangles = 124;
+
+struct Meshlet {
+    unsigned int first_triangle; // into the triangles it was built from
+    unsigned int triangle_count;
+    unsigned int vertex_count; // distinct ones
+    // Bounding sphere, model space
+    float center[3];
+    float radius;
+    // Every outward normal is within the cone around axis. cutoff is the
+    // sine of its half angle, 1 when it is too wide to ever face away.
+    float cone_axis[3];
+    float cone_cutoff;
+};
+
+// Reorders triangles [first_triangle, first_triangle + triangle_count) so
+// that each meshlet is a run of them, and appends the meshlets. Triangles
+// are grown from a seed, preferring the ones that bring in the fewest new
+// vertices and then the closest, so meshlets come out round. Blocks of the
+// range are clustered in parallel. Outward is taken from the sign of the
+// volume the triangles enclose, since meshes here wind either way.
+void BuildMeshlets(const ColorVertex* vertices, Triangle* triangles,
+                   unsigned int first_triangle, unsigned int triangle_count,
+                   std::vector<Meshlet>* meshlets);
+
+// What is left to draw, as index ranges: neighbouring meshlets that are
+// both kept make one range.
+struct MeshletDrawList {
+    std::vector<GLsizei> index_counts;
+    std::vector<size_t> first_indices;
+
+    void Clear() {
+        index_counts.clear();
+        first_indices.clear();
+    }
+};
+
+// Added to by every CullMeshlets()
+struct MeshletCullStats {
+    unsigned long long meshlets;
+    unsigned long long triangles;
+    unsigned long long frustum_culled; // triangles outside every view
+    unsigned long long backface_culled; // in a view, facing away from all
+    unsigned long long draws;
+};
+
+// Keeps the meshlets some view may see: inside its frustum and with a
+// normal facing its camera. The test runs in model space, with the frustum
+// planes and the camera (a point, or a direction for orthographic views)
+// taken from the inverse of each model-view-projection.
+void CullMeshlets(const Meshlet* meshlets, unsigned int count,
+                  const Mat4& model_matrix, const Mat4* view_projections,
+                  unsigned int view_count, MeshletDrawList* draws,
+                  MeshletCullStats* stats);
+
+#endif // MESHLETS_H
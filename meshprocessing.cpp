@@ -0,0 +1,346 @@
+#include "meshprocessing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "jobsystem.h"
+#include "matma.h"
+
+static const unsigned int kFaceGrain = 1 << 14;
+static const unsigned int kVertexGrain = 1 << 12;
+static const float kMaxCreaseCosine = 0.999999f; // about 0.08 degrees
+
+// Four-lane helpers; w is always 0 for directions.
+#ifdef __SSE2__
+typedef __m128 F4;
+static inline F4 Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void Store(float* p, F4 a) { _mm_storeu_ps(p, a); }
+static inline F4 Zero() { return _mm_setzero_ps(); }
+static inline F4 Add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+static inline F4 Sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+static inline F4 Mul(F4 a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+static inline F4 Cross(F4 a, F4 b) {
+    // (a * b.yzx - a.yzx * b).yzx
+    F4 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    F4 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    F4 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+static inline float Dot(F4 a, F4 b) {
+    F4 p = _mm_mul_ps(a, b);
+    p = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)));
+    p = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(p);
+}
+#else
+struct F4 {
+    float v[4];
+};
+static inline F4 Load(const float* p) {
+    F4 a;
+    memcpy(a.v, p, sizeof(a.v));
+    return a;
+}
+static inline void Store(float* p, F4 a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline F4 Zero() { return F4{{0, 0, 0, 0}}; }
+static inline F4 Add(F4 a, F4 b) {
+    return F4{{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2],
+               a.v[3] + b.v[3]}};
+}
+static inline F4 Sub(F4 a, F4 b) {
+    return F4{{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2],
+               a.v[3] - b.v[3]}};
+}
+static inline F4 Mul(F4 a, float s) {
+    return F4{{a.v[0] * s, a.v[1] * s, a.v[2] * s, a.v[3] * s}};
+}
+static inline F4 Cross(F4 a, F4 b) {
+    return F4{{a.v[1] * b.v[2] - a.v[2] * b.v[1],
+               a.v[2] * b.v[0] - a.v[0] * b.v[2],
+               a.v[0] * b.v[1] - a.v[1] * b.v[0], 0}};
+}
+static inline float Dot(F4 a, F4 b) {
+    return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] +
+           a.v[3] * b.v[3];
+}
+#endif
+
+static inline F4 Normalized(F4 a) {
+    float length_squared = Dot(a, a);
+    return length_squared > 0 ? Mul(a, 1.0f / sqrtf(length_squared)) : a;
+}
+
+void ComputeFaceNormals(const ColorVertex* vertices, const Triangle* triangles,
+                        unsigned int triangle_count, float* normals) {
+    JobSystem::Instance().ParallelFor(
+        triangle_count, kFaceGrain, [=](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                const unsigned int* index = triangles[i].indices;
+                F4 a = Load(vertices[index[0]].position);
+                F4 b = Load(vertices[index[1]].position);
+                F4 c = Load(vertices[index[2]].position);
+                float normal[4];
+                Store(normal, Cross(Sub(b, a), Sub(c, a)));
+                memcpy(normals + 3 * i, normal, 3 * sizeof(float));
+            }
+        });
+}
+
+namespace {
+
+// Per-face data shared by every corner: area-weighted normal plus the UV
+// gradient directions used for tangents. The unit normal is only filled in
+// when corners are grouped by crease angle.
+struct FaceFrame {
+    float normal[4];
+    float s_direction[4];
+    float t_direction[4];
+    float unit_normal[4];
+};
+
+// What the corners of one output vertex add up to
+struct GroupSums {
+    F4 normal;
+    F4 s; // tangent directions
+    F4 t;
+};
+
+struct MeshInput {
+    const ColorVertex* vertices;
+    const Triangle* triangles;
+    const float* uvs;
+
+    void Uv(unsigned int vertex, float* uv) const {
+        if (uvs) {
+            uv[0] = uvs[2 * vertex];
+            uv[1] = uvs[2 * vertex + 1];
+        } else {
+            uv[0] = vertices[vertex].position[0] + 0.5f;
+            uv[1] = vertices[vertex].position[1] + 0.5f;
+        }
+    }
+};
+
+// Union-find over the corners around one vertex
+unsigned int FindGroup(std::vector<unsigned int>& parents, unsigned int c) {
+    while (parents[c] != c) {
+        parents[c] = parents[parents[c]];
+        c = parents[c];
+    }
+    return c;
+}
+
+void JoinGroups(std::vector<unsigned int>& parents, unsigned int a,
+                unsigned int b) {
+    a = FindGroup(parents, a);
+    b = FindGroup(parents, b);
+    // The lower corner stays the root, so numbering does not depend on order
+    if (a < b)
+        parents[b] = a;
+    else
+        parents[a] = b;
+}
+
+} // namespace
+
+void BuildShadedMesh(const ColorVertex* vertices, unsigned int vertex_count,
+                     const Triangle* triangles, unsigned int triangle_count,
+                     float crease_degrees, const float* uvs, ShadedMesh* out) {
+    JobSystem& jobs = JobSystem::Instance();
+    const MeshInput input = {vertices, triangles, uvs};
+    const bool smooth = crease_degrees >= 180.0f;
+    // Capped so that faces in one plane still join at a crease of 0, whatever
+    // rounding their normals picked up
+    const float min_cosine =
+        std::min(cosf(crease_degrees * kDegreesToRadians), kMaxCreaseCosine);
+
+    // 1. Face frames
+    std::unique_ptr<FaceFrame[]> frames(new FaceFrame[triangle_count]);
+    jobs.ParallelFor(triangle_count, kFaceGrain, [&](unsigned int begin,
+                                                     unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            const unsigned int* index = triangles[i].indices;
+            F4 p0 = Load(vertices[index[0]].position);
+            F4 e1 = Sub(Load(vertices[index[1]].position), p0);
+            F4 e2 = Sub(Load(vertices[index[2]].position), p0);
+            FaceFrame& frame = frames[i];
+            F4 normal = Cross(e1, e2);
+            Store(frame.normal, normal);
+            if (!smooth)
+                Store(frame.unit_normal, Normalized(normal));
+
+            float uv0[2], uv1[2], uv2[2];
+            input.Uv(index[0], uv0);
+            input.Uv(index[1], uv1);
+            input.Uv(index[2], uv2);
+            float du1 = uv1[0] - uv0[0], dv1 = uv1[1] - uv0[1];
+            float du2 = uv2[0] - uv0[0], dv2 = uv2[1] - uv0[1];
+            // Only the orientation of the UV mapping matters; the magnitude
+            // keeps the area weighting of the geometric edges.
+            float sign = du1 * dv2 - du2 * dv1 < 0 ? -1.0f : 1.0f;
+            Store(frame.s_direction,
+                  Mul(Sub(Mul(e1, dv2), Mul(e2, dv1)), sign));
+            Store(frame.t_direction,
+                  Mul(Sub(Mul(e2, du1), Mul(e1, du2)), sign));
+        }
+    });
+
+    // 2. Vertex -> corner adjacency (CSR). Corner c is face c / 3, slot c % 3.
+    std::unique_ptr<std::atomic<unsigned int>[]> cursor(
+        new std::atomic<unsigned int>[vertex_count + 1]());
+    jobs.ParallelFor(triangle_count, kFaceGrain,
+                     [&](unsigned int begin, unsigned int end) {
+                         for (unsigned int i = begin; i < end; i++)
+                             for (int k = 0; k < 3; k++)
+                                 cursor[triangles[i].indices[k]].fetch_add(
+                                     1, std::memory_order_relaxed);
+                     });
+    std::vector<unsigned int> offsets(vertex_count + 1);
+    unsigned int running = 0;
+    for (unsigned int v = 0; v < vertex_count; v++) {
+        offsets[v] = running;
+        running += cursor[v].load(std::memory_order_relaxed);
+        cursor[v].store(offsets[v], std::memory_order_relaxed);
+    }
+    offsets[vertex_count] = running;
+
+    std::vector<unsigned int> entries(3 * (size_t)triangle_count);
+    jobs.ParallelFor(triangle_count, kFaceGrain, [&](unsigned int begin,
+                                                     unsigned int end) {
+        for (unsigned int i = begin; i < end; i++)
+            for (unsigned int k = 0; k < 3; k++)
+                entries[cursor[triangles[i].indices[k]].fetch_add(
+                    1, std::memory_order_relaxed)] = 3 * i + k;
+    });
+    cursor.reset();
+
+    // 3. Group the corners of every vertex: faces that share an edge through
+    // it and meet within the crease angle are joined, and each group gets one
+    // normal. Sorting the lists makes the float sums independent of thread
+    // timing.
+    std::vector<unsigned int> corner_group(entries.size());
+    std::vector<unsigned int> group_offsets(vertex_count + 1);
+    jobs.ParallelFor(vertex_count, kVertexGrain, [&](unsigned int begin,
+                                                     unsigned int end) {
+        std::vector<unsigned int> parents, root_groups;
+        // The far end of each edge through the vertex, and the corner
+        std::vector<std::pair<unsigned int, unsigned int>> edges;
+        for (unsigned int v = begin; v < end; v++) {
+            unsigned int* list = &entries[offsets[v]];
+            unsigned int count = offsets[v + 1] - offsets[v];
+            std::sort(list, list + count);
+            unsigned int* groups = &corner_group[offsets[v]];
+            if (smooth || count < 2) {
+                std::fill(groups, groups + count, 0);
+                group_offsets[v] = count ? 1 : 0;
+                continue;
+            }
+
+            parents.resize(count);
+            edges.clear();
+            for (unsigned int c = 0; c < count; c++) {
+                parents[c] = c;
+                const unsigned int* index = triangles[list[c] / 3].indices;
+                unsigned int slot = list[c] % 3;
+                edges.push_back({index[(slot + 1) % 3], c});
+                edges.push_back({index[(slot + 2) % 3], c});
+            }
+            std::sort(edges.begin(), edges.end());
+            // Every pair on an edge, which is more than two faces only where
+            // the mesh is not manifold
+            for (size_t a = 0; a < edges.size(); a++)
+                for (size_t b = a + 1;
+                     b < edges.size() && edges[b].first == edges[a].first;
+                     b++) {
+                    unsigned int c = edges[a].second, d = edges[b].second;
+                    if (Dot(Load(frames[list[c] / 3].unit_normal),
+                            Load(frames[list[d] / 3].unit_normal)) >=
+                        min_cosine)
+                        JoinGroups(parents, c, d);
+                }
+
+            root_groups.assign(count, ~0u);
+            unsigned int group_count = 0;
+            for (unsigned int c = 0; c < count; c++) {
+                unsigned int& group = root_groups[FindGroup(parents, c)];
+                if (group == ~0u)
+                    group = group_count++;
+                groups[c] = group;
+            }
+            group_offsets[v] = group_count;
+        }
+    });
+
+    running = 0;
+    for (unsigned int v = 0; v < vertex_count; v++) {
+        unsigned int groups = group_offsets[v];
+        group_offsets[v] = running;
+        running += groups;
+    }
+    group_offsets[vertex_count] = running;
+
+    // 4. Emit one output vertex per group and point its corners at it.
+    out->vertices.resize(running);
+    out->tangents.resize(4 * (size_t)running);
+    out->triangles.resize(triangle_count);
+    jobs.ParallelFor(vertex_count, kVertexGrain, [&](unsigned int begin,
+                                                     unsigned int end) {
+        std::vector<GroupSums> sums;
+        for (unsigned int v = begin; v < end; v++) {
+            const unsigned int* list = &entries[offsets[v]];
+            const unsigned int* groups = &corner_group[offsets[v]];
+            unsigned int count = offsets[v + 1] - offsets[v];
+            unsigned int group_count = group_offsets[v + 1] - group_offsets[v];
+            sums.assign(group_count, GroupSums{Zero(), Zero(), Zero()});
+            for (unsigned int c = 0; c < count; c++) {
+                const FaceFrame& frame = frames[list[c] / 3];
+                GroupSums& sum = sums[groups[c]];
+                sum.normal = Add(sum.normal, Load(frame.normal));
+                sum.s = Add(sum.s, Load(frame.s_direction));
+                sum.t = Add(sum.t, Load(frame.t_direction));
+                out->triangles[list[c] / 3].indices[list[c] % 3] =
+                    group_offsets[v] + groups[c];
+            }
+
+            for (unsigned int group = 0; group < group_count; group++) {
+                unsigned int out_index = group_offsets[v] + group;
+                F4 normal = Normalized(sums[group].normal);
+                F4 s_sum = sums[group].s, t_sum = sums[group].t;
+
+                // Gram-Schmidt against the normal, any perpendicular if the
+                // UVs are degenerate here.
+                F4 tangent = Sub(s_sum, Mul(normal, Dot(normal, s_sum)));
+                if (Dot(tangent, tangent) < 1e-20f) {
+                    float n[4];
+                    Store(n, normal);
+                    float axis[4] = {fabsf(n[0]) < 0.9f ? 1.0f : 0.0f,
+                                     fabsf(n[0]) < 0.9f ? 0.0f : 1.0f, 0, 0};
+                    tangent = Cross(Load(axis), normal);
+                }
+                tangent = Normalized(tangent);
+                float handedness =
+                    Dot(Cross(normal, tangent), t_sum) < 0 ? -1.0f : 1.0f;
+
+                NormalTextureVertex& vertex = out->vertices[out_index];
+                memcpy(vertex.position, vertices[v].position,
+                       sizeof(vertex.position));
+                input.Uv(v, vertex.texture);
+                float n[4], t[4];
+                Store(n, normal);
+                Store(t, tangent);
+                memcpy(vertex.normal, n, sizeof(vertex.normal));
+                float* out_tangent = &out->tangents[4 * (size_t)out_index];
+                memcpy(out_tangent, t, 3 * sizeof(float));
+                out_tangent[3] = handedness;
+            }
+        }
+    });
+}
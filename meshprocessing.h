@@ -0,0 +1,29 @@
+#ifndef MESHPROCESSING_H
+#define MESHPROCESSING_H
+
+#include <vector>
+
+#include "vertices.h"
+
+// Mesh ready for lit shading. Vertices are split wherever the faces around
+// them meet at more than the crease angle, so one input vertex can turn into
+// several output vertices with different normals.
+struct ShadedMesh {
+    std::vector<NormalTextureVertex> vertices;
+    std::vector<float> tangents; // x, y, z, handedness per vertex
+    std::vector<Triangle> triangles;
+};
+
+// Area-weighted (unnormalized) face normals, three floats per triangle.
+void ComputeFaceNormals(const ColorVertex* vertices, const Triangle* triangles,
+                        unsigned int triangle_count, float* normals);
+
+// Computes normals and tangents for an indexed mesh, in parallel on the job
+// system. A crease angle of 0 gives flat shading, 180 fully smooth shading.
+// uvs holds two floats per input vertex; without them the XY plane is used as
+// a planar projection so tangents are still well defined.
+void BuildShadedMesh(const ColorVertex* vertices, unsigned int vertex_count,
+                     const Triangle* triangles, unsigned int triangle_count,
+                     float crease_degrees, const float* uvs, ShadedMesh* out);
+
+#endif // MESHPROCESSING_H
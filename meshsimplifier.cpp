@@ -0,0 +1,474 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "jobsystem.h"
+
+namespace {
+
+// Items per job for the parallel parts of a pass
+const unsigned int kGrain = 4096;
+// Border edges are held in place by a plane through them, perpendicular to
+// the face, weighted this much more than the faces themselves
+const float kBorderWeight = 10.0f;
+// Collapses may turn a face normal by at most about 75 degrees
+const float kMinNormalCosine = 0.25f;
+// Levels that lose less than this share of their triangles end the chain
+const float kMinLevelReduction = 0.1f;
+
+// Garland-Heckbert error quadric. The total weight is kept so the error can be
+// reported as a weighted mean squared distance instead of a sum. Doubles,
+// because in float the cancellation noise alone reads as an error of about
+// 1/2000 of the mesh size, more than the first levels really have.
+struct Quadric {
+    double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2, weight;
+
+    void Clear() { *this = Quadric(); }
+    void AddPlane(double a, double b, double c, double d, double w) {
+        a2 += w * a * a;
+        b2 += w * b * b;
+        c2 += w * c * c;
+        ab += w * a * b;
+        ac += w * a * c;
+        bc += w * b * c;
+        ad += w * a * d;
+        bd += w * b * d;
+        cd += w * c * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+    void Add(const Quadric& other) {
+        a2 += other.a2;
+        b2 += other.b2;
+        c2 += other.c2;
+        ab += other.ab;
+        ac += other.ac;
+        bc += other.bc;
+        ad += other.ad;
+        bd += other.bd;
+        cd += other.cd;
+        d2 += other.d2;
+        weight += other.weight;
+    }
+    double Evaluate(const float* p) const {
+        double x = p[0], y = p[1], z = p[2];
+        return a2 * x * x + b2 * y * y + c2 * z * z +
+               2 * (ab * x * y + ac * x * z + bc * y * z) +
+               2 * (ad * x + bd * y + cd * z) + d2;
+    }
+};
+
+struct Collapse {
+    float error;
+    unsigned int from;
+    unsigned int to;
+
+    bool operator<(const Collapse& other) const { return error < other.error; }
+};
+
+inline void Cross(const float* a, const float* b, float* out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+inline float Dot(const float* a, const float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Incremental simplifier: quadrics and vertex kinds are worked out once,
+// then every Simplify() call continues from where the previous one stopped.
+class Simplifier {
+  public:
+    Simplifier(const ColorVertex* vertices, unsigned int vertex_count,
+               const Triangle* triangles, unsigned int triangle_count);
+    void Simplify(unsigned int target_triangles);
+    const std::vector<Triangle>& triangles() const { return triangles_; }
+    // Largest collapse error so far, in model units, as an RMS distance
+    float error() const { return std::sqrt(error_) * scale_; }
+
+  private:
+    enum Kind : unsigned char {
+        Interior,
+        Border, // on an edge used by a single triangle
+        Locked, // border shared with a separate part of the mesh
+    };
+
+    void BuildAdjacency();
+    void ComputeQuadricsAndKinds();
+    bool HasDirectedEdge(unsigned int from, unsigned int to) const;
+    bool IsBorderEdge(unsigned int a, unsigned int b) const;
+    float CollapseError(unsigned int from, unsigned int to) const;
+    bool FlipsTriangles(unsigned int from, unsigned int to) const;
+    Collapse BestCollapse(unsigned int vertex) const;
+    bool Pass(unsigned int target_triangles);
+    const float* Position(unsigned int vertex) const {
+        return &positions_[vertex * 3];
+    }
+
+    unsigned int vertex_count_;
+    std::vector<float> positions_; // x, y, z, scaled into the unit cube
+    float scale_;                  // model units per unit cube side
+    std::vector<Triangle> triangles_;
+    std::vector<Quadric> quadrics_;
+    std::vector<Kind> kinds_;
+    // Triangles around each vertex, rebuilt before every pass
+    std::vector<unsigned int> adjacency_offsets_;
+    std::vector<unsigned int> adjacency_;
+    std::vector<unsigned int> remap_;
+    std::vector<Collapse> candidates_;
+    std::vector<unsigned char> involved_;
+    float error_; // squared, unit cube space
+};
+
+Simplifier::Simplifier(const ColorVertex* vertices, unsigned int vertex_count,
+                       const Triangle* triangles, unsigned int triangle_count)
+    : vertex_count_(vertex_count),
+      triangles_(triangles, triangles + triangle_count), error_(0) {
+    // Scaling into the unit cube keeps the quadric terms of similar size
+    float low[3] = {INFINITY, INFINITY, INFINITY};
+    float high[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (unsigned int i = 0; i < vertex_count; i++)
+        for (int k = 0; k < 3; k++) {
+            low[k] = std::min(low[k], vertices[i].position[k]);
+            high[k] = std::max(high[k], vertices[i].position[k]);
+        }
+    scale_ = std::max({high[0] - low[0], high[1] - low[1], high[2] - low[2],
+                       1e-20f});
+    positions_.resize(vertex_count * 3);
+    JobSystem::Instance().ParallelFor(
+        vertex_count, kGrain, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+                for (int k = 0; k < 3; k++)
+                    positions_[i * 3 + k] =
+                        (vertices[i].position[k] - low[k]) / scale_;
+        });
+
+    remap_.resize(vertex_count);
+    for (unsigned int i = 0; i < vertex_count; i++)
+        remap_[i] = i;
+    BuildAdjacency();
+    ComputeQuadricsAndKinds();
+}
+
+void Simplifier::BuildAdjacency() {
+    adjacency_offsets_.assign(vertex_count_ + 1, 0);
+    for (const Triangle& triangle : triangles_)
+        for (int k = 0; k < 3; k++)
+            adjacency_offsets_[triangle.indices[k] + 1]++;
+    for (unsigned int i = 0; i < vertex_count_; i++)
+        adjacency_offsets_[i + 1] += adjacency_offsets_[i];
+    adjacency_.resize(adjacency_offsets_[vertex_count_]);
+    std::vector<unsigned int> cursor(adjacency_offsets_.begin(),
+                                     adjacency_offsets_.end() - 1);
+    for (unsigned int t = 0; t < triangles_.size(); t++)
+        for (int k = 0; k < 3; k++)
+            adjacency_[cursor[triangles_[t].indices[k]]++] = t;
+}
+
+bool Simplifier::HasDirectedEdge(unsigned int from, unsigned int to) const {
+    for (unsigned int a = adjacency_offsets_[from];
+         a < adjacency_offsets_[from + 1]; a++) {
+        const unsigned int* indices = triangles_[adjacency_[a]].indices;
+        for (int k = 0; k < 3; k++)
+            if (indices[k] == from && indices[(k + 1) % 3] == to)
+                return true;
+    }
+    return false;
+}
+
+bool Simplifier::IsBorderEdge(unsigned int a, unsigned int b) const {
+    return HasDirectedEdge(a, b) != HasDirectedEdge(b, a);
+}
+
+void Simplifier::ComputeQuadricsAndKinds() {
+    quadrics_.resize(vertex_count_);
+    kinds_.assign(vertex_count_, Interior);
+    // Each vertex gathers its own face and border planes, so no two jobs
+    // write to the same quadric.
+    JobSystem::Instance().ParallelFor(
+        vertex_count_, kGrain, [this](unsigned int begin, unsigned int end) {
+            for (unsigned int v = begin; v < end; v++) {
+                Quadric& quadric = quadrics_[v];
+                quadric.Clear();
+                for (unsigned int a = adjacency_offsets_[v];
+                     a < adjacency_offsets_[v + 1]; a++) {
+                    const unsigned int* indices =
+                        triangles_[adjacency_[a]].indices;
+                    const float* p0 = Position(indices[0]);
+                    const float* p1 = Position(indices[1]);
+                    const float* p2 = Position(indices[2]);
+                    float e1[3], e2[3], normal[3];
+                    for (int k = 0; k < 3; k++) {
+                        e1[k] = p1[k] - p0[k];
+                        e2[k] = p2[k] - p0[k];
+                    }
+                    Cross(e1, e2, normal);
+                    float length = std::sqrt(Dot(normal, normal));
+                    if (length == 0)
+                        continue;
+                    for (int k = 0; k < 3; k++)
+                        normal[k] /= length;
+                    // Weighted by area; length is twice the area
+                    quadric.AddPlane(normal[0], normal[1], normal[2],
+                                     -Dot(normal, p0), 0.5f * length);
+
+                    for (int k = 0; k < 3; k++) {
+                        unsigned int from = indices[k];
+                        unsigned int to = indices[(k + 1) % 3];
+                        if ((from != v && to != v) || HasDirectedEdge(to, from))
+                            continue;
+                        kinds_[v] = Border;
+                        const float* a_position = Position(from);
+                        const float* b_position = Position(to);
+                        float edge[3], side[3];
+                        for (int j = 0; j < 3; j++)
+                            edge[j] = b_position[j] - a_position[j];
+                        Cross(edge, normal, side);
+                        float side_length = std::sqrt(Dot(side, side));
+                        if (side_length == 0)
+                            continue;
+                        for (int j = 0; j < 3; j++)
+                            side[j] /= side_length;
+                        quadric.AddPlane(side[0], side[1], side[2],
+                                         -Dot(side, a_position),
+                                         kBorderWeight * Dot(edge, edge));
+                    }
+                }
+            }
+        });
+
+    // Border vertices sharing their position with another vertex sit on a
+    // seam between separately indexed parts; moving them would open cracks.
+    std::vector<unsigned int> border;
+    for (unsigned int v = 0; v < vertex_count_; v++)
+        if (kinds_[v] == Border)
+            border.push_back(v);
+    auto less = [this](unsigned int a, unsigned int b) {
+        return std::lexicographical_compare(Position(a), Position(a) + 3,
+                                            Position(b), Position(b) + 3);
+    };
+    std::sort(border.begin(), border.end(), less);
+    for (unsigned int i = 0; i + 1 < border.size(); i++)
+        if (!less(border[i], border[i + 1])) {
+            kinds_[border[i]] = Locked;
+            kinds_[border[i + 1]] = Locked;
+        }
+}
+
+float Simplifier::CollapseError(unsigned int from, unsigned int to) const {
+    Quadric sum = quadrics_[from];
+    sum.Add(quadrics_[to]);
+    if (sum.weight == 0)
+        return 0;
+    return (float)(std::fabs(sum.Evaluate(Position(to))) / sum.weight);
+}
+
+bool Simplifier::FlipsTriangles(unsigned int from, unsigned int to) const {
+    for (unsigned int a = adjacency_offsets_[from];
+         a < adjacency_offsets_[from + 1]; a++) {
+        const unsigned int* indices = triangles_[adjacency_[a]].indices;
+        if (indices[0] == to || indices[1] == to || indices[2] == to)
+            continue; // collapses away
+        int k = indices[0] == from ? 0 : indices[1] == from ? 1 : 2;
+        const float* p1 = Position(indices[(k + 1) % 3]);
+        const float* p2 = Position(indices[(k + 2) % 3]);
+        const float* before = Position(from);
+        const float* after = Position(to);
+        float e1[3], e2[3], e3[3], old_normal[3], new_normal[3];
+        for (int j = 0; j < 3; j++) {
+            e1[j] = p1[j] - before[j];
+            e2[j] = p2[j] - before[j];
+            e3[j] = p1[j] - after[j];
+        }
+        Cross(e1, e2, old_normal);
+        for (int j = 0; j < 3; j++)
+            e2[j] = p2[j] - after[j];
+        Cross(e3, e2, new_normal);
+        float old_length = Dot(old_normal, old_normal);
+        float new_length = Dot(new_normal, new_normal);
+        if (old_length == 0)
+            continue;
+        float cosine = Dot(old_normal, new_normal);
+        if (cosine <= 0 || cosine * cosine < kMinNormalCosine *
+                                                 kMinNormalCosine *
+                                                 old_length * new_length)
+            return true;
+    }
+    return false;
+}
+
+Collapse Simplifier::BestCollapse(unsigned int vertex) const {
+    Collapse best = {INFINITY, vertex, vertex};
+    if (kinds_[vertex] == Locked)
+        return best;
+    for (unsigned int a = adjacency_offsets_[vertex];
+         a < adjacency_offsets_[vertex + 1]; a++) {
+        const unsigned int* indices = triangles_[adjacency_[a]].indices;
+        for (int k = 0; k < 3; k++) {
+            unsigned int other = indices[k];
+            if (other == vertex)
+                continue;
+            // Border vertices only slide along their border
+            if (kinds_[vertex] == Border &&
+                (kinds_[other] == Interior || !IsBorderEdge(vertex, other)))
+                continue;
+            float error = CollapseError(vertex, other);
+            if (error < best.error) {
+                best.error = error;
+                best.to = other;
+            }
+        }
+    }
+    return best;
+}
+
+// One round of collapses, cheapest first. A collapse claims its vertex's
+// whole fan, so every flip test in the pass sees up to date triangles.
+bool Simplifier::Pass(unsigned int target_triangles) {
+    BuildAdjacency();
+    candidates_.resize(vertex_count_);
+    JobSystem::Instance().ParallelFor(
+        vertex_count_, kGrain, [this](unsigned int begin, unsigned int end) {
+            for (unsigned int v = begin; v < end; v++)
+                candidates_[v] = BestCollapse(v);
+        });
+    candidates_.erase(std::remove_if(candidates_.begin(), candidates_.end(),
+                                     [](const Collapse& collapse) {
+                                         return collapse.from == collapse.to;
+                                     }),
+                      candidates_.end());
+    std::sort(candidates_.begin(), candidates_.end());
+
+    involved_.assign(vertex_count_, 0);
+    unsigned int removed = 0, collapsed = 0;
+    unsigned int excess = triangles_.size() - target_triangles;
+    for (const Collapse& collapse : candidates_) {
+        if (removed >= excess)
+            break;
+        unsigned int from = collapse.from, to = collapse.to;
+        if (involved_[from] || involved_[to] || FlipsTriangles(from, to))
+            continue;
+        for (unsigned int a = adjacency_offsets_[from];
+             a < adjacency_offsets_[from + 1]; a++) {
+            const unsigned int* indices = triangles_[adjacency_[a]].indices;
+            bool shared = false;
+            for (int k = 0; k < 3; k++) {
+                involved_[indices[k]] = 1;
+                shared = shared || indices[k] == to;
+            }
+            removed += shared;
+        }
+        remap_[from] = to;
+        quadrics_[to].Add(quadrics_[from]);
+        error_ = std::max(error_, collapse.error);
+        collapsed++;
+    }
+    if (collapsed == 0)
+        return false;
+
+    JobSystem::Instance().ParallelFor(
+        triangles_.size(), kGrain,
+        [this](unsigned int begin, unsigned int end) {
+            for (unsigned int t = begin; t < end; t++)
+                for (int k = 0; k < 3; k++)
+                    triangles_[t].indices[k] =
+                        remap_[triangles_[t].indices[k]];
+        });
+    triangles_.erase(std::remove_if(triangles_.begin(), triangles_.end(),
+                                    [](const Triangle& triangle) {
+                                        const unsigned int* i =
+                                            triangle.indices;
+                                        return i[0] == i[1] || i[1] == i[2] ||
+                                               i[0] == i[2];
+                                    }),
+                     triangles_.end());
+    return true;
+}
+
+void Simplifier::Simplify(unsigned int target_triangles) {
+    while (triangles_.size() > target_triangles && Pass(target_triangles)) {
+    }
+}
+
+} // namespace
+
+void BuildLodChain(const ColorVertex* vertices, unsigned int vertex_count,
+                   const Triangle* triangles, unsigned int triangle_count,
+                   LodChain* out, float ratio, unsigned int max_levels,
+                   unsigned int min_triangles) {
+    out->triangles.assign(triangles, triangles + triangle_count);
+    out->levels.assign(1, LodLevel{0, triangle_count, 0});
+
+    float low[3] = {0, 0, 0}, high[3] = {0, 0, 0};
+    for (unsigned int i = 0; i < vertex_count; i++)
+        for (int k = 0; k < 3; k++) {
+            float value = vertices[i].position[k];
+            low[k] = i == 0 ? value : std::min(low[k], value);
+            high[k] = i == 0 ? value : std::max(high[k], value);
+        }
+    float half[3];
+    for (int k = 0; k < 3; k++) {
+        out->center[k] = 0.5f * (low[k] + high[k]);
+        half[k] = 0.5f * (high[k] - low[k]);
+    }
+    out->radius = std::sqrt(Dot(half, half));
+
+    Simplifier simplifier(vertices, vertex_count, triangles, triangle_count);
+    while (out->levels.size() < max_levels) {
+        unsigned int previous = out->levels.back().triangle_count;
+        if (previous <= min_triangles)
+            break;
+        simplifier.Simplify(
+            std::max(min_triangles, (unsigned int)(previous * ratio)));
+        const std::vector<Triangle>& result = simplifier.triangles();
+        if (result.size() > previous * (1 - kMinLevelReduction))
+            break;
+        out->levels.push_back(
+            LodLevel{(unsigned int)out->triangles.size(),
+                     (unsigned int)result.size(), simplifier.error()});
+        out->triangles.insert(out->triangles.end(), result.begin(),
+                              result.end());
+    }
+}
+
+float PixelsPerUnit(const LodChain& chain, const Mat4& model_view_matrix,
+                    const Mat4& projection_matrix, float viewport_height) {
+    const float* model_view = model_view_matrix;
+    const float* projection = projection_matrix;
+    // The largest stretch of the model-view matrix turns model units into
+    // eye units
+    float scale = 0;
+    for (int k = 0; k < 3; k++)
+        scale = std::max(scale, Dot(model_view + 4 * k, model_view + 4 * k));
+    scale = std::sqrt(scale);
+    float pixels = 0.5f * viewport_height * projection[5] * scale;
+    // Orthographic projections do not divide by distance
+    if (projection[11] == 0)
+        return pixels;
+    float eye[4];
+    model_view_matrix.Transform(chain.center[0], chain.center[1],
+                                chain.center[2], 1, eye);
+    float distance = -eye[2] - chain.radius * scale;
+    // Inside the bounding sphere anything may be right in front of the eye
+    if (distance <= 1e-3f)
+        return INFINITY;
+    return pixels / distance;
+}
+
+unsigned int SelectLod(const LodChain& chain, float pixels_per_unit,
+                       float max_error_pixels, unsigned int current_level) {
+    // The budget moves by this factor against whichever change is considered
+    const float kHysteresis = 1.25f;
+    unsigned int last = chain.levels.size() - 1;
+    unsigned int level = std::min(current_level, last);
+    while (level > 0 && chain.levels[level].error * pixels_per_unit >
+                            max_error_pixels * kHysteresis)
+        level--;
+    while (level < last && chain.levels[level + 1].error * pixels_per_unit *
+                                   kHysteresis <=
+                               max_error_pixels)
+        level++;
+    return level;
+}
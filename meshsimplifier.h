@@ -0,0 +1,53 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <vector>
+
+#include "matma.h"
+#include "vertices.h"
+
+// A range of LodChain::triangles. error is the costliest collapse so far, in
+// model units: the root mean square distance from the vertex it kept to the
+// planes of the faces merged into it. The surface itself can have moved
+// further; on the generated meshes up to about three times as far.
+struct LodLevel {
+    unsigned int first_triangle;
+    unsigned int triangle_count;
+    float error;
+};
+
+// Levels of detail of one mesh, finest first. Every level indexes the
+// original vertex buffer, so all of them can share it and be concatenated
+// into one index buffer.
+struct LodChain {
+    std::vector<Triangle> triangles;
+    std::vector<LodLevel> levels;
+    float center[3]; // bounding sphere, model space
+    float radius;
+};
+
+// Quadric error metric simplification (Garland-Heckbert) by half-edge
+// collapses, so no vertex is moved or added. Each level keeps about ratio of
+// the previous one's triangles; the chain stops at max_levels, at
+// min_triangles or when a level can no longer be reduced much (open borders
+// shared with another part of the mesh are kept as they are, so there are no
+// cracks). The collapses run in passes whose analysis is spread over the job
+// system.
+void BuildLodChain(const ColorVertex* vertices, unsigned int vertex_count,
+                   const Triangle* triangles, unsigned int triangle_count,
+                   LodChain* out, float ratio = 0.5f,
+                   unsigned int max_levels = 8,
+                   unsigned int min_triangles = 256);
+
+// Screen pixels covered by one model unit at the near side of the chain's
+// bounding sphere, for a viewport of the given height.
+float PixelsPerUnit(const LodChain& chain, const Mat4& model_view_matrix,
+                    const Mat4& projection_matrix, float viewport_height);
+
+// Coarsest level whose error stays under max_error_pixels on screen, starting
+// from the level drawn last. A switch only happens once the budget is missed
+// or met by a clear margin, so a model at the boundary does not flicker.
+unsigned int SelectLod(const LodChain& chain, float pixels_per_unit,
+                       float max_error_pixels, unsigned int current_level);
+
+#endif // MESHSIMPLIFIER_H
@@ -1,11 +1,15 @@
 #include "modelprogram.h"
 
-void ModelProgram::Initialize(const char *vertex_shader_file, const char *fragment_shader_file){
-    CameraProgram::Initialize(vertex_shader_file, fragment_shader_file);
+void ModelProgram::Initialize(const char* vertex_shader_file,
+                              const char* fragment_shader_file,
+                              const std::string& defines) {
+    CameraProgram::Initialize(vertex_shader_file, fragment_shader_file,
+                              defines);
     model_matrix_location_ = GetUniformLocationOrDie("model_matrix");
 }
 
 
-void ModelProgram::SetModelMatrix(const Mat4 & matrix) const{
-    glUniformMatrix4fv(model_matrix_location_, 1, GL_FALSE, matrix);
+void ModelProgram::SetModelMatrix(const Mat4& matrix,
+                                  CommandList* commands) const {
+    commands->SetMatrix(model_matrix_location_, matrix);
 }
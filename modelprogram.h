@@ -6,8 +6,10 @@
 
 class ModelProgram : public CameraProgram{
 public:
-    void Initialize(const char* vertex_shader_file, const char* fragment_shader_file);
-    void SetModelMatrix(const Mat4 &) const;
+    void Initialize(const char* vertex_shader_file,
+                    const char* fragment_shader_file,
+                    const std::string& defines = "") override;
+    void SetModelMatrix(const Mat4&, CommandList* commands) const;
 private:
     GLuint model_matrix_location_;
 };
@@ -0,0 +1,40 @@
+#include "movablemodel.h"
+
+MovableModel::MovableModel(OrientationMode mode) {
+    orientation_mode_ = mode;
+    matrix_dirty_ = false;
+    angular_velocity_[0] = angular_velocity_[1] = angular_velocity_[2] = 0;
+}
+
+void MovableModel::ToggleOrientationMode() {
+    if (orientation_mode_ == EulerAngles) {
+        orientation_ = CurrentEulerOrientation();
+        orientation_mode_ = Quaternion;
+        matrix_dirty_ = true;
+    } else {
+        // Euler angles did not advance while integrating, so the model snaps
+        // back to where it was when the mode was switched on.
+        orientation_mode_ = EulerAngles;
+        matrix_dirty_ = false;
+    }
+}
+
+const Mat4& MovableModel::ModelMatrix() const {
+    if (matrix_dirty_) {
+        orientation_.ToMat4(&model_matrix_);
+        matrix_dirty_ = false;
+    }
+    return model_matrix_;
+}
+
+void MovableModel::IntegrateOrientation(float delta_t) {
+    orientation_.Integrate(angular_velocity_, delta_t);
+    matrix_dirty_ = true;
+}
+
+void MovableModel::RotateOrientation(const Quat& rotation, bool body_frame) {
+    orientation_ =
+        body_frame ? orientation_ * rotation : rotation * orientation_;
+    orientation_.Normalize();
+    matrix_dirty_ = true;
+}
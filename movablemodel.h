@@ -3,10 +3,33 @@
 
 #include "matma.h"
 
+class MovableModel {
+  public:
+    enum OrientationMode {
+        EulerAngles,
+        Quaternion,
+    };
 
-class MovableModel{
-protected:
-    Mat4 model_matrix_;
+    explicit MovableModel(OrientationMode mode = EulerAngles);
+    void ToggleOrientationMode();
+    OrientationMode orientation_mode() const { return orientation_mode_; }
+    // In Quaternion mode the matrix is only rebuilt from orientation_ when
+    // somebody asks for it, e.g. when the model is drawn or picked.
+    const Mat4& ModelMatrix() const;
+
+  protected:
+    void IntegrateOrientation(float delta_t);
+    void RotateOrientation(const Quat& rotation, bool body_frame);
+    // Called when switching into Quaternion mode.
+    virtual Quat CurrentEulerOrientation() const = 0;
+
+    mutable Mat4 model_matrix_;
+    Quat orientation_;
+    float angular_velocity_[3]; // body frame, radians per second
+
+  private:
+    OrientationMode orientation_mode_;
+    mutable bool matrix_dirty_;
 };
 
 #endif // MOVABLEMODEL_H
@@ -0,0 +1,33 @@
+#include "multiview.h"
+
+#include <cstring>
+
+void MultiView::Initialize() {
+    buffer_.Create(GpuResources::UniformBuffers, "multi-view");
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    buffer_.Allocate(GL_UNIFORM_BUFFER, sizeof(Block), nullptr,
+                     GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void MultiView::Add(const View& view) {
+    if (views_.size() < kMaxViews)
+        views_.push_back(view);
+}
+
+void MultiView::Record(CommandList* commands) const {
+    Block block;
+    memset(&block, 0, sizeof(block));
+    for (unsigned int i = 0; i < views_.size(); i++) {
+        Mat4 view_projection = views_[i].projection_matrix *
+                               views_[i].view_matrix;
+        memcpy(block.view_projection[i], (const float*)view_projection,
+               sizeof(block.view_projection[i]));
+    }
+    block.view_count = views_.size();
+    commands->UpdateBuffer(GL_UNIFORM_BUFFER, buffer_, &block, sizeof(block));
+    commands->BindUniformBuffer(kBinding, buffer_);
+    for (unsigned int i = 0; i < views_.size(); i++)
+        commands->ViewportIndexed(i, views_[i].x, views_[i].y,
+                                  views_[i].width, views_[i].height);
+}
@@ -0,0 +1,53 @@
+#ifndef MULTIVIEW_H
+#define MULTIVIEW_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "commandlist.h"
+#include "gpuresources.h"
+#include "matma.h"
+
+// Several cameras fed by one submission. MULTI_VIEW shader variants run their
+// geometry shader once per view (instanced), project each triangle with that
+// view's matrix from the Views uniform block and send it to the view's
+// viewport, so the scene is recorded and drawn once however many views there
+// are.
+class MultiView {
+  public:
+    // Geometry shader invocations; must match SimpleShader.geometry.glsl
+    static const unsigned int kMaxViews = 4;
+    // Uniform buffer binding of the Views block
+    static const GLuint kBinding = 0;
+
+    struct View {
+        GLint x, y;
+        GLsizei width, height;
+        Mat4 view_matrix;
+        Mat4 projection_matrix;
+    };
+
+    void Initialize(); // the uniform buffer; needs a GL context
+    void Clear() { views_.clear(); }
+    // Views past kMaxViews are dropped
+    void Add(const View& view);
+    unsigned int count() const { return views_.size(); }
+    const View& view(unsigned int i) const { return views_[i]; }
+
+    // Uploads the matrices and sets the viewport array for the draws after
+    void Record(CommandList* commands) const;
+
+  private:
+    // std140 layout of the Views block
+    struct Block {
+        float view_projection[kMaxViews][16];
+        GLint view_count;
+        GLint padding[3];
+    };
+
+    std::vector<View> views_;
+    GpuBuffer buffer_;
+};
+
+#endif // MULTIVIEW_H
@@ -0,0 +1,265 @@
+#include "occlusionculler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static double Now() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+OcclusionCuller::OcclusionCuller(unsigned int width, unsigned int height) {
+    width_ = (std::max(width, 4u) + 3) & ~3u;
+    height_ = std::max(height, 1u);
+    for (unsigned int w = width_, h = height_;; w = (w + 1) / 2,
+                      h = (h + 1) / 2) {
+        sizes_.push_back({w, h});
+        levels_.push_back(std::vector<float>((size_t)w * h, 1.0f));
+        if (w == 1 && h == 1)
+            break;
+    }
+    stats_ = Stats();
+}
+
+void OcclusionCuller::BeginFrame(const Mat4& view_projection) {
+    view_projection_ = view_projection;
+    std::fill(levels_[0].begin(), levels_[0].end(), 1.0f);
+    stats_ = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const ColorVertex* vertices,
+                                  unsigned int vertex_count,
+                                  const Triangle* triangles,
+                                  unsigned int triangle_count,
+                                  const Mat4& model_matrix) {
+    double start = Now();
+    Mat4 mvp = view_projection_ * model_matrix;
+    const float* m = mvp;
+
+    screen_vertices_.resize(vertex_count * 4);
+    for (unsigned int i = 0; i < vertex_count; i++) {
+        const float* p = vertices[i].position;
+        float clip[4];
+        for (int r = 0; r < 4; r++)
+            clip[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] +
+                      m[12 + r];
+        float* out = &screen_vertices_[i * 4];
+        // Triangles touching the near plane are dropped; fewer occluders is
+        // always safe.
+        out[3] = clip[3] > 1e-6f && clip[2] >= -clip[3];
+        if (!out[3])
+            continue;
+        float inverse_w = 1.0f / clip[3];
+        out[0] = (clip[0] * inverse_w * 0.5f + 0.5f) * width_;
+        out[1] = (clip[1] * inverse_w * 0.5f + 0.5f) * height_;
+        out[2] = std::min(clip[2] * inverse_w * 0.5f + 0.5f, 1.0f);
+    }
+
+    for (unsigned int i = 0; i < triangle_count; i++) {
+        const float* v0 = &screen_vertices_[triangles[i].indices[0] * 4];
+        const float* v1 = &screen_vertices_[triangles[i].indices[1] * 4];
+        const float* v2 = &screen_vertices_[triangles[i].indices[2] * 4];
+        if (v0[3] == 0 || v1[3] == 0 || v2[3] == 0)
+            continue;
+        RasterizeTriangle(v0, v1, v2);
+        stats_.occluder_triangles++;
+    }
+    stats_.raster_seconds += Now() - start;
+}
+
+void OcclusionCuller::RasterizeTriangle(const float* v0, const float* v1,
+                                        const float* v2) {
+    float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) -
+                 (v1[1] - v0[1]) * (v2[0] - v0[0]);
+    if (area < 0) { // occluders count from both sides
+        std::swap(v1, v2);
+        area = -area;
+    }
+    if (area < 1e-8f)
+        return;
+
+    int min_x = std::max((int)floorf(std::min({v0[0], v1[0], v2[0]})), 0);
+    int max_x = std::min((int)ceilf(std::max({v0[0], v1[0], v2[0]})),
+                         (int)width_ - 1);
+    int min_y = std::max((int)floorf(std::min({v0[1], v1[1], v2[1]})), 0);
+    int max_y = std::min((int)ceilf(std::max({v0[1], v1[1], v2[1]})),
+                         (int)height_ - 1);
+    if (min_x > max_x || min_y > max_y)
+        return;
+    min_x &= ~3; // whole quads; width_ is a multiple of 4
+
+    // Edge functions e = a * x + b * y + c, non-negative inside. Edge k is
+    // opposite vertex k, so e_k / area is that vertex's barycentric weight.
+    const float* v[3] = {v0, v1, v2};
+    float a[3], b[3], c[3];
+    for (int k = 0; k < 3; k++) {
+        const float* from = v[(k + 1) % 3];
+        const float* to = v[(k + 2) % 3];
+        a[k] = from[1] - to[1];
+        b[k] = to[0] - from[0];
+        c[k] = -(a[k] * from[0] + b[k] * from[1]);
+    }
+    // Depth is affine in screen space
+    float inverse_area = 1.0f / area;
+    float z_a = 0, z_b = 0, z_c = 0;
+    for (int k = 0; k < 3; k++) {
+        z_a += v[k][2] * a[k] * inverse_area;
+        z_b += v[k][2] * b[k] * inverse_area;
+        z_c += v[k][2] * c[k] * inverse_area;
+    }
+    // Both are evaluated at texel centres but stand for the worst corner of
+    // the texel: it is only written when the triangle covers all of it, and
+    // then with the farthest depth the triangle has over it.
+    for (int k = 0; k < 3; k++)
+        c[k] -= 0.5f * (fabsf(a[k]) + fabsf(b[k]));
+    z_c += 0.5f * (fabsf(z_a) + fabsf(z_b));
+
+    float* depth = levels_[0].data();
+    for (int y = min_y; y <= max_y; y++) {
+        float py = y + 0.5f;
+        float* row = depth + (size_t)y * width_;
+#ifdef __SSE2__
+        __m128 px = _mm_add_ps(_mm_set1_ps(min_x + 0.5f),
+                               _mm_setr_ps(0, 1, 2, 3));
+        __m128 e[3], step[3];
+        for (int k = 0; k < 3; k++) {
+            e[k] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[k]), px),
+                              _mm_set1_ps(b[k] * py + c[k]));
+            step[k] = _mm_set1_ps(4 * a[k]);
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z_a), px),
+                              _mm_set1_ps(z_b * py + z_c));
+        __m128 z_step = _mm_set1_ps(4 * z_a);
+        const __m128 zero = _mm_setzero_ps();
+        for (int x = min_x; x <= max_x; x += 4) {
+            __m128 inside = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)),
+                _mm_cmpge_ps(e[2], zero));
+            if (_mm_movemask_ps(inside)) {
+                __m128 old_depth = _mm_loadu_ps(row + x);
+                __m128 new_depth = _mm_min_ps(old_depth, z);
+                _mm_storeu_ps(row + x,
+                              _mm_or_ps(_mm_and_ps(inside, new_depth),
+                                        _mm_andnot_ps(inside, old_depth)));
+            }
+            for (int k = 0; k < 3; k++)
+                e[k] = _mm_add_ps(e[k], step[k]);
+            z = _mm_add_ps(z, z_step);
+        }
+#else
+        for (int x = min_x; x <= max_x; x++) {
+            float px = x + 0.5f;
+            if (a[0] * px + b[0] * py + c[0] >= 0 &&
+                a[1] * px + b[1] * py + c[1] >= 0 &&
+                a[2] * px + b[2] * py + c[2] >= 0)
+                row[x] = std::min(row[x], z_a * px + z_b * py + z_c);
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::BuildPyramid() {
+    double start = Now();
+    for (unsigned int i = 1; i < levels_.size(); i++) {
+        const Level& from = sizes_[i - 1];
+        const Level& to = sizes_[i];
+        const float* src = levels_[i - 1].data();
+        float* dst = levels_[i].data();
+        for (unsigned int y = 0; y < to.height; y++) {
+            const float* row0 = src + (size_t)(2 * y) * from.width;
+            const float* row1 =
+                src + (size_t)std::min(2 * y + 1, from.height - 1) * from.width;
+            float* out = dst + (size_t)y * to.width;
+            unsigned int x = 0;
+#ifdef __SSE2__
+            for (; 2 * x + 8 <= from.width; x += 4) {
+                __m128 left = _mm_max_ps(_mm_loadu_ps(row0 + 2 * x),
+                                         _mm_loadu_ps(row1 + 2 * x));
+                __m128 right = _mm_max_ps(_mm_loadu_ps(row0 + 2 * x + 4),
+                                          _mm_loadu_ps(row1 + 2 * x + 4));
+                __m128 even =
+                    _mm_shuffle_ps(left, right, _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 odd =
+                    _mm_shuffle_ps(left, right, _MM_SHUFFLE(3, 1, 3, 1));
+                _mm_storeu_ps(out + x, _mm_max_ps(even, odd));
+            }
+#endif
+            for (; x < to.width; x++) {
+                unsigned int x0 = 2 * x;
+                unsigned int x1 = std::min(2 * x + 1, from.width - 1);
+                out[x] = std::max(std::max(row0[x0], row0[x1]),
+                                  std::max(row1[x0], row1[x1]));
+            }
+        }
+    }
+    stats_.raster_seconds += Now() - start;
+}
+
+bool OcclusionCuller::IsVisible(const Aabb& box, const Mat4& model_matrix) {
+    stats_.tested++;
+    Mat4 mvp = view_projection_ * model_matrix;
+    const float* m = mvp;
+
+    // Outcodes per clip plane: -x, +x, -y, +y, near, far
+    unsigned int outside_all = 0x3f;
+    bool crosses_near = false;
+    float min_x = 1e30f, max_x = -1e30f, min_y = 1e30f, max_y = -1e30f;
+    float min_z = 1.0f;
+    for (int corner = 0; corner < 8; corner++) {
+        float p[3] = {corner & 1 ? box.max[0] : box.min[0],
+                      corner & 2 ? box.max[1] : box.min[1],
+                      corner & 4 ? box.max[2] : box.min[2]};
+        float clip[4];
+        for (int r = 0; r < 4; r++)
+            clip[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] +
+                      m[12 + r];
+        float w = clip[3];
+        unsigned int outcode = (clip[0] < -w) | (clip[0] > w) << 1 |
+                               (clip[1] < -w) << 2 | (clip[1] > w) << 3 |
+                               (clip[2] < -w) << 4 | (clip[2] > w) << 5;
+        outside_all &= outcode;
+        if (w <= 1e-6f || clip[2] < -w) {
+            crosses_near = true;
+            continue;
+        }
+        float inverse_w = 1.0f / w;
+        float sx = (clip[0] * inverse_w * 0.5f + 0.5f) * width_;
+        float sy = (clip[1] * inverse_w * 0.5f + 0.5f) * height_;
+        min_x = std::min(min_x, sx);
+        max_x = std::max(max_x, sx);
+        min_y = std::min(min_y, sy);
+        max_y = std::max(max_y, sy);
+        min_z = std::min(min_z, clip[2] * inverse_w * 0.5f + 0.5f);
+    }
+    if (outside_all) {
+        stats_.frustum_culled++;
+        return false;
+    }
+    if (crosses_near)
+        return true;
+
+    int x0 = std::max((int)floorf(min_x), 0);
+    int x1 = std::min((int)floorf(max_x), (int)width_ - 1);
+    int y0 = std::max((int)floorf(min_y), 0);
+    int y1 = std::min((int)floorf(max_y), (int)height_ - 1);
+    unsigned int level = 0;
+    while ((x1 >> level) - (x0 >> level) > 1 ||
+           (y1 >> level) - (y0 >> level) > 1)
+        level++;
+
+    bool visible = false;
+    const std::vector<float>& depth = levels_[level];
+    unsigned int level_width = sizes_[level].width;
+    for (int ty = y0 >> level; ty <= y1 >> level && !visible; ty++)
+        for (int tx = x0 >> level; tx <= x1 >> level && !visible; tx++)
+            visible = min_z <= depth[ty * level_width + tx];
+    if (!visible)
+        stats_.occlusion_culled++;
+    return visible;
+}
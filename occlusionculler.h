@@ -0,0 +1,59 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <vector>
+
+#include "bounds.h"
+#include "matma.h"
+#include "vertices.h"
+
+// CPU occlusion culling. A few large occluders are rasterized with SSE into a
+// small depth buffer, which is reduced into a max-depth pyramid; boxes are
+// then tested against the pyramid level where their screen rectangle covers
+// at most 2x2 texels. Every test is conservative: occluders only fill texels
+// they cover completely, with their farthest depth over the texel, and
+// anything touching the near plane or the edge of a texel counts as visible.
+class OcclusionCuller {
+  public:
+    struct Stats {
+        unsigned int occluder_triangles;
+        unsigned int tested;
+        unsigned int frustum_culled;
+        unsigned int occlusion_culled;
+        double raster_seconds; // occluders and pyramid
+    };
+
+    explicit OcclusionCuller(unsigned int width = 256,
+                             unsigned int height = 128);
+    // Clears the depth buffer for a new frame seen through view_projection.
+    void BeginFrame(const Mat4& view_projection);
+    void AddOccluder(const ColorVertex* vertices, unsigned int vertex_count,
+                     const Triangle* triangles, unsigned int triangle_count,
+                     const Mat4& model_matrix);
+    // Call once after the last occluder and before the first test.
+    void BuildPyramid();
+    bool IsVisible(const Aabb& box, const Mat4& model_matrix);
+
+    const Stats& stats() const { return stats_; }
+    unsigned int width() const { return width_; }
+    unsigned int height() const { return height_; }
+    const float* depth() const { return levels_[0].data(); }
+
+  private:
+    struct Level {
+        unsigned int width;
+        unsigned int height;
+    };
+
+    void RasterizeTriangle(const float* v0, const float* v1, const float* v2);
+
+    unsigned int width_;  // multiple of 4
+    unsigned int height_;
+    Mat4 view_projection_;
+    std::vector<Level> sizes_;
+    std::vector<std::vector<float>> levels_; // depth in [0, 1], 1 is far
+    std::vector<float> screen_vertices_;     // x, y, z, valid per vertex
+    Stats stats_;
+};
+
+#endif // OCCLUSIONCULLER_H
@@ -0,0 +1,411 @@
+#include "proceduralmodel.h"
+
+#include <iostream>
+#include <utility>
+
+#include <GLFW/glfw3.h>
+
+#include "jobsystem.h"
+
+// Caps the glBufferSubData traffic of a single frame
+static const unsigned int kUploadBytesPerFrame = 64 << 20;
+// Simplification error allowed on screen before a finer level is used. The
+// levels report an RMS distance, so a third of a pixel keeps the surface's
+// largest move at about one.
+static const float kLodErrorPixels = 0.33f;
+// GPU memory is accounted and budgeted under this name
+const char* ProceduralModel::kOwner = "procedural";
+
+ProceduralModel::Generation::Generation(MeshGenerator::Shape shape,
+                                        unsigned int level)
+    : generator(shape, level) {
+    cancelled = false;
+    vertices = nullptr;
+    triangles = nullptr;
+    bvh_ready = false;
+    bounds_ready = false;
+    lod_ready = false;
+}
+
+ProceduralModel::Generation::~Generation() {
+    delete[] vertices;
+    delete[] triangles;
+}
+
+ProceduralModel::ProceduralModel(float init_velocity)
+    : MovableModel(Quaternion) {
+    uploaded_chunks_ = 0;
+    drawable_triangles_ = 0;
+    start_time_ = 0;
+    lod_uploaded_ = false;
+    lod_enabled_ = true;
+    lod_level_ = lod_switches_ = 0;
+    lod_frames_ = lod_triangles_ = full_triangles_ = 0;
+    meshlet_culling_ = true;
+    meshlets_culled_ = false;
+    meshlet_stats_ = MeshletCullStats();
+    meshlet_frames_ = 0;
+    meshlet_cull_seconds_ = 0;
+    velocity_ = init_velocity;
+    animated_ = true;
+}
+
+ProceduralModel::~ProceduralModel() { Release(); }
+
+void ProceduralModel::Release() {
+    // Jobs still queued or running give up at their next check and free the
+    // buffers with the last reference, so nothing waits for them here
+    if (generation_)
+        generation_->cancelled.store(true, std::memory_order_relaxed);
+    generation_.reset();
+    uploaded_chunks_ = 0;
+    drawable_triangles_ = 0;
+    ResetBounds();
+    lod_uploaded_ = false;
+    lod_chain_ = LodChain();
+    lod_level_ = lod_switches_ = 0;
+    lod_frames_ = lod_triangles_ = full_triangles_ = 0;
+    std::vector<Meshlet>().swap(meshlets_);
+    level_meshlets_.clear();
+    meshlets_culled_ = false;
+    meshlet_draws_.Clear();
+    meshlet_stats_ = MeshletCullStats();
+    meshlet_frames_ = 0;
+    meshlet_cull_seconds_ = 0;
+
+    index_buffer_.Reset();
+    vertex_buffer_.Reset();
+    vao_.Reset();
+}
+
+bool ProceduralModel::Initialize(MeshGenerator::Shape shape,
+                                 unsigned int level) {
+    std::shared_ptr<Generation> generation =
+        std::make_shared<Generation>(shape, level);
+    const MeshGenerator& generator = generation->generator;
+    // The levels of detail take about as much again as the first index list
+    size_t bytes =
+        (size_t)generator.VertexCount() * sizeof(ColorVertex) +
+        (size_t)generator.TriangleCount() * sizeof(Triangle) * 2;
+    GpuResources& resources = GpuResources::Instance();
+    if (!resources.Fits(kOwner, bytes, resources.OwnerBytes(kOwner))) {
+        std::cerr << "Not generating " << MeshGenerator::ShapeName(shape)
+                  << " level " << generator.level() << ": "
+                  << bytes / 1048576.0 << " MiB would go over the GPU memory "
+                  << "budget" << std::endl;
+        return false;
+    }
+    Release();
+
+    generation_ = generation;
+    unsigned int chunk_count = generator.ChunkCount();
+    generation->vertices = new ColorVertex[generator.VertexCount()];
+    generation->triangles = new Triangle[generator.TriangleCount()];
+    generation->chunk_ready.reset(new std::atomic<bool>[chunk_count]);
+    for (unsigned int i = 0; i < chunk_count; i++)
+        generation->chunk_ready[i] = false;
+    uploaded_chunks_ = 0;
+    drawable_triangles_ = 0;
+
+    vao_.Create(kOwner);
+    glBindVertexArray(vao_);
+
+    vertex_buffer_.Create(GpuResources::VertexBuffers, kOwner);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    vertex_buffer_.Allocate(GL_ARRAY_BUFFER,
+                            (size_t)generator.VertexCount() *
+                                sizeof(ColorVertex),
+                            nullptr, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ColorVertex),
+                          (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ColorVertex),
+                          (GLvoid*)sizeof(ColorVertex::position));
+    glEnableVertexAttribArray(1);
+
+    index_buffer_.Create(GpuResources::IndexBuffers, kOwner);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+    index_buffer_.Allocate(GL_ELEMENT_ARRAY_BUFFER,
+                           (size_t)generator.TriangleCount() *
+                               sizeof(Triangle),
+                           nullptr, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    start_time_ = glfwGetTime();
+    for (unsigned int i = 0; i < chunk_count; i++) {
+        JobSystem::Instance().Submit([generation, i] {
+            if (generation->cancelled.load(std::memory_order_relaxed))
+                return;
+            generation->generator.GenerateChunk(i, generation->vertices,
+                                                generation->triangles);
+            generation->chunk_ready[i].store(true, std::memory_order_release);
+        });
+    }
+
+    std::cout << "Generating " << MeshGenerator::ShapeName(shape) << " level "
+              << generator.level() << ": " << generator.TriangleCount()
+              << " triangles in " << chunk_count << " chunks" << std::endl;
+    return true;
+}
+
+void ProceduralModel::StreamFinishedChunks() {
+    const MeshGenerator& generator = generation_->generator;
+    unsigned int chunk_count = generator.ChunkCount();
+    if (uploaded_chunks_ == chunk_count)
+        return;
+
+    unsigned int uploaded_bytes = 0;
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    // Only a contiguous prefix is uploaded so the draw range stays one call
+    while (uploaded_chunks_ < chunk_count &&
+           uploaded_bytes < kUploadBytesPerFrame &&
+           generation_->chunk_ready[uploaded_chunks_].load(
+               std::memory_order_acquire)) {
+        const MeshGenerator::Chunk& chunk =
+            generator.GetChunk(uploaded_chunks_);
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        (GLintptr)chunk.first_vertex * sizeof(ColorVertex),
+                        (GLsizeiptr)chunk.vertex_count * sizeof(ColorVertex),
+                        generation_->vertices + chunk.first_vertex);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,
+                        (GLintptr)chunk.first_triangle * sizeof(Triangle),
+                        (GLsizeiptr)chunk.triangle_count * sizeof(Triangle),
+                        generation_->triangles + chunk.first_triangle);
+        uploaded_bytes += chunk.vertex_count * sizeof(ColorVertex) +
+                          chunk.triangle_count * sizeof(Triangle);
+        uploaded_chunks_++;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    // A chunk's last strip reaches into the next chunk's first row, so it is
+    // only drawable once that chunk is on the GPU too.
+    if (uploaded_chunks_ == chunk_count) {
+        drawable_triangles_.store(generator.TriangleCount(),
+                                  std::memory_order_release);
+        std::cout << "Streamed " << generator.TriangleCount()
+                  << " triangles in "
+                  << (glfwGetTime() - start_time_) * 1000.0 << " ms"
+                  << std::endl;
+        std::shared_ptr<Generation> generation = generation_;
+        JobSystem::Instance().Submit(
+            [generation] { BuildFromMesh(generation.get()); });
+    } else if (uploaded_chunks_ > 0) {
+        drawable_triangles_.store(
+            generator.GetChunk(uploaded_chunks_ - 1).first_triangle,
+            std::memory_order_release);
+    }
+}
+
+void ProceduralModel::BuildFromMesh(Generation* generation) {
+    // Drawing only needs the GPU copy; the CPU copy lives until the picking
+    // hierarchy, the bounds, the levels of detail and their meshlets have
+    // been built from it. A replaced mesh stops at the next stage.
+    const MeshGenerator& generator = generation->generator;
+    const std::atomic<bool>& cancelled = generation->cancelled;
+    if (cancelled.load(std::memory_order_relaxed))
+        return;
+    double start = glfwGetTime();
+    generation->bvh.Build(generation->vertices, generation->triangles,
+                          generator.TriangleCount());
+    std::cout << "Built picking hierarchy: " << generation->bvh.NodeCount()
+              << " nodes in " << (glfwGetTime() - start) * 1000.0 << " ms"
+              << std::endl;
+    generation->bvh_ready.store(true, std::memory_order_release);
+    if (cancelled.load(std::memory_order_relaxed))
+        return;
+
+    start = glfwGetTime();
+    ComputeMeshBounds(generation->vertices, generator.VertexCount(),
+                      &generation->bounds);
+    std::cout << "Built bounds: hull of "
+              << generation->bounds.hull.vertices.size() << " vertices in "
+              << (glfwGetTime() - start) * 1000.0 << " ms" << std::endl;
+    generation->bounds_ready.store(true, std::memory_order_release);
+    if (cancelled.load(std::memory_order_relaxed))
+        return;
+
+    start = glfwGetTime();
+    LodChain& lod_chain = generation->lod_chain;
+    BuildLodChain(generation->vertices, generator.VertexCount(),
+                  generation->triangles, generator.TriangleCount(),
+                  &lod_chain);
+    std::cout << "Built " << lod_chain.levels.size()
+              << " levels of detail in " << (glfwGetTime() - start) * 1000.0
+              << " ms" << std::endl;
+
+    start = glfwGetTime();
+    std::vector<Meshlet>& meshlets = generation->meshlets;
+    for (const LodLevel& level : lod_chain.levels) {
+        if (cancelled.load(std::memory_order_relaxed))
+            return;
+        generation->level_meshlets.push_back(meshlets.size());
+        BuildMeshlets(generation->vertices, lod_chain.triangles.data(),
+                      level.first_triangle, level.triangle_count, &meshlets);
+    }
+    generation->level_meshlets.push_back(meshlets.size());
+    std::cout << "Built " << meshlets.size() << " meshlets in "
+              << (glfwGetTime() - start) * 1000.0 << " ms" << std::endl;
+    delete[] generation->vertices;
+    delete[] generation->triangles;
+    generation->vertices = nullptr;
+    generation->triangles = nullptr;
+    generation->lod_ready.store(true, std::memory_order_release);
+}
+
+void ProceduralModel::UploadLodChain() {
+    if (lod_uploaded_.load(std::memory_order_relaxed) ||
+        !generation_->lod_ready.load(std::memory_order_acquire))
+        return;
+    // The job is done with them
+    lod_chain_ = std::move(generation_->lod_chain);
+    meshlets_ = std::move(generation_->meshlets);
+    level_meshlets_ = std::move(generation_->level_meshlets);
+
+    // Level 0 is the streamed mesh itself, so the buffer can be replaced
+    // wholesale; the vertex array keeps pointing at the same buffer name.
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+    index_buffer_.Allocate(GL_ELEMENT_ARRAY_BUFFER,
+                           lod_chain_.triangles.size() * sizeof(Triangle),
+                           lod_chain_.triangles.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    std::vector<Triangle>().swap(lod_chain_.triangles);
+    lod_uploaded_.store(true, std::memory_order_release);
+
+    std::cout << "Levels of detail:";
+    for (const LodLevel& level : lod_chain_.levels)
+        std::cout << " " << level.triangle_count;
+    std::cout << " triangles" << std::endl;
+}
+
+void ProceduralModel::UpdateLod(const Mat4& view_matrix,
+                                const Mat4& projection_matrix,
+                                int viewport_height) {
+    if (!lod_uploaded_.load(std::memory_order_acquire))
+        return;
+    float pixels_per_unit =
+        PixelsPerUnit(lod_chain_, view_matrix * ModelMatrix(),
+                      projection_matrix, (float)viewport_height);
+    unsigned int previous = lod_level_;
+    lod_level_ =
+        SelectLod(lod_chain_, pixels_per_unit, kLodErrorPixels, lod_level_);
+    lod_switches_ += lod_level_ != previous;
+    lod_frames_++;
+    lod_triangles_ += lod_chain_.levels[lod_level_].triangle_count;
+    full_triangles_ += lod_chain_.levels[0].triangle_count;
+}
+
+void ProceduralModel::LogLodStats() {
+    if (lod_frames_ == 0) {
+        std::cout << "No levels of detail drawn yet" << std::endl;
+        return;
+    }
+    std::cout << "LOD " << (lod_enabled_ ? "on" : "off") << ": level "
+              << lod_level_ << ", " << lod_triangles_ / lod_frames_
+              << " triangles per frame with LOD, "
+              << full_triangles_ / lod_frames_ << " without, "
+              << lod_switches_ << " switches in " << lod_frames_ << " frames"
+              << std::endl;
+    lod_switches_ = 0;
+    lod_frames_ = lod_triangles_ = full_triangles_ = 0;
+}
+
+void ProceduralModel::CullMeshlets(const Mat4* view_projections,
+                                   unsigned int view_count) {
+    meshlet_draws_.Clear();
+    meshlets_culled_ = false;
+    if (!meshlet_culling_ || !lod_uploaded_.load(std::memory_order_acquire))
+        return;
+    double start = glfwGetTime();
+    unsigned int level = lod_enabled_ ? lod_level_ : 0;
+    unsigned int first = level_meshlets_[level];
+    ::CullMeshlets(meshlets_.data() + first, level_meshlets_[level + 1] - first,
+                   ModelMatrix(), view_projections, view_count,
+                   &meshlet_draws_, &meshlet_stats_);
+    meshlet_cull_seconds_ += glfwGetTime() - start;
+    meshlet_frames_++;
+    meshlets_culled_ = true;
+}
+
+void ProceduralModel::LogMeshletStats() {
+    if (meshlet_frames_ == 0) {
+        std::cout << "No meshlets culled yet" << std::endl;
+        return;
+    }
+    const MeshletCullStats& stats = meshlet_stats_;
+    unsigned long long culled = stats.frustum_culled + stats.backface_culled;
+    std::cout << "Meshlet culling " << (meshlet_culling_ ? "on" : "off")
+              << ": " << stats.triangles / meshlet_frames_
+              << " triangles in " << stats.meshlets / meshlet_frames_
+              << " meshlets per frame, " << culled / meshlet_frames_
+              << " culled ("
+              << (stats.triangles ? culled * 100.0 / stats.triangles : 0)
+              << "%: " << stats.frustum_culled / meshlet_frames_
+              << " outside the views, "
+              << stats.backface_culled / meshlet_frames_
+              << " facing away), " << stats.draws / meshlet_frames_
+              << " ranges drawn, "
+              << meshlet_cull_seconds_ * 1000.0 / meshlet_frames_
+              << " ms culling" << std::endl;
+    meshlet_stats_ = MeshletCullStats();
+    meshlet_frames_ = 0;
+    meshlet_cull_seconds_ = 0;
+}
+
+void ProceduralModel::Stream() {
+    if (!generation_)
+        return;
+    StreamFinishedChunks();
+    if (!bounds() && generation_->bounds_ready.load(std::memory_order_acquire))
+        SetBounds(std::move(generation_->bounds));
+    UploadLodChain();
+}
+
+void ProceduralModel::Update(float delta_t) {
+    if (!animated_)
+        return;
+    angular_velocity_[0] = angular_velocity_[1] = velocity_ * kDegreesToRadians;
+    IntegrateOrientation(delta_t);
+}
+
+void ProceduralModel::SpeedUp() { velocity_ *= kSpeedStep; }
+
+void ProceduralModel::SlowDown() { velocity_ /= kSpeedStep; }
+
+void ProceduralModel::ToggleAnimated() { animated_ = !animated_; }
+
+void ProceduralModel::Draw(const ModelProgram& program,
+                           CommandList* commands) const {
+    // What earlier frames uploaded; this frame's chunks arrive at replay
+    unsigned int first = 0,
+                 count = drawable_triangles_.load(std::memory_order_acquire);
+    if (count == 0)
+        return;
+    if (lod_uploaded_.load(std::memory_order_acquire) && lod_enabled_) {
+        first = lod_chain_.levels[lod_level_].first_triangle;
+        count = lod_chain_.levels[lod_level_].triangle_count;
+    }
+
+    commands->UseProgram(program);
+    commands->BindVertexArray(vao_);
+
+    program.SetModelMatrix(ModelMatrix(), commands);
+
+    // The culled list covers the same level; with nothing left, nothing is
+    // drawn
+    if (meshlets_culled_) {
+        if (!meshlet_draws_.index_counts.empty())
+            MultiDrawIndexed(program, meshlet_draws_.index_counts.data(),
+                             meshlet_draws_.first_indices.data(),
+                             meshlet_draws_.index_counts.size(), commands);
+    } else {
+        DrawIndexed(program, count * 3, (size_t)first * 3, commands);
+    }
+
+    commands->BindVertexArray(0);
+    commands->UseProgram(0);
+}
@@ -0,0 +1,126 @@
+#ifndef PROCEDURALMODEL_H
+#define PROCEDURALMODEL_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "bvh.h"
+#include "indexmodel.h"
+#include "meshgenerator.h"
+#include "meshlets.h"
+#include "meshsimplifier.h"
+#include "modelprogram.h"
+#include "movablemodel.h"
+
+// Large generated mesh. Chunks are produced on the job system straight into
+// buffers sized for the whole mesh and streamed to the GPU from Stream() as
+// they finish, so the model starts drawing long before generation is done.
+// Once complete, a chain of simplified index lists is built in the background
+// and the level drawn follows the mesh's size on screen. Every level is also
+// split into meshlets, and only those some view may see are drawn.
+class ProceduralModel : public IndexModel, public MovableModel {
+  public:
+    ProceduralModel(float init_velocity = 15);
+    ~ProceduralModel();
+    // Keeps the current mesh and returns false if the new one would not fit
+    // the GPU memory budget of kOwner.
+    bool Initialize(MeshGenerator::Shape shape, unsigned int level);
+    void Draw(const ModelProgram& program, CommandList* commands) const;
+    void Update(float delta_t);
+    // GL side of the frame: uploads finished chunks and levels of detail.
+    // Runs on the GL thread, possibly while the next frame is recorded.
+    void Stream();
+    void SpeedUp();
+    void SlowDown();
+    void ToggleAnimated();
+    // Picks the level of detail for this camera and counts the triangles
+    void UpdateLod(const Mat4& view_matrix, const Mat4& projection_matrix,
+                   int viewport_height);
+    void ToggleLod() { lod_enabled_ = !lod_enabled_; }
+    bool lod() const { return lod_enabled_; }
+    // Triangles per frame with and without LOD since the last call
+    void LogLodStats();
+    // Keeps the meshlets of the level drawn that any of the views may see
+    void CullMeshlets(const Mat4* view_projections, unsigned int view_count);
+    void ToggleMeshletCulling() { meshlet_culling_ = !meshlet_culling_; }
+    bool meshlet_culling() const { return meshlet_culling_; }
+    // Triangles culled per frame since the last call
+    void LogMeshletStats();
+
+    static const char* kOwner;
+
+    MeshGenerator::Shape shape() const {
+        return generation_->generator.shape();
+    }
+    unsigned int level() const { return generation_->generator.level(); }
+    // Null until the whole mesh is generated and its hierarchy built
+    const MeshBvh* bvh() const {
+        return generation_ &&
+                       generation_->bvh_ready.load(std::memory_order_acquire)
+                   ? &generation_->bvh
+                   : nullptr;
+    }
+
+  private:
+    // Everything the jobs of one Initialize() write or read. They share it
+    // with the model, so a replaced mesh is cancelled and left to them: the
+    // last one to finish frees it.
+    struct Generation {
+        Generation(MeshGenerator::Shape shape, unsigned int level);
+        ~Generation();
+
+        MeshGenerator generator;
+        std::atomic<bool> cancelled;
+        ColorVertex* vertices; // freed once the builds below are done
+        Triangle* triangles;
+        std::unique_ptr<std::atomic<bool>[]> chunk_ready;
+        MeshBvh bvh;
+        std::atomic<bool> bvh_ready;
+        MeshBounds bounds;
+        std::atomic<bool> bounds_ready;
+        // Handed over to the model by UploadLodChain()
+        LodChain lod_chain;
+        std::vector<Meshlet> meshlets;
+        std::vector<unsigned int> level_meshlets;
+        std::atomic<bool> lod_ready;
+    };
+
+    Quat CurrentEulerOrientation() const { return orientation_; }
+    void StreamFinishedChunks();
+    void UploadLodChain();
+    void Release();
+    // The job run once every chunk is on the GPU
+    static void BuildFromMesh(Generation* generation);
+
+    std::shared_ptr<Generation> generation_;
+    unsigned int uploaded_chunks_;
+    std::atomic<unsigned int> drawable_triangles_; // written by Stream()
+    double start_time_;
+    // All levels share the vertex buffer and replace the index buffer
+    LodChain lod_chain_;
+    std::atomic<bool> lod_uploaded_;
+    bool lod_enabled_;
+    unsigned int lod_level_;
+    unsigned int lod_switches_;
+    unsigned long long lod_frames_;
+    unsigned long long lod_triangles_;  // what the selected levels hold
+    unsigned long long full_triangles_; // what level 0 would have cost
+    // Built with the levels, each level's triangles reordered meshlet by
+    // meshlet
+    std::vector<Meshlet> meshlets_;
+    std::vector<unsigned int> level_meshlets_; // first of each level, end
+    bool meshlet_culling_;
+    bool meshlets_culled_; // the draw list is for this frame
+    MeshletDrawList meshlet_draws_;
+    MeshletCullStats meshlet_stats_;
+    unsigned long long meshlet_frames_;
+    double meshlet_cull_seconds_;
+
+    float velocity_;
+    bool animated_;
+};
+
+#endif // PROCEDURALMODEL_H
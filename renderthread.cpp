@@ -0,0 +1,127 @@
+#include "renderthread.h"
+
+#include <chrono>
+
+static double Now() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+RenderThread::RenderThread() {
+    window_ = nullptr;
+    present_callback_ = nullptr;
+    present_context_ = nullptr;
+    recording_ = 0;
+    pending_ = paused_ = stopping_ = has_context_ = false;
+    stats_ = Stats();
+}
+
+RenderThread::~RenderThread() { Stop(); }
+
+void RenderThread::Start(GLFWwindow* window) {
+    if (running())
+        return;
+    window_ = window;
+    recording_ = 0;
+    pending_ = paused_ = stopping_ = has_context_ = false;
+    // A context can only be current on one thread at a time
+    if (window_)
+        glfwMakeContextCurrent(nullptr);
+    thread_ = std::thread(&RenderThread::Loop, this);
+}
+
+void RenderThread::Stop() {
+    if (!running())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    if (window_)
+        glfwMakeContextCurrent(window_);
+}
+
+CommandList* RenderThread::BeginFrame() {
+    // The other list may still be replaying; this one finished a frame ago
+    lists_[recording_].Reset();
+    return &lists_[recording_];
+}
+
+void RenderThread::Submit() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        double start = Now();
+        done_.wait(lock, [this] { return !pending_; });
+        stats_.wait_seconds += Now() - start;
+        recording_ = 1 - recording_;
+        pending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void RenderThread::Pause() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    paused_ = true;
+    wake_.notify_one();
+    done_.wait(lock, [this] { return !pending_ && !has_context_; });
+    lock.unlock();
+    if (window_)
+        glfwMakeContextCurrent(window_);
+}
+
+void RenderThread::Resume() {
+    if (window_)
+        glfwMakeContextCurrent(nullptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The render thread takes the context back with the next frame
+    paused_ = false;
+}
+
+RenderThread::Stats RenderThread::TakeStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats_ = Stats();
+    return stats;
+}
+
+void RenderThread::Loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] {
+            return pending_ || stopping_ || (paused_ && has_context_);
+        });
+        if (pending_) {
+            if (!has_context_ && window_)
+                glfwMakeContextCurrent(window_);
+            has_context_ = true;
+            const CommandList& list = lists_[1 - recording_];
+            lock.unlock();
+            double start = Now();
+            list.Replay();
+            double replayed = Now();
+            if (window_)
+                glfwSwapBuffers(window_);
+            double presented = Now();
+            if (present_callback_)
+                present_callback_(present_context_);
+            lock.lock();
+            stats_.frames++;
+            stats_.replay_seconds += replayed - start;
+            stats_.present_seconds += presented - replayed;
+            pending_ = false;
+            done_.notify_all();
+            continue;
+        }
+        if (has_context_) {
+            if (window_)
+                glfwMakeContextCurrent(nullptr);
+            has_context_ = false;
+            done_.notify_all();
+        }
+        if (stopping_)
+            return;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#include "commandlist.h"
+
+// Owns the window's GL context on a thread of its own and replays the command
+// lists recorded by the main thread, so the simulation of one frame overlaps
+// the submission of the previous one. Lists are double buffered: the main
+// thread records into one while the other is replayed, and Submit() waits
+// only when the main thread gets a whole frame ahead.
+class RenderThread {
+  public:
+    struct Stats {
+        unsigned int frames;
+        double replay_seconds;  // render thread, running the lists
+        double present_seconds; // render thread, swapping buffers
+        double wait_seconds;    // main thread, blocked in Submit()
+    };
+
+    RenderThread();
+    ~RenderThread();
+    // Moves the window's context, current on the calling thread, over to a
+    // new thread. Without a window nothing is made current or presented.
+    void Start(GLFWwindow* window);
+    // Finishes the frame in flight and makes the context current on the
+    // calling thread again.
+    void Stop();
+    bool running() const { return thread_.joinable(); }
+    // Runs on the render thread right after every swap. Set while stopped.
+    void SetPresentCallback(CommandList::Callback callback, void* context) {
+        present_callback_ = callback;
+        present_context_ = context;
+    }
+
+    // Empty list to record the next frame into.
+    CommandList* BeginFrame();
+    void Submit();
+
+    // Brings the context over to the calling thread once the frame in flight
+    // is done, for one-off GL work such as creating resources in an input
+    // handler. Nothing is replayed until Resume().
+    void Pause();
+    void Resume();
+
+    // Totals since the last call
+    Stats TakeStats();
+
+  private:
+    void Loop();
+
+    GLFWwindow* window_;
+    CommandList::Callback present_callback_;
+    void* present_context_;
+    CommandList lists_[2];
+    unsigned int recording_;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_; // frame submitted, pause or stop
+    std::condition_variable done_; // frame replayed or context released
+    bool pending_;                 // lists_[1 - recording_] awaits replay
+    bool paused_;
+    bool stopping_;
+    bool has_context_;
+    Stats stats_;
+};
+
+// Keeps the render thread paused, if it runs, for the life of the object.
+class RenderThreadPause {
+  public:
+    explicit RenderThreadPause(RenderThread* thread)
+        : thread_(thread->running() ? thread : nullptr) {
+        if (thread_)
+            thread_->Pause();
+    }
+    ~RenderThreadPause() {
+        if (thread_)
+            thread_->Resume();
+    }
+
+  private:
+    RenderThread* thread_;
+};
+
+#endif // RENDERTHREAD_H
@@ -0,0 +1,725 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+static const char kMagic[4] = {'K', 'S', 'C', 'N'};
+static const uint32_t kVersion = 1;
+// Larger counts are taken for a corrupt file rather than allocated
+static const uint32_t kMaxRecords = 1u << 26;
+// The same for meshes, which are generated and shaded whole when first used.
+// Below the level bound no shape's triangle count can overflow.
+static const uint32_t kMaxMeshLevel = 16;
+static const unsigned long long kMaxMeshTriangles = 1u << 22;
+// Indexed by MeshGenerator::Shape and AnimationSet::Interpolation
+static const char* kShapeNames[] = {"subdivided", "fractal", "parametric"};
+static const char* kInterpolationNames[] = {"linear", "bezier", "slerp"};
+
+static bool ValidMesh(const SceneMesh& mesh) {
+    return mesh.level <= kMaxMeshLevel &&
+           MeshGenerator::CountTriangles(mesh.shape, mesh.level) <=
+               kMaxMeshTriangles;
+}
+
+static float Length(const float* v) {
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+Aabb InstanceBounds(const SceneInstance& instance, const Aabb& mesh_bounds,
+                    const AnimationSet::Clip* clip) {
+    float radius = 0;
+    for (int corner = 0; corner < 8; corner++) {
+        float point[3];
+        for (int k = 0; k < 3; k++)
+            point[k] = corner >> k & 1 ? mesh_bounds.max[k]
+                                       : mesh_bounds.min[k];
+        radius = std::max(radius, Length(point));
+    }
+    // Bezier curves stay inside the hull of their control points
+    float reach = 0, clip_scale = clip && !clip->scales.empty() ? 0 : 1;
+    if (clip) {
+        for (const AnimationSet::VectorKey& key : clip->positions)
+            reach = std::max({reach, Length(key.value), Length(key.out),
+                              Length(key.in)});
+        for (const AnimationSet::VectorKey& key : clip->scales)
+            for (int k = 0; k < 3; k++)
+                clip_scale =
+                    std::max({clip_scale, std::fabs(key.value[k]),
+                              std::fabs(key.out[k]), std::fabs(key.in[k])});
+    }
+    float scale = std::max({std::fabs(instance.scale[0]),
+                            std::fabs(instance.scale[1]),
+                            std::fabs(instance.scale[2])});
+    float extent = scale * (reach + radius * clip_scale);
+    Aabb box;
+    for (int k = 0; k < 3; k++) {
+        box.min[k] = instance.position[k] - extent;
+        box.max[k] = instance.position[k] + extent;
+    }
+    return box;
+}
+
+Mat4 InstanceMatrix(const SceneInstance& instance) {
+    const float* translations[3] = {&instance.position[0],
+                                    &instance.position[1],
+                                    &instance.position[2]};
+    float q[4] = {instance.rotation.x(), instance.rotation.y(),
+                  instance.rotation.z(), instance.rotation.w()};
+    const float* rotations[4] = {&q[0], &q[1], &q[2], &q[3]};
+    const float* scales[3] = {&instance.scale[0], &instance.scale[1],
+                              &instance.scale[2]};
+    Mat4 matrix;
+    Mat4::CreateTransforms(translations, rotations, scales, &matrix, 1);
+    return matrix;
+}
+
+// Keys must start at 0 and move forward for AnimationSet to loop them
+template <typename Key> static bool KeysInOrder(const std::vector<Key>& keys) {
+    for (unsigned int i = 0; i < keys.size(); i++)
+        if (i == 0 ? keys[i].time != 0 : !(keys[i].time > keys[i - 1].time))
+            return false;
+    return true;
+}
+
+static bool ValidClip(const AnimationSet::Clip& clip) {
+    return clip.position_interpolation != AnimationSet::Slerp &&
+           clip.scale_interpolation != AnimationSet::Slerp &&
+           clip.rotation_interpolation != AnimationSet::Bezier &&
+           KeysInOrder(clip.positions) && KeysInOrder(clip.rotations) &&
+           KeysInOrder(clip.scales);
+}
+
+// Binary reading
+
+namespace {
+
+// Every binary field is 32 bits, so records have no padding. Materials and
+// vector keys are written as they are in memory.
+static_assert(sizeof(SceneMaterial) == 4 * 4, "material record");
+static_assert(sizeof(AnimationSet::VectorKey) == 10 * 4, "vector key record");
+struct MeshRecord {
+    uint32_t shape;
+    uint32_t level;
+    float crease_degrees;
+};
+struct RotationKeyRecord {
+    float time;
+    float value[4];
+};
+struct ChunkRecord {
+    float min[3];
+    float max[3];
+    uint32_t instance_count;
+    uint32_t offset_low;
+    uint32_t offset_high;
+};
+struct InstanceRecord {
+    uint32_t mesh;
+    uint32_t material;
+    int32_t clip;
+    float time_offset;
+    float position[3];
+    float rotation[4];
+    float scale[3];
+};
+
+} // namespace
+
+SceneReader::SceneReader() {
+    binary_ = false;
+    header_ = nullptr;
+    next_chunk_ = 0;
+    bytes_read_ = 0;
+    line_pending_ = false;
+}
+
+bool SceneReader::Open(const char* file, SceneHeader* header,
+                       const char** error) {
+    *header = SceneHeader();
+    header_ = header;
+    next_chunk_ = 0;
+    bytes_read_ = 0;
+    line_pending_ = false;
+    file_.open(file, std::ios::in | std::ios::binary);
+    if (!file_) {
+        *error = "could not open the file";
+        return false;
+    }
+    char magic[4] = {};
+    file_.read(magic, sizeof(magic));
+    binary_ = file_ && memcmp(magic, kMagic, sizeof(magic)) == 0;
+    if (binary_) {
+        bytes_read_ = sizeof(magic);
+        return ReadBinaryHeader(header, error);
+    }
+    file_.clear();
+    file_.seekg(0);
+    return ReadTextHeader(header, error);
+}
+
+template <typename T>
+static bool ReadRecords(std::ifstream& file, unsigned int count,
+                        std::vector<T>* records,
+                        unsigned long long* bytes_read) {
+    records->resize(count);
+    file.read((char*)records->data(), (std::streamsize)count * sizeof(T));
+    *bytes_read += (unsigned long long)count * sizeof(T);
+    return (bool)file;
+}
+
+bool SceneReader::ReadBinaryHeader(SceneHeader* header, const char** error) {
+    std::vector<uint32_t> counts;
+    if (!ReadRecords(file_, 5, &counts, &bytes_read_)) {
+        *error = "truncated scene header";
+        return false;
+    }
+    if (counts[0] != kVersion) {
+        *error = "unsupported scene version";
+        return false;
+    }
+    for (unsigned int i = 1; i < 5; i++)
+        if (counts[i] > kMaxRecords) {
+            *error = "corrupt scene header";
+            return false;
+        }
+
+    std::vector<MeshRecord> meshes;
+    std::vector<SceneMaterial> materials;
+    if (!ReadRecords(file_, counts[1], &meshes, &bytes_read_) ||
+        !ReadRecords(file_, counts[2], &materials, &bytes_read_)) {
+        *error = "truncated scene header";
+        return false;
+    }
+    for (const MeshRecord& record : meshes) {
+        if (record.shape > MeshGenerator::Parametric) {
+            *error = "unknown mesh shape";
+            return false;
+        }
+        SceneMesh mesh = {(MeshGenerator::Shape)record.shape, record.level,
+                          record.crease_degrees};
+        if (!ValidMesh(mesh)) {
+            *error = "mesh too large";
+            return false;
+        }
+        header->meshes.push_back(mesh);
+    }
+    header->materials = materials;
+
+    for (unsigned int i = 0; i < counts[3]; i++) {
+        std::vector<uint32_t> layout;
+        std::vector<RotationKeyRecord> rotations;
+        AnimationSet::Clip clip;
+        if (!ReadRecords(file_, 6, &layout, &bytes_read_) ||
+            layout[0] > AnimationSet::Slerp ||
+            layout[1] > AnimationSet::Slerp ||
+            layout[2] > AnimationSet::Slerp || layout[3] > kMaxRecords ||
+            layout[4] > kMaxRecords || layout[5] > kMaxRecords ||
+            !ReadRecords(file_, layout[3], &clip.positions, &bytes_read_) ||
+            !ReadRecords(file_, layout[4], &rotations, &bytes_read_) ||
+            !ReadRecords(file_, layout[5], &clip.scales, &bytes_read_)) {
+            *error = "truncated or corrupt clip";
+            return false;
+        }
+        clip.position_interpolation = (AnimationSet::Interpolation)layout[0];
+        clip.rotation_interpolation = (AnimationSet::Interpolation)layout[1];
+        clip.scale_interpolation = (AnimationSet::Interpolation)layout[2];
+        for (const RotationKeyRecord& record : rotations)
+            clip.rotations.push_back(
+                {record.time, Quat(record.value[0], record.value[1],
+                                   record.value[2], record.value[3])});
+        if (!ValidClip(clip)) {
+            *error = "clip with misplaced keys or interpolation";
+            return false;
+        }
+        header->clips.push_back(clip);
+    }
+
+    std::vector<ChunkRecord> chunks;
+    if (!ReadRecords(file_, counts[4], &chunks, &bytes_read_)) {
+        *error = "truncated chunk table";
+        return false;
+    }
+    for (const ChunkRecord& record : chunks) {
+        SceneHeader::ChunkEntry entry;
+        memcpy(entry.bounds.min, record.min, sizeof(record.min));
+        memcpy(entry.bounds.max, record.max, sizeof(record.max));
+        entry.instance_count = record.instance_count;
+        entry.offset = (unsigned long long)record.offset_high << 32 |
+                       record.offset_low;
+        if (entry.instance_count > kMaxRecords) {
+            *error = "corrupt chunk table";
+            return false;
+        }
+        header->chunks.push_back(entry);
+    }
+    return true;
+}
+
+bool SceneReader::ReadChunk(unsigned int index, SceneChunk* chunk,
+                            const char** error) {
+    if (!binary_ || index >= header_->chunks.size()) {
+        *error = "no such chunk";
+        return false;
+    }
+    const SceneHeader::ChunkEntry& entry = header_->chunks[index];
+    file_.clear();
+    file_.seekg((std::streamoff)entry.offset);
+    std::vector<InstanceRecord> records;
+    if (!ReadRecords(file_, entry.instance_count, &records, &bytes_read_)) {
+        *error = "truncated chunk";
+        return false;
+    }
+    chunk->bounds = entry.bounds;
+    chunk->instances.resize(records.size());
+    for (unsigned int i = 0; i < records.size(); i++) {
+        const InstanceRecord& record = records[i];
+        SceneInstance& instance = chunk->instances[i];
+        instance.mesh = record.mesh;
+        instance.material = record.material;
+        instance.clip = record.clip;
+        instance.time_offset = record.time_offset;
+        memcpy(instance.position, record.position, sizeof(record.position));
+        instance.rotation = Quat(record.rotation[0], record.rotation[1],
+                                 record.rotation[2], record.rotation[3]);
+        memcpy(instance.scale, record.scale, sizeof(record.scale));
+    }
+    next_chunk_ = index + 1;
+    return Validate(*chunk, error);
+}
+
+bool SceneReader::NextChunk(SceneChunk* chunk, const char** error) {
+    *error = nullptr;
+    if (binary_)
+        return next_chunk_ < header_->chunks.size() &&
+               ReadChunk(next_chunk_, chunk, error);
+    return ReadTextChunk(chunk, error);
+}
+
+bool SceneReader::Validate(const SceneChunk& chunk, const char** error) const {
+    for (const SceneInstance& instance : chunk.instances)
+        if (instance.mesh >= header_->meshes.size() ||
+            instance.material >= header_->materials.size() ||
+            instance.clip < -1 || instance.clip >= (int)header_->clips.size()) {
+            *error = "instance of a missing mesh, material or clip";
+            return false;
+        }
+    return true;
+}
+
+// Text reading
+
+// The next record, comments and blank lines skipped
+static bool NextLine(std::ifstream& file, std::string* line,
+                     unsigned long long* bytes_read) {
+    while (std::getline(file, *line)) {
+        *bytes_read += line->size() + 1;
+        size_t comment = line->find('#');
+        if (comment != std::string::npos)
+            line->erase(comment);
+        if (line->find_first_not_of(" \t\r") != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+static bool ReadName(std::istringstream& fields, const char* const* names,
+                     unsigned int count, unsigned int* index) {
+    std::string name;
+    fields >> name;
+    for (*index = 0; *index < count; (*index)++)
+        if (name == names[*index])
+            return true;
+    return false;
+}
+
+static bool ReadFloats(std::istringstream& fields, float* values,
+                       unsigned int count) {
+    for (unsigned int i = 0; i < count; i++)
+        fields >> values[i];
+    return (bool)fields;
+}
+
+// Bezier control points are optional; without them the key is a corner
+static bool ReadVectorKey(std::istringstream& fields,
+                          AnimationSet::VectorKey* key) {
+    if (!ReadFloats(fields, &key->time, 1) ||
+        !ReadFloats(fields, key->value, 3))
+        return false;
+    fields >> std::ws;
+    if (fields.eof()) {
+        memcpy(key->out, key->value, sizeof(key->value));
+        memcpy(key->in, key->value, sizeof(key->value));
+        return true;
+    }
+    return ReadFloats(fields, key->out, 3) && ReadFloats(fields, key->in, 3);
+}
+
+bool SceneReader::ReadTextHeader(SceneHeader* header, const char** error) {
+    unsigned int version = 0;
+    if (NextLine(file_, &line_, &bytes_read_)) {
+        std::istringstream fields(line_);
+        std::string keyword;
+        fields >> keyword >> version;
+        if (keyword != "scene")
+            version = 0;
+    }
+    if (version != kVersion) {
+        *error = "not a scene file, or an unsupported version";
+        return false;
+    }
+
+    AnimationSet::Clip* clip = nullptr;
+    while (NextLine(file_, &line_, &bytes_read_)) {
+        std::istringstream fields(line_);
+        std::string keyword;
+        fields >> keyword;
+        bool ok = true;
+        if (keyword == "chunk") {
+            line_pending_ = true;
+            break;
+        } else if (keyword == "mesh" && !clip) {
+            SceneMesh mesh;
+            unsigned int shape = 0;
+            ok = ReadName(fields, kShapeNames, 3, &shape);
+            fields >> mesh.level >> mesh.crease_degrees;
+            mesh.shape = (MeshGenerator::Shape)shape;
+            ok = ok && fields && ValidMesh(mesh);
+            header->meshes.push_back(mesh);
+        } else if (keyword == "material" && !clip) {
+            SceneMaterial material;
+            ok = ReadFloats(fields, material.base_color, 4);
+            header->materials.push_back(material);
+        } else if (keyword == "clip" && !clip) {
+            header->clips.emplace_back();
+            clip = &header->clips.back();
+            unsigned int position = 0, rotation = 0, scale = 0;
+            ok = ReadName(fields, kInterpolationNames, 3, &position) &&
+                 ReadName(fields, kInterpolationNames, 3, &rotation) &&
+                 ReadName(fields, kInterpolationNames, 3, &scale);
+            clip->position_interpolation =
+                (AnimationSet::Interpolation)position;
+            clip->rotation_interpolation =
+                (AnimationSet::Interpolation)rotation;
+            clip->scale_interpolation = (AnimationSet::Interpolation)scale;
+        } else if ((keyword == "position" || keyword == "scale") && clip) {
+            AnimationSet::VectorKey key;
+            ok = ReadVectorKey(fields, &key);
+            (keyword == "position" ? clip->positions : clip->scales)
+                .push_back(key);
+        } else if (keyword == "rotation" && clip) {
+            float values[5];
+            ok = ReadFloats(fields, values, 5);
+            clip->rotations.push_back(
+                {values[0], Quat(values[1], values[2], values[3], values[4])});
+        } else if (keyword == "end" && clip) {
+            ok = ValidClip(*clip);
+            clip = nullptr;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            *error = "malformed scene record";
+            return false;
+        }
+    }
+    if (clip) {
+        *error = "clip without an end";
+        return false;
+    }
+    return true;
+}
+
+bool SceneReader::ReadTextChunk(SceneChunk* chunk, const char** error) {
+    if (!line_pending_ && !NextLine(file_, &line_, &bytes_read_))
+        return false; // no more chunks
+    line_pending_ = false;
+    std::istringstream bounds(line_);
+    std::string keyword;
+    bounds >> keyword;
+    if (keyword != "chunk" || !ReadFloats(bounds, chunk->bounds.min, 3) ||
+        !ReadFloats(bounds, chunk->bounds.max, 3)) {
+        *error = "malformed chunk record";
+        return false;
+    }
+    chunk->instances.clear();
+    while (NextLine(file_, &line_, &bytes_read_)) {
+        std::istringstream fields(line_);
+        fields >> keyword;
+        if (keyword == "chunk") {
+            line_pending_ = true;
+            break;
+        }
+        SceneInstance instance;
+        float rotation[4];
+        fields >> instance.mesh >> instance.material >> instance.clip;
+        if (keyword != "instance" ||
+            !ReadFloats(fields, &instance.time_offset, 1) ||
+            !ReadFloats(fields, instance.position, 3) ||
+            !ReadFloats(fields, rotation, 4) ||
+            !ReadFloats(fields, instance.scale, 3)) {
+            *error = "malformed instance record";
+            return false;
+        }
+        instance.rotation =
+            Quat(rotation[0], rotation[1], rotation[2], rotation[3]);
+        chunk->instances.push_back(instance);
+    }
+    next_chunk_++;
+    return Validate(*chunk, error);
+}
+
+// Writing
+
+unsigned int SceneWriter::AddMesh(const SceneMesh& mesh) {
+    header_.meshes.push_back(mesh);
+    return header_.meshes.size() - 1;
+}
+
+unsigned int SceneWriter::AddMaterial(const SceneMaterial& material) {
+    header_.materials.push_back(material);
+    return header_.materials.size() - 1;
+}
+
+unsigned int SceneWriter::AddClip(const AnimationSet::Clip& clip) {
+    header_.clips.push_back(clip);
+    return header_.clips.size() - 1;
+}
+
+void SceneWriter::AddInstance(const SceneInstance& instance) {
+    instances_.push_back(instance);
+}
+
+void SceneWriter::BuildChunks(float chunk_size,
+                              std::vector<SceneChunk>* chunks) const {
+    std::vector<Aabb> mesh_bounds;
+    for (const SceneMesh& mesh : header_.meshes) {
+        MeshGenerator generator(mesh.shape, mesh.level);
+        std::vector<ColorVertex> vertices(generator.VertexCount());
+        std::vector<Triangle> triangles(generator.TriangleCount());
+        generator.Generate(vertices.data(), triangles.data());
+        mesh_bounds.push_back(ComputeAabb(vertices.data(), vertices.size()));
+    }
+
+    std::map<std::array<int, 3>, std::vector<unsigned int>> cells;
+    for (unsigned int i = 0; i < instances_.size(); i++) {
+        std::array<int, 3> cell;
+        for (int k = 0; k < 3; k++)
+            cell[k] = (int)std::floor(instances_[i].position[k] / chunk_size);
+        cells[cell].push_back(i);
+    }
+    std::vector<std::pair<float, const std::vector<unsigned int>*>> order;
+    for (const auto& cell : cells) {
+        float center[3];
+        for (int k = 0; k < 3; k++)
+            center[k] = (cell.first[k] + 0.5f) * chunk_size;
+        order.push_back({Length(center), &cell.second});
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<float, const void*>& a,
+                        const std::pair<float, const void*>& b) {
+                         return a.first < b.first;
+                     });
+
+    chunks->clear();
+    for (const auto& cell : order) {
+        chunks->emplace_back();
+        SceneChunk& chunk = chunks->back();
+        for (unsigned int i : *cell.second)
+            chunk.instances.push_back(instances_[i]);
+        // Runs of one mesh and material draw with fewer state changes
+        std::stable_sort(chunk.instances.begin(), chunk.instances.end(),
+                         [](const SceneInstance& a, const SceneInstance& b) {
+                             return a.mesh != b.mesh ? a.mesh < b.mesh
+                                                     : a.material < b.material;
+                         });
+        for (unsigned int i = 0; i < chunk.instances.size(); i++) {
+            const SceneInstance& instance = chunk.instances[i];
+            Aabb box = InstanceBounds(
+                instance, mesh_bounds[instance.mesh],
+                instance.clip < 0 ? nullptr : &header_.clips[instance.clip]);
+            for (int k = 0; k < 3; k++) {
+                if (i == 0 || box.min[k] < chunk.bounds.min[k])
+                    chunk.bounds.min[k] = box.min[k];
+                if (i == 0 || box.max[k] > chunk.bounds.max[k])
+                    chunk.bounds.max[k] = box.max[k];
+            }
+        }
+    }
+}
+
+template <typename T>
+static void WriteRecords(std::ofstream& file, const T* records,
+                         unsigned int count) {
+    file.write((const char*)records, (std::streamsize)count * sizeof(T));
+}
+
+static void WriteBinary(std::ofstream& file, const SceneHeader& header,
+                        const std::vector<SceneChunk>& chunks) {
+    file.write(kMagic, sizeof(kMagic));
+    uint32_t counts[5] = {kVersion, (uint32_t)header.meshes.size(),
+                          (uint32_t)header.materials.size(),
+                          (uint32_t)header.clips.size(),
+                          (uint32_t)chunks.size()};
+    WriteRecords(file, counts, 5);
+    for (const SceneMesh& mesh : header.meshes) {
+        MeshRecord record = {(uint32_t)mesh.shape, mesh.level,
+                             mesh.crease_degrees};
+        WriteRecords(file, &record, 1);
+    }
+    WriteRecords(file, header.materials.data(), header.materials.size());
+    for (const AnimationSet::Clip& clip : header.clips) {
+        uint32_t layout[6] = {(uint32_t)clip.position_interpolation,
+                              (uint32_t)clip.rotation_interpolation,
+                              (uint32_t)clip.scale_interpolation,
+                              (uint32_t)clip.positions.size(),
+                              (uint32_t)clip.rotations.size(),
+                              (uint32_t)clip.scales.size()};
+        WriteRecords(file, layout, 6);
+        WriteRecords(file, clip.positions.data(), clip.positions.size());
+        for (const AnimationSet::RotationKey& key : clip.rotations) {
+            RotationKeyRecord record = {key.time,
+                                        {key.value.x(), key.value.y(),
+                                         key.value.z(), key.value.w()}};
+            WriteRecords(file, &record, 1);
+        }
+        WriteRecords(file, clip.scales.data(), clip.scales.size());
+    }
+
+    unsigned long long offset = (unsigned long long)file.tellp() +
+                                chunks.size() * sizeof(ChunkRecord);
+    for (const SceneChunk& chunk : chunks) {
+        ChunkRecord record;
+        memcpy(record.min, chunk.bounds.min, sizeof(record.min));
+        memcpy(record.max, chunk.bounds.max, sizeof(record.max));
+        record.instance_count = chunk.instances.size();
+        record.offset_low = (uint32_t)offset;
+        record.offset_high = (uint32_t)(offset >> 32);
+        WriteRecords(file, &record, 1);
+        offset += chunk.instances.size() * sizeof(InstanceRecord);
+    }
+    for (const SceneChunk& chunk : chunks)
+        for (const SceneInstance& instance : chunk.instances) {
+            InstanceRecord record = {
+                instance.mesh,
+                instance.material,
+                instance.clip,
+                instance.time_offset,
+                {instance.position[0], instance.position[1],
+                 instance.position[2]},
+                {instance.rotation.x(), instance.rotation.y(),
+                 instance.rotation.z(), instance.rotation.w()},
+                {instance.scale[0], instance.scale[1], instance.scale[2]}};
+            WriteRecords(file, &record, 1);
+        }
+}
+
+// Each value after a space, in the fewest digits that read back the same
+static void WriteFloats(std::ofstream& file, const float* values,
+                        unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        char text[32];
+        for (int digits = 6; digits <= 9; digits++) {
+            snprintf(text, sizeof(text), "%.*g", digits, values[i]);
+            if (strtof(text, nullptr) == values[i])
+                break;
+        }
+        file << " " << text;
+    }
+}
+
+static void WriteVectorKey(std::ofstream& file, const char* keyword,
+                           const AnimationSet::VectorKey& key, bool bezier) {
+    file << keyword;
+    WriteFloats(file, &key.time, 1);
+    WriteFloats(file, key.value, 3);
+    if (bezier) {
+        WriteFloats(file, key.out, 3);
+        WriteFloats(file, key.in, 3);
+    }
+    file << "\n";
+}
+
+static void WriteText(std::ofstream& file, const SceneHeader& header,
+                      const std::vector<SceneChunk>& chunks) {
+    file << "scene " << kVersion << "\n";
+    for (const SceneMesh& mesh : header.meshes) {
+        file << "mesh " << kShapeNames[mesh.shape] << " " << mesh.level;
+        WriteFloats(file, &mesh.crease_degrees, 1);
+        file << "\n";
+    }
+    for (const SceneMaterial& material : header.materials) {
+        file << "material";
+        WriteFloats(file, material.base_color, 4);
+        file << "\n";
+    }
+    for (const AnimationSet::Clip& clip : header.clips) {
+        file << "clip " << kInterpolationNames[clip.position_interpolation]
+             << " " << kInterpolationNames[clip.rotation_interpolation] << " "
+             << kInterpolationNames[clip.scale_interpolation] << "\n";
+        for (const AnimationSet::VectorKey& key : clip.positions)
+            WriteVectorKey(file, "position", key,
+                           clip.position_interpolation == AnimationSet::Bezier);
+        for (const AnimationSet::RotationKey& key : clip.rotations) {
+            float values[5] = {key.time, key.value.x(), key.value.y(),
+                               key.value.z(), key.value.w()};
+            file << "rotation";
+            WriteFloats(file, values, 5);
+            file << "\n";
+        }
+        for (const AnimationSet::VectorKey& key : clip.scales)
+            WriteVectorKey(file, "scale", key,
+                           clip.scale_interpolation == AnimationSet::Bezier);
+        file << "end\n";
+    }
+    for (const SceneChunk& chunk : chunks) {
+        file << "chunk";
+        WriteFloats(file, chunk.bounds.min, 3);
+        WriteFloats(file, chunk.bounds.max, 3);
+        file << "\n";
+        for (const SceneInstance& instance : chunk.instances) {
+            float rotation[4] = {instance.rotation.x(), instance.rotation.y(),
+                                 instance.rotation.z(), instance.rotation.w()};
+            file << "instance " << instance.mesh << " " << instance.material
+                 << " " << instance.clip;
+            WriteFloats(file, &instance.time_offset, 1);
+            WriteFloats(file, instance.position, 3);
+            WriteFloats(file, rotation, 4);
+            WriteFloats(file, instance.scale, 3);
+            file << "\n";
+        }
+    }
+}
+
+bool SceneWriter::Write(const char* file_name, Format format,
+                        float chunk_size, const char** error) const {
+    for (const AnimationSet::Clip& clip : header_.clips)
+        if (!ValidClip(clip)) {
+            *error = "clip with misplaced keys or interpolation";
+            return false;
+        }
+    std::vector<SceneChunk> chunks;
+    BuildChunks(chunk_size, &chunks);
+
+    std::ofstream file(file_name, std::ios::out | std::ios::binary);
+    if (!file) {
+        *error = "could not create the file";
+        return false;
+    }
+    if (format == Binary)
+        WriteBinary(file, header_, chunks);
+    else
+        WriteText(file, header_, chunks);
+    file.close();
+    if (!file) {
+        *error = "could not write the file";
+        return false;
+    }
+    return true;
+}
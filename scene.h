@@ -0,0 +1,150 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "animation.h"
+#include "bounds.h"
+#include "matma.h"
+#include "meshgenerator.h"
+
+// Scene files: instances of generated meshes with a placement, a material and
+// optionally a looping keyframe clip, grouped into spatial chunks that load
+// one at a time. Everything a chunk refers to comes before the first chunk.
+//
+// Binary files start with "KSCN" and hold little-endian 32-bit fields:
+//   version, mesh, material, clip and chunk counts
+//   meshes:    shape, level, crease degrees
+//   materials: base color rgba
+//   clips:     position, rotation and scale interpolation and key counts,
+//              then the keys: time, value, out, in (time, x, y, z, w for
+//              rotations)
+//   chunk table: bounds min and max, instance count, 64-bit file offset
+//   chunks:    instances: mesh, material, clip (-1 for none), time offset,
+//              position, rotation x y z w, scale
+// so a loader can read any chunk first. Anything else is the text variant,
+// one record per line and read front to back:
+//   scene 1
+//   mesh subdivided|fractal|parametric <level> <crease degrees>
+//   material <r g b a>
+//   clip linear|bezier linear|slerp linear|bezier
+//   position|scale <time> <x y z> [<out x y z> <in x y z>]
+//   rotation <time> <x y z w>
+//   end
+//   chunk <min x y z> <max x y z>
+//   instance <mesh> <material> <clip> <time offset> <position x y z>
+//            <rotation x y z w> <scale x y z>
+// with # starting a comment. Meshes, materials and clips are numbered in the
+// order they appear.
+
+struct SceneMesh {
+    MeshGenerator::Shape shape;
+    unsigned int level;
+    float crease_degrees; // as for BuildShadedMesh
+};
+
+struct SceneMaterial {
+    float base_color[4];
+};
+
+// Placed at position, turned by rotation and scaled along its own axes. The
+// clip, if any, moves the mesh within that frame: its keys are relative to
+// the instance.
+struct SceneInstance {
+    unsigned int mesh;
+    unsigned int material;
+    int clip; // -1 for none
+    float time_offset;
+    float position[3];
+    Quat rotation;
+    float scale[3];
+};
+
+struct SceneChunk {
+    Aabb bounds; // around everything its instances can reach
+    std::vector<SceneInstance> instances;
+};
+
+// What comes before the chunks
+struct SceneHeader {
+    struct ChunkEntry {
+        Aabb bounds;
+        unsigned int instance_count;
+        unsigned long long offset; // into the file
+    };
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneMaterial> materials;
+    std::vector<AnimationSet::Clip> clips;
+    // Binary files only; text chunks are found as they are read
+    std::vector<ChunkEntry> chunks;
+};
+
+// World box around everything an instance of a mesh with this model-space box
+// can cover while its clip plays. Loose: the mesh is taken as the sphere
+// around its box, so the rotations need not be looked at.
+Aabb InstanceBounds(const SceneInstance& instance, const Aabb& mesh_bounds,
+                    const AnimationSet::Clip* clip);
+// The instance's placement, without its clip
+Mat4 InstanceMatrix(const SceneInstance& instance);
+
+// Reads either format. Errors are returned the way DecodeImage returns them;
+// the reader is left unusable after one.
+class SceneReader {
+  public:
+    SceneReader();
+    // Reads everything up to the first chunk
+    bool Open(const char* file, SceneHeader* header, const char** error);
+    // Binary files can be read in any chunk order
+    bool seekable() const { return binary_; }
+    // Binary only: chunk index of the header's table
+    bool ReadChunk(unsigned int index, SceneChunk* chunk, const char** error);
+    // The chunk after the last one read. Returns false with error left null
+    // at the end of the file.
+    bool NextChunk(SceneChunk* chunk, const char** error);
+    unsigned long long bytes_read() const { return bytes_read_; }
+
+  private:
+    bool ReadBinaryHeader(SceneHeader* header, const char** error);
+    bool ReadTextHeader(SceneHeader* header, const char** error);
+    bool ReadTextChunk(SceneChunk* chunk, const char** error);
+    bool Validate(const SceneChunk& chunk, const char** error) const;
+
+    std::ifstream file_;
+    bool binary_;
+    const SceneHeader* header_;
+    unsigned int next_chunk_;
+    unsigned long long bytes_read_;
+    std::string line_; // text: read ahead, the next record
+    bool line_pending_;
+};
+
+// Collects a scene and writes it in either format. Instances are grouped into
+// cubic cells chunk_size wide, and chunks go out nearest the origin first,
+// which is also the order a reader that cannot seek gets them in.
+class SceneWriter {
+  public:
+    enum Format {
+        Binary,
+        Text,
+    };
+
+    unsigned int AddMesh(const SceneMesh& mesh);
+    unsigned int AddMaterial(const SceneMaterial& material);
+    unsigned int AddClip(const AnimationSet::Clip& clip);
+    void AddInstance(const SceneInstance& instance);
+    unsigned int InstanceCount() const { return instances_.size(); }
+
+    // Generates every mesh once for its bounds
+    bool Write(const char* file, Format format, float chunk_size,
+               const char** error) const;
+
+  private:
+    void BuildChunks(float chunk_size, std::vector<SceneChunk>* chunks) const;
+
+    SceneHeader header_;
+    std::vector<SceneInstance> instances_;
+};
+
+#endif // SCENE_H
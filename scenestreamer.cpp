@@ -0,0 +1,385 @@
+#include "scenestreamer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+#include "meshgenerator.h"
+
+// GPU memory is accounted under this name
+const char* SceneStreamer::kOwner = "scene";
+
+// Whether any of the box can be in the view volume: false only when all eight
+// corners are outside the same clip plane
+static bool InFrustum(const Aabb& box, const Mat4& view_projection) {
+    float corners[8][4];
+    for (int corner = 0; corner < 8; corner++)
+        view_projection.Transform(corner & 1 ? box.max[0] : box.min[0],
+                                  corner & 2 ? box.max[1] : box.min[1],
+                                  corner & 4 ? box.max[2] : box.min[2], 1,
+                                  corners[corner]);
+    for (int axis = 0; axis < 3; axis++) {
+        bool below = true, above = true;
+        for (int corner = 0; corner < 8; corner++) {
+            below = below && corners[corner][axis] < -corners[corner][3];
+            above = above && corners[corner][axis] > corners[corner][3];
+        }
+        if (below || above)
+            return false;
+    }
+    return true;
+}
+
+SceneStreamer::SceneStreamer() {
+    stopping_ = false;
+    header_ready_ = false;
+    focus_[0] = focus_[1] = focus_[2] = 0;
+    finished_ = false;
+    error_ = nullptr;
+    bytes_read_ = 0;
+    drawn_instances_ = 0;
+    time_ = 0;
+    animated_ = true;
+    reported_ = false;
+    first_chunk_seconds_ = 0;
+    load_seconds_ = 0;
+}
+
+SceneStreamer::~SceneStreamer() { Close(); }
+
+void SceneStreamer::Close() {
+    stopping_ = true;
+    if (loader_.joinable())
+        loader_.join();
+    stopping_ = false;
+
+    header_ = SceneHeader();
+    meshes_.clear();
+    header_ready_ = false;
+    arrived_.clear();
+    finished_ = false;
+    error_ = nullptr;
+    bytes_read_ = 0;
+
+    chunk_bounds_.clear();
+    chunk_starts_.clear();
+    instance_meshes_.clear();
+    instance_materials_.clear();
+    model_matrices_.clear();
+    visible_chunks_.clear();
+    drawn_instances_ = 0;
+    animation_.Clear();
+    animated_instances_.clear();
+    placements_.clear();
+    clip_matrices_.clear();
+    time_ = 0;
+    reported_ = false;
+    first_chunk_seconds_ = 0;
+    load_seconds_ = 0;
+}
+
+void SceneStreamer::Open(const char* file) {
+    Close();
+    file_ = file;
+    open_time_ = std::chrono::steady_clock::now();
+    loader_ = std::thread(&SceneStreamer::Load, this, file_);
+    std::cout << "Loading the scene " << file_ << std::endl;
+}
+
+void SceneStreamer::SetFocus(const float position[3]) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::copy(position, position + 3, focus_);
+}
+
+double SceneStreamer::SecondsSinceOpen() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         open_time_)
+        .count();
+}
+
+void SceneStreamer::Load(std::string file) {
+    SceneReader reader;
+    const char* error = nullptr;
+    bool ok = reader.Open(file.c_str(), &header_, &error);
+    if (ok) {
+        for (unsigned int i = 0; i < header_.meshes.size(); i++) {
+            meshes_.emplace_back();
+            meshes_.back().built = false;
+            meshes_.back().uploaded = false;
+            meshes_.back().triangle_count = 0;
+        }
+        header_ready_.store(true, std::memory_order_release);
+    }
+
+    std::vector<bool> read(header_.chunks.size(), false);
+    while (ok && !stopping_.load(std::memory_order_relaxed)) {
+        SceneChunk chunk;
+        if (reader.seekable()) {
+            unsigned int next = NearestChunk(read);
+            if (next == read.size())
+                break;
+            read[next] = true;
+            ok = reader.ReadChunk(next, &chunk, &error);
+        } else {
+            ok = reader.NextChunk(&chunk, &error);
+            if (!ok && !error) { // the end of the file
+                ok = true;
+                break;
+            }
+        }
+        if (!ok)
+            break;
+        // Whatever a chunk draws is ready by the time it shows up. A mesh
+        // can take seconds, so Close() is not kept waiting for the rest.
+        for (const SceneInstance& instance : chunk.instances) {
+            Mesh& mesh = meshes_[instance.mesh];
+            if (stopping_.load(std::memory_order_relaxed))
+                break;
+            if (!mesh.built.load(std::memory_order_relaxed))
+                BuildMesh(&mesh, header_.meshes[instance.mesh]);
+        }
+        if (stopping_.load(std::memory_order_relaxed))
+            break;
+        std::lock_guard<std::mutex> lock(mutex_);
+        arrived_.push_back(std::move(chunk));
+        bytes_read_ = reader.bytes_read();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    error_ = ok ? nullptr : error;
+    bytes_read_ = reader.bytes_read();
+}
+
+void SceneStreamer::BuildMesh(Mesh* mesh, const SceneMesh& description) {
+    MeshGenerator generator(description.shape, description.level);
+    std::vector<ColorVertex> vertices(generator.VertexCount());
+    std::vector<Triangle> triangles(generator.TriangleCount());
+    generator.Generate(vertices.data(), triangles.data());
+    if (stopping_.load(std::memory_order_relaxed))
+        return;
+    BuildShadedMesh(vertices.data(), vertices.size(), triangles.data(),
+                    triangles.size(), description.crease_degrees, nullptr,
+                    &mesh->shaded);
+    mesh->built.store(true, std::memory_order_release);
+}
+
+// Distance from the focus to the box, nothing for the boxes around it
+unsigned int SceneStreamer::NearestChunk(const std::vector<bool>& read) {
+    float focus[3];
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::copy(focus_, focus_ + 3, focus);
+    }
+    unsigned int nearest = read.size();
+    float nearest_distance = 0;
+    for (unsigned int i = 0; i < read.size(); i++) {
+        if (read[i])
+            continue;
+        const Aabb& box = header_.chunks[i].bounds;
+        float distance = 0;
+        for (int k = 0; k < 3; k++) {
+            float outside = std::max({box.min[k] - focus[k], 0.0f,
+                                      focus[k] - box.max[k]});
+            distance += outside * outside;
+        }
+        if (nearest == read.size() || distance < nearest_distance) {
+            nearest = i;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
+}
+
+void SceneStreamer::Update(float delta_t) {
+    std::vector<SceneChunk> arrived;
+    bool finished;
+    const char* error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        arrived.swap(arrived_);
+        finished = finished_;
+        error = error_;
+    }
+    for (const SceneChunk& chunk : arrived)
+        AddChunk(chunk);
+    if (!arrived.empty() && first_chunk_seconds_ == 0)
+        first_chunk_seconds_ = SecondsSinceOpen();
+    if (finished && !reported_) {
+        reported_ = true;
+        load_seconds_ = SecondsSinceOpen();
+        if (error)
+            std::cerr << "ERROR: Could not load the scene " << file_ << ": "
+                      << error << std::endl;
+        else
+            std::cout << "Loaded the scene " << file_ << ": "
+                      << model_matrices_.size() << " instances in "
+                      << chunk_bounds_.size() << " chunks, the first after "
+                      << first_chunk_seconds_ * 1000.0 << " ms, the last after "
+                      << load_seconds_ * 1000.0 << " ms" << std::endl;
+    }
+
+    if (!animated_ || animated_instances_.empty())
+        return;
+    time_ += delta_t;
+    animation_.Evaluate(time_);
+    animation_.BuildMatrices(clip_matrices_.data());
+    for (unsigned int i = 0; i < animated_instances_.size(); i++)
+        model_matrices_[animated_instances_[i]] =
+            placements_[i] * clip_matrices_[i];
+}
+
+void SceneStreamer::AddChunk(const SceneChunk& chunk) {
+    chunk_bounds_.push_back(chunk.bounds);
+    chunk_starts_.push_back(model_matrices_.size());
+    for (const SceneInstance& instance : chunk.instances) {
+        Mat4 placement = InstanceMatrix(instance);
+        if (instance.clip >= 0) {
+            animation_.AddObject(header_.clips[instance.clip],
+                                 instance.time_offset);
+            animated_instances_.push_back(model_matrices_.size());
+            placements_.push_back(placement);
+            clip_matrices_.emplace_back();
+        }
+        instance_meshes_.push_back(instance.mesh);
+        instance_materials_.push_back(instance.material);
+        model_matrices_.push_back(placement);
+    }
+}
+
+void SceneStreamer::Stream() {
+    if (!header_ready_.load(std::memory_order_acquire))
+        return;
+    for (Mesh& mesh : meshes_)
+        if (!mesh.uploaded.load(std::memory_order_relaxed) &&
+            mesh.built.load(std::memory_order_acquire))
+            Upload(&mesh);
+}
+
+void SceneStreamer::Upload(Mesh* mesh) {
+    const ShadedMesh& shaded = mesh->shaded;
+    mesh->vao.Create(kOwner);
+    glBindVertexArray(mesh->vao);
+
+    mesh->vertex_buffer.Create(GpuResources::VertexBuffers, kOwner);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertex_buffer);
+    mesh->vertex_buffer.Allocate(
+        GL_ARRAY_BUFFER, shaded.vertices.size() * sizeof(NormalTextureVertex),
+        shaded.vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(NormalTextureVertex),
+                          (GLvoid*)offsetof(NormalTextureVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(NormalTextureVertex),
+                          (GLvoid*)offsetof(NormalTextureVertex, texture));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(NormalTextureVertex),
+                          (GLvoid*)offsetof(NormalTextureVertex, normal));
+    glEnableVertexAttribArray(2);
+
+    mesh->tangent_buffer.Create(GpuResources::VertexBuffers, kOwner);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->tangent_buffer);
+    mesh->tangent_buffer.Allocate(GL_ARRAY_BUFFER,
+                                  shaded.tangents.size() * sizeof(float),
+                                  shaded.tangents.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                          (GLvoid*)0);
+    glEnableVertexAttribArray(3);
+
+    mesh->index_buffer.Create(GpuResources::IndexBuffers, kOwner);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->index_buffer);
+    mesh->index_buffer.Allocate(GL_ELEMENT_ARRAY_BUFFER,
+                                shaded.triangles.size() * sizeof(Triangle),
+                                shaded.triangles.data(), GL_STATIC_DRAW);
+    mesh->triangle_count = shaded.triangles.size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    mesh->shaded = ShadedMesh();
+    mesh->uploaded.store(true, std::memory_order_release);
+}
+
+void SceneStreamer::Cull(const Mat4* view_projections,
+                         unsigned int view_count) {
+    visible_chunks_.clear();
+    drawn_instances_ = 0;
+    for (unsigned int i = 0; i < chunk_bounds_.size(); i++)
+        for (unsigned int view = 0; view < view_count; view++)
+            if (InFrustum(chunk_bounds_[i], view_projections[view])) {
+                visible_chunks_.push_back(i);
+                unsigned int end = i + 1 < chunk_starts_.size()
+                                       ? chunk_starts_[i + 1]
+                                       : model_matrices_.size();
+                drawn_instances_ += end - chunk_starts_[i];
+                break;
+            }
+}
+
+void SceneStreamer::Draw(const LitProgram& program,
+                         CommandList* commands) const {
+    // Chunks come sorted by mesh and material, so most draws only move
+    unsigned int bound_mesh = ~0u, bound_material = ~0u;
+    for (unsigned int chunk : visible_chunks_) {
+        unsigned int end = chunk + 1 < chunk_starts_.size()
+                               ? chunk_starts_[chunk + 1]
+                               : model_matrices_.size();
+        for (unsigned int i = chunk_starts_[chunk]; i < end; i++) {
+            const Mesh& mesh = meshes_[instance_meshes_[i]];
+            if (!mesh.uploaded.load(std::memory_order_acquire))
+                continue; // arrives at replay
+            if (instance_meshes_[i] != bound_mesh) {
+                bound_mesh = instance_meshes_[i];
+                commands->BindVertexArray(mesh.vao);
+            }
+            if (instance_materials_[i] != bound_material) {
+                bound_material = instance_materials_[i];
+                program.SetBaseColor(
+                    header_.materials[bound_material].base_color, commands);
+            }
+            program.SetModelMatrix(model_matrices_[i], commands);
+            commands->DrawTriangles(mesh.triangle_count * 3);
+        }
+    }
+    commands->BindVertexArray(0);
+}
+
+bool SceneStreamer::loading() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return loader_.joinable() && !finished_;
+}
+
+SceneStreamer::Stats SceneStreamer::stats() const {
+    Stats stats = Stats();
+    stats.chunks = chunk_bounds_.size();
+    stats.chunk_count = header_ready_.load(std::memory_order_acquire)
+                            ? header_.chunks.size()
+                            : 0;
+    if (reported_ && stats.chunk_count == 0)
+        stats.chunk_count = stats.chunks;
+    stats.instances = model_matrices_.size();
+    stats.animated = animated_instances_.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.bytes_read = bytes_read_;
+    }
+    stats.first_chunk_seconds = first_chunk_seconds_;
+    stats.load_seconds = load_seconds_;
+    stats.drawn_chunks = visible_chunks_.size();
+    stats.drawn_instances = drawn_instances_;
+    return stats;
+}
+
+void SceneStreamer::LogStats() const {
+    if (!loader_.joinable()) {
+        std::cout << "No scene loaded" << std::endl;
+        return;
+    }
+    Stats stats = this->stats();
+    std::cout << "Scene " << file_ << ": " << stats.chunks;
+    if (stats.chunk_count)
+        std::cout << " of " << stats.chunk_count;
+    std::cout << " chunks, " << stats.instances << " instances ("
+              << stats.animated << " animated), " << stats.bytes_read
+              << " bytes read, drawing " << stats.drawn_instances
+              << " instances in " << stats.drawn_chunks << " chunks"
+              << std::endl;
+}
@@ -0,0 +1,125 @@
+#ifndef SCENESTREAMER_H
+#define SCENESTREAMER_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "animation.h"
+#include "commandlist.h"
+#include "gpuresources.h"
+#include "litprogram.h"
+#include "meshprocessing.h"
+#include "scene.h"
+
+// Draws a scene file while it is still loading. A thread of its own reads the
+// header and then the chunks, nearest the camera first when the file can be
+// read in any order, and shades each mesh the first time a chunk uses it.
+// Chunks join the scene from Update() as they arrive, so the first ones are
+// on screen long before the last is read; meshes go to the GPU from Stream().
+// Every chunk is culled against the frustum as a whole.
+class SceneStreamer {
+  public:
+    struct Stats {
+        unsigned int chunks;      // in the scene so far
+        unsigned int chunk_count; // in the file; 0 for text until loaded
+        unsigned int instances;
+        unsigned int animated;
+        unsigned long long bytes_read;
+        double first_chunk_seconds; // from Open(), 0 until then
+        double load_seconds;        // 0 while loading
+        unsigned int drawn_chunks;  // by the last Cull()
+        unsigned int drawn_instances;
+    };
+    static const char* kOwner;
+
+    SceneStreamer();
+    ~SceneStreamer();
+    // Drops the current scene and starts loading this one. GL thread, like
+    // the other places that release GPU objects.
+    void Open(const char* file);
+    void Close();
+    // Where the camera is; the chunks around it are read first
+    void SetFocus(const float position[3]);
+
+    // Adds the chunks that arrived and plays the clips
+    void Update(float delta_t);
+    // Uploads the meshes shaded since the last call. GL thread, possibly
+    // while the next frame is recorded.
+    void Stream();
+    // Keeps the chunks any of the cameras sees
+    void Cull(const Mat4* view_projections, unsigned int view_count);
+    // Program already in use with its camera set. Meshes have the vertex
+    // layout of LitModel.
+    void Draw(const LitProgram& program, CommandList* commands) const;
+    void ToggleAnimated() { animated_ = !animated_; }
+
+    bool loading() const;
+    Stats stats() const;
+    void LogStats() const;
+
+  private:
+    struct Mesh {
+        // Filled by the loader when a chunk first needs the mesh, then
+        // handed to Stream() by built and freed after the upload
+        ShadedMesh shaded;
+        std::atomic<bool> built;
+        std::atomic<bool> uploaded; // the GL objects below are ready
+        GpuVertexArray vao;
+        GpuBuffer vertex_buffer;
+        GpuBuffer tangent_buffer;
+        GpuBuffer index_buffer;
+        unsigned int triangle_count;
+    };
+
+    void Load(std::string file); // loader thread
+    void BuildMesh(Mesh* mesh, const SceneMesh& description);
+    unsigned int NearestChunk(const std::vector<bool>& read);
+    void AddChunk(const SceneChunk& chunk);
+    void Upload(Mesh* mesh);
+    double SecondsSinceOpen() const;
+
+    std::string file_;
+    std::chrono::steady_clock::time_point open_time_;
+    std::thread loader_;
+    std::atomic<bool> stopping_;
+    // Written by the loader before header_ready_, then read only
+    SceneHeader header_;
+    std::deque<Mesh> meshes_;
+    std::atomic<bool> header_ready_;
+
+    mutable std::mutex mutex_; // guards what the loader hands over
+    std::vector<SceneChunk> arrived_;
+    float focus_[3];
+    bool finished_;
+    const char* error_;
+    unsigned long long bytes_read_;
+
+    // Main thread. Chunk i holds instances chunk_starts_[i] up to the next
+    // chunk's start.
+    std::vector<Aabb> chunk_bounds_;
+    std::vector<unsigned int> chunk_starts_;
+    std::vector<unsigned int> instance_meshes_;
+    std::vector<unsigned int> instance_materials_;
+    std::vector<Mat4> model_matrices_;
+    std::vector<unsigned int> visible_chunks_;
+    unsigned int drawn_instances_;
+    // Instances with clips, one AnimationSet object each
+    AnimationSet animation_;
+    std::vector<unsigned int> animated_instances_;
+    std::vector<Mat4> placements_; // without the clip
+    std::vector<Mat4> clip_matrices_;
+    float time_;
+    bool animated_;
+    bool reported_;
+    double first_chunk_seconds_;
+    double load_seconds_;
+};
+
+#endif // SCENESTREAMER_H
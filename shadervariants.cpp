@@ -0,0 +1,277 @@
+#include "shadervariants.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <GLFW/glfw3.h>
+
+static const char* kFeatureNames[kShaderFeatureCount] = {
+    "VERTEX_COLOR", "VERTEX_TEXTURE", "VERTEX_NORMAL", "VERTEX_TANGENT",
+    "ALBEDO_MAP", "MULTI_VIEW", "TESSELLATION",
+};
+static const char* kAttributeNames[kShaderFeatureCount] = {
+    "in_color", "in_texture", "in_normal", "in_tangent",
+    nullptr,    nullptr,      nullptr,
+};
+
+// Attributes the vertex layout must have for a feature to be compiled in
+static unsigned int Needs(unsigned int feature) {
+    return feature == kAlbedoMap ? kVertexTexture : 0;
+}
+
+std::string ShaderDefines(unsigned int features) {
+    std::string defines;
+    for (int i = 0; i < kShaderFeatureCount; i++)
+        if (features & 1u << i)
+            defines += std::string("#define ") + kFeatureNames[i] + "\n";
+    return defines;
+}
+
+std::string ShaderFeatureNames(unsigned int features) {
+    std::string names;
+    for (int i = 0; i < kShaderFeatureCount; i++)
+        if (features & 1u << i)
+            names += (names.empty() ? "" : " ") +
+                     std::string(kFeatureNames[i]);
+    return names.empty() ? "base" : names;
+}
+
+ShaderVariants::ShaderVariants(const char* vertex_shader_file,
+                               const char* fragment_shader_file,
+                               unsigned int supported, Factory factory)
+    : vertex_shader_file_(vertex_shader_file),
+      fragment_shader_file_(fragment_shader_file), supported_(supported),
+      factory_(factory) {
+    geometry_shader_file_ = nullptr;
+    geometry_features_ = 0;
+    tess_control_shader_file_ = tess_evaluation_shader_file_ = nullptr;
+    tessellation_features_ = 0;
+    fallbacks_ = failures_ = 0;
+    blocking_seconds_ = 0;
+}
+
+unsigned int ShaderVariants::Key(unsigned int layout,
+                                 unsigned int features) const {
+    unsigned int key = ((layout & kVertexAttributes) |
+                        (features & ~kVertexAttributes)) &
+                       supported_;
+    for (int i = 0; i < kShaderFeatureCount; i++)
+        if ((key & 1u << i) && (Needs(1u << i) & ~key))
+            key &= ~(1u << i);
+    return key;
+}
+
+ShaderVariants::Variant* ShaderVariants::Lookup(unsigned int key) {
+    std::map<unsigned int, Variant>::iterator found = variants_.find(key);
+    if (found != variants_.end())
+        return &found->second;
+    Variant& variant = variants_[key];
+    variant.ready = false;
+    variant.start = 0;
+    queued_.push_back(key);
+    return &variant;
+}
+
+BaseProgram* ShaderVariants::Make(unsigned int key) const {
+    BaseProgram* program = factory_();
+    if (key & geometry_features_)
+        program->set_geometry_shader(geometry_shader_file_);
+    if (key & tessellation_features_)
+        program->set_tessellation_shaders(tess_control_shader_file_,
+                                          tess_evaluation_shader_file_);
+    return program;
+}
+
+bool ShaderVariants::Uses(const std::string& file) const {
+    for (const char* source :
+         {vertex_shader_file_, fragment_shader_file_, geometry_shader_file_,
+          tess_control_shader_file_, tess_evaluation_shader_file_})
+        if (source && file == source)
+            return true;
+    return false;
+}
+
+BaseProgram* ShaderVariants::Prepare(unsigned int layout,
+                                     unsigned int features) {
+    unsigned int key = Key(layout, features);
+    Variant* variant;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        variant = Lookup(key);
+        if (variant->ready)
+            return variant->program.get();
+        queued_.erase(std::remove(queued_.begin(), queued_.end(), key),
+                      queued_.end());
+    }
+    compiling_.erase(std::remove(compiling_.begin(), compiling_.end(), key),
+                     compiling_.end());
+    // Unlike the ones Update() starts, a new program here exits on errors
+    if (!variant->building)
+        variant->building.reset(Make(key));
+    if (!Finish(key, variant)) {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    return variant->program.get();
+}
+
+BaseProgram* ShaderVariants::Find(unsigned int layout, unsigned int features) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Variant* variant = Lookup(Key(layout, features));
+    if (!variant->ready) {
+        fallbacks_++;
+        return nullptr;
+    }
+    return variant->program.get();
+}
+
+void ShaderVariants::Reload() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::pair<const unsigned int, Variant>& variant : variants_)
+        if (std::find(queued_.begin(), queued_.end(), variant.first) ==
+            queued_.end())
+            queued_.push_back(variant.first);
+}
+
+void ShaderVariants::Update() {
+    // A replaced program may still be used by the frame replaying now and by
+    // the one being recorded, which Find() could have handed it to
+    for (unsigned int i = 0; i < retired_.size();) {
+        if (--retired_[i].updates == 0)
+            retired_.erase(retired_.begin() + i);
+        else
+            i++;
+    }
+
+    std::vector<unsigned int> queued;
+    std::vector<Variant*> started;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued.swap(queued_);
+        for (unsigned int key : queued)
+            started.push_back(&variants_[key]);
+    }
+    // Hand everything to the driver first so its threads can work on all of
+    // it at once, and only then look at what is done. A reload arriving
+    // mid-compile starts over from the newer sources.
+    for (unsigned int i = 0; i < queued.size(); i++) {
+        Variant* variant = started[i];
+        variant->building.reset(Make(queued[i]));
+        variant->building->set_fatal_errors(false);
+        variant->start = glfwGetTime();
+        variant->building->StartCompile(vertex_shader_file_,
+                                        fragment_shader_file_,
+                                        ShaderDefines(queued[i]));
+        if (std::find(compiling_.begin(), compiling_.end(), queued[i]) ==
+            compiling_.end())
+            compiling_.push_back(queued[i]);
+    }
+
+    for (unsigned int i = 0; i < compiling_.size();) {
+        unsigned int key = compiling_[i];
+        Variant* variant;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            variant = &variants_[key];
+        }
+        if (!variant->building->CompileFinished()) {
+            i++;
+            continue;
+        }
+        // Only this thread replaces programs, so no lock is needed to look
+        bool replacing = variant->program != nullptr;
+        if (Finish(key, variant))
+            std::cout << (replacing ? "Reloaded" : "Compiled")
+                      << " shader variant " << ShaderFeatureNames(key)
+                      << " of " << fragment_shader_file_ << " in "
+                      << (glfwGetTime() - variant->start) * 1000.0 << " ms"
+                      << std::endl;
+        else
+            std::cerr << "ERROR: Shader variant " << ShaderFeatureNames(key)
+                      << " of " << fragment_shader_file_
+                      << " did not build, "
+                      << (replacing ? "keeping the previous one"
+                                    : "drawing with a fallback")
+                      << std::endl;
+        compiling_.erase(compiling_.begin() + i);
+    }
+}
+
+bool ShaderVariants::Finish(unsigned int key, Variant* variant) {
+    double start = glfwGetTime();
+    BaseProgram* program = variant->building.get();
+    // Starts the compile if Update() has not, then waits for the link
+    program->Initialize(vertex_shader_file_, fragment_shader_file_,
+                        ShaderDefines(key));
+    bool built = !program->failed() && CheckAttributes(key, *program);
+    if (built && setup_)
+        setup_(program);
+
+    std::unique_ptr<BaseProgram> replaced;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (built) {
+            replaced.swap(variant->program);
+            variant->program.swap(variant->building);
+            variant->ready = true;
+        } else {
+            failures_++;
+        }
+        blocking_seconds_ += glfwGetTime() - start;
+    }
+    variant->building.reset();
+    if (replaced)
+        retired_.push_back({std::move(replaced), kRetireUpdates});
+    return built;
+}
+
+bool ShaderVariants::CheckAttributes(unsigned int key, GLuint program) const {
+    GLint count = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    for (GLint i = 0; i < count; i++) {
+        char name[64];
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(program, i, sizeof(name), nullptr, &size, &type,
+                          name);
+        for (int f = 0; f < kShaderFeatureCount; f++) {
+            if (!kAttributeNames[f] || strcmp(name, kAttributeNames[f]) != 0 ||
+                (key & 1u << f))
+                continue;
+            // Reading it anyway would get a constant instead of mesh data
+            std::cerr << "ERROR: Shader variant " << ShaderFeatureNames(key)
+                      << " of " << vertex_shader_file_ << " reads " << name
+                      << ", which its vertex layout does not have"
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+ShaderVariants::Stats ShaderVariants::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = Stats();
+    for (const std::pair<const unsigned int, Variant>& variant : variants_)
+        (variant.second.ready ? stats.ready : stats.compiling)++;
+    stats.fallbacks = fallbacks_;
+    stats.failures = failures_;
+    stats.blocking_seconds = blocking_seconds_;
+    return stats;
+}
+
+void ShaderVariants::LogStats(const char* name) const {
+    Stats total = stats();
+    std::cout << name << ": " << total.ready << " variants ready, "
+              << total.compiling << " compiling, " << total.failures
+              << " failed builds, " << total.fallbacks << " fallback draws, "
+              << total.blocking_seconds * 1000.0
+              << " ms blocked on compiles" << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::pair<const unsigned int, Variant>& variant : variants_)
+        std::cout << "  " << ShaderFeatureNames(variant.first)
+                  << (variant.second.ready ? "" : " (compiling)")
+                  << std::endl;
+}
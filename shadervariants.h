@@ -0,0 +1,163 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "baseprogram.h"
+
+// What a shader variant is specialised for. Each bit is a #define in the
+// sources, so a variant holds only the code its draws need instead of
+// branching on uniforms.
+enum ShaderFeature {
+    // Vertex attributes; a mesh's vertex layout is a mask of these
+    kVertexColor = 1 << 0,   // VERTEX_COLOR: in_color
+    kVertexTexture = 1 << 1, // VERTEX_TEXTURE: in_texture
+    kVertexNormal = 1 << 2,  // VERTEX_NORMAL: in_normal
+    kVertexTangent = 1 << 3, // VERTEX_TANGENT: in_tangent
+    kVertexAttributes = 0xf,
+    // Material switches
+    kAlbedoMap = 1 << 4, // ALBEDO_MAP: sample albedo, needs VERTEX_TEXTURE
+    // Passes
+    kMultiView = 1 << 5,    // MULTI_VIEW: every MultiView view in one draw
+    kTessellation = 1 << 6, // TESSELLATION: refined on the GPU, drawn as
+                            // patches
+    kShaderFeatureCount = 7,
+};
+
+// A "#define NAME" line for each feature
+std::string ShaderDefines(unsigned int features);
+// The names separated by spaces, for logs
+std::string ShaderFeatureNames(unsigned int features);
+
+// Programs built from one pair of sources, one per feature set, made when a
+// draw first asks for them. Find() never waits: a variant that is not ready
+// yet is compiled from Update() at the start of a later frame, in parallel
+// where the driver supports ARB_parallel_shader_compile, and the caller
+// draws with a fallback meanwhile. Reload() rebuilds them all the same way,
+// keeping the old programs until the new ones link.
+class ShaderVariants {
+  public:
+    struct Stats {
+        unsigned int ready;
+        unsigned int compiling;   // queued or in the driver, or failed
+        unsigned int failures;    // builds thrown away on errors
+        unsigned int fallbacks;   // Find() calls that came back empty
+        double blocking_seconds;  // spent waiting on compiles and links
+    };
+    typedef std::function<BaseProgram*()> Factory;
+    typedef std::function<void(BaseProgram*)> Setup;
+
+    // supported is the mask of features the sources know about; other bits
+    // are dropped so no two variants compile to the same program.
+    ShaderVariants(const char* vertex_shader_file,
+                   const char* fragment_shader_file, unsigned int supported,
+                   Factory factory);
+    // Called with each variant once it is linked and in use, on the GL
+    // thread, e.g. to set the uniforms that never change
+    void set_setup(Setup setup) { setup_ = setup; }
+    // Variants with any of features also get this geometry shader
+    void set_geometry_shader(const char* file, unsigned int features) {
+        geometry_shader_file_ = file;
+        geometry_features_ = features;
+    }
+    // And these tessellation stages
+    void set_tessellation_shaders(const char* control_file,
+                                  const char* evaluation_file,
+                                  unsigned int features) {
+        tess_control_shader_file_ = control_file;
+        tess_evaluation_shader_file_ = evaluation_file;
+        tessellation_features_ = features;
+    }
+
+    // The variant drawing a mesh with this vertex layout: attributes come
+    // from the layout, and features it cannot feed are dropped.
+    unsigned int Key(unsigned int layout, unsigned int features) const;
+    // Compiles the variant right away. GL thread only; for the variants
+    // the first frames draw with.
+    BaseProgram* Prepare(unsigned int layout, unsigned int features);
+    // The variant, or nullptr while it is compiling; asking for a new one
+    // queues it. Any thread.
+    BaseProgram* Find(unsigned int layout, unsigned int features);
+    // Rebuilds every variant from the sources as they are now. A variant
+    // that fails to build is logged and the previous program kept. Any
+    // thread; the work happens in Update().
+    void Reload();
+    // GL thread, once a frame: starts the queued compiles, swaps in the
+    // ones the driver is done with and deletes programs no frame uses.
+    void Update();
+
+    // Whether some variant is built from this source, i.e. needs a Reload()
+    // when it changes
+    bool Uses(const std::string& file) const;
+
+    Stats stats() const;
+    void LogStats(const char* name) const;
+
+  private:
+    struct Variant {
+        std::unique_ptr<BaseProgram> program;  // what Find() hands out
+        std::unique_ptr<BaseProgram> building; // GL thread only
+        bool ready;
+        double start; // when building was started
+    };
+    struct Retired {
+        std::unique_ptr<BaseProgram> program;
+        unsigned int updates; // left until no frame can be using it
+    };
+    static const unsigned int kRetireUpdates = 2;
+
+    Variant* Lookup(unsigned int key); // mutex_ must be held
+    BaseProgram* Make(unsigned int key) const;
+    // Links building and swaps it in; false and discarded on errors
+    bool Finish(unsigned int key, Variant* variant);
+    bool CheckAttributes(unsigned int key, GLuint program) const;
+
+    const char* vertex_shader_file_;
+    const char* fragment_shader_file_;
+    const unsigned int supported_;
+    const char* geometry_shader_file_;
+    unsigned int geometry_features_;
+    const char* tess_control_shader_file_;
+    const char* tess_evaluation_shader_file_;
+    unsigned int tessellation_features_;
+    Factory factory_;
+    Setup setup_;
+
+    mutable std::mutex mutex_;
+    std::map<unsigned int, Variant> variants_;
+    std::vector<unsigned int> queued_;
+    std::vector<unsigned int> compiling_; // GL thread only
+    std::vector<Retired> retired_;        // GL thread only
+    unsigned int fallbacks_;
+    unsigned int failures_;
+    double blocking_seconds_;
+};
+
+// ShaderVariants of one program class, so callers get its setters back
+template <typename ProgramT> class ProgramVariants : public ShaderVariants {
+  public:
+    ProgramVariants(const char* vertex_shader_file,
+                    const char* fragment_shader_file, unsigned int supported)
+        : ShaderVariants(vertex_shader_file, fragment_shader_file, supported,
+                         [] { return (BaseProgram*)new ProgramT(); }) {}
+    void set_setup(std::function<void(const ProgramT&)> setup) {
+        ShaderVariants::set_setup([setup](BaseProgram* program) {
+            setup(*static_cast<const ProgramT*>(program));
+        });
+    }
+    const ProgramT* Prepare(unsigned int layout, unsigned int features) {
+        return static_cast<const ProgramT*>(
+            ShaderVariants::Prepare(layout, features));
+    }
+    const ProgramT* Find(unsigned int layout, unsigned int features) {
+        return static_cast<const ProgramT*>(
+            ShaderVariants::Find(layout, features));
+    }
+};
+
+#endif // SHADERVARIANTS_H
@@ -0,0 +1,279 @@
+#include "texturestreamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#include "jobsystem.h"
+
+// Big enough for one row of a 16384 pixel wide level
+static const unsigned int kMinUploadBudget = 16384 * 4;
+// Textures and pixel buffers are accounted under this name
+static const char* kOwner = "texture streamer";
+
+TextureStreamer::TextureStreamer() {
+    pending_jobs_ = 0;
+    next_pixel_buffer_ = 0;
+    upload_budget_ = 0;
+    memory_cap_ = 0;
+    frame_ = 0;
+    resident_bytes_ = 0;
+    uploaded_bytes_ = 0;
+    evictions_ = 0;
+    decode_seconds_ = 0;
+}
+
+TextureStreamer::~TextureStreamer() {
+    // Decode jobs write into our textures, so they have to drain first
+    while (pending_jobs_.load() != 0)
+        std::this_thread::yield();
+}
+
+void TextureStreamer::Initialize(unsigned int upload_budget,
+                                 size_t memory_cap) {
+    upload_budget_ = std::max(upload_budget, kMinUploadBudget);
+    memory_cap_ = memory_cap;
+
+    for (unsigned int i = 0; i < kPixelBufferCount; i++) {
+        pixel_buffers_[i].Create(GpuResources::PixelBuffers, kOwner);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffers_[i]);
+        pixel_buffers_[i].Allocate(GL_PIXEL_UNPACK_BUFFER, upload_budget_,
+                                   nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+unsigned int TextureStreamer::Request(const char* file, MipFilter filter) {
+    for (unsigned int i = 0; i < textures_.size(); i++)
+        if (textures_[i].file == file && textures_[i].filter == filter)
+            return i;
+
+    textures_.emplace_back();
+    Texture& texture = textures_.back();
+    texture.file = file;
+    texture.filter = filter;
+    texture.state = Queued;
+    texture.bytes = 0;
+    texture.last_used_frame = frame_;
+    texture.decoded = false;
+    texture.error = nullptr;
+    texture.decode_seconds = 0;
+    texture.base_level = 0;
+    texture.level_count = 0;
+    texture.upload_level = 0;
+    texture.upload_row = 0;
+    StartDecode(&texture);
+    return textures_.size() - 1;
+}
+
+void TextureStreamer::StartDecode(Texture* texture) {
+    texture->state = Decoding;
+    pending_jobs_.fetch_add(1);
+    JobSystem::Instance().Submit([this, texture] {
+        double start = glfwGetTime();
+        texture->decoded = LoadMipChain(texture->file.c_str(), texture->filter,
+                                        &texture->chain, &texture->error);
+        texture->decode_seconds = glfwGetTime() - start;
+        {
+            std::lock_guard<std::mutex> lock(decoded_mutex_);
+            decoded_.push_back(texture);
+        }
+        pending_jobs_.fetch_sub(1, std::memory_order_release);
+    });
+}
+
+GLuint TextureStreamer::Acquire(unsigned int handle) {
+    Texture& texture = textures_[handle];
+    texture.last_used_frame = frame_;
+    switch (texture.state) {
+    case Uploading:
+    case Resident:
+        lru_.splice(lru_.end(), lru_, texture.lru_position);
+        if (texture.base_level == texture.level_count)
+            return 0;
+        return texture.texture;
+    case Evicted:
+        StartDecode(&texture);
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+TextureStreamer::State TextureStreamer::state(unsigned int handle) const {
+    return textures_[handle].state;
+}
+
+void TextureStreamer::Update() {
+    EvictOverCap();
+    FinishDecodes();
+    UploadWithinBudget();
+    frame_++;
+}
+
+void TextureStreamer::FinishDecodes() {
+    std::vector<Texture*> decoded;
+    {
+        std::lock_guard<std::mutex> lock(decoded_mutex_);
+        decoded.swap(decoded_);
+    }
+    for (Texture* texture : decoded) {
+        if (!texture->decoded) {
+            std::cerr << "ERROR: Could not load the texture " << texture->file
+                      << ": " << texture->error << std::endl;
+            texture->state = Failed;
+            continue;
+        }
+        decode_seconds_ += texture->decode_seconds;
+        Allocate(texture);
+    }
+}
+
+void TextureStreamer::Allocate(Texture* texture) {
+    const std::vector<MipChain::Level>& levels = texture->chain.levels;
+    unsigned int coarsest = levels.size() - 1;
+
+    texture->texture.Create(kOwner);
+    glBindTexture(GL_TEXTURE_2D, texture->texture);
+    // Storage only; the pixels come through the pixel buffers later
+    for (unsigned int i = 0; i < levels.size(); i++)
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, levels[i].width,
+                     levels[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, coarsest);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, coarsest);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    texture->bytes = texture->chain.pixels.size();
+    texture->texture.SetBytes(texture->bytes);
+    resident_bytes_ += texture->bytes;
+    texture->state = Uploading;
+    texture->level_count = levels.size();
+    texture->base_level = texture->level_count; // nothing usable yet
+    texture->upload_level = coarsest;
+    texture->upload_row = 0;
+    texture->lru_position = lru_.insert(lru_.end(), texture);
+    uploading_.push_back(texture);
+}
+
+void TextureStreamer::UploadWithinBudget() {
+    if (uploading_.empty())
+        return;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffers_[next_pixel_buffer_]);
+    next_pixel_buffer_ = (next_pixel_buffer_ + 1) % kPixelBufferCount;
+    // Invalidating lets the driver hand out fresh memory instead of waiting
+    // for copies from this buffer's previous frame to finish.
+    unsigned char* mapped = (unsigned char*)glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, upload_budget_,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    std::vector<PendingCopy> copies;
+    size_t used = 0;
+    bool full = false;
+    for (unsigned int i = 0; i < uploading_.size() && !full; i++) {
+        Texture* texture = uploading_[i];
+        while (texture->upload_row < texture->chain.levels[0].height ||
+               texture->upload_level > 0) {
+            unsigned int level = texture->upload_level;
+            const MipChain::Level& size = texture->chain.levels[level];
+            size_t row_bytes = size.width * 4;
+            unsigned int rows =
+                std::min<size_t>(size.height - texture->upload_row,
+                                 (upload_budget_ - used) / row_bytes);
+            if (rows == 0) {
+                full = true;
+                break;
+            }
+            memcpy(mapped + used,
+                   texture->chain.LevelPixels(level) +
+                       texture->upload_row * row_bytes,
+                   rows * row_bytes);
+            copies.push_back({texture, level, texture->upload_row, rows, used});
+            used += rows * row_bytes;
+            texture->upload_row += rows;
+            if (texture->upload_row == size.height && level > 0) {
+                texture->upload_level--;
+                texture->upload_row = 0;
+            }
+        }
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    for (const PendingCopy& copy : copies) {
+        const MipChain::Level& size = copy.texture->chain.levels[copy.level];
+        glBindTexture(GL_TEXTURE_2D, copy.texture->texture);
+        glTexSubImage2D(GL_TEXTURE_2D, copy.level, 0, copy.first_row,
+                        size.width, copy.rows, GL_RGBA, GL_UNSIGNED_BYTE,
+                        (GLvoid*)copy.offset);
+        if (copy.first_row + copy.rows == size.height) {
+            // Level complete, let the sampler use it
+            copy.texture->base_level = copy.level;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, copy.level);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    uploaded_bytes_ += used;
+
+    // Textures finish in queue order since the budget is spent front to back
+    while (!uploading_.empty() && uploading_.front()->base_level == 0) {
+        Texture* texture = uploading_.front();
+        uploading_.pop_front();
+        const MipChain::Level& size = texture->chain.levels[0];
+        std::cout << "Streamed texture " << texture->file << " ("
+                  << size.width << "x" << size.height << ", "
+                  << texture->chain.levels.size() << " levels, decoded in "
+                  << texture->decode_seconds * 1000.0 << " ms)" << std::endl;
+        texture->chain = MipChain(); // the GPU copy is all we need now
+        texture->state = Resident;
+    }
+}
+
+void TextureStreamer::Evict(Texture* texture) {
+    texture->texture.Reset();
+    resident_bytes_ -= texture->bytes;
+    texture->bytes = 0;
+    texture->chain = MipChain();
+    lru_.erase(texture->lru_position);
+    std::deque<Texture*>::iterator uploading =
+        std::find(uploading_.begin(), uploading_.end(), texture);
+    if (uploading != uploading_.end())
+        uploading_.erase(uploading);
+    texture->state = Evicted;
+    evictions_++;
+}
+
+void TextureStreamer::EvictOverCap() {
+    // Anything used since the last Update is still on screen and stays, even
+    // if that keeps us over the cap.
+    while (resident_bytes_ > memory_cap_ && !lru_.empty() &&
+           lru_.front()->last_used_frame != frame_)
+        Evict(lru_.front());
+}
+
+void TextureStreamer::LogStats() const {
+    unsigned int resident = 0, in_flight = 0;
+    for (const Texture& texture : textures_) {
+        if (texture.state == Resident || texture.state == Uploading)
+            resident++;
+        else if (texture.state == Queued || texture.state == Decoding)
+            in_flight++;
+    }
+    std::cout << "Textures: " << resident << " on the GPU ("
+              << resident_bytes_ / 1024 << " of " << memory_cap_ / 1024
+              << " KiB), " << in_flight << " decoding, " << evictions_
+              << " evicted, " << uploaded_bytes_ / 1024 << " KiB uploaded, "
+              << decode_seconds_ * 1000.0 << " ms spent decoding" << std::endl;
+}
@@ -0,0 +1,109 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gpuresources.h"
+#include "image.h"
+
+// Loads textures without stalling the render loop. Files are decoded and
+// mipmapped on the job system, then uploaded from Update() through a ring of
+// pixel buffer objects, at most upload_budget bytes per frame and coarsest
+// level first, so a texture shows up blurry and sharpens over a few frames.
+// Textures that were not used during the last frame are evicted in LRU order
+// whenever the resident total goes over the memory cap.
+class TextureStreamer {
+  public:
+    enum State {
+        Queued,
+        Decoding,
+        Uploading, // on the GPU, finer levels still arriving
+        Resident,
+        Evicted,
+        Failed,
+    };
+
+    TextureStreamer();
+    ~TextureStreamer();
+    void Initialize(unsigned int upload_budget, size_t memory_cap);
+
+    // Returns a handle; requesting the same file and filter twice returns the
+    // same handle.
+    unsigned int Request(const char* file, MipFilter filter = BoxMipFilter);
+    // Returns the texture to bind this frame, or 0 while nothing is uploaded
+    // yet. Marks the texture as used and brings evicted textures back.
+    GLuint Acquire(unsigned int handle);
+    State state(unsigned int handle) const;
+
+    // Call once per frame from the GL thread.
+    void Update();
+    void LogStats() const;
+
+  private:
+    struct Texture {
+        std::string file;
+        MipFilter filter;
+        State state;
+        GpuTexture texture;
+        size_t bytes;
+        unsigned int last_used_frame;
+        std::list<Texture*>::iterator lru_position;
+
+        // Written by the decode job, read after it is handed back
+        MipChain chain;
+        bool decoded;
+        const char* error;
+        double decode_seconds;
+
+        // Finest level the sampler may use, level_count while none is
+        unsigned int base_level;
+        unsigned int level_count;
+        // Next rows to upload; levels go from the coarsest down to 0
+        unsigned int upload_level;
+        unsigned int upload_row;
+    };
+    struct PendingCopy {
+        Texture* texture;
+        unsigned int level;
+        unsigned int first_row;
+        unsigned int rows;
+        size_t offset;
+    };
+
+    void StartDecode(Texture* texture);
+    void FinishDecodes();
+    void Allocate(Texture* texture);
+    void UploadWithinBudget();
+    void Evict(Texture* texture);
+    void EvictOverCap();
+
+    std::deque<Texture> textures_; // handles index into this
+    std::list<Texture*> lru_;      // textures on the GPU, oldest use first
+    std::deque<Texture*> uploading_;
+
+    std::mutex decoded_mutex_;
+    std::vector<Texture*> decoded_;
+    std::atomic<unsigned int> pending_jobs_;
+
+    static const unsigned int kPixelBufferCount = 3;
+    GpuBuffer pixel_buffers_[kPixelBufferCount];
+    unsigned int next_pixel_buffer_;
+    unsigned int upload_budget_;
+    size_t memory_cap_;
+    unsigned int frame_;
+
+    size_t resident_bytes_;
+    size_t uploaded_bytes_;
+    unsigned int evictions_;
+    double decode_seconds_;
+};
+
+#endif // TEXTURESTREAMER_H
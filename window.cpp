@@ -2,23 +2,57 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <string>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include "glerror.h"
+#include "gpuresources.h"
 #include "kdron.h"
 
 const char* kVertexShader = "SimpleShader.vertex.glsl";
 const char* kFragmentShader = "SimpleShader.fragment.glsl";
+const char* kGeometryShader = "SimpleShader.geometry.glsl";
+const char* kTessControlShader = "SimpleShader.tesscontrol.glsl";
+const char* kTessEvaluationShader = "SimpleShader.tesseval.glsl";
+const char* kLitVertexShader = "LitShader.vertex.glsl";
+const char* kLitFragmentShader = "LitShader.fragment.glsl";
+const char* kAlbedoTexture = "albedo.ppm";
+const char* kSceneFile = "Scene.txt";
+const float kLitBaseColor[4] = {0.9f, 0.7f, 0.3f, 1.0f};
+const char* kCapturePrefix = "capture_";
+const float kCaptureTimeStep = 1.0f / 60;
+// What X steps through; 0 leaves pacing to the swap interval
+const double kTargetRates[] = {0, 30, 60, 120};
+const char* kViewModeNames[] = {"Single view",
+                                "Split screen, one pass per view",
+                                "Split screen, one multi-view pass"};
 
-Window::Window(const char* title, int width, int height) {
+Window::Window(const char* title, int width, int height)
+    : programs_(kVertexShader, kFragmentShader,
+                kVertexColor | kMultiView | kTessellation),
+      lit_programs_(kLitVertexShader, kLitFragmentShader,
+                    LitProgram::kFeatures) {
     title_ = title;
     width_ = width;
     height_ = height;
     projection_ = Perspective;
+    view_mode_ = SingleView;
+    tessellation_ = false;
     active_model_ = 1; // Start on k-dron
+    scene_file_ = kSceneFile;
+    lit_kdron_ = true;
+    albedo_mode_ = 0;
+    albedo_handle_ = 0;
     last_time_ = 0;
+    toggle_render_thread_ = false;
+    inline_stats_ = RenderThread::Stats();
+    frame_seconds_ = 0;
+    timed_frames_ = 0;
+    target_rate_index_ = 0;
+    render_thread_.SetPresentCallback(FramePacer::FramePresented, &pacer_);
 }
 
 void Window::Initialize(int major_gl_version, int minor_gl_version) {
@@ -31,17 +65,26 @@ void Window::Initialize(int major_gl_version, int minor_gl_version) {
               << " GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION)
               << std::endl;
 
+    // Well within what any GL 4.1 card has; the procedural mesh is the one
+    // thing big enough to hit its own budget at the finer levels
+    GpuResources::Instance().SetBudget((size_t)1 << 30);
+    GpuResources::Instance().SetOwnerBudget(ProceduralModel::kOwner,
+                                            (size_t)512 << 20);
     InitModels();
     InitPrograms();
+    multi_view_.Initialize();
+    texture_streamer_.Initialize(4 << 20, 256 << 20);
 
     view_matrix_.Translate(0, 0, -2);
-    SetViewMatrix();
-
     SetProjectionMatrix();
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glPatchParameteri(GL_PATCH_VERTICES, 3); // every tessellated mesh
+    pacer_.SetSwapInterval(pacer_.swap_interval());
+
+    render_thread_.Start(window_);
 }
 
 void Window::InitGlfwOrDie(int major_gl_version, int minor_gl_version) {
@@ -87,24 +130,72 @@ void Window::InitGlewOrDie() {
     } else
         std::cout << "glDebugMessageCallback not available" << std::endl;
 #endif
+    // Let the driver compile shader variants on as many threads as it likes
+    if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xffffffff);
 }
 
 void Window::InitModels() {
     cube_.Initialize();
     kdron_.Initialize();
+    procedural_.Initialize(MeshGenerator::Subdivided, 6);
+    InitLitModel(30);
+    crowd_.Initialize(24, 18, 24);
+    kdron_bvh_.Build(KDron::kVertices, KDron::kIndices, KDron::kTriangleCount);
+}
+
+void Window::InitLitModel(float crease_degrees) {
+    if (lit_kdron_) {
+        lit_.Initialize(KDron::kVertices, KDron::kVertexCount, KDron::kIndices,
+                        KDron::kTriangleCount, crease_degrees);
+        return;
+    }
+    MeshGenerator generator(MeshGenerator::Parametric, 4);
+    std::vector<ColorVertex> vertices(generator.VertexCount());
+    std::vector<Triangle> triangles(generator.TriangleCount());
+    generator.Generate(vertices.data(), triangles.data());
+    lit_.Initialize(vertices.data(), vertices.size(), triangles.data(),
+                    triangles.size(), crease_degrees);
+}
+
+void Window::RegenerateProcedural(MeshGenerator::Shape shape,
+                                  unsigned int level) {
+    if (procedural_.Initialize(shape, level))
+        active_model_ = 2;
 }
 
 void Window::InitPrograms() {
-    program_.Initialize(kVertexShader, kFragmentShader);
+    // The multi-view and tessellation variants compile in the background
+    // when first used
+    programs_.set_geometry_shader(kGeometryShader, kMultiView);
+    programs_.set_tessellation_shaders(kTessControlShader,
+                                       kTessEvaluationShader, kTessellation);
+    programs_.Prepare(kVertexColor, 0);
+    lit_programs_.set_setup([](const LitProgram& program) {
+        program.SetLightDirection(0.4f, 0.6f, 0.7f);
+        program.SetBumpStrength(0.08f);
+    });
+    // What the lit model draws with until its albedo map streams in; the
+    // textured variant compiles in the background once it is asked for
+    lit_programs_.Prepare(LitModel::kLayout, 0);
+
+    for (const char* file :
+         {kVertexShader, kFragmentShader, kGeometryShader, kTessControlShader,
+          kTessEvaluationShader, kLitVertexShader, kLitFragmentShader})
+        shader_watcher_.Watch(file);
 }
 
-void Window::SetViewMatrix() const {
-    glUseProgram(program_);
-    program_.SetViewMatrix(view_matrix_);
+void Window::ReloadChangedShaders() {
+    ShaderVariants* all_variants[] = {&programs_, &lit_programs_};
+    for (const std::string& file : shader_watcher_.Poll()) {
+        std::cout << "Shader " << file << " changed, rebuilding" << std::endl;
+        for (ShaderVariants* variants : all_variants)
+            if (variants->Uses(file))
+                variants->Reload();
+    }
 }
 
 void Window::SetProjectionMatrix() {
-    glUseProgram(program_);
     if (projection_ == Orthographic) {
         projection_matrix_ = Mat4::CreateOrthoProjectionMatrix(
             -1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 100.0f);
@@ -112,7 +203,6 @@ void Window::SetProjectionMatrix() {
         projection_matrix_ = Mat4::CreatePerspectiveProjectionMatrix(
             60, (float)width_ / (float)height_, 0.1f, 100.0f);
     }
-    program_.SetProjectionMatrix(projection_matrix_);
 }
 
 void Window::SetProjection(Projection projection) {
@@ -122,18 +212,37 @@ void Window::SetProjection(Projection projection) {
 
 void Window::Zoom(float amount) {
     view_matrix_.Translate(0, 0, amount);
-    SetViewMatrix();
+}
+
+void Window::ToggleCapture(FrameCapture::Format format) {
+    if (capture_.active()) {
+        capture_.Stop();
+        return;
+    }
+    std::string target = kCapturePrefix;
+    if (format == FrameCapture::EncoderPipe)
+        target = "ffmpeg -y -loglevel error -f rawvideo -pixel_format rgba "
+                 "-video_size " +
+                 std::to_string(width_) + "x" + std::to_string(height_) +
+                 " -framerate 60 -i - -pix_fmt yuv420p capture.mp4";
+    capture_.Start(format, target, width_, height_);
 }
 
 void Window::Resize(int new_width, int new_height) {
+    // Frames in the ring have the old size
+    RenderThreadPause pause(&render_thread_);
+    capture_.Stop();
     width_ = new_width;
     height_ = new_height;
     SetProjectionMatrix();
-    glViewport(0, 0, width_, height_);
 }
 
 void Window::KeyEvent(int key, int /*scancode*/, int action, int /*mods*/) {
     if (action == GLFW_PRESS) {
+        // Before the pause, which can wait for a frame
+        pacer_.InputArrived(glfwGetTime());
+        // Presses may create GL resources; repeats only move things around
+        RenderThreadPause pause(&render_thread_);
         switch (key) {
         case GLFW_KEY_ESCAPE:
             glfwSetWindowShouldClose(window_, GLFW_TRUE);
@@ -142,15 +251,35 @@ void Window::KeyEvent(int key, int /*scancode*/, int action, int /*mods*/) {
         case GLFW_KEY_LEFT_BRACKET:
             cube_.SlowDown();
             kdron_.SlowDown();
+            procedural_.SlowDown();
+            lit_.SlowDown();
+            crowd_.SlowDown();
             break;
         case GLFW_KEY_RIGHT_BRACKET:
             cube_.SpeedUp();
             kdron_.SpeedUp();
+            procedural_.SpeedUp();
+            lit_.SpeedUp();
+            crowd_.SpeedUp();
             break;
         // Play/pause animation
         case GLFW_KEY_SPACE:
             cube_.ToggleAnimated();
             kdron_.ToggleAnimated();
+            procedural_.ToggleAnimated();
+            lit_.ToggleAnimated();
+            crowd_.ToggleAnimated();
+            scene_.ToggleAnimated();
+            break;
+        // Switch between Euler angles and quaternion integration
+        case GLFW_KEY_Q:
+            cube_.ToggleOrientationMode();
+            kdron_.ToggleOrientationMode();
+            std::cout << "Orientation mode: "
+                      << (kdron_.orientation_mode() == MovableModel::Quaternion
+                              ? "quaternion"
+                              : "euler angles")
+                      << std::endl;
             break;
         // Rotation
         case GLFW_KEY_LEFT:
@@ -181,9 +310,142 @@ void Window::KeyEvent(int key, int /*scancode*/, int action, int /*mods*/) {
             break;
         // Change model
         case GLFW_KEY_TAB:
-            active_model_ = (active_model_ + 1) % 2;
+            active_model_ = (active_model_ + 1) % 6;
             std::cout << "Changed model to " << active_model_ << std::endl;
             break;
+        // Procedural model: next shape, fewer/more triangles
+        case GLFW_KEY_G:
+            RegenerateProcedural(
+                (MeshGenerator::Shape)((procedural_.shape() + 1) % 3), 6);
+            break;
+        case GLFW_KEY_N:
+            if (procedural_.level() > 0)
+                RegenerateProcedural(procedural_.shape(),
+                                     procedural_.level() - 1);
+            break;
+        case GLFW_KEY_M:
+            RegenerateProcedural(procedural_.shape(), procedural_.level() + 1);
+            break;
+        // Lit model: flat -> 30 degree creases -> smooth, K-dron/superellipsoid
+        case GLFW_KEY_F:
+            lit_.SetCreaseAngle(lit_.crease_angle() == 0    ? 30
+                                : lit_.crease_angle() == 30 ? 180
+                                                            : 0);
+            active_model_ = 3;
+            break;
+        case GLFW_KEY_H:
+            lit_kdron_ = !lit_kdron_;
+            InitLitModel(lit_.crease_angle());
+            active_model_ = 3;
+            break;
+        // Lit model albedo: off -> box mips -> Kaiser mips
+        case GLFW_KEY_T:
+            albedo_mode_ = (albedo_mode_ + 1) % 3;
+            if (albedo_mode_ != 0)
+                albedo_handle_ = texture_streamer_.Request(
+                    kAlbedoTexture,
+                    albedo_mode_ == 1 ? BoxMipFilter : KaiserMipFilter);
+            texture_streamer_.LogStats();
+            active_model_ = 3;
+            break;
+        // Crowd: report the last frame's culling, then switch it on/off
+        case GLFW_KEY_U:
+            crowd_.LogStats();
+            crowd_.ToggleCulling();
+            active_model_ = 4;
+            break;
+        // Procedural mesh: report triangles drawn, then switch LOD on/off
+        case GLFW_KEY_L:
+            procedural_.LogLodStats();
+            procedural_.ToggleLod();
+            active_model_ = 2;
+            break;
+        // Procedural mesh: report triangles culled, then switch meshlet
+        // culling on/off
+        case GLFW_KEY_J:
+            procedural_.LogMeshletStats();
+            procedural_.ToggleMeshletCulling();
+            active_model_ = 2;
+            break;
+        // Crowd: let the K-drons drift and collide, or freeze them in place
+        case GLFW_KEY_K:
+            crowd_.ToggleTumbling();
+            std::cout << "Crowd tumbling " << (crowd_.tumbling() ? "on" : "off")
+                      << std::endl;
+            active_model_ = 4;
+            break;
+        // Report frame times, pacing and input latency, then switch the
+        // render thread on/off
+        case GLFW_KEY_R:
+            LogFrameStats();
+            pacer_.LogStats();
+            toggle_render_thread_ = true;
+            break;
+        // Frame pacing: swap interval 1 -> 0 -> adaptive, target frame rate,
+        // events polled after the wait for the frame or before it
+        case GLFW_KEY_W:
+            pacer_.NextSwapInterval();
+            std::cout << "Swap interval " << pacer_.swap_interval()
+                      << std::endl;
+            break;
+        case GLFW_KEY_X:
+            target_rate_index_ = (target_rate_index_ + 1) %
+                                 (sizeof(kTargetRates) / sizeof(double));
+            pacer_.SetTargetRate(kTargetRates[target_rate_index_]);
+            if (pacer_.target_rate() > 0)
+                std::cout << "Target frame rate " << pacer_.target_rate()
+                          << " fps" << std::endl;
+            else
+                std::cout << "No target frame rate" << std::endl;
+            break;
+        case GLFW_KEY_Z:
+            pacer_.ToggleLatePolling();
+            std::cout << "Events polled "
+                      << (pacer_.late_polling() ? "after" : "before")
+                      << " the wait for the frame" << std::endl;
+            break;
+        // Single view -> split screen in passes -> split screen in one pass
+        case GLFW_KEY_S:
+            view_mode_ = (ViewMode)((view_mode_ + 1) % 3);
+            std::cout << kViewModeNames[view_mode_] << std::endl;
+            break;
+        // Streamed scene: report the load so far, then load it again from
+        // the start
+        case GLFW_KEY_D:
+            scene_.LogStats();
+            scene_.Open(scene_file_.c_str());
+            active_model_ = 5;
+            break;
+        // The crowd plays keyframed clips instead of spinning
+        case GLFW_KEY_A:
+            crowd_.ToggleKeyframed();
+            std::cout << "Crowd keyframes "
+                      << (crowd_.keyframed() ? "on" : "off") << std::endl;
+            break;
+        // Triangles from the index buffers or refined on the GPU to the
+        // size they have on screen
+        case GLFW_KEY_E:
+            tessellation_ = !tessellation_;
+            std::cout << "GPU tessellation " << (tessellation_ ? "on" : "off")
+                      << std::endl;
+            break;
+        // Report GPU objects and memory by kind and owner, and the shader
+        // variants compiled so far
+        case GLFW_KEY_I:
+            GpuResources::Instance().LogReport();
+            programs_.LogStats("Simple shader");
+            lit_programs_.LogStats("Lit shader");
+            break;
+        // Start/stop recording: PPM frames, PNG frames, ffmpeg video
+        case GLFW_KEY_C:
+            ToggleCapture(FrameCapture::PpmSequence);
+            break;
+        case GLFW_KEY_V:
+            ToggleCapture(FrameCapture::PngSequence);
+            break;
+        case GLFW_KEY_B:
+            ToggleCapture(FrameCapture::EncoderPipe);
+            break;
         // Change projection
         case GLFW_KEY_HOME:
             SetProjection(Perspective);
@@ -207,10 +469,16 @@ void Window::KeyEvent(int key, int /*scancode*/, int action, int /*mods*/) {
         case GLFW_KEY_LEFT_BRACKET:
             cube_.SlowDown();
             kdron_.SlowDown();
+            procedural_.SlowDown();
+            lit_.SlowDown();
+            crowd_.SlowDown();
             break;
         case GLFW_KEY_RIGHT_BRACKET:
             cube_.SpeedUp();
             kdron_.SpeedUp();
+            procedural_.SpeedUp();
+            lit_.SpeedUp();
+            crowd_.SpeedUp();
             break;
         // Rotation
         case GLFW_KEY_LEFT:
@@ -245,26 +513,306 @@ void Window::KeyEvent(int key, int /*scancode*/, int action, int /*mods*/) {
     }
 }
 
+void Window::MouseButtonEvent(int button, int action, int /*mods*/) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        double x, y;
+        glfwGetCursorPos(window_, &x, &y);
+        Pick(x, y);
+    }
+}
+
+void Window::Pick(double x, double y) {
+    if (multi_view_.count() == 0) // no frame recorded yet
+        return;
+    // The view under the cursor; window y runs down, viewport y up
+    const MultiView::View* view = &multi_view_.view(0);
+    for (unsigned int i = 0; i < multi_view_.count(); i++)
+        if (x >= multi_view_.view(i).x &&
+            x < multi_view_.view(i).x + multi_view_.view(i).width)
+            view = &multi_view_.view(i);
+    Mat4 inverse;
+    if (!(view->projection_matrix * view->view_matrix).Inverse(&inverse))
+        return;
+    // Unproject the cursor onto the near and far planes. The ray keeps the
+    // unnormalized near-to-far direction, so hit distances are in [0, 1].
+    float ndc_x = 2.0f * ((float)x - view->x) / (float)view->width - 1.0f;
+    float top = (float)(height_ - view->y - view->height);
+    float ndc_y = 1.0f - 2.0f * ((float)y - top) / (float)view->height;
+    float near_point[4], far_point[4];
+    inverse.Transform(ndc_x, ndc_y, -1, 1, near_point);
+    inverse.Transform(ndc_x, ndc_y, 1, 1, far_point);
+    Ray ray;
+    for (int k = 0; k < 3; k++) {
+        ray.origin[k] = near_point[k] / near_point[3];
+        ray.direction[k] = far_point[k] / far_point[3] - ray.origin[k];
+    }
+
+    double start = glfwGetTime();
+    scene_bvh_.Clear();
+    if (active_model_ == 1) {
+        scene_bvh_.AddInstance(&kdron_bvh_, kdron_.ModelMatrix(), 0);
+    } else if (active_model_ == 2) {
+        if (!procedural_.bvh()) {
+            std::cout << "Procedural mesh is still being generated"
+                      << std::endl;
+            return;
+        }
+        scene_bvh_.AddInstance(procedural_.bvh(), procedural_.ModelMatrix(),
+                               0);
+    } else if (active_model_ == 3) {
+        scene_bvh_.AddInstance(&lit_.bvh(), lit_.ModelMatrix(), 0);
+    } else if (active_model_ == 4) {
+        // Culled instances are not on screen, so they cannot be clicked
+        for (unsigned int i : crowd_.draw_list())
+            scene_bvh_.AddInstance(&kdron_bvh_, crowd_.model_matrix(i), i);
+    } else if (active_model_ == 5) {
+        std::cout << "The streamed scene has no picking hierarchy"
+                  << std::endl;
+        return;
+    } else {
+        std::cout << "The cube has no geometry to pick" << std::endl;
+        return;
+    }
+    scene_bvh_.Build();
+    double built = glfwGetTime();
+
+    RayHit hit;
+    hit.distance = std::numeric_limits<float>::max();
+    bool found = scene_bvh_.Intersect(ray, &hit);
+    double done = glfwGetTime();
+    if (found)
+        std::cout << "Picked model " << active_model_ << " instance "
+                  << hit.instance << " triangle " << hit.triangle
+                  << " at depth " << hit.distance;
+    else
+        std::cout << "Picked nothing";
+    std::cout << " (" << scene_bvh_.InstanceCount() << " instances, build "
+              << (built - start) * 1000.0 << " ms, query "
+              << (done - built) * 1000.0 << " ms)" << std::endl;
+}
+
+void Window::RecordFrame(CommandList* commands) {
+    // Uploads go first; the draws below were recorded against what earlier
+    // frames uploaded, which is still there.
+    commands->Call(StreamResources, this);
+    commands->Viewport(0, 0, width_, height_);
+    commands->Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Once a frame rather than once a view: the level of detail follows the
+    // perspective view, which comes last, and the crowd and the scene keep
+    // what any view sees
+    SetUpViews();
+    const MultiView::View& last = multi_view_.view(multi_view_.count() - 1);
+    Mat4 view_projections[MultiView::kMaxViews];
+    for (unsigned int i = 0; i < multi_view_.count(); i++)
+        view_projections[i] = multi_view_.view(i).projection_matrix *
+                              multi_view_.view(i).view_matrix;
+    if (active_model_ == 2) {
+        procedural_.UpdateLod(last.view_matrix, last.projection_matrix,
+                              last.height);
+        procedural_.CullMeshlets(view_projections, multi_view_.count());
+    } else if (active_model_ == 4) {
+        crowd_.Cull(view_projections, multi_view_.count());
+    } else if (active_model_ == 5) {
+        Mat4 camera;
+        if (last.view_matrix.Inverse(&camera))
+            scene_.SetFocus((const float*)camera + 12);
+        scene_.Cull(view_projections, multi_view_.count());
+    }
+
+    // Reloads swap programs between frames; these stay for the frame. The
+    // lit shader has no multi-view variant, tessellation sizes edges for
+    // one view, and until the simple one has compiled the views are drawn
+    // one by one.
+    bool lit = active_model_ == 3 || active_model_ == 5;
+    const ModelProgram* multi_view_program = nullptr;
+    if (view_mode_ == SplitMultiView && !lit && !tessellation_)
+        multi_view_program = programs_.Find(kVertexColor, kMultiView);
+    if (multi_view_program) {
+        multi_view_.Record(commands);
+        DrawScene(*multi_view_program, nullptr, commands);
+    } else {
+        const ModelProgram* program = nullptr;
+        if (tessellation_) // untessellated while it compiles
+            program = programs_.Find(kVertexColor, kTessellation);
+        if (!program)
+            program = programs_.Find(kVertexColor, 0);
+        for (unsigned int i = 0; i < multi_view_.count(); i++) {
+            const MultiView::View& view = multi_view_.view(i);
+            commands->Viewport(view.x, view.y, view.width, view.height);
+            DrawScene(*program, &view, commands);
+        }
+    }
+
+    commands->Call(CaptureFrame, &capture_);
+}
+
+void Window::SetUpViews() {
+    multi_view_.Clear();
+    MultiView::View view;
+    view.x = view.y = 0;
+    view.width = width_;
+    view.height = height_;
+    view.view_matrix = view_matrix_;
+    if (view_mode_ == SingleView) {
+        view.projection_matrix = projection_matrix_;
+        multi_view_.Add(view);
+        return;
+    }
+    view.width = width_ / 2;
+    view.projection_matrix = Mat4::CreateOrthoProjectionMatrix(
+        -1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 100.0f);
+    multi_view_.Add(view);
+    view.x = view.width;
+    view.width = width_ - view.x;
+    view.projection_matrix = Mat4::CreatePerspectiveProjectionMatrix(
+        60, (float)view.width / (float)height_, 0.1f, 100.0f);
+    multi_view_.Add(view);
+}
+
+// With view null, program is a multi-view one drawing every view at once
+void Window::DrawScene(const ModelProgram& program,
+                       const MultiView::View* view, CommandList* commands) {
+    if (active_model_ == 3 || active_model_ == 5) {
+        DrawLit(*view, commands);
+        return;
+    }
+    commands->UseProgram(program);
+    if (view) {
+        program.SetViewMatrix(view->view_matrix, commands);
+        program.SetProjectionMatrix(view->projection_matrix, commands);
+        program.SetViewportHeight(view->height, commands);
+    }
+
+    if (active_model_ == 0)
+        cube_.Draw(program, commands);
+    else if (active_model_ == 1)
+        kdron_.Draw(program, commands);
+    else if (active_model_ == 2)
+        procedural_.Draw(program, commands);
+    else if (active_model_ == 4)
+        crowd_.Draw(program, commands);
+    else
+        std::cerr << "ERROR: Unknown model index: " << active_model_
+                  << std::endl;
+}
+
+// The lit model, or the streamed scene, whose meshes have the same layout
+void Window::DrawLit(const MultiView::View& view, CommandList* commands) {
+    GLuint albedo = active_model_ == 3 ? lit_.albedo() : 0;
+    const LitProgram* program =
+        lit_programs_.Find(LitModel::kLayout, albedo ? kAlbedoMap : 0);
+    if (!program) // still compiling
+        program = lit_programs_.Find(LitModel::kLayout, 0);
+    commands->UseProgram(*program);
+    program->SetViewMatrix(view.view_matrix, commands);
+    program->SetProjectionMatrix(view.projection_matrix, commands);
+    if (active_model_ == 5) {
+        scene_.Draw(*program, commands);
+        return;
+    }
+    // The scene's materials leave theirs behind
+    program->SetBaseColor(kLitBaseColor, commands);
+    lit_.Draw(*program, albedo, commands);
+}
+
+// Streaming state is only touched here and while the render thread is paused
+void Window::StreamResources(void* window) {
+    Window* self = (Window*)window;
+    self->procedural_.Stream();
+    self->scene_.Stream();
+    self->programs_.Update();
+    self->lit_programs_.Update();
+    self->texture_streamer_.Update();
+    self->lit_.SetAlbedo(
+        self->albedo_mode_ != 0
+            ? self->texture_streamer_.Acquire(self->albedo_handle_)
+            : 0);
+}
+
+void Window::CaptureFrame(void* capture) {
+    ((FrameCapture*)capture)->CaptureFrame();
+}
+
+void Window::ToggleRenderThread() {
+    toggle_render_thread_ = false;
+    if (render_thread_.running())
+        render_thread_.Stop();
+    else
+        render_thread_.Start(window_);
+    std::cout << "Render thread " << (render_thread_.running() ? "on" : "off")
+              << std::endl;
+}
+
+void Window::LogFrameStats() {
+    RenderThread::Stats stats = render_thread_.running()
+                                    ? render_thread_.TakeStats()
+                                    : inline_stats_;
+    inline_stats_ = RenderThread::Stats();
+    if (timed_frames_ == 0 || stats.frames == 0) {
+        std::cout << "No frames timed yet" << std::endl;
+        return;
+    }
+    std::cout << "Render thread " << (render_thread_.running() ? "on" : "off")
+              << ": main thread " << frame_seconds_ * 1000.0 / timed_frames_
+              << " ms per frame (" << stats.wait_seconds * 1000.0 / stats.frames
+              << " ms waiting), replay "
+              << stats.replay_seconds * 1000.0 / stats.frames << " ms, present "
+              << stats.present_seconds * 1000.0 / stats.frames << " ms over "
+              << timed_frames_ << " frames" << std::endl;
+    frame_seconds_ = 0;
+    timed_frames_ = 0;
+}
+
 void Window::Run(void) {
     while (!glfwWindowShouldClose(window_)) {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        clock_t now = clock();
+        // Input is read as late as it can be: after the wait for the frame's
+        // start, right before the simulation that uses it
+        if (!pacer_.late_polling())
+            glfwPollEvents();
+        pacer_.WaitForFrame();
+        if (pacer_.late_polling())
+            glfwPollEvents();
+        ReloadChangedShaders();
+        if (toggle_render_thread_)
+            ToggleRenderThread();
+
+        // Wall time; clock() would count the render thread too
+        double now = glfwGetTime();
         if (last_time_ == 0)
             last_time_ = now;
-        float delta_time = (float)(now - last_time_) / CLOCKS_PER_SEC;
+        float delta_time = (float)(now - last_time_);
+        // Recordings advance by a fixed step so runs can be compared
+        if (capture_.active())
+            delta_time = kCaptureTimeStep;
         cube_.Update(delta_time);
         kdron_.Update(delta_time);
+        procedural_.Update(delta_time);
+        lit_.Update(delta_time);
+        crowd_.Update(delta_time);
+        scene_.Update(delta_time);
         last_time_ = now;
 
-        if (active_model_ == 0)
-            cube_.Draw(program_);
-        else if (active_model_ == 1)
-            kdron_.Draw(program_);
-        else
-            std::cerr << "ERROR: Unknown model index: " << active_model_
-                      << std::endl;
-
-        glfwSwapBuffers(window_);
-        glfwPollEvents();
+        if (render_thread_.running()) {
+            RecordFrame(render_thread_.BeginFrame());
+            pacer_.FrameRecorded();
+            render_thread_.Submit();
+        } else {
+            inline_commands_.Reset();
+            RecordFrame(&inline_commands_);
+            pacer_.FrameRecorded();
+            double replay_start = glfwGetTime();
+            inline_commands_.Replay();
+            double present_start = glfwGetTime();
+            glfwSwapBuffers(window_);
+            FramePacer::FramePresented(&pacer_);
+            inline_stats_.frames++;
+            inline_stats_.replay_seconds += present_start - replay_start;
+            inline_stats_.present_seconds += glfwGetTime() - present_start;
+        }
+        frame_seconds_ += glfwGetTime() - now;
+        timed_frames_++;
     }
+    render_thread_.Stop();
+    capture_.Stop();
 }
@@ -1,14 +1,28 @@
 #ifndef WINDOW_H
 #define WINDOW_H
 
-#include <ctime>
+#include <string>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "bvh.h"
+#include "commandlist.h"
+#include "crowd.h"
 #include "cube.h"
+#include "filewatcher.h"
+#include "framecapture.h"
+#include "framepacer.h"
 #include "kdron.h"
+#include "litmodel.h"
+#include "litprogram.h"
 #include "matma.h"
+#include "multiview.h"
+#include "proceduralmodel.h"
+#include "renderthread.h"
+#include "scenestreamer.h"
+#include "shadervariants.h"
+#include "texturestreamer.h"
 
 class Window {
   public:
@@ -16,13 +30,22 @@ class Window {
     void Initialize(int major_gl_version, int minor_gl_version);
     void Resize(int new_width, int new_height);
     void KeyEvent(int key, int scancode, int action, int mods);
+    void MouseButtonEvent(int button, int action, int mods);
     void Run(void);
+    // What D streams in
+    void SetSceneFile(const char* file) { scene_file_ = file; }
     operator GLFWwindow*() { return window_; }
 
     enum Projection {
         Perspective,
         Orthographic,
     };
+    // Split screen shows orthographic and perspective side by side
+    enum ViewMode {
+        SingleView,
+        SplitPasses,    // the scene recorded once per view
+        SplitMultiView, // once for both, through a geometry shader
+    };
 
   private:
     int width_;
@@ -30,23 +53,64 @@ class Window {
     const char* title_;
     GLFWwindow* window_;
     Projection projection_;
+    ViewMode view_mode_;
+    MultiView multi_view_; // this frame's views
+    bool tessellation_;    // refine the simple shader's meshes on the GPU
 
     Cube cube_;
     KDron kdron_;
+    ProceduralModel procedural_;
+    LitModel lit_;
+    Crowd crowd_;
+    SceneStreamer scene_;
+    std::string scene_file_;
+    MeshBvh kdron_bvh_; // shared by the k-dron and every crowd instance
+    SceneBvh scene_bvh_;
+    bool lit_kdron_;
     unsigned int active_model_;
 
-    ModelProgram program_;
-    clock_t last_time_;
+    ProgramVariants<ModelProgram> programs_;
+    ProgramVariants<LitProgram> lit_programs_;
+    FileWatcher shader_watcher_; // edited shaders are rebuilt on the fly
+    TextureStreamer texture_streamer_;
+    unsigned int albedo_mode_; // 0 off, then box and Kaiser filtered mips
+    unsigned int albedo_handle_;
+    FrameCapture capture_;
+    double last_time_;
+
+    // Frames are recorded on this thread and replayed either by the render
+    // thread or, with it off, right away from inline_commands_.
+    RenderThread render_thread_;
+    CommandList inline_commands_;
+    bool toggle_render_thread_;
+    RenderThread::Stats inline_stats_;
+    double frame_seconds_; // this thread, from the updates to submission
+    unsigned int timed_frames_;
+    FramePacer pacer_;
+    unsigned int target_rate_index_;
 
     Mat4 view_matrix_;
     Mat4 projection_matrix_;
 
     void InitModels();
+    void RegenerateProcedural(MeshGenerator::Shape shape, unsigned int level);
+    void InitLitModel(float crease_degrees);
     void InitPrograms();
-    void SetViewMatrix() const;
+    void ReloadChangedShaders();
     void Zoom(float amount);
     void SetProjectionMatrix();
     void SetProjection(Projection projection);
+    void ToggleCapture(FrameCapture::Format format);
+    void Pick(double x, double y);
+    void RecordFrame(CommandList* commands);
+    void SetUpViews();
+    void DrawScene(const ModelProgram& program, const MultiView::View* view,
+                   CommandList* commands);
+    void DrawLit(const MultiView::View& view, CommandList* commands);
+    static void StreamResources(void* window);
+    static void CaptureFrame(void* capture);
+    void ToggleRenderThread();
+    void LogFrameStats();
 
     void InitGlfwOrDie(int major_gl_version, int minor_gl_version);
     void InitGlewOrDie();